@@ -154,9 +154,12 @@ LOCAL_SRC_FILES     := \
     common/api_info_auto.cpp \
     common/api_info.cpp \
     common/in_file_mt.cpp \
+    common/chunk_pool.cpp \
     common/in_file_ra.cpp \
     common/in_file.cpp \
     common/out_file.cpp \
+    common/chunk_codec.cpp \
+    common/hash.cpp \
     common/memoryinfo.cpp \
     common/call_parser.cpp \
     common/image.cpp \
@@ -222,12 +225,20 @@ LOCAL_SRC_FILES     := \
     ../../thirdparty/hwcpipe/vendor/arm/pmu/pmu_counter.cpp \
     ../../thirdparty/hwcpipe/vendor/arm/pmu/pmu_profiler.cpp \
     dispatch/eglproc_retrace.cpp \
+    dispatch/eglproc_null.cpp \
+    dispatch/eglproc_null_auto.cpp \
     dispatch/eglproc_auto.cpp \
     fastforwarder/fastforwarder.cpp \
     retracer/retracer.cpp \
     retracer/retrace_api.cpp \
     retracer/retrace_gles_auto.cpp \
     retracer/afrc_enum.cpp \
+    retracer/frame_timeline.cpp \
+    retracer/call_stats.cpp \
+    retracer/shader_cache.cpp \
+    retracer/shader_warmup.cpp \
+    retracer/action_schedule.cpp \
+    retracer/snapshot_writer.cpp \
     retracer/retrace_egl.cpp \
     retracer/eglconfiginfo.cpp \
     retracer/glws.cpp \
@@ -114,8 +114,11 @@ LOCAL_SRC_FILES     := \
     common/api_info_auto.cpp \
     common/api_info.cpp \
     common/in_file_mt.cpp \
+    common/chunk_pool.cpp \
     common/in_file_ra.cpp \
     common/out_file.cpp \
+    common/chunk_codec.cpp \
+    common/hash.cpp \
     common/image.cpp \
     common/image_bmp.cpp \
     common/image_png.cpp \
@@ -186,6 +189,8 @@ LOCAL_SRC_FILES    := \
     tracer/interactivecmd.cpp \
     tracer/glstate_images.cpp \
     tracer/path.cpp \
+    tracer/shadow_state.cpp \
+    tracer/write_tracker.cpp \
     helper/paramsize.cpp \
     dispatch/gleslayer_helper.cpp \
     dispatch/eglproc_trace.cpp \
@@ -14,8 +14,11 @@ set(SRC_COMMON
     ${SRC_ROOT}/common/api_info.cpp
     ${SRC_ROOT}/common/in_file.cpp
     ${SRC_ROOT}/common/in_file_mt.cpp
+    ${SRC_ROOT}/common/chunk_pool.cpp
     ${SRC_ROOT}/common/in_file_ra.cpp
     ${SRC_ROOT}/common/out_file.cpp
+    ${SRC_ROOT}/common/chunk_codec.cpp
+    ${SRC_ROOT}/common/hash.cpp
     ${SRC_ROOT}/common/image.cpp
     ${SRC_ROOT}/common/image_png.cpp
     ${SRC_ROOT}/common/image_bmp.cpp
@@ -15,11 +15,19 @@ set(SRC_MM
     ${SRC_ROOT}/dispatch/eglproc_auto.hpp
     ${SRC_ROOT}/dispatch/eglproc_auto.cpp
     ${SRC_ROOT}/dispatch/eglproc_retrace.cpp
+    ${SRC_ROOT}/dispatch/eglproc_null.cpp
+    ${SRC_ROOT}/dispatch/eglproc_null_auto.cpp
     ${SRC_ROOT}/drawstate/drawstate.cpp
     ${SRC_ROOT}/retracer/retracer.cpp
     ${SRC_ROOT}/retracer/retrace_api.cpp
     ${SRC_ROOT}/retracer/retrace_gles_auto.cpp
     ${SRC_ROOT}/retracer/afrc_enum.cpp
+    ${SRC_ROOT}/retracer/frame_timeline.cpp
+    ${SRC_ROOT}/retracer/call_stats.cpp
+    ${SRC_ROOT}/retracer/shader_cache.cpp
+    ${SRC_ROOT}/retracer/shader_warmup.cpp
+    ${SRC_ROOT}/retracer/action_schedule.cpp
+    ${SRC_ROOT}/retracer/snapshot_writer.cpp
     ${SRC_ROOT}/retracer/retrace_egl.cpp
     ${SRC_ROOT}/retracer/eglconfiginfo.cpp
     ${SRC_ROOT}/retracer/glws.cpp
@@ -43,6 +51,7 @@ set_source_files_properties(
     ${SRC_ROOT}/common/call_parser.cpp
     ${SRC_ROOT}/dispatch/eglproc_auto.hpp
     ${SRC_ROOT}/dispatch/eglproc_auto.cpp
+    ${SRC_ROOT}/dispatch/eglproc_null_auto.cpp
     ${SRC_ROOT}/retracer/retrace_gles_auto.cpp
     PROPERTIES
         GENERATED True
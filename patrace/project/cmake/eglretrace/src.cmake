@@ -12,11 +12,19 @@ set(SRC_EGLRETRACE
     ${SRC_ROOT}/dispatch/eglproc_auto.hpp
     ${SRC_ROOT}/dispatch/eglproc_auto.cpp
     ${SRC_ROOT}/dispatch/eglproc_retrace.cpp
+    ${SRC_ROOT}/dispatch/eglproc_null.cpp
+    ${SRC_ROOT}/dispatch/eglproc_null_auto.cpp
     ${SRC_ROOT}/retracer/retracer.cpp
     ${SRC_ROOT}/retracer/retrace_api.cpp
     ${SRC_ROOT}/retracer/retrace_gles_auto.cpp
     ${SRC_ROOT}/retracer/retrace_egl.cpp
     ${SRC_ROOT}/retracer/afrc_enum.cpp
+    ${SRC_ROOT}/retracer/frame_timeline.cpp
+    ${SRC_ROOT}/retracer/call_stats.cpp
+    ${SRC_ROOT}/retracer/shader_cache.cpp
+    ${SRC_ROOT}/retracer/shader_warmup.cpp
+    ${SRC_ROOT}/retracer/action_schedule.cpp
+    ${SRC_ROOT}/retracer/snapshot_writer.cpp
     ${SRC_ROOT}/retracer/eglconfiginfo.cpp
     ${SRC_ROOT}/retracer/glws.cpp
     ${SRC_ROOT}/retracer/glws_egl.cpp
@@ -38,6 +46,7 @@ set(SRC_EGLRETRACE
 set_source_files_properties (
     ${SRC_ROOT}/dispatch/eglproc_auto.hpp
     ${SRC_ROOT}/dispatch/eglproc_auto.cpp
+    ${SRC_ROOT}/dispatch/eglproc_null_auto.cpp
     ${SRC_ROOT}/retracer/retrace_gles_auto.cpp
     PROPERTIES
         GENERATED True
@@ -31,6 +31,8 @@ set(SRC_EGLTRACE
     ${SRC_ROOT}/tracer/interactivecmd.cpp
     ${SRC_ROOT}/tracer/glstate_images.cpp
     ${SRC_ROOT}/tracer/path.cpp
+    ${SRC_ROOT}/tracer/shadow_state.cpp
+    ${SRC_ROOT}/tracer/write_tracker.cpp
 )
 
 set_source_files_properties (
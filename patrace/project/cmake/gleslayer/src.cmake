@@ -37,4 +37,6 @@ set(SRC_GLES_LAYER
     ${SRC_ROOT}/tracer/tracerparams.cpp
     ${SRC_ROOT}/tracer/interactivecmd.cpp
     ${SRC_ROOT}/tracer/glstate_images.cpp
+    ${SRC_ROOT}/tracer/shadow_state.cpp
+    ${SRC_ROOT}/tracer/write_tracker.cpp
 )
@@ -8,4 +8,10 @@ set(SRC_UNITTEST
     ${SRC_UNITTEST_DIR}/context_test.cpp
     ${SRC_UNITTEST_DIR}/system_test.cpp
     ${SRC_UNITTEST_DIR}/image_test.cpp
+    ${SRC_UNITTEST_DIR}/chunk_codec_test.cpp
+    ${SRC_UNITTEST_DIR}/hash_test.cpp
+    ${SRC_UNITTEST_DIR}/value_map_test.cpp
+    ${SRC_UNITTEST_DIR}/write_tracker_test.cpp
+
+    ${SRC_ROOT}/tracer/write_tracker.cpp
 )
@@ -0,0 +1,160 @@
+#include <common/chunk_codec.hpp>
+#include <common/os.hpp>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <snappy.h>
+#include <zlib.h>
+
+namespace common {
+
+class SnappyCodec : public ChunkCodec
+{
+public:
+    const char* name() const override { return "snappy"; }
+
+    size_t maxCompressedLength(size_t length) const override
+    {
+        return snappy::MaxCompressedLength(length);
+    }
+
+    size_t compress(const char* src, size_t length, char* dst, int) const override
+    {
+        size_t compressedLength = 0;
+        snappy::RawCompress(src, length, dst, &compressedLength);
+        return compressedLength;
+    }
+
+    bool uncompressedLength(const char* src, size_t length, size_t* result) const override
+    {
+        return snappy::GetUncompressedLength(src, length, result);
+    }
+
+    bool uncompress(const char* src, size_t length, char* dst) const override
+    {
+        return snappy::RawUncompress(src, length, dst);
+    }
+};
+
+class ZlibCodec : public ChunkCodec
+{
+public:
+    const char* name() const override { return "zlib"; }
+
+    size_t maxCompressedLength(size_t length) const override
+    {
+        return sizeof(uint32_t) + compressBound(length);
+    }
+
+    size_t compress(const char* src, size_t length, char* dst, int level) const override
+    {
+        const uint32_t uncompressed = length;
+        writeLE32(dst, uncompressed);
+        uLongf compressedLength = compressBound(length);
+        if (compress2((Bytef*)dst + sizeof(uncompressed), &compressedLength, (const Bytef*)src, length,
+                      level < 0 ? Z_DEFAULT_COMPRESSION : level) != Z_OK)
+        {
+            DBG_LOG("Failed to compress chunk of size %u with zlib - aborting!\n", (unsigned)length);
+            os::abort();
+        }
+        return sizeof(uncompressed) + compressedLength;
+    }
+
+    bool uncompressedLength(const char* src, size_t length, size_t* result) const override
+    {
+        uint32_t uncompressed;
+        if (length < sizeof(uncompressed))
+        {
+            return false;
+        }
+        uncompressed = readLE32(src);
+        *result = uncompressed;
+        return true;
+    }
+
+    bool uncompress(const char* src, size_t length, char* dst) const override
+    {
+        size_t expected = 0;
+        if (!uncompressedLength(src, length, &expected))
+        {
+            return false;
+        }
+        uLongf uncompressed = expected;
+        return ::uncompress((Bytef*)dst, &uncompressed, (const Bytef*)src + sizeof(uint32_t), length - sizeof(uint32_t)) == Z_OK
+            && uncompressed == expected;
+    }
+};
+
+const ChunkCodec* getChunkCodec(unsigned codec)
+{
+    static const SnappyCodec snappyCodec;
+    static const ZlibCodec zlibCodec;
+    switch (codec)
+    {
+    case CHUNK_CODEC_SNAPPY: return &snappyCodec;
+    case CHUNK_CODEC_ZLIB: return &zlibCodec;
+    default: return NULL;
+    }
+}
+
+size_t writeChunkHeader(char* dst, unsigned codec, uint32_t length)
+{
+    if (codec == CHUNK_CODEC_SNAPPY)
+    {
+        writeLE32(dst, length);
+        return 4;
+    }
+    writeLE32(dst, CHUNK_CODEC_MARKER);
+    writeLE32(dst + 4, codec);
+    writeLE32(dst + 8, length);
+    return CHUNK_HEADER_MAX_LENGTH;
+}
+
+size_t readChunkHeader(const char* src, size_t size, unsigned& codec, uint32_t& length)
+{
+    if (size < 4)
+    {
+        return 0;
+    }
+    const uint32_t field = readLE32(src);
+    if (field != CHUNK_CODEC_MARKER)
+    {
+        codec = CHUNK_CODEC_SNAPPY;
+        length = field;
+        return 4;
+    }
+    if (size < CHUNK_HEADER_MAX_LENGTH)
+    {
+        return 0;
+    }
+    codec = readLE32(src + 4);
+    length = readLE32(src + 8);
+    return CHUNK_HEADER_MAX_LENGTH;
+}
+
+bool parseChunkCodec(const std::string& str, unsigned& codec, int& level)
+{
+    const size_t colon = str.find(':');
+    const std::string name = str.substr(0, colon);
+    level = -1;
+    if (colon != std::string::npos)
+    {
+        char* end = NULL;
+        level = strtol(str.c_str() + colon + 1, &end, 10);
+        if (*end != '\0' || level < 1 || level > 9)
+        {
+            return false;
+        }
+    }
+    for (codec = 0; codec < CHUNK_CODEC_COUNT; codec++)
+    {
+        if (name == getChunkCodec(codec)->name())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
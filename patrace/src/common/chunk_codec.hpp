@@ -0,0 +1,77 @@
+#ifndef _COMMON_CHUNK_CODEC_HPP_
+#define _COMMON_CHUNK_CODEC_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace common {
+
+// Each chunk starts with a 32 bit little endian length field. For snappy chunks it holds the
+// compressed length, so files written before codecs existed read as snappy throughout. Chunks
+// compressed with any other codec start with CHUNK_CODEC_MARKER instead, followed by the codec id
+// and the compressed length, both 32 bit little endian. Older readers take the marker for a chunk
+// that is longer than the file, and stop there. A length field of SEEK_INDEX_MARKER (0xffffffff)
+// marks the seek index.
+#define CHUNK_CODEC_MARKER 0xfffffffe
+#define CHUNK_HEADER_MAX_LENGTH 12
+
+enum ChunkCodecId
+{
+    CHUNK_CODEC_SNAPPY = 0,
+    CHUNK_CODEC_ZLIB = 1,   // uncompressed length as 32 bit LE, then a zlib stream
+    CHUNK_CODEC_COUNT
+};
+
+inline uint32_t readLE32(const char* src)
+{
+    const unsigned char* p = (const unsigned char*)src;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline void writeLE32(char* dst, uint32_t value)
+{
+    for (int i = 0; i < 4; i++, value >>= 8)
+    {
+        dst[i] = value & 0xff;
+    }
+}
+
+/// Number of bytes in front of a chunk that starts with the given length field.
+inline size_t chunkHeaderLength(uint32_t lengthField) { return lengthField == CHUNK_CODEC_MARKER ? CHUNK_HEADER_MAX_LENGTH : 4; }
+
+/// Write the header of a chunk into dst, which must hold CHUNK_HEADER_MAX_LENGTH bytes.
+/// Returns its length. Snappy chunks must be shorter than CHUNK_CODEC_MARKER.
+size_t writeChunkHeader(char* dst, unsigned codec, uint32_t length);
+
+/// Parse the header of a chunk from the first size bytes of src. Returns its length, or 0 if
+/// it is incomplete. Check for SEEK_INDEX_MARKER first.
+size_t readChunkHeader(const char* src, size_t size, unsigned& codec, uint32_t& length);
+
+class ChunkCodec
+{
+public:
+    virtual ~ChunkCodec() {}
+    virtual const char* name() const = 0;
+    virtual size_t maxCompressedLength(size_t length) const = 0;
+    /// Compress length bytes of src into dst, which must hold maxCompressedLength(length) bytes.
+    /// level is codec specific, -1 for the codec's default. Returns the compressed length.
+    virtual size_t compress(const char* src, size_t length, char* dst, int level) const = 0;
+    /// Read the uncompressed length from the start of a compressed chunk. Needs at most
+    /// CHUNK_CODEC_PREFIX_LENGTH bytes.
+    virtual bool uncompressedLength(const char* src, size_t length, size_t* result) const = 0;
+    /// Decompress into dst, which must hold uncompressedLength() bytes.
+    virtual bool uncompress(const char* src, size_t length, char* dst) const = 0;
+};
+
+#define CHUNK_CODEC_PREFIX_LENGTH 5
+
+/// Returns NULL for unknown codec ids.
+const ChunkCodec* getChunkCodec(unsigned codec);
+
+/// Parse a codec name such as "snappy", "zlib" or "zlib:9" (codec and level, from 1 to 9).
+bool parseChunkCodec(const std::string& str, unsigned& codec, int& level);
+
+}
+
+#endif
@@ -0,0 +1,213 @@
+#include <common/chunk_pool.hpp>
+#include <common/os.hpp>
+
+#include <stdlib.h>
+#include <algorithm>
+#include <iterator>
+#include <sys/mman.h>
+
+namespace common {
+
+// Matches the chunk size of the trace writer, so that nearly all chunks fit in a slot
+#define CHUNK_POOL_SLOT_SIZE (1 * 1024 * 1024)
+#define CHUNK_POOL_SLAB_SIZE (2 * 1024 * 1024)
+#define CHUNK_POOL_LARGE_ALIGN (64 * 1024)
+// Released buffers and empty slabs kept for reuse; more are freed
+#define CHUNK_POOL_MAX_FREE_BUFFERS 8
+#define CHUNK_POOL_MAX_FREE_SLABS 2
+
+void ChunkBuffer::resize(size_t size)
+{
+    if (size > mCapacity)
+    {
+        mPool->deallocate(this);
+        mPool->allocate(this, size);
+    }
+    mSize = size;
+}
+
+void ChunkBuffer::swap(ChunkBuffer& other)
+{
+    std::swap(mData, other.mData);
+    std::swap(mSize, other.mSize);
+    std::swap(mCapacity, other.mCapacity);
+    std::swap(mSlot, other.mSlot);
+}
+
+std::map<char*, unsigned>::iterator ChunkPool::slabOf(char* slot)
+{
+    return std::prev(mSlabs.upper_bound(slot));
+}
+
+// Must be called with mMutex held, and the slab empty
+void ChunkPool::freeSlab(std::map<char*, unsigned>::iterator slab)
+{
+    char* begin = slab->first;
+    mFreeSlots.erase(std::remove_if(mFreeSlots.begin(), mFreeSlots.end(), [begin](char* slot) {
+        return slot >= begin && slot < begin + CHUNK_POOL_SLAB_SIZE; }), mFreeSlots.end());
+    mSlabs.erase(slab);
+    free(begin);
+    mStats.slabBytes -= CHUNK_POOL_SLAB_SIZE;
+}
+
+ChunkBuffer* ChunkPool::acquire()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStats.acquires++;
+    mStats.buffers++;
+    mClearPending = false;
+    if (mFreeBuffers.empty())
+    {
+        return new ChunkBuffer(this);
+    }
+    ChunkBuffer* buffer = mFreeBuffers.back();
+    mFreeBuffers.pop_back();
+    buffer->mSize = 0;
+    return buffer;
+}
+
+void ChunkPool::release(ChunkBuffer* buffer)
+{
+    if (!buffer)
+    {
+        return;
+    }
+    bool keep;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.buffers--;
+        keep = buffer->mSlot && !mClearPending && mFreeBuffers.size() < CHUNK_POOL_MAX_FREE_BUFFERS;
+        if (keep)
+        {
+            mFreeBuffers.push_back(buffer);
+        }
+    }
+    if (!keep)
+    {
+        deallocate(buffer);
+        delete buffer;
+    }
+}
+
+void ChunkPool::allocate(ChunkBuffer* buffer, size_t size)
+{
+    if (size > CHUNK_POOL_SLOT_SIZE)
+    {
+        const size_t capacity = (size + CHUNK_POOL_LARGE_ALIGN - 1) & ~(size_t)(CHUNK_POOL_LARGE_ALIGN - 1);
+        buffer->mData = (char*)malloc(capacity);
+        if (!buffer->mData)
+        {
+            DBG_LOG("Failed to allocate %u bytes for a chunk - aborting!\n", (unsigned)capacity);
+            os::abort();
+        }
+        buffer->mCapacity = capacity;
+        buffer->mSlot = false;
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.largeBytes += capacity;
+        mStats.allocations++;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mFreeSlots.empty())
+    {
+        void* slab = nullptr;
+        if (posix_memalign(&slab, CHUNK_POOL_SLAB_SIZE, CHUNK_POOL_SLAB_SIZE) != 0)
+        {
+            DBG_LOG("Failed to allocate a chunk slab - aborting!\n");
+            os::abort();
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(slab, CHUNK_POOL_SLAB_SIZE, MADV_HUGEPAGE);
+#endif
+        mSlabs[(char*)slab] = 0;
+        for (size_t offset = 0; offset + CHUNK_POOL_SLOT_SIZE <= CHUNK_POOL_SLAB_SIZE; offset += CHUNK_POOL_SLOT_SIZE)
+        {
+            mFreeSlots.push_back((char*)slab + offset);
+        }
+        mStats.slabBytes += CHUNK_POOL_SLAB_SIZE;
+        mStats.allocations++;
+    }
+    buffer->mData = mFreeSlots.back();
+    mFreeSlots.pop_back();
+    slabOf(buffer->mData)->second++;
+    buffer->mCapacity = CHUNK_POOL_SLOT_SIZE;
+    buffer->mSlot = true;
+}
+
+void ChunkPool::deallocate(ChunkBuffer* buffer)
+{
+    if (!buffer->mData)
+    {
+        return;
+    }
+    if (buffer->mSlot)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFreeSlots.push_back(buffer->mData);
+        auto slab = slabOf(buffer->mData);
+        if (--slab->second == 0 && (mClearPending || mFreeSlots.size() * CHUNK_POOL_SLOT_SIZE > CHUNK_POOL_MAX_FREE_SLABS * CHUNK_POOL_SLAB_SIZE))
+        {
+            freeSlab(slab);
+        }
+    }
+    else
+    {
+        free(buffer->mData);
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.largeBytes -= buffer->mCapacity;
+    }
+    buffer->mData = nullptr;
+    buffer->mCapacity = 0;
+    buffer->mSize = 0;
+    buffer->mSlot = false;
+}
+
+void ChunkPool::clear()
+{
+    std::vector<ChunkBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        buffers.swap(mFreeBuffers);
+    }
+    for (ChunkBuffer* buffer : buffers)
+    {
+        deallocate(buffer);
+        delete buffer;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto slab = mSlabs.begin(); slab != mSlabs.end();)
+    {
+        auto next = std::next(slab);
+        if (slab->second == 0)
+        {
+            freeSlab(slab);
+        }
+        slab = next;
+    }
+    // The rest goes as the buffers that use it are released
+    mClearPending = mStats.buffers > 0;
+    if (mClearPending)
+    {
+        DBG_LOG("%u chunk buffers still in use - freeing their memory when they are released\n", (unsigned)mStats.buffers);
+    }
+}
+
+ChunkPool::Stats ChunkPool::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Stats stats = mStats;
+    stats.freeBuffers = mFreeBuffers.size();
+    stats.slabs = mSlabs.size();
+    stats.freeSlots = mFreeSlots.size();
+    return stats;
+}
+
+size_t ChunkPool::bytesReserved() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats.slabBytes + mStats.largeBytes;
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef _COMMON_CHUNK_POOL_HPP_
+#define _COMMON_CHUNK_POOL_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace common {
+
+class ChunkPool;
+
+/// Memory for one uncompressed chunk, handed out by a ChunkPool.
+class ChunkBuffer
+{
+public:
+    char* data() { return mData; }
+    const char* data() const { return mData; }
+    size_t size() const { return mSize; }
+    size_t capacity() const { return mCapacity; }
+
+    /// Unlike std::vector::resize this leaves new memory uninitialised, and does not keep
+    /// the old contents when it has to grow, since chunks are always overwritten completely.
+    void resize(size_t size);
+    /// Swaps the memory only; pins stay with the buffer object, so neither side may be pinned.
+    void swap(ChunkBuffer& other);
+
+    /// Pins mark memory that is still referenced from outside, and must not be overwritten or released
+    void pin() { mPins++; }
+    void unpin() { mPins--; }
+    unsigned pins() const { return mPins; }
+
+private:
+    friend class ChunkPool;
+    explicit ChunkBuffer(ChunkPool* pool) : mPool(pool) {}
+
+    ChunkPool* mPool;
+    char* mData = nullptr;
+    size_t mSize = 0;
+    size_t mCapacity = 0;
+    bool mSlot = false; ///< memory is a slot in one of the pool's slabs rather than an allocation of its own
+    unsigned mPins = 0;
+};
+
+/// Recycles chunk buffers. Chunks up to the writer's chunk size live in fixed-size slots carved
+/// out of huge page sized and aligned slabs; larger chunks get memory of their own. A few released
+/// buffers and empty slabs are kept for reuse, other slabs are freed once they are empty. Thread safe.
+class ChunkPool
+{
+public:
+    ChunkPool() {}
+    ~ChunkPool() { clear(); }
+
+    ChunkBuffer* acquire();
+    void release(ChunkBuffer* buffer);
+    /// Free all memory that is not in use. The memory of buffers that are still in use, such as
+    /// pinned chunks, is freed when they are released.
+    void clear();
+
+    struct Stats
+    {
+        size_t buffers = 0;         ///< buffers handed out and not released
+        size_t freeBuffers = 0;
+        size_t slabs = 0;
+        size_t freeSlots = 0;
+        size_t slabBytes = 0;
+        size_t largeBytes = 0;      ///< memory of chunks too large for a slot
+        uint64_t acquires = 0;
+        uint64_t allocations = 0;   ///< slabs and large chunks allocated
+    };
+    Stats getStats() const;
+    /// Bytes of memory held by the pool
+    size_t bytesReserved() const;
+
+private:
+    friend class ChunkBuffer;
+    void allocate(ChunkBuffer* buffer, size_t size);
+    void deallocate(ChunkBuffer* buffer);
+    std::map<char*, unsigned>::iterator slabOf(char* slot);
+    void freeSlab(std::map<char*, unsigned>::iterator slab);
+
+    mutable std::mutex mMutex;
+    std::map<char*, unsigned> mSlabs; ///< slab to number of slots in use
+    std::vector<char*> mFreeSlots;
+    std::vector<ChunkBuffer*> mFreeBuffers;
+    bool mClearPending = false; ///< clear() was called with buffers in use, so keep nothing for reuse
+    Stats mStats;
+};
+
+}
+
+#endif
@@ -157,6 +157,45 @@ public:
     }
 };
 
+// Optional seek index, written after the last chunk and located through the
+// "seekIndex" object of the JSON header. It starts with a chunk length that can
+// never be valid, so chunk readers stop in front of it. Layout:
+//   BSeekIndexHeader
+//   BSeekIndexChunk[chunkCount] - one per compressed chunk, in file order
+//   BSeekIndexSwap[swapCount]   - one per eglSwapBuffers* call, in call order
+#define SEEK_INDEX_MARKER 0xffffffff
+#define SEEK_INDEX_MAGIC 0x58444950 // "PIDX"
+#define SEEK_INDEX_VERSION 1
+
+struct BSeekIndexHeader {
+    uint32_t marker = SEEK_INDEX_MARKER;
+    uint32_t magic = SEEK_INDEX_MAGIC;
+    uint32_t version = SEEK_INDEX_VERSION;
+    uint32_t chunkCount = 0;
+    uint32_t swapCount = 0;
+    uint32_t callCount = 0;
+};
+
+struct BSeekIndexChunk {
+    uint64_t offset;        // file offset of the chunk's compressed length field
+    uint32_t size;          // uncompressed size
+    uint32_t firstCall;     // number of the first call starting in this chunk
+    uint32_t firstFrame;    // swaps on any thread before this chunk
+    uint32_t reserved;      // zero; keeps the layout the same on ABIs that align uint64_t to 4
+};
+
+struct BSeekIndexSwap {
+    uint32_t chunk;         // position of the call following the swap, as chunk index
+    uint32_t offset;        // and offset into the uncompressed chunk (may equal its size)
+    uint32_t callNo;        // number of the call following the swap
+    uint32_t tid;           // thread that swapped
+};
+
+// The index is read and written as raw arrays, so these sizes are part of the file format
+static_assert(sizeof(BSeekIndexHeader) == 24, "seek index header size");
+static_assert(sizeof(BSeekIndexChunk) == 24, "seek index chunk size");
+static_assert(sizeof(BSeekIndexSwap) == 16, "seek index swap size");
+
 
 enum CALL_ERROR_NO {
     CALL_GL_NO_ERROR = 0,
@@ -287,6 +326,25 @@ inline char* WriteStringArray(char* dest, int cnt, const char* const* strv, cons
     return dest;
 }
 
+// Upper bounds of what the functions above write, for making room before writing
+#define WRITE_FIXED_MAX_SIZE 8
+
+inline size_t WriteStringSize(const char* src) {
+    return sizeof(unsigned int) + (src ? strlen(src)+1 : 0) + 3;
+}
+
+template <class T>
+inline size_t Write1DArraySize(unsigned int len, const T* array) {
+    return sizeof(unsigned int) + (array ? (size_t)len*sizeof(T) : 0) + 3;
+}
+
+inline size_t WriteStringArraySize(int cnt, const char* const* strv) {
+    size_t size = sizeof(unsigned int) + cnt*sizeof(unsigned int) + sizeof(unsigned int);
+    for (int i = 0; i < cnt; ++i)
+        size += WriteStringSize(strv[i]);
+    return size;
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Read functions
 template <class T>
@@ -0,0 +1,168 @@
+#include <common/hash.hpp>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace common {
+
+namespace {
+
+const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// Unaligned little endian reads
+inline uint64_t read64(const unsigned char* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t read32(const unsigned char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t val)
+{
+    acc ^= round(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+// The initial accumulators of the 32 byte stripes, and their merge
+struct Lanes
+{
+    explicit Lanes(uint64_t seed) : v1(seed + PRIME1 + PRIME2), v2(seed + PRIME2), v3(seed), v4(seed - PRIME1) {}
+
+    inline void stripe(const unsigned char* p)
+    {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+    }
+
+    inline uint64_t merge() const
+    {
+        uint64_t h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+        return h;
+    }
+
+    uint64_t v1, v2, v3, v4;
+};
+
+// The bytes after the last whole stripe, and the final avalanche
+inline uint64_t finish(uint64_t h, const unsigned char* p, const unsigned char* end, size_t size)
+{
+    h += (uint64_t)size;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (p + 4 <= end)
+    {
+        h ^= (uint64_t)read32(p) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        h ^= (*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+}
+
+uint64_t hash64(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* const end = p + size;
+    uint64_t h;
+
+    if (size >= 32)
+    {
+        const unsigned char* const limit = end - 32;
+        Lanes lanes(seed);
+        do
+        {
+            lanes.stripe(p);
+            p += 32;
+        } while (p <= limit);
+        h = lanes.merge();
+    }
+    else
+    {
+        h = seed + PRIME5;
+    }
+    return finish(h, p, end, size);
+}
+
+Hash128 hash128(const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* const end = p + size;
+    Hash128 h;
+
+    if (size >= 32)
+    {
+        const unsigned char* const limit = end - 32;
+        Lanes low(0);
+        Lanes high(1);
+        do
+        {
+            low.stripe(p);
+            high.stripe(p);
+            p += 32;
+        } while (p <= limit);
+        h.low = low.merge();
+        h.high = high.merge();
+    }
+    else
+    {
+        h.low = PRIME5;
+        h.high = 1 + PRIME5;
+    }
+    h.low = finish(h.low, p, end, size);
+    h.high = finish(h.high, p, end, size);
+    return h;
+}
+
+std::string hashToString(uint64_t hash)
+{
+    char str[17];
+    snprintf(str, sizeof(str), "%016llx", (unsigned long long)hash);
+    return str;
+}
+
+}
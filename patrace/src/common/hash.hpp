@@ -0,0 +1,29 @@
+#ifndef _COMMON_HASH_HPP_
+#define _COMMON_HASH_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace common {
+
+/// Fast non-cryptographic 64 bit hash, the XXH64 algorithm, for telling whether data has changed.
+/// Chain calls by passing the previous result as the seed to hash data that is not contiguous.
+uint64_t hash64(const void* data, size_t size, uint64_t seed = 0);
+
+struct Hash128
+{
+    uint64_t low;
+    uint64_t high;
+};
+
+/// 128 bit hash, for telling contents apart where 64 bits could collide. The same as hash64() with
+/// the seeds 0 and 1, but reads the data only once.
+Hash128 hash128(const void* data, size_t size);
+
+/// As 16 lower case hex digits
+std::string hashToString(uint64_t hash);
+
+}
+
+#endif
@@ -202,4 +202,96 @@ void InFileBase::setFrameRange(unsigned startFrame, unsigned endFrame, int tid,
     eglSwapBuffersWithDamage_id = NameToExId("eglSwapBuffersWithDamageKHR");
 }
 
+bool InFileBase::getSeekIndexLocation(long long fileSize, long long& offset, long long& size) const
+{
+    if (!mJsonHeader.isMember("seekIndex"))
+    {
+        return false;
+    }
+    const Json::Value& index = mJsonHeader["seekIndex"];
+    offset = index.get("offset", 0).asInt64();
+    size = index.get("size", 0).asInt64();
+    if (offset <= 0 || size < (long long)sizeof(BSeekIndexHeader) || offset + size > fileSize)
+    {
+        DBG_LOG("Invalid seek index location - ignoring it\n");
+        return false;
+    }
+    return true;
+}
+
+bool InFileBase::parseSeekIndex(const char* data, long long size)
+{
+    mSeekChunks.clear();
+    mSeekSwaps.clear();
+    BSeekIndexHeader header;
+    if (size < (long long)sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.marker != SEEK_INDEX_MARKER || header.magic != SEEK_INDEX_MAGIC || header.version != SEEK_INDEX_VERSION
+        || size != (long long)(sizeof(header) + header.chunkCount * sizeof(BSeekIndexChunk) + header.swapCount * sizeof(BSeekIndexSwap)))
+    {
+        DBG_LOG("Unsupported or corrupt seek index - ignoring it\n");
+        return false;
+    }
+    data += sizeof(header);
+    mSeekChunks.resize(header.chunkCount);
+    memcpy(mSeekChunks.data(), data, header.chunkCount * sizeof(BSeekIndexChunk));
+    data += header.chunkCount * sizeof(BSeekIndexChunk);
+    mSeekSwaps.resize(header.swapCount);
+    memcpy(mSeekSwaps.data(), data, header.swapCount * sizeof(BSeekIndexSwap));
+    mSeekCallCount = header.callCount;
+    for (const BSeekIndexSwap& swap : mSeekSwaps)
+    {
+        if (swap.chunk >= mSeekChunks.size() || swap.offset > mSeekChunks[swap.chunk].size)
+        {
+            DBG_LOG("Corrupt seek index - ignoring it\n");
+            mSeekChunks.clear();
+            mSeekSwaps.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+static InFileBase::SeekPosition toSeekPosition(const BSeekIndexSwap& swap)
+{
+    InFileBase::SeekPosition pos;
+    pos.chunk = swap.chunk;
+    pos.offset = swap.offset;
+    pos.callNo = swap.callNo;
+    return pos;
+}
+
+bool InFileBase::findFrameInSeekIndex(unsigned frame, int tid, SeekPosition& pos) const
+{
+    if (frame == 0)
+    {
+        return false;
+    }
+    unsigned frames = 0;
+    for (const BSeekIndexSwap& swap : mSeekSwaps)
+    {
+        if ((tid == -1 || (int)swap.tid == tid) && ++frames == frame)
+        {
+            pos = toSeekPosition(swap);
+            return true;
+        }
+    }
+    return false;
+}
+
+void InFileBase::getSeekIndexFrames(int tid, std::vector<SeekPosition>& frames) const
+{
+    frames.clear();
+    for (const BSeekIndexSwap& swap : mSeekSwaps)
+    {
+        if (tid == -1 || (int)swap.tid == tid)
+        {
+            frames.push_back(toSeekPosition(swap));
+        }
+    }
+}
+
 } // namespace common
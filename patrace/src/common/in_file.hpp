@@ -37,15 +37,39 @@ public:
     }
 
     void setFrameRange(unsigned startFrame, unsigned endFrame, int tid, bool preload, bool keep_all = false);
+    /// Whether chunks of the frame range stay in memory after their calls are read, so that they can be read again
+    bool keepsAllChunks() const { return mKeepAll; }
 
     inline int getMaxSigId() const { return mMaxSigId; }
     inline const std::vector<std::string>& getFuncNames() const { return mExIdToName; }
+    /// Bytes the call takes up in the trace, including its header
+    inline unsigned getCallSize(const BCall_vlen& call) const { return mExIdToLen[call.funcId] ? mExIdToLen[call.funcId] : call.toNext; }
+    /// Retrace function of a call id, or null if it is not supported
+    inline void* getFuncPtr(unsigned id) const { return mExIdToFunc[id]; }
+
+    /// Where a frame starts, according to the seek index
+    struct SeekPosition
+    {
+        unsigned chunk = 0;     ///< index of the chunk holding the first call of the frame
+        unsigned offset = 0;    ///< offset of that call in the uncompressed chunk, may equal the chunk size
+        unsigned callNo = 0;    ///< number of that call
+    };
+
+    bool hasSeekIndex() const { return !mSeekChunks.empty(); }
+    /// Find the start of the given frame, counting swaps of thread tid only, or of all threads if tid is -1.
+    /// Frame zero is not in the index, since it starts right after the sigbook.
+    bool findFrameInSeekIndex(unsigned frame, int tid, SeekPosition& pos) const;
+    /// Starts of all frames after frame zero, counted as above
+    void getSeekIndexFrames(int tid, std::vector<SeekPosition>& frames) const;
 
 protected:
     bool parseHeader(BHeaderV1 hdrV1, Json::Value &value);
     bool parseHeader(BHeaderV2 hdrV2, Json::Value &value);
     bool parseHeader(BHeaderV3 hdrV3, Json::Value &value);
     bool checkJsonMembers(Json::Value &root);
+    /// Find the seek index location from the JSON header, returns false if there is none
+    bool getSeekIndexLocation(long long fileSize, long long& offset, long long& size) const;
+    bool parseSeekIndex(const char* data, long long size);
 
     bool                mIsOpen = false;
     bool                mMultithread = false;
@@ -69,6 +93,10 @@ protected:
     bool mPreload = false;
 
     HeaderVersion mHeaderVer = HEADER_VERSION_1;
+
+    std::vector<BSeekIndexChunk> mSeekChunks;
+    std::vector<BSeekIndexSwap> mSeekSwaps;
+    unsigned mSeekCallCount = 0;
 };
 
 } // namespace common
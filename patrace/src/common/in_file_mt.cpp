@@ -11,9 +11,22 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sched.h>
 
 namespace common {
 
+const char* InFile::preloadModeName(PreloadMode mode)
+{
+    switch (mode)
+    {
+    case PRELOAD_NONE: return "none";
+    case PRELOAD_DECOMPRESSED: return "decompressed";
+    case PRELOAD_COMPRESSED: return "compressed";
+    case PRELOAD_STREAMING: return "streaming";
+    }
+    return "unknown";
+}
+
 void InFile::rollback()
 {
     if (mCheckpointOffset == -1)
@@ -21,45 +34,283 @@ void InFile::rollback()
         DBG_LOG("No checkpoint set - not able to rollback!\n");
         abort();
     }
-    mPreloadedChunks.push_front(mCurrentChunk);
-    while (mFreeChunks.size())
+    if (mCheckpointChunk)
+    {
+        // Decompress the frame range again, starting with the chunk after the checkpoint
+        mCurrentChunk = recycle(mCurrentChunk);
+        mCurrentChunk->resize(mCheckpointChunk->size());
+        memcpy(mCurrentChunk->data(), mCheckpointChunk->data(), mCheckpointChunk->size());
+        rewindTo(mPreloadSource);
+    }
+    else
     {
-        mCurrentChunk = mFreeChunks.back();
-        mFreeChunks.pop_back();
         mPreloadedChunks.push_front(mCurrentChunk);
+        while (mFreeChunks.size())
+        {
+            mCurrentChunk = mFreeChunks.back();
+            mFreeChunks.pop_back();
+            mPreloadedChunks.push_front(mCurrentChunk);
+        }
+        mCurrentChunk = mPreloadedChunks.front();
+        mPreloadedChunks.pop_front();
     }
-    mCurrentChunk = mPreloadedChunks.front();
-    mPreloadedChunks.pop_front();
     mPtr = mCurrentChunk->data() + mCheckpointOffset;
+    mChunkEnd = mCurrentChunk->data() + mCurrentChunk->size();
     mFrameNo = mBeginFrame;
+    updatePreloadPeak();
 }
 
-// Read another uncompressed memory chunk from the memory mapped file
-bool InFile::readChunk(std::vector<char> *buf)
+// Done with a chunk. If it is still pinned, keep it until it is unpinned.
+void InFile::retire(ChunkBuffer *buf)
+{
+    if (buf && buf->pins() > 0)
+    {
+        mDetachedChunks.insert(buf);
+        mPinStats.heldBytes += buf->capacity();
+        mPinStats.peakHeldBytes = std::max(mPinStats.peakHeldBytes, mPinStats.heldBytes);
+        return;
+    }
+    mChunkPool.release(buf);
+}
+
+// Returns buf, or a replacement for it if it is pinned and so must not be overwritten
+ChunkBuffer* InFile::recycle(ChunkBuffer *buf)
+{
+    if (buf->pins() == 0)
+    {
+        return buf;
+    }
+    retire(buf);
+    return mChunkPool.acquire();
+}
+
+ChunkBuffer* InFile::pinChunk(const void *ptr, size_t size)
+{
+    const char *p = static_cast<const char*>(ptr);
+    if (mPinLimit == 0 || !mCurrentChunk || p < mCurrentChunk->data() || p + size > mCurrentChunk->data() + mCurrentChunk->size())
+    {
+        return nullptr;
+    }
+    if (mPinStats.heldBytes + mCurrentChunk->capacity() > mPinLimit)
+    {
+        mPinStats.refused++;
+        return nullptr;
+    }
+    mCurrentChunk->pin();
+    mPinStats.pins++;
+    return mCurrentChunk;
+}
+
+void InFile::unpinChunk(ChunkBuffer *chunk)
+{
+    chunk->unpin();
+    if (chunk->pins() == 0 && mDetachedChunks.erase(chunk))
+    {
+        mPinStats.heldBytes -= chunk->capacity();
+        mChunkPool.release(chunk);
+    }
+}
+
+// Continue reading compressed chunks from source. Works with and without decoder threads.
+void InFile::rewindTo(char *source)
+{
+    {
+        std::lock_guard<std::mutex> lk(mDecodeMutex);
+        for (auto& pair : mDecodedChunks) mChunkPool.release(pair.second.buffer);
+        mDecodedChunks.clear();
+        mDecodeGeneration++;
+        mCompressedSource = source;
+        mCompressedRemaining = mChunksEnd - (source - mCompressedBuffer);
+        mDecodeNextSubmit = 0;
+        mDecodeNextConsume = 0;
+        mDecodeEof = false;
+    }
+    mDecodeSpaceCond.notify_all();
+}
+
+// Find the next compressed chunk in the memory mapped file. When decoder threads
+// are running, the caller must hold mDecodeMutex.
+bool InFile::nextCompressedChunk(const char*& source, size_t& length, unsigned& codec)
 {
     if (mCompressedRemaining < 4) { return false; }
-    size_t compressedLength = *(unsigned*)mCompressedSource;
-    mCompressedRemaining -= 4;
-    mCompressedSource += 4;
-    if ((int64_t)compressedLength <= mCompressedRemaining)
+    if (readLE32(mCompressedSource) == SEEK_INDEX_MARKER) { return false; }
+    uint32_t compressedLength = 0;
+    const size_t headerLength = readChunkHeader(mCompressedSource, mCompressedRemaining, codec, compressedLength);
+    if (headerLength == 0 || (int64_t)compressedLength > mCompressedRemaining - (int64_t)headerLength) { return false; }
+    source = mCompressedSource + headerLength;
+    length = compressedLength;
+    mCompressedSource += headerLength + compressedLength;
+    mCompressedRemaining -= headerLength + compressedLength;
+    return true;
+}
+
+void InFile::decompressChunk(const char* source, size_t compressedLength, unsigned codec, ChunkBuffer *buf)
+{
+    const ChunkCodec* decoder = getChunkCodec(codec);
+    if (!decoder)
+    {
+        DBG_LOG("Chunk of size %u uses unknown codec %u - aborting!\n", (unsigned)compressedLength, codec);
+        abort();
+    }
+    size_t uncompressedLength = 0;
+    if (!decoder->uncompressedLength(source, compressedLength, &uncompressedLength))
+    {
+        DBG_LOG("Failed to parse chunk of size %u - file is corrupt - aborting!\n", (unsigned)compressedLength);
+        abort();
+    }
+    buf->resize(uncompressedLength);
+    if (!decoder->uncompress(source, compressedLength, buf->data()))
+    {
+        DBG_LOG("Failed to decompress chunk of size %u - file is corrupt - aborting!\n", (unsigned)compressedLength);
+        abort();
+    }
+}
+
+// Read another uncompressed memory chunk from the memory mapped file
+bool InFile::readChunk(ChunkBuffer *buf)
+{
+    if (!mDecoders.empty())
+    {
+        return readDecodedChunk(buf);
+    }
+    const char *source = nullptr;
+    size_t compressedLength = 0;
+    unsigned codec = CHUNK_CODEC_SNAPPY;
+    if (!nextCompressedChunk(source, compressedLength, codec))
     {
-        size_t uncompressedLength = 0;
-        if (!snappy::GetUncompressedLength(mCompressedSource, compressedLength, &uncompressedLength))
+        return false;
+    }
+    decompressChunk(source, compressedLength, codec, buf);
+    mChunkSourceEnd = mCompressedSource;
+    return true;
+}
+
+static void set_thread_cpu_mask(const std::string& descr)
+{
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (unsigned i = 0; i < descr.size(); i++)
+    {
+        if (descr.at(i) == '1')
         {
-            DBG_LOG("Failed to parse chunk of size %u - file is corrupt - aborting!\n", (unsigned)compressedLength);
-            abort();
+            CPU_SET(i, &mask);
         }
-        buf->resize(uncompressedLength);
-        if (!snappy::RawUncompress(mCompressedSource, compressedLength, buf->data()))
+        else if (descr.at(i) != '0')
         {
-            DBG_LOG("Failed to decompress chunk of size %u - file is corrupt - aborting!\n", (unsigned)compressedLength);
-            abort();
+            DBG_LOG("Invalid decoder CPU mask: %s!\n", descr.c_str());
+            return;
+        }
+    }
+    // pid zero means the calling thread, not the whole process
+    if (sched_setaffinity(0, sizeof(mask), &mask) != 0)
+    {
+        DBG_LOG("Failed to set decoder CPU mask: %s\n", strerror(errno));
+    }
+}
+
+void InFile::startDecodeThreads()
+{
+    mDecodeStop = false;
+    mDecodeEof = false;
+    mDecodeNextSubmit = 0;
+    mDecodeNextConsume = 0;
+    mDecodeGeneration = 0;
+    for (int i = 0; i < mDecodeThreads; i++)
+    {
+        mDecoders.emplace_back(&InFile::decodeThread, this);
+    }
+    DBG_LOG("Decoding ahead with %d threads and %d chunks lookahead\n", mDecodeThreads, mDecodeDepth);
+}
+
+void InFile::stopDecodeThreads()
+{
+    {
+        std::lock_guard<std::mutex> lk(mDecodeMutex);
+        mDecodeStop = true;
+    }
+    mDecodeSpaceCond.notify_all();
+    mDecodeReadyCond.notify_all();
+    for (std::thread &t : mDecoders)
+    {
+        if (t.joinable()) t.join();
+    }
+    mDecoders.clear();
+    for (auto& pair : mDecodedChunks) mChunkPool.release(pair.second.buffer);
+    mDecodedChunks.clear();
+}
+
+// Decoder threads claim chunks in file order under the lock, then decompress outside of it.
+// At the end of the file they wait, since a rollback may rewind them.
+void InFile::decodeThread()
+{
+    if (!mDecodeCpuMask.empty()) set_thread_cpu_mask(mDecodeCpuMask);
+
+    std::unique_lock<std::mutex> lk(mDecodeMutex);
+    while (true)
+    {
+        mDecodeSpaceCond.wait(lk, [this]{ return mDecodeStop || (!mDecodeEof && mDecodeNextSubmit - mDecodeNextConsume < (uint64_t)mDecodeDepth); });
+        if (mDecodeStop) break;
+
+        const char *source = nullptr;
+        size_t compressedLength = 0;
+        unsigned codec = CHUNK_CODEC_SNAPPY;
+        if (!nextCompressedChunk(source, compressedLength, codec))
+        {
+            mDecodeEof = true;
+            mDecodeReadyCond.notify_all();
+            continue;
+        }
+        const uint64_t seq = mDecodeNextSubmit++;
+        const uint64_t generation = mDecodeGeneration;
+        char *sourceEnd = mCompressedSource;
+
+        lk.unlock();
+        ChunkBuffer *buf = mChunkPool.acquire();
+        decompressChunk(source, compressedLength, codec, buf);
+        lk.lock();
+
+        if (generation != mDecodeGeneration)
+        {
+            mChunkPool.release(buf);
+            continue;
+        }
+        mDecodedChunks[seq] = { buf, sourceEnd };
+        mDecodeReadyCond.notify_all();
+    }
+}
+
+// Consumer side of the decode-ahead ring. We swap contents with the decoded buffer so that
+// callers keep owning the same buffer objects as in the synchronous path.
+bool InFile::readDecodedChunk(ChunkBuffer *buf)
+{
+    std::unique_lock<std::mutex> lk(mDecodeMutex);
+    auto it = mDecodedChunks.find(mDecodeNextConsume);
+    if (it == mDecodedChunks.end())
+    {
+        if (mDecodeEof && mDecodeNextConsume == mDecodeNextSubmit)
+        {
+            return false;
+        }
+        const int64_t pre = os::getTime();
+        mDecodeReadyCond.wait(lk, [this]{ return mDecodedChunks.count(mDecodeNextConsume) > 0 || (mDecodeEof && mDecodeNextConsume == mDecodeNextSubmit); });
+        mDecodeStats.waits++;
+        mDecodeStats.waitTime += os::getTime() - pre;
+        it = mDecodedChunks.find(mDecodeNextConsume);
+        if (it == mDecodedChunks.end())
+        {
+            return false;
         }
-        mCompressedSource += compressedLength;
-        mCompressedRemaining -= compressedLength;
-        return true;
     }
-    return false;
+    ChunkBuffer *decoded = it->second.buffer;
+    mChunkSourceEnd = it->second.sourceEnd;
+    mDecodedChunks.erase(it);
+    buf->swap(*decoded);
+    mDecodeNextConsume++;
+    mDecodeStats.chunks++;
+    lk.unlock();
+    mChunkPool.release(decoded);
+    mDecodeSpaceCond.notify_one();
+    return true;
 }
 
 bool InFile::Open(const char* name, bool readHeaderAndExit)
@@ -132,6 +383,16 @@ bool InFile::Open(const char* name, bool readHeaderAndExit)
         return false;
     }
     mCompressedRemaining -= mCompressedSource - mCompressedBuffer;
+    mChunksEnd = mCompressedSize;
+    long long indexOffset = 0;
+    long long indexSize = 0;
+    if (getSeekIndexLocation(mCompressedSize, indexOffset, indexSize) && indexOffset >= mCompressedSource - mCompressedBuffer
+        && parseSeekIndex(mCompressedBuffer + indexOffset, indexSize))
+    {
+        // Chunks end where the index begins
+        mChunksEnd = indexOffset;
+        mCompressedRemaining = indexOffset - (mCompressedSource - mCompressedBuffer);
+    }
 
     // when we only wanted to use -info to see header contents, no playback
     if (readHeaderAndExit)
@@ -141,8 +402,8 @@ bool InFile::Open(const char* name, bool readHeaderAndExit)
     }
 
     // Read first chunk
-    mCurrentChunk = new std::vector<char>;
-    mPrevChunk = new std::vector<char>;
+    mCurrentChunk = mChunkPool.acquire();
+    mPrevChunk = mChunkPool.acquire();
     if (!readChunk(mCurrentChunk))
     {
         DBG_LOG("Failed to read first chunk!\n");
@@ -152,37 +413,106 @@ bool InFile::Open(const char* name, bool readHeaderAndExit)
     mChunkEnd = mCurrentChunk->data() + mCurrentChunk->size();
 
     ReadSigBook();
+
+    if (mDecodeThreads > 0)
+    {
+        // Stats add up across restarts of the decoder threads by seekToFrame()
+        mDecodeStats = DecodeStats();
+        mDecodeStats.threads = mDecodeThreads;
+        mDecodeStats.depth = mDecodeDepth;
+        startDecodeThreads();
+    }
     return true;
 }
 
+int InFile::countFrames(const ChunkBuffer *buf, int tid) const
+{
+    int frames = 0;
+    const char *ptr = buf->data();
+    while (ptr < buf->data() + buf->size())
+    {
+        const common::BCall& call = *(const common::BCall*)ptr;
+        if ((call.tid == tid || tid == -1) && (call.funcId == eglSwapBuffers_id || call.funcId == eglSwapBuffersWithDamage_id)) frames++;
+        unsigned int callLen = mExIdToLen[call.funcId];
+        if (callLen == 0)
+        {
+            ptr += reinterpret_cast<const common::BCall_vlen*>(ptr)->toNext;
+        } else {
+            ptr += callLen;
+        }
+    }
+    return frames;
+}
+
+void InFile::updatePreloadPeak()
+{
+    mPreloadStats.peakBytes = std::max(mPreloadStats.peakBytes, mChunkPool.bytesReserved() + mPinnedSize);
+}
+
+// Read the chunks of the frame range and keep them decompressed as long as they fit in the budget.
+// Otherwise only remember where the range starts, so that it can be decompressed again from the
+// file, and lock its compressed data in memory if that fits in the budget.
 void InFile::PreloadFrames(int frames_to_read, int tid)
 {
-    int frames_read = 0;
-    std::vector<char> *newchunk = new std::vector<char>;
+    mPreload = false;
+    mPreloadStats = PreloadStats();
+    mPreloadStats.mode = PRELOAD_DECOMPRESSED;
+    mPreloadStats.budget = mPreloadBudget;
     mCheckpointOffset = mPtr - mCurrentChunk->data();
-    while (readChunk(newchunk) && frames_read < frames_to_read)
+    mPreloadSource = mChunkSourceEnd;
+
+    int frames_read = 0;
+    ChunkBuffer *newchunk = mChunkPool.acquire();
+    while (frames_read < frames_to_read && readChunk(newchunk))
     {
-        mPreloadedChunks.push_back(newchunk);
+        frames_read += countFrames(newchunk, tid);
+        mPreloadStats.chunks++;
+        mPreloadStats.compressedBytes = mChunkSourceEnd - mPreloadSource;
+        mPreloadStats.uncompressedBytes += newchunk->size();
+        updatePreloadPeak();
+        if (mPreloadStats.mode == PRELOAD_DECOMPRESSED && mPreloadBudget > 0 && mPreloadStats.uncompressedBytes > mPreloadBudget)
+        {
+            mPreloadStats.mode = PRELOAD_COMPRESSED;
+            for (auto* b : mPreloadedChunks) mChunkPool.release(b);
+            mPreloadedChunks.clear();
+        }
+        if (mPreloadStats.mode == PRELOAD_COMPRESSED && mPreloadStats.compressedBytes > mPreloadBudget)
+        {
+            mPreloadStats.mode = PRELOAD_STREAMING;
+            break; // no need to know where the range ends
+        }
+        if (mPreloadStats.mode == PRELOAD_DECOMPRESSED)
+        {
+            mPreloadedChunks.push_back(newchunk);
+            newchunk = mChunkPool.acquire();
+        }
+    }
+    mChunkPool.release(newchunk); // we always make one in excess
 
-        // Count the number of frames in the chunk
-        char *ptr = newchunk->data();
-        while (ptr < newchunk->data() + newchunk->size())
+    if (mPreloadStats.mode != PRELOAD_DECOMPRESSED)
+    {
+        mCheckpointChunk = mChunkPool.acquire();
+        mCheckpointChunk->resize(mCurrentChunk->size());
+        memcpy(mCheckpointChunk->data(), mCurrentChunk->data(), mCurrentChunk->size());
+        if (mPreloadStats.mode == PRELOAD_COMPRESSED)
         {
-            const common::BCall& call = *(common::BCall*)ptr;
-            if ((call.tid == tid || tid == -1) && (call.funcId == eglSwapBuffers_id || call.funcId == eglSwapBuffersWithDamage_id)) frames_read++;
-            unsigned int callLen = mExIdToLen[call.funcId];
-            if (callLen == 0)
+            const long pageSize = sysconf(_SC_PAGESIZE);
+            mPinnedBegin = (char*)((uintptr_t)mPreloadSource & ~(uintptr_t)(pageSize - 1));
+            mPinnedSize = mChunkSourceEnd - mPinnedBegin;
+            madvise(mPinnedBegin, mPinnedSize, MADV_WILLNEED);
+            if (mlock(mPinnedBegin, mPinnedSize) != 0)
             {
-                ptr += reinterpret_cast<common::BCall_vlen*>(ptr)->toNext;
-            } else {
-                ptr += callLen;
+                DBG_LOG("Failed to lock %u bytes of compressed frames in memory: %s\n", (unsigned)mPinnedSize, strerror(errno));
+                mPinnedBegin = nullptr;
+                mPinnedSize = 0;
             }
-       }
-
-       newchunk = new std::vector<char>;
-   }
-   delete newchunk; // we always make one in excess
-   mPreload = false;
+        }
+        rewindTo(mPreloadSource);
+    }
+    updatePreloadPeak();
+    DBG_LOG("Preloaded %u chunks %s (%llu bytes compressed, %llu bytes decompressed, budget %llu bytes)\n",
+            (unsigned)mPreloadStats.chunks, preloadModeName(mPreloadStats.mode), (unsigned long long)mPreloadStats.compressedBytes,
+            (unsigned long long)mPreloadStats.uncompressedBytes, (unsigned long long)mPreloadBudget);
 }
 
 bool InFile::GetNextCall(void*& fptr, common::BCall_vlen& call, char*& src)
@@ -200,7 +530,7 @@ bool InFile::GetNextCall(void*& fptr, common::BCall_vlen& call, char*& src)
             }
             else
             {
-                delete mPrevChunk;
+                retire(mPrevChunk);
                 std::swap(mPrevChunk, mCurrentChunk);
                 mCurrentChunk = mPreloadedChunks.front();
             }
@@ -208,8 +538,10 @@ bool InFile::GetNextCall(void*& fptr, common::BCall_vlen& call, char*& src)
         }
         else
         {
+            mPrevChunk = recycle(mPrevChunk);
             if (!readChunk(mPrevChunk)) return false;
             std::swap(mPrevChunk, mCurrentChunk);
+            if (mCheckpointChunk) updatePreloadPeak();
         }
         mPtr = mCurrentChunk->data();
         mChunkEnd = mCurrentChunk->data() + mCurrentChunk->size();
@@ -258,19 +590,75 @@ bool InFile::GetNextCall(void*& fptr, common::BCall_vlen& call, char*& src)
 void InFile::Close()
 {
     if (!mIsOpen) return;
+    stopDecodeThreads(); // must be done before the mapping goes away
+    if (mPinnedSize) munlock(mPinnedBegin, mPinnedSize);
+    mPinnedBegin = nullptr; mPinnedSize = 0;
     munmap(mCompressedBuffer, mCompressedSize);
     close(mFd); mFd = 0;
     mIsOpen = false;
     mPreload = false;
-    for (auto* b : mPreloadedChunks) delete b;
-    for (auto* b : mFreeChunks) delete b;
+    // Chunks that are still pinned stay around until they are unpinned
+    for (auto* b : mPreloadedChunks) retire(b);
+    for (auto* b : mFreeChunks) retire(b);
     mPreloadedChunks.clear();
     mFreeChunks.clear();
-    delete mCurrentChunk; mCurrentChunk = nullptr;
-    delete mPrevChunk; mPrevChunk = nullptr;
+    retire(mCurrentChunk); mCurrentChunk = nullptr;
+    retire(mPrevChunk); mPrevChunk = nullptr;
+    mChunkPool.release(mCheckpointChunk); mCheckpointChunk = nullptr;
+    mChunkPool.clear();
     mExIdToName.clear();
     delete [] mExIdToLen; mExIdToLen = nullptr;
     delete [] mExIdToFunc; mExIdToFunc = nullptr;
+    mSeekChunks.clear();
+    mSeekSwaps.clear();
+}
+
+bool InFile::seekToFrame(unsigned frame, int tid)
+{
+    SeekPosition pos;
+    if (frame == 0 || !findFrameInSeekIndex(frame, tid, pos))
+    {
+        return false;
+    }
+    if (!mPreloadedChunks.empty() || !mFreeChunks.empty())
+    {
+        DBG_LOG("Cannot seek after frames have been preloaded\n");
+        return false;
+    }
+    if (pos.offset == mSeekChunks[pos.chunk].size)
+    {
+        // Swap was the last call of its chunk
+        pos.chunk++;
+        pos.offset = 0;
+        if (pos.chunk >= mSeekChunks.size())
+        {
+            return false; // nothing after it
+        }
+    }
+
+    const bool decoding = !mDecoders.empty();
+    if (decoding)
+    {
+        stopDecodeThreads();
+    }
+    const BSeekIndexChunk& chunk = mSeekChunks[pos.chunk];
+    mCurrentChunk = recycle(mCurrentChunk);
+    mCompressedSource = mCompressedBuffer + chunk.offset;
+    mCompressedRemaining = mChunksEnd - chunk.offset;
+    if (!readChunk(mCurrentChunk) || pos.offset >= mCurrentChunk->size())
+    {
+        DBG_LOG("Failed to read chunk %u at offset %llu for frame %u!\n", pos.chunk, (unsigned long long)chunk.offset, frame);
+        return false;
+    }
+    mPtr = mCurrentChunk->data() + pos.offset;
+    mChunkEnd = mCurrentChunk->data() + mCurrentChunk->size();
+    mFrameNo = frame;
+    curCallNo = (int)pos.callNo - 1;
+    if (decoding)
+    {
+        startDecodeThreads();
+    }
+    return true;
 }
 
 void InFile::ReadSigBook()
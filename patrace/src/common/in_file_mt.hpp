@@ -5,9 +5,17 @@
 #include <common/api_info.hpp>
 #include <common/os_time.hpp>
 #include <common/in_file.hpp>
+#include <common/chunk_codec.hpp>
+#include <common/chunk_pool.hpp>
 
 #include <snappy.h>
+#include <algorithm>
 #include <deque>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 namespace common {
 
@@ -15,7 +23,58 @@ class InFile : public InFileBase
 {
 public:
     InFile() { Close(); }
-    ~InFile() {}
+    ~InFile() { Close(); }
+
+    /// Decompress upcoming chunks on background threads. Must be called before Open().
+    /// threads is the number of decoder threads (zero disables), depth is the number of
+    /// decoded chunks that may be kept ready ahead of the consumer, and cpumask is an
+    /// optional CPU mask for the decoder threads in the same format as -cpumask.
+    void setDecodeAhead(int threads, int depth, const std::string& cpumask = std::string())
+    {
+        mDecodeThreads = threads;
+        mDecodeDepth = std::max(1, depth);
+        mDecodeCpuMask = cpumask;
+    }
+
+    struct DecodeStats
+    {
+        int threads = 0;
+        int depth = 0;
+        uint64_t chunks = 0; ///< chunks handed to the consumer
+        uint64_t waits = 0; ///< number of times the consumer had to wait for a decoder thread
+        int64_t waitTime = 0; ///< total time the consumer spent waiting, in os::timeFrequency units
+    };
+    /// Totals since Open(), safe to call while the decoder threads run
+    DecodeStats getDecodeStats() const
+    {
+        std::lock_guard<std::mutex> lk(mDecodeMutex);
+        return mDecodeStats;
+    }
+
+    enum PreloadMode
+    {
+        PRELOAD_NONE,
+        PRELOAD_DECOMPRESSED, ///< all chunks of the frame range are kept decompressed
+        PRELOAD_COMPRESSED, ///< only the compressed chunks are locked in memory and decompressed again on every loop
+        PRELOAD_STREAMING, ///< nothing is kept, every loop reads the frame range from the file again
+    };
+    static const char* preloadModeName(PreloadMode mode);
+
+    /// Limit the memory used by a preloaded frame range. If the decompressed range does not
+    /// fit in this many bytes, fall back to keeping it compressed, and if that does not fit
+    /// either, to streaming it from the file. Zero means no limit. Must be called before Open().
+    void setPreloadBudget(size_t bytes) { mPreloadBudget = bytes; }
+
+    struct PreloadStats
+    {
+        PreloadMode mode = PRELOAD_NONE;
+        size_t budget = 0;
+        uint64_t chunks = 0; ///< chunks scanned when preloading
+        uint64_t compressedBytes = 0; ///< compressed size of the scanned chunks
+        uint64_t uncompressedBytes = 0;
+        size_t peakBytes = 0; ///< most memory held for chunks at once during the frame range
+    };
+    PreloadStats getPreloadStats() const { return mPreloadStats; }
 
     bool Open(const char *name, bool readHeaderAndExit = false);
     void Close();
@@ -23,42 +82,114 @@ public:
 
     void rollback();
 
-    long memoryUsed()
+    /// Jump straight to the first call of a frame using the seek index, counting swaps on thread
+    /// tid only, or on all threads if tid is -1. Must be done before any frames are preloaded.
+    /// Returns false if the trace has no seek index or the frame is not in it.
+    bool seekToFrame(unsigned frame, int tid);
+
+    /// Allow chunks to be referenced from outside with pinChunk(), holding on to at most this many
+    /// bytes of chunks that would otherwise have been recycled. Zero disables pinning.
+    void setPinLimit(size_t bytes) { mPinLimit = bytes; }
+
+    /// Keep the chunk holding the data of the current call, from ptr to ptr + size, from being
+    /// overwritten or freed until unpinChunk() is called with the returned handle. Returns NULL if
+    /// the data is not in the current chunk or too much memory is already held for pinned chunks,
+    /// in which case the caller should copy the data instead.
+    ChunkBuffer* pinChunk(const void *ptr, size_t size);
+    void unpinChunk(ChunkBuffer *chunk);
+
+    struct PinStats
     {
-        long s = 0;
-        if (mCurrentChunk) s += mCurrentChunk->size();
-        if (mPrevChunk) s += mPrevChunk->size();
-        for (const auto* c : mPreloadedChunks) s += c->size();
-        for (const auto* c : mFreeChunks) s += c->size();
-        return s;
-    }
+        uint64_t pins = 0;
+        uint64_t refused = 0; ///< pins refused because of the limit
+        size_t heldBytes = 0; ///< memory of chunks that are only kept because they are pinned
+        size_t peakHeldBytes = 0;
+    };
+    PinStats getPinStats() const { return mPinStats; }
+
+    /// Bytes of memory held for uncompressed chunks
+    long memoryUsed() const { return mChunkPool.bytesReserved(); }
+    ChunkPool::Stats getChunkPoolStats() const { return mChunkPool.getStats(); }
 
     int curCallNo = -1;
 
 private:
     void ReadSigBook();
     void PreloadFrames(int frames_to_read, int tid);
-    bool readChunk(std::vector<char> *buf);
+    int countFrames(const ChunkBuffer *buf, int tid) const;
+    void updatePreloadPeak();
+    void rewindTo(char *source);
+    void retire(ChunkBuffer *buf);
+    ChunkBuffer* recycle(ChunkBuffer *buf);
+    bool readChunk(ChunkBuffer *buf);
+    bool nextCompressedChunk(const char*& source, size_t& length, unsigned& codec);
+    static void decompressChunk(const char* source, size_t length, unsigned codec, ChunkBuffer *buf);
+
+    // Decode-ahead support
+    void startDecodeThreads();
+    void stopDecodeThreads();
+    void decodeThread();
+    bool readDecodedChunk(ChunkBuffer *buf);
 
-    std::deque<std::vector<char>*> mPreloadedChunks;
+    /// All chunk buffers come from here, including those of the decoder threads
+    ChunkPool mChunkPool;
+    std::deque<ChunkBuffer*> mPreloadedChunks;
     /// The free list is used for loop tracing.
-    std::deque<std::vector<char>*> mFreeChunks;
-    std::vector<char> *mCurrentChunk = nullptr;
+    std::deque<ChunkBuffer*> mFreeChunks;
+    ChunkBuffer *mCurrentChunk = nullptr;
     /// We cannot immediately free the previous chunk since pointers may still be pointing
     /// into its memory area which are consumed by calls in the next.
-    std::vector<char> *mPrevChunk = nullptr;
+    ChunkBuffer *mPrevChunk = nullptr;
 
     /// Offset into first packet that we should start a rollback at
     intptr_t mCheckpointOffset = -1;
+    /// Copy of the chunk holding the checkpoint, and where the compressed chunks after it start,
+    /// when the frame range is not kept decompressed
+    ChunkBuffer *mCheckpointChunk = nullptr;
+    char *mPreloadSource = nullptr;
+    char *mPinnedBegin = nullptr;
+    size_t mPinnedSize = 0;
+    size_t mPreloadBudget = 0;
+    PreloadStats mPreloadStats;
+
+    /// Chunks that were done with while still pinned, released when their last pin goes
+    std::set<ChunkBuffer*> mDetachedChunks;
+    size_t mPinLimit = 0;
+    PinStats mPinStats;
 
     char *mPtr = nullptr;
     void *mChunkEnd = nullptr;
     int64_t mCompressedRemaining = 0;
     int64_t mCompressedSize = 0;
+    int64_t mChunksEnd = 0; ///< file offset where the chunks end, which is where the seek index starts if there is one
     char *mCompressedBuffer = nullptr;
     char *mCompressedSource = nullptr;
+    char *mChunkSourceEnd = nullptr; ///< end of the compressed data of the last chunk returned by readChunk()
     int mFrameNo = 0;
     int mFd = 0;
+
+    int mDecodeThreads = 0;
+    int mDecodeDepth = 4;
+    std::string mDecodeCpuMask;
+    std::vector<std::thread> mDecoders;
+    /// Protects everything below as well as mCompressedSource and mCompressedRemaining while decoders run
+    mutable std::mutex mDecodeMutex;
+    std::condition_variable mDecodeSpaceCond; ///< signalled when the consumer frees a slot
+    std::condition_variable mDecodeReadyCond; ///< signalled when a decoder has finished a chunk
+    struct DecodedChunk
+    {
+        ChunkBuffer *buffer;
+        char *sourceEnd;
+    };
+    /// Decoded chunks keyed by their sequence number in the file, since decoders can finish out of order
+    std::map<uint64_t, DecodedChunk> mDecodedChunks;
+    /// Bumped by rewindTo(), so that chunks decoded from the old position are thrown away
+    uint64_t mDecodeGeneration = 0;
+    uint64_t mDecodeNextSubmit = 0;
+    uint64_t mDecodeNextConsume = 0;
+    bool mDecodeEof = false;
+    bool mDecodeStop = false;
+    DecodeStats mDecodeStats;
 };
 
 }
@@ -1,6 +1,7 @@
 #include <common/in_file_ra.hpp>
 #include <libgen.h> // basename()
 #include <sstream>
+#include <algorithm>
 
 namespace common {
 
@@ -21,9 +22,19 @@ static bool StrEndWith(const char* str, const char* substr)
 bool InFileRA::Open(const char *name, bool readHeaderAndExit)
 {
     mFileName = name;
+    mSeekChunks.clear();
+    mSeekSwaps.clear();
+    mSeekChunkStarts.clear();
+    mRAFile = mUseRAFile || StrEndWith(name, "ra");
 
-    // generate RA (random access) file if needed
-    if (!StrEndWith(name, "ra"))
+    if (mChunkCacheLimit < 0)
+    {
+        const char *cacheSize = getenv("PATRACE_CHUNK_CACHE_MB");
+        mChunkCacheLimit = (int64_t)(cacheSize ? std::max(0, atoi(cacheSize)) : 256) * 1024 * 1024;
+    }
+
+    // generate RA (random access) file if asked for
+    if (mRAFile && !StrEndWith(name, "ra"))
     {
         if (!CreateRAFile(name, mTarget))
             return false;
@@ -80,6 +91,12 @@ bool InFileRA::Open(const char *name, bool readHeaderAndExit)
     {
         return true;
     }
+
+    mPos = mStream.tellg();
+    if (!mRAFile && !FindChunks(mPos))
+    {
+        return false;
+    }
     mIsOpen = true;
 
     // read signature book
@@ -88,6 +105,213 @@ bool InFileRA::Open(const char *name, bool readHeaderAndExit)
     return true;
 }
 
+void InFileRA::Close()
+{
+    mStream.close();
+    mIsOpen = false;
+    mChunks.clear();
+    mChunkCache.clear();
+    mChunkLru.clear();
+    mChunkCacheBytes = 0;
+    std::vector<char>().swap(mCompressed);
+    mCurChunkData = nullptr;
+    mCurChunkBegin = mCurChunkEnd = 0;
+    mPos = 0;
+}
+
+bool InFileRA::FindChunks(std::streamoff firstChunk)
+{
+    mChunks.clear();
+    mStream.seekg(0, std::ios_base::end);
+    const std::streamoff fileSize = mStream.tellg();
+
+    // Use the seek index if there is one, so that we need not touch every chunk up front
+    long long indexOffset = 0, indexSize = 0;
+    if (getSeekIndexLocation(fileSize, indexOffset, indexSize))
+    {
+        std::vector<char> index(indexSize);
+        mStream.seekg(indexOffset, std::ios_base::beg);
+        mStream.read(index.data(), index.size());
+        if (!mStream.fail() && parseSeekIndex(index.data(), index.size())
+            && !mSeekChunks.empty() && (std::streamoff)mSeekChunks[0].offset == firstChunk)
+        {
+            std::streamoff begin = firstChunk;
+            for (unsigned int i = 0; i < mSeekChunks.size(); ++i)
+            {
+                ChunkInfo chunk;
+                chunk.fileOffset = mSeekChunks[i].offset;
+                chunk.begin = begin;
+                chunk.size = mSeekChunks[i].size;
+                mChunks.push_back(chunk);
+                mSeekChunkStarts.push_back(begin);
+                begin += chunk.size;
+            }
+            mSeekChunkStarts.push_back(begin);
+            mStream.clear();
+            return true;
+        }
+        DBG_LOG("Seek index does not match the chunks - ignoring it\n");
+        mSeekChunks.clear();
+        mSeekSwaps.clear();
+        mChunks.clear();
+    }
+
+    // Otherwise walk the chunk length fields, reading only the start of each chunk for its uncompressed size
+    mStream.clear();
+    std::streamoff offset = firstChunk;
+    std::streamoff begin = firstChunk;
+    while (offset + (std::streamoff)sizeof(unsigned int) <= fileSize)
+    {
+        const std::streamoff chunkStart = offset;
+        mStream.seekg(offset, std::ios_base::beg);
+        const unsigned int lengthField = ReadCompressedLength(mStream);
+        if (lengthField == SEEK_INDEX_MARKER || lengthField == 0)
+        {
+            break;
+        }
+        unsigned int codecId = CHUNK_CODEC_SNAPPY;
+        unsigned int compressedLength = 0;
+        const size_t headerLength = ReadChunkHeader(mStream, lengthField, codecId, compressedLength);
+        if (headerLength == 0)
+        {
+            DBG_LOG("Chunk header at %lld is truncated - ignoring the rest of the file\n", (long long)offset);
+            break;
+        }
+        const ChunkCodec* codec = getChunkCodec(codecId);
+        if (!codec)
+        {
+            DBG_LOG("Chunk at %lld uses unknown codec %u - aborting!\n", (long long)offset, codecId);
+            os::abort();
+        }
+        offset += headerLength;
+        if (offset + compressedLength > fileSize)
+        {
+            DBG_LOG("Chunk of size %u at %lld is truncated - ignoring the rest of the file\n", compressedLength, (long long)offset);
+            break;
+        }
+        char prefix[CHUNK_CODEC_PREFIX_LENGTH];
+        const unsigned int prefixLen = std::min<unsigned int>(compressedLength, sizeof(prefix));
+        size_t uncompressedLength = 0;
+        mStream.read(prefix, prefixLen);
+        if (mStream.fail() || !codec->uncompressedLength(prefix, prefixLen, &uncompressedLength))
+        {
+            DBG_LOG("Failed to parse chunk of size %u - file corrupt - aborting!\n", compressedLength);
+            os::abort();
+        }
+        ChunkInfo chunk;
+        chunk.fileOffset = chunkStart;
+        chunk.begin = begin;
+        chunk.size = uncompressedLength;
+        mChunks.push_back(chunk);
+        begin += uncompressedLength;
+        offset += compressedLength;
+    }
+    mStream.clear();
+
+    if (mChunks.empty())
+    {
+        DBG_LOG("No chunks found in %s\n", mFileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+const char* InFileRA::LoadChunk(unsigned int idx)
+{
+    auto it = mChunkCache.find(idx);
+    if (it != mChunkCache.end())
+    {
+        mChunkLru.splice(mChunkLru.begin(), mChunkLru, it->second.lru);
+        return it->second.data.data();
+    }
+
+    const ChunkInfo& chunk = mChunks[idx];
+    while (!mChunkLru.empty() && mChunkCacheBytes + chunk.size > (size_t)mChunkCacheLimit)
+    {
+        auto victim = mChunkCache.find(mChunkLru.back());
+        mChunkCacheBytes -= victim->second.data.size();
+        mChunkCache.erase(victim);
+        mChunkLru.pop_back();
+    }
+
+    // The header in front of the chunk tells its codec
+    mStream.seekg(chunk.fileOffset, std::ios_base::beg);
+    const unsigned int lengthField = ReadCompressedLength(mStream);
+    unsigned int codecId = CHUNK_CODEC_COUNT;
+    unsigned int compressedLength = 0;
+    ReadChunkHeader(mStream, lengthField, codecId, compressedLength);
+    if (mCompressed.size() < compressedLength)
+    {
+        mCompressed.resize(compressedLength);
+    }
+    mStream.read(mCompressed.data(), compressedLength);
+    const ChunkCodec* codec = getChunkCodec(codecId);
+    if (mStream.fail() || !codec)
+    {
+        DBG_LOG("Failed to read chunk %u - file corrupt - aborting!\n", idx);
+        os::abort();
+    }
+
+    CachedChunk& cached = mChunkCache[idx];
+    cached.data.resize(chunk.size);
+    if (!codec->uncompress(mCompressed.data(), compressedLength, cached.data.data()))
+    {
+        DBG_LOG("Failed to decompress chunk of size %u - file is corrupt - aborting!\n", compressedLength);
+        os::abort();
+    }
+    mChunkLru.push_front(idx);
+    cached.lru = mChunkLru.begin();
+    mChunkCacheBytes += chunk.size;
+    return cached.data.data();
+}
+
+const char* InFileRA::FetchSlow(unsigned int len)
+{
+    if (mChunks.empty() || mPos < mChunks.front().begin || mPos + len > mChunks.back().begin + mChunks.back().size)
+    {
+        return nullptr;
+    }
+
+    // Find the last chunk starting at or before mPos, which skips empty chunks
+    auto it = std::upper_bound(mChunks.begin(), mChunks.end(), mPos,
+                               [](std::streamoff pos, const ChunkInfo& chunk) { return pos < chunk.begin; });
+    unsigned int idx = (it - mChunks.begin()) - 1;
+
+    mCurChunkData = LoadChunk(idx);
+    mCurChunkBegin = mChunks[idx].begin;
+    mCurChunkEnd = mCurChunkBegin + mChunks[idx].size;
+    if (mPos + len <= mCurChunkEnd)
+    {
+        const char* ptr = mCurChunkData + (mPos - mCurChunkBegin);
+        mPos += len;
+        return ptr;
+    }
+
+    // Calls do not straddle chunks, but do not rely on it: assemble the data in mCache
+    if (mCacheLen < len)
+    {
+        mCacheLen = len * 2;
+        delete [] mCache;
+        mCache = new char[mCacheLen];
+    }
+    unsigned int copied = 0;
+    while (copied < len)
+    {
+        const ChunkInfo& chunk = mChunks[idx];
+        const char* data = LoadChunk(idx);
+        const std::streamoff from = mPos + copied - chunk.begin;
+        const unsigned int n = std::min<std::streamoff>(len - copied, chunk.size - from);
+        memcpy(mCache + copied, data + from, n);
+        copied += n;
+        idx++;
+    }
+    // The chunk cache may have evicted the current chunk meanwhile
+    mCurChunkData = nullptr;
+    mCurChunkBegin = mCurChunkEnd = 0;
+    mPos += len;
+    return mCache;
+}
+
 unsigned int InFileRA::ReadCompressedLength(std::fstream& inStream)
 {
     unsigned char buf[4];
@@ -104,6 +328,22 @@ unsigned int InFileRA::ReadCompressedLength(std::fstream& inStream)
     return length;
 }
 
+// Read the rest of the header of a chunk, which starts with lengthField. Returns the length
+// of the header, or 0 if it is truncated.
+size_t InFileRA::ReadChunkHeader(std::fstream& inStream, unsigned int lengthField, unsigned int& codec, unsigned int& length)
+{
+    char buf[CHUNK_HEADER_MAX_LENGTH];
+    const size_t headerLength = chunkHeaderLength(lengthField);
+    writeLE32(buf, lengthField);
+    inStream.read(buf + 4, headerLength - 4);
+    if (inStream.fail() || !readChunkHeader(buf, headerLength, codec, length))
+    {
+        length = 0;
+        return 0;
+    }
+    return headerLength;
+}
+
 static void streamCopyBytes(std::istream& in, std::size_t count, std::ostream& out)
 {
     // copy count bytes from in to out
@@ -202,6 +442,7 @@ bool InFileRA::CreateRAFile(const char* name, const std::string& target)
 
 
     // content part
+    std::streamoff chunksBegin = outStream.tellp();
     char*               compressedCache = NULL;
     unsigned int        compressedCacheLen = 0;
     char*               unCompressedCache = NULL;
@@ -209,8 +450,37 @@ bool InFileRA::CreateRAFile(const char* name, const std::string& target)
 
     while ( !inStream.eof() )
     {
-        unsigned int compressedLength = ReadCompressedLength(inStream);
+        const unsigned int lengthField = ReadCompressedLength(inStream);
         size_t uncompressedLength = 0;
+        if (lengthField == SEEK_INDEX_MARKER)
+        {
+            // The seek index follows the last chunk
+            const std::streamoff indexBegin = (std::streamoff)inStream.tellg() - 4;
+            inStream.seekg(0, std::ios_base::end);
+            std::vector<char> index((std::streamoff)inStream.tellg() - indexBegin);
+            inStream.seekg(indexBegin, std::ios_base::beg);
+            inStream.read(index.data(), index.size());
+            if (!inStream.fail() && parseSeekIndex(index.data(), index.size()))
+            {
+                mSeekChunkStarts.push_back(chunksBegin);
+                for (const BSeekIndexChunk& chunk : mSeekChunks)
+                {
+                    mSeekChunkStarts.push_back(mSeekChunkStarts.back() + chunk.size);
+                }
+                if (mSeekChunkStarts.back() != (std::streamoff)outStream.tellp())
+                {
+                    DBG_LOG("Seek index does not match the chunks - ignoring it\n");
+                    mSeekChunks.clear();
+                    mSeekSwaps.clear();
+                    mSeekChunkStarts.clear();
+                }
+            }
+            break;
+        }
+        unsigned int codecId = CHUNK_CODEC_SNAPPY;
+        unsigned int compressedLength = 0;
+        ReadChunkHeader(inStream, lengthField, codecId, compressedLength);
+        const ChunkCodec* codec = getChunkCodec(codecId);
         if (compressedLength)
         {
             if (compressedCacheLen < compressedLength)
@@ -221,8 +491,13 @@ bool InFileRA::CreateRAFile(const char* name, const std::string& target)
             }
         }
 
+        if (!codec)
+        {
+            DBG_LOG("Chunk uses unknown codec %u - aborting!\n", codecId);
+            os::abort();
+        }
         inStream.read(compressedCache, compressedLength);
-        if (!snappy::GetUncompressedLength(compressedCache, (size_t)compressedLength, &uncompressedLength) && compressedLength > 0)
+        if (!codec->uncompressedLength(compressedCache, (size_t)compressedLength, &uncompressedLength) && compressedLength > 0)
         {
             DBG_LOG("Failed to parse chunk of size %u - file corrupt - aborting!\n", compressedLength);
             os::abort();
@@ -233,7 +508,7 @@ bool InFileRA::CreateRAFile(const char* name, const std::string& target)
             unCompressedCacheLen = uncompressedLength;
             unCompressedCache = new char [unCompressedCacheLen];
         }
-        if (!snappy::RawUncompress(compressedCache, compressedLength, unCompressedCache) && compressedLength > 0)
+        if (!codec->uncompress(compressedCache, compressedLength, unCompressedCache) && compressedLength > 0)
         {
             DBG_LOG("Failed to decompress chunk of size %u - file is corrupt - aborting!\n", compressedLength);
             os::abort();
@@ -252,11 +527,19 @@ bool InFileRA::CreateRAFile(const char* name, const std::string& target)
 
 void InFileRA::ReadSigBook()
 {
-    unsigned int toNext;
-    mStream.read((char*)&toNext, sizeof(toNext));
-    this->ReadChunk(toNext - sizeof(toNext));
-
-    char* src = mCache;
+    const char* ptr = Fetch(sizeof(unsigned int));
+    if (!ptr)
+    {
+        DBG_LOG("Failed to read the signature book - aborting!\n");
+        os::abort();
+    }
+    const unsigned int toNext = *(const unsigned int*)ptr;
+    char* src = const_cast<char*>(Fetch(toNext - sizeof(toNext)));
+    if (!src)
+    {
+        DBG_LOG("Failed to read the signature book - aborting!\n");
+        os::abort();
+    }
     src = ReadFixed(src, mMaxSigId);
 
     if (mMaxSigId > ApiInfo::MaxSigId) {
@@ -3,11 +3,18 @@
 
 #include <common/api_info.hpp>
 #include <common/in_file.hpp>
+#include <common/chunk_codec.hpp>
 
 #include <snappy.h>
+#include <list>
+#include <unordered_map>
 
 namespace common {
 
+/// Random access reader. Read positions are offsets into the trace as if all its chunks were
+/// decompressed back to back after the header, which is also the layout of a .ra file.
+/// By default chunks are decompressed on demand into a size-limited LRU cache. Creating and
+/// reading an uncompressed .ra copy of the trace is still possible with setUseRAFile().
 class InFileRA : public InFileBase {
 public:
     InFileRA()
@@ -26,37 +33,55 @@ public:
     }
 
     void setTarget(const std::string& target) { mTarget = target; }
+    /// Create an uncompressed .ra copy of the trace and read from that instead. Must be called before Open().
+    void setUseRAFile(bool value) { mUseRAFile = value; }
+    /// Memory limit for decompressed chunks. The chunk currently read from is always kept.
+    /// If not set, the environment variable PATRACE_CHUNK_CACHE_MB is used, and otherwise 256 MB.
+    void setChunkCacheSize(size_t bytes) { mChunkCacheLimit = bytes; }
     bool Open(const char *name, bool readHeaderAndExit = false);
-    void Close() { mStream.close(); }
+    void Close();
 
     std::streamoff GetReadPos()
     {
-        return mStream.tellg();
+        if (mRAFile)
+        {
+            return mStream.tellg();
+        }
+        return mPos;
     }
 
     void SetReadPos(std::streamoff pos)
     {
-        mStream.seekg(pos, std::ios_base::beg);
+        if (mRAFile)
+        {
+            mStream.seekg(pos, std::ios_base::beg);
+        }
+        mPos = pos;
     }
 
     bool GetNextCall(void*& fptr, common::BCall_vlen& call, char*& src)
     {
-        mStream.read(mCache, sizeof(common::BCall));
-        if (mStream.fail())
+        const char* ptr = Fetch(sizeof(common::BCall));
+        if (!ptr)
         {
-            mStream.clear();
             return false;
         }
 
         common::BCall tmpCall;
-        tmpCall = *(common::BCall*)mCache;
+        tmpCall = *(common::BCall*)ptr;
         unsigned int callLen = mExIdToLen[tmpCall.funcId];
         unsigned int contentLen;
         if (callLen == 0)
         {
-            mStream.read((char*)&callLen, sizeof(unsigned int));
+            ptr = Fetch(sizeof(unsigned int));
+            if (!ptr)
+            {
+                return false;
+            }
+            callLen = *(unsigned int*)ptr;
             contentLen = callLen - sizeof(common::BCall_vlen);
-            call = *(common::BCall_vlen*)mCache;
+            call = tmpCall;
+            call.toNext = callLen;
         }
         else
         {
@@ -64,13 +89,13 @@ public:
             call = tmpCall;
         }
 
-        if (!this->ReadChunk(contentLen))
+        ptr = Fetch(contentLen);
+        if (!ptr)
         {
-            mStream.clear();
             return false;
         }
 
-        mDataPtr = src = mCache;
+        mDataPtr = src = const_cast<char*>(ptr);
         fptr = mExIdToFunc[call.funcId];
 
         return true;
@@ -78,6 +103,13 @@ public:
 
     void copySigBook(std::vector<std::string> &sigbook);
 
+    /// Read position of a seek index position
+    std::streamoff getSeekReadPos(const SeekPosition& pos) const { return mSeekChunkStarts.at(pos.chunk) + pos.offset; }
+    /// Read position after the last call, according to the seek index
+    std::streamoff getSeekEndReadPos() const { return mSeekChunkStarts.back(); }
+    /// Number of calls in the trace, according to the seek index
+    unsigned getSeekCallCount() const { return mSeekCallCount; }
+
 private:
     inline bool ReadChunk(unsigned int len)
     {
@@ -92,13 +124,69 @@ private:
         return true;
     }
 
+    /// Return a pointer to the next len bytes and advance past them, or nullptr at the end of the trace.
+    /// The pointer is valid until the next call.
+    inline const char* Fetch(unsigned int len)
+    {
+        if (mRAFile)
+        {
+            if (!ReadChunk(len))
+            {
+                mStream.clear();
+                return nullptr;
+            }
+            return mCache;
+        }
+        if (mPos >= mCurChunkBegin && mPos + len <= mCurChunkEnd)
+        {
+            const char* ptr = mCurChunkData + (mPos - mCurChunkBegin);
+            mPos += len;
+            return ptr;
+        }
+        return FetchSlow(len);
+    }
+
+    const char* FetchSlow(unsigned int len);
+    bool FindChunks(std::streamoff firstChunk);
+    const char* LoadChunk(unsigned int idx);
+
     unsigned int ReadCompressedLength(std::fstream& inStream);
+    size_t ReadChunkHeader(std::fstream& inStream, unsigned int lengthField, unsigned int& codec, unsigned int& length);
     bool CreateRAFile(const char* name, const std::string& target);
     void ReadSigBook();
 
     unsigned int mCacheLen;
     char *mCache;
     std::string mTarget;
+    bool mUseRAFile = false;
+    /// Whether we read from an uncompressed .ra file rather than from the compressed trace
+    bool mRAFile = false;
+
+    struct ChunkInfo
+    {
+        std::streamoff fileOffset;  ///< offset of the chunk header in the trace file
+        std::streamoff begin;       ///< read position of the first uncompressed byte
+        unsigned int size;          ///< uncompressed size
+    };
+    std::vector<ChunkInfo> mChunks;
+    std::streamoff mPos = 0;
+
+    struct CachedChunk
+    {
+        std::vector<char> data;
+        std::list<unsigned int>::iterator lru;
+    };
+    std::unordered_map<unsigned int, CachedChunk> mChunkCache;
+    std::list<unsigned int> mChunkLru; ///< most recently used first
+    size_t mChunkCacheBytes = 0;
+    int64_t mChunkCacheLimit = -1; ///< -1 until set or read from the environment by Open()
+    std::vector<char> mCompressed;
+    const char* mCurChunkData = nullptr;
+    std::streamoff mCurChunkBegin = 0;
+    std::streamoff mCurChunkEnd = 0;
+
+    /// Read position of each chunk, plus the end of the last one
+    std::vector<std::streamoff> mSeekChunkStarts;
 };
 
 }
@@ -22,6 +22,56 @@ void PrintMemory(const void *mem, size_t len)
     printf("\nMEMORY PRINT END : %d <<<<<<<<<<<<< }\n", (int)len);
 }
 
+static DigestKind digestKind = DIGEST_XXH64X2;
+
+void setBufferDigestKind(DigestKind kind)
+{
+    digestKind = kind;
+}
+
+DigestKind bufferDigestKind()
+{
+    return digestKind;
+}
+
+const char* digestKindName(DigestKind kind)
+{
+    switch (kind)
+    {
+    case DIGEST_MD5: return "md5";
+    case DIGEST_XXH64X2: return "xxh64x2";
+    }
+    return "unknown";
+}
+
+bool parseDigestKind(const std::string& name, DigestKind& kind)
+{
+    for (DigestKind k : { DIGEST_MD5, DIGEST_XXH64X2 })
+    {
+        if (name == digestKindName(k))
+        {
+            kind = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+BufferDigest::BufferDigest(const void* p, size_t size)
+{
+    if (digestKind == DIGEST_MD5)
+    {
+        const MD5Digest md5(p, size);
+        memcpy(words, (const unsigned char*)md5, sizeof(words));
+    }
+    else
+    {
+        const Hash128 hash = hash128(p, size);
+        words[0] = hash.low;
+        words[1] = hash.high;
+    }
+}
+
 void * ClientSideBufferObject::extend(const void *p, ptrdiff_t s)
 {
     const void *new_base_address = PTR_DIFF(base_address, p) > (ptrdiff_t)(0) ? p : base_address;
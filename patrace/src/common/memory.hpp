@@ -5,10 +5,12 @@
 #include <cstring>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <map>
 #include <set>
 #include "md5/md5.h"
 
+#include <common/hash.hpp>
 #include <common/os.hpp>
 #include <iostream>
 #include <iomanip>
@@ -141,6 +143,39 @@ inline std::ostream& operator<<(std::ostream& o, const MD5Digest& md)
     return o;
 }
 
+/// How client-side buffer objects with the same contents are found. Digests are not stored in
+/// traces, so the kind only matters for how fast, and how likely to collide, they are.
+enum DigestKind
+{
+    DIGEST_MD5,
+    DIGEST_XXH64X2, ///< two XXH64 with different seeds, see hash128()
+};
+
+/// Set before any client-side buffer object is created, since digests of different kinds never match
+void setBufferDigestKind(DigestKind kind);
+DigestKind bufferDigestKind();
+const char* digestKindName(DigestKind kind);
+/// Returns false if the name is not a digest kind
+bool parseDigestKind(const std::string& name, DigestKind& kind);
+
+/// A 128 bit digest of a memory range, of the kind set with setBufferDigestKind()
+struct BufferDigest
+{
+    BufferDigest() {}
+    BufferDigest(const void* p, size_t size);
+
+    bool operator==(const BufferDigest &other) const
+    {
+        return words[0] == other.words[0] && words[1] == other.words[1];
+    }
+    bool operator!=(const BufferDigest &other) const
+    {
+        return !(*this == other);
+    }
+
+    uint64_t words[2] = { 0, 0 };
+};
+
 struct CSBPatch
 {
     unsigned int offset;
@@ -152,6 +187,9 @@ struct CSBPatchList
     unsigned int count;
 };
 
+/// Called when a client-side buffer object stops referencing memory given to it with set_data_ref()
+typedef void (*ExternalMemoryRelease)(void *token);
+
 // Represents a contiguous memory range
 class ClientSideBufferObject
 {
@@ -161,6 +199,7 @@ public:
         if (_own_memory)
             delete [] static_cast<const char*>(base_address);
         base_address = NULL;
+        release_external();
     }
 
     ClientSideBufferObject()
@@ -185,13 +224,14 @@ public:
         if (this == &other)
             return *this;
 
-        set_data(other.base_address, other.size, other._own_memory);
+        // We cannot share the other object's hold on external memory, so copy it
+        set_data(other.base_address, other.size, other._own_memory || other._release);
         return *this;
     }
 
     bool operator==(const ClientSideBufferObject &other) const
     {
-        return size == other.size && md5_digest() == other.md5_digest();
+        return size == other.size && digest() == other.digest();
     }
 
     void set_data(const void *p, ptrdiff_t s, bool copy = false)
@@ -225,20 +265,40 @@ public:
         {
             base_address = const_cast<void *>(p);
         }
+        // Only now, since p may point into the external memory
+        release_external();
         size = s;
-        _dirty_md5_digest = true;
+        _dirty_digest = true;
 
         if (!_own_memory)
         {
             // If we don't own the memory referenced, meaning we also don't
-            // control the lifetime of it, we calculate the MD5 digest now as
+            // control the lifetime of it, we calculate the digest now as
             // the referenced memory might be invalidated at any time.
-            calculate_md5_digest();
+            calculate_digest();
         }
     }
 
+    /// Reference memory without copying it, and without calculating its digest up front. The caller
+    /// guarantees the memory stays valid until release is called with token.
+    void set_data_ref(const void *p, ptrdiff_t s, ExternalMemoryRelease release, void *token)
+    {
+        set_data(NULL, 0);
+        base_address = const_cast<void *>(p);
+        size = s;
+        _dirty_digest = true;
+        _release = release;
+        _release_token = token;
+    }
+
     void set_subdata(const void *p, ptrdiff_t offset, ptrdiff_t s)
     {
+        if (_release)
+        {
+            // Copy on write
+            set_data(base_address, size, true);
+        }
+
         if (_own_memory == false)
         {
             DBG_LOG("Can not set the sub-data of a client-side buffer object which does not own its memory.\n");
@@ -255,7 +315,7 @@ public:
         {
             memcpy(static_cast<char*>(base_address) + offset, p, s);
         }
-        _dirty_md5_digest = true;
+        _dirty_digest = true;
     }
 
     // Whether these two contiguous memory regions overlap
@@ -264,20 +324,26 @@ public:
     // Extend this memory region to contain another contiguous memory region, and return the new base address
     void * extend(const void *p, ptrdiff_t size);
 
+    const BufferDigest digest() const
+    {
+        if (_dirty_digest) calculate_digest();
+        return _digest;
+    }
+
+    /// Of the current contents, whatever the digest kind is. Not cached.
     const MD5Digest md5_digest() const
     {
-        if (_dirty_md5_digest) calculate_md5_digest();
-        return _md5_digest;
+        return MD5Digest(base_address, size);
     }
 
     const bool modified() const
     {
-        return _md5_last_copy != md5_digest();
+        return _last_copy_digest != digest();
     }
 
-    void save_md5_last_copy()
+    void save_last_copy_digest()
     {
-        _md5_last_copy = md5_digest();
+        _last_copy_digest = digest();
     }
 
     void * translate_address(ptrdiff_t offset) const
@@ -309,19 +375,33 @@ private:
     // If own its memory, should delete it in the destructor
     bool _own_memory;
 
-    // Cached MD5 digest
-    mutable bool _dirty_md5_digest = true;
-    mutable MD5Digest _md5_digest;
-    mutable MD5Digest _md5_last_copy;
+    // Cached digest
+    mutable bool _dirty_digest = true;
+    mutable BufferDigest _digest;
+    BufferDigest _last_copy_digest;
 
     // If != 0, this will be used as destination by set_data
     // This is used by the glReadMapBufferRange, and glUnmapBuffer functiosn.
     void* _destinationAddress = nullptr;
 
-    void calculate_md5_digest() const
+    // Memory referenced through set_data_ref()
+    ExternalMemoryRelease _release = nullptr;
+    void *_release_token = nullptr;
+
+    void release_external()
+    {
+        if (_release)
+        {
+            _release(_release_token);
+            _release = nullptr;
+            _release_token = nullptr;
+        }
+    }
+
+    void calculate_digest() const
     {
-        _md5_digest = MD5Digest(base_address, size);
-        _dirty_md5_digest = false;
+        _digest = BufferDigest(base_address, size);
+        _dirty_digest = false;
     }
 };
 
@@ -388,11 +468,13 @@ public:
     void create_object(ClientSideBufferObjectName name)
     {
         _objects.emplace(name, new ClientSideBufferObject);
+        changed(name);
     }
 #else
     ClientSideBufferObjectName create_object()
     {
         _objects.emplace(_objects.size() + 1, new ClientSideBufferObject);
+        changed(_objects.size());
         return _objects.size();
     }
 #endif
@@ -404,6 +486,7 @@ public:
         {
             delete _objects.at(name);
             _objects.at(name) = NULL;
+            changed(name);
             return;
         }
 
@@ -418,6 +501,18 @@ public:
             _objects.emplace(name, new ClientSideBufferObject);
         }
         _objects[name]->set_data(data, size, copy);
+        changed(name);
+    }
+
+    void object_data_ref(ClientSideBufferObjectName name, int size, const void *data, ExternalMemoryRelease release, void *token)
+    {
+        ClientSideBufferObjectList::iterator iter = _objects.find(name);
+        if (iter == _objects.end())
+        {
+            _objects.emplace(name, new ClientSideBufferObject);
+        }
+        _objects[name]->set_data_ref(data, size, release, token);
+        changed(name);
     }
 
     void object_subdata(ClientSideBufferObjectName name, int offset, int size, const void* data)
@@ -428,6 +523,7 @@ public:
             DBG_LOG("Invalid client-side buffer name to set sub-data : %d\n", name);
         }
         _objects[name]->set_subdata(data, offset, size);
+        changed(name);
     }
 
     ClientSideBufferObject *get_object(ClientSideBufferObjectName name) const
@@ -442,16 +538,14 @@ public:
 
     bool find(const ClientSideBufferObject &obj, ClientSideBufferObjectName &name) const
     {
-        ClientSideBufferObjectList::const_iterator iter;
-        for (iter = _objects.begin(); iter != _objects.end(); iter++)
+        update_index();
+        const auto range = _index.equal_range(IndexKey{ obj.size, obj.digest() });
+        if (range.first == range.second)
         {
-            if (iter->second && *(iter->second) == obj)
-            {
-                name = iter->first;
-                return true;
-            }
+            return false;
         }
-        return false;
+        name = range.first->second;
+        return true;
     }
 
     size_t total_size() const
@@ -469,8 +563,82 @@ public:
     }
 
 private:
+    struct IndexKey
+    {
+        ptrdiff_t size;
+        BufferDigest digest;
+
+        bool operator==(const IndexKey &other) const
+        {
+            return size == other.size && digest == other.digest;
+        }
+    };
+
+    struct IndexKeyHash
+    {
+        size_t operator()(const IndexKey &key) const
+        {
+            return key.digest.words[0] ^ key.size;
+        }
+    };
+
+    // Taken out of the index until the next find, so that objects changed many times between finds
+    // are not digested for it each time. Nothing is indexed before the first find, which the
+    // retracer never does.
+    void changed(ClientSideBufferObjectName name)
+    {
+        if (!_indexing)
+        {
+            return;
+        }
+        const auto indexed = _indexed.find(name);
+        if (indexed != _indexed.end())
+        {
+            const auto range = _index.equal_range(indexed->second);
+            for (auto iter = range.first; iter != range.second; ++iter)
+            {
+                if (iter->second == name)
+                {
+                    _index.erase(iter);
+                    break;
+                }
+            }
+            _indexed.erase(indexed);
+        }
+        _unindexed.insert(name);
+    }
+
+    void update_index() const
+    {
+        if (!_indexing)
+        {
+            for (const auto &iter : _objects)
+            {
+                _unindexed.insert(iter.first);
+            }
+            _indexing = true;
+        }
+        for (const ClientSideBufferObjectName name : _unindexed)
+        {
+            const ClientSideBufferObject *obj = get_object(name);
+            if (obj)
+            {
+                const IndexKey key{ obj->size, obj->digest() };
+                _index.emplace(key, name);
+                _indexed.emplace(name, key);
+            }
+        }
+        _unindexed.clear();
+    }
+
     typedef std::unordered_map<unsigned int, ClientSideBufferObject*> ClientSideBufferObjectList;
     ClientSideBufferObjectList _objects;
+
+    // Objects by size and digest, to find objects with the same contents
+    mutable std::unordered_multimap<IndexKey, ClientSideBufferObjectName, IndexKeyHash> _index;
+    mutable std::unordered_map<ClientSideBufferObjectName, IndexKey> _indexed;
+    mutable std::unordered_set<ClientSideBufferObjectName> _unindexed;
+    mutable bool _indexing = false;
 };
 
 class ClientSideBufferObjectSet
@@ -505,6 +673,14 @@ public:
         _per_threads[tid].object_data(name, size, data, copy);
     }
 
+    // For thread N, make the object with the specific name reference memory owned by someone else,
+    // who will be told with release(token) when the object no longer needs it
+    void object_data_ref(unsigned int tid, ClientSideBufferObjectName name,
+        int size, const void *data, ExternalMemoryRelease release, void *token)
+    {
+        _per_threads[tid].object_data_ref(name, size, data, release, token);
+    }
+
     // For thread N, set the sub-data of the object with the specific name
     void object_subdata(unsigned int tid, ClientSideBufferObjectName name,
         int offset, int size, const void* data)
@@ -1,11 +1,15 @@
 #include <common/out_file.hpp>
 
 #include <vector>
+#include <algorithm>
+#include <stdlib.h>
 #include <common/os.hpp>
 #include <common/api_info.hpp>
 #include <common/pa_exception.h>
 
-#include <snappy.h> // Compression
+#include "json/writer.h"
+#include "json/reader.h"
+
 
 namespace common {
 
@@ -38,6 +42,23 @@ OutFile::~OutFile()
     Close();
 }
 
+void OutFile::setAsync(int threads, int inflight)
+{
+    mWriterThreads = std::max(0, threads);
+    mMaxInFlight = std::max(1, inflight);
+}
+
+void OutFile::setChunkCodec(unsigned codec, int level)
+{
+    if (!getChunkCodec(codec))
+    {
+        DBG_LOG("Unknown chunk codec %u - using snappy\n", codec);
+        codec = CHUNK_CODEC_SNAPPY;
+    }
+    mCodec = codec;
+    mCodecLevel = level;
+}
+
 bool OutFile::Open(const char* name, bool writeSigBook, const std::vector<std::string> *sigbook)
 {
     os::String autogenFileName;
@@ -77,13 +98,56 @@ bool OutFile::Open(const char* name, bool writeSigBook, const std::vector<std::s
         mHeader.jsonFileEnd = jsonEnd; // is this more robust than calculating it beforehand, assuming all bytes we have is header+jsonMaxLength?
     }
 
+    if (mWriterThreads < 0)
+    {
+        const char *threads = getenv("PATRACE_WRITER_THREADS");
+        mWriterThreads = threads ? std::max(0, atoi(threads)) : 0;
+    }
+    if (mWriterThreads > 0)
+    {
+        StartWriterThreads();
+    }
+
+    if (mCodec < 0)
+    {
+        const char *codec = getenv("PATRACE_CHUNK_CODEC");
+        unsigned id = CHUNK_CODEC_SNAPPY;
+        int level = -1;
+        if (codec && !parseChunkCodec(codec, id, level))
+        {
+            DBG_LOG("Unknown chunk codec %s - using snappy\n", codec);
+            id = CHUNK_CODEC_SNAPPY;
+            level = -1;
+        }
+        mCodec = id;
+        mCodecLevel = level;
+    }
+    mCodecImpl = getChunkCodec(mCodec);
+
+    mNextChunkOffset = mHeader.jsonFileEnd;
+    mIndexing = false;
+    mLastJson.clear();
+
+    if (mSeekIndexEnabled < 0)
+    {
+        const char *seekIndex = getenv("PATRACE_SEEK_INDEX");
+        mSeekIndexEnabled = (seekIndex && atoi(seekIndex) > 0) ? 1 : 0;
+    }
+
     CreateCache(SNAPPY_CHUNK_SIZE);
     if (writeSigBook)
     {
+        if (mSeekIndexEnabled > 0)
+        {
+            StartIndexing(sigbook);
+        }
+        const bool indexing = mIndexing;
+        mIndexing = false; // the sigbook is not a call
         if (sigbook)
             WriteSigBook(sigbook);
         else
             WriteSigBook(NULL);
+        mIndexing = indexing;
     }
 
     return true;
@@ -95,6 +159,21 @@ void OutFile::Close()
         return;
 
     Flush();
+    if (!mCompressors.empty())
+    {
+        WaitForWriter();
+        StopWriterThreads();
+    }
+    if (mIndexing)
+    {
+        WriteSeekIndex();
+    }
+    mIndexing = false;
+    mIndexIdToLen.clear();
+    mIndexIdIsSwap.clear();
+    mIndexChunks.clear();
+    mIndexChunkOffsets.clear();
+    mIndexSwaps.clear();
     fseek(mStream, 0, SEEK_SET);
     filewrite((char*)&mHeader, sizeof(BHeaderV3));
 
@@ -117,20 +196,52 @@ void OutFile::Flush()
     if (len == 0)
         return;
 
-    size_t compressedLen;
-    ::snappy::RawCompress(mCache, len, mCompressedCache, &compressedLen);
-    WriteCompressedLength((unsigned int)compressedLen);
-    filewrite(mCompressedCache, compressedLen);
-    fflush(mStream);
+    if (!mIndexIdToLen.empty())
+    {
+        IndexChunk(len);
+    }
+
+    if (mCurrentJob)
+    {
+        // Hand the filled cache over to the compressors and continue in a recycled one
+        mCurrentJob->len = len;
+        mCurrentJob->isHeader = false;
+        SubmitJob(mCurrentJob);
+        mCurrentJob = GetFreeJob(mCacheLen);
+        mCache = mCurrentJob->data;
+        mCacheP = mCache;
+        return;
+    }
+
+    const size_t compressedLen = mCodecImpl->compress(mCache, len, mCompressedCache, mCodecLevel);
+    WriteChunk(mCompressedCache, compressedLen);
     mCacheP = mCache;
 }
 
-void OutFile::FlushHeader()
+void OutFile::WriteChunk(const char* buf, unsigned int len)
+{
+    if (len >= CHUNK_CODEC_MARKER)
+    {
+        DBG_LOG("Compressed chunk of %u bytes is too large for the file format - aborting!\n", len);
+        os::abort();
+    }
+    char header[CHUNK_HEADER_MAX_LENGTH];
+    const size_t headerLen = writeChunkHeader(header, mCodec, len);
+    mIndexChunkOffsets.push_back(mNextChunkOffset);
+    mNextChunkOffset += headerLen + len;
+    filewrite(header, headerLen);
+    filewrite(buf, len);
+    fflush(mStream);
+}
+
+void OutFile::WriteJsonAndHeader(const char* buf, unsigned int len, const BHeaderV3& header)
 {
-    long curP = ftell(mStream);
+    long oldP = ftell(mStream);
+    fseek(mStream, mHeader.jsonFileBegin, SEEK_SET);
+    filewrite(buf, len);
     fseek(mStream, 0, SEEK_SET);
-    filewrite((char*)&mHeader, sizeof(BHeaderV3));
-    fseek(mStream, curP, SEEK_SET);
+    filewrite((const char*)&header, sizeof(BHeaderV3));
+    fseek(mStream, oldP, SEEK_SET);
     fflush(mStream);
 }
 
@@ -141,23 +252,47 @@ void OutFile::WriteHeader(const char* buf, unsigned int len, bool verbose)
         return;
     }
 
+    mLastJson.assign(buf, len);
+    if (mLastJson.find("\"seekIndex\"") != std::string::npos)
+    {
+        // Headers copied from another trace refer to that trace's index, not ours
+        Json::Value root;
+        Json::Reader reader;
+        if (reader.parse(mLastJson, root))
+        {
+            root.removeMember("seekIndex");
+            Json::FastWriter writer;
+            mLastJson = writer.write(root);
+            buf = mLastJson.c_str();
+            len = mLastJson.size();
+        }
+    }
+
     // write variable length header to beginning of file, then seek back to previous file put position
     Flush(); // flush last compressed part
     if ( len > mHeader.jsonMaxLength ) {
         DBG_LOG("Error: json file too long for header, %d > %d\n", len, mHeader.jsonMaxLength);
         os::abort();
     } else {
-        long oldP = ftell(mStream);
-        fseek(mStream, mHeader.jsonFileBegin, SEEK_SET);
-        filewrite(buf, len);
         mHeader.jsonLength = len;
+        if (mCurrentJob)
+        {
+            // Queued behind the chunks flushed so far, so the header never describes unwritten data
+            WriteJob* job = GetFreeJob(len);
+            memcpy(job->data, buf, len);
+            job->len = len;
+            job->header = mHeader;
+            job->isHeader = true;
+            SubmitJob(job);
+        }
+        else
+        {
+            WriteJsonAndHeader(buf, len, mHeader);
+        }
         if (verbose)
         {
             DBG_LOG("wrote json header, length=%d\n", mHeader.jsonLength);
         }
-        fseek(mStream, oldP, SEEK_SET);
-
-        FlushHeader();
     }
 }
 
@@ -166,16 +301,312 @@ void OutFile::CreateCache(int len)
     if (len <= mCacheLen)
         return;
 
+    if (mCurrentJob)
+    {
+        delete [] mCurrentJob->data;
+        mCurrentJob->data = new char[len];
+        mCurrentJob->capacity = len;
+        mCacheLen = len;
+        mCache = mCurrentJob->data;
+        mCacheP = mCache;
+        return;
+    }
+
     delete [] mCache;
     delete [] mCompressedCache;
 
     mCacheLen = len;
-    mCompressedCacheLen = snappy::MaxCompressedLength(mCacheLen);
+    mCompressedCacheLen = mCodecImpl->maxCompressedLength(mCacheLen);
     mCache = new char[mCacheLen];
     mCacheP = mCache;
     mCompressedCache = new char[mCompressedCacheLen];
 }
 
+void OutFile::StartIndexing(const std::vector<std::string> *sigbook)
+{
+    const unsigned int count = sigbook ? sigbook->size() : ApiInfo::MaxSigId + 1;
+    mIndexIdToLen.assign(count, 0);
+    mIndexIdIsSwap.assign(count, false);
+    for (unsigned int id = 1; id < count; ++id)
+    {
+        const char* name = sigbook ? sigbook->at(id).c_str() : ApiInfo::IdToNameArr[id];
+        if (!name)
+            continue;
+        mIndexIdToLen[id] = sigbook ? gApiInfo.NameToLen(name) : ApiInfo::IdToLenArr[id];
+        mIndexIdIsSwap[id] = strcmp(name, "eglSwapBuffers") == 0 || strcmp(name, "eglSwapBuffersWithDamageKHR") == 0;
+    }
+    mIndexCallNo = 0;
+    mIndexFrameNo = 0;
+    mIndexChunkFirstCall = 0;
+    mIndexChunkFirstFrame = 0;
+    mIndexChunks.clear();
+    mIndexChunkOffsets.clear();
+    mIndexSwaps.clear();
+    mIndexing = true;
+}
+
+void OutFile::IndexCalls(const char* buf, unsigned int len)
+{
+    const uint32_t chunk = mIndexChunks.size();
+    const char* ptr = buf;
+    const char* end = buf + len;
+    while (ptr + sizeof(BCall) <= end)
+    {
+        const BCall* call = (const BCall*)ptr;
+        if (call->funcId == 0 || call->funcId >= mIndexIdToLen.size())
+            break;
+        unsigned int callLen = mIndexIdToLen[call->funcId];
+        if (callLen == 0)
+        {
+            if (ptr + sizeof(BCall_vlen) > end)
+                break;
+            callLen = ((const BCall_vlen*)ptr)->toNext;
+        }
+        if (callLen < sizeof(BCall) || callLen > (unsigned int)(end - ptr))
+            break;
+        ptr += callLen;
+        mIndexCallNo++;
+        if (mIndexIdIsSwap[call->funcId])
+        {
+            mIndexFrameNo++;
+            BSeekIndexSwap swap;
+            swap.chunk = chunk;
+            swap.offset = UsedSize() + (ptr - buf);
+            swap.callNo = mIndexCallNo;
+            swap.tid = call->tid;
+            mIndexSwaps.push_back(swap);
+        }
+    }
+    if (ptr != end)
+    {
+        DBG_LOG("Write of %u bytes at call %u is not a sequence of whole calls - not writing a seek index\n", len, mIndexCallNo);
+        mIndexing = false;
+    }
+}
+
+void OutFile::IndexChunk(unsigned int len)
+{
+    BSeekIndexChunk chunk;
+    chunk.offset = 0; // only known once written
+    chunk.size = len;
+    chunk.firstCall = mIndexChunkFirstCall;
+    chunk.firstFrame = mIndexChunkFirstFrame;
+    chunk.reserved = 0;
+    mIndexChunks.push_back(chunk);
+    mIndexChunkFirstCall = mIndexCallNo;
+    mIndexChunkFirstFrame = mIndexFrameNo;
+}
+
+void OutFile::WriteSeekIndex()
+{
+    if (mLastJson.empty())
+    {
+        DBG_LOG("No JSON header written - not writing a seek index\n");
+        return;
+    }
+    if (mIndexChunks.size() != mIndexChunkOffsets.size())
+    {
+        DBG_LOG("Seek index has %u chunks but %u were written - not writing it\n", (unsigned)mIndexChunks.size(), (unsigned)mIndexChunkOffsets.size());
+        return;
+    }
+    for (unsigned int i = 0; i < mIndexChunks.size(); ++i)
+    {
+        mIndexChunks[i].offset = mIndexChunkOffsets[i];
+    }
+
+    BSeekIndexHeader header;
+    header.chunkCount = mIndexChunks.size();
+    header.swapCount = mIndexSwaps.size();
+    header.callCount = mIndexCallNo;
+    const long long offset = mNextChunkOffset;
+    const unsigned long long size = sizeof(header) + mIndexChunks.size() * sizeof(BSeekIndexChunk) + mIndexSwaps.size() * sizeof(BSeekIndexSwap);
+    filewrite((const char*)&header, sizeof(header));
+    filewrite((const char*)mIndexChunks.data(), mIndexChunks.size() * sizeof(BSeekIndexChunk));
+    filewrite((const char*)mIndexSwaps.data(), mIndexSwaps.size() * sizeof(BSeekIndexSwap));
+
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(mLastJson, root))
+    {
+        DBG_LOG("Failed to parse JSON header - seek index will not be used\n");
+        return;
+    }
+    Json::Value& index = root["seekIndex"];
+    index["offset"] = (Json::Int64)offset;
+    index["size"] = (Json::UInt64)size;
+    index["chunks"] = header.chunkCount;
+    index["frames"] = mIndexFrameNo;
+    Json::FastWriter writer;
+    const std::string json = writer.write(root);
+    if (json.size() > mHeader.jsonMaxLength)
+    {
+        DBG_LOG("No room for seek index in JSON header - it will not be used\n");
+        return;
+    }
+    mHeader.jsonLength = json.size();
+    WriteJsonAndHeader(json.c_str(), json.size(), mHeader);
+    DBG_LOG("Wrote seek index for %u chunks and %u frames\n", header.chunkCount, mIndexFrameNo);
+}
+
+void OutFile::StartWriterThreads()
+{
+    mStopWriters = false;
+    mChunksInFlight = 0;
+    mCurrentJob = new WriteJob;
+    for (int i = 0; i < mWriterThreads; i++)
+    {
+        mCompressors.push_back(std::thread(&OutFile::CompressThread, this));
+    }
+    mWriter = std::thread(&OutFile::WriterThread, this);
+}
+
+void OutFile::StopWriterThreads()
+{
+    {
+        std::lock_guard<std::mutex> lock(mJobMutex);
+        mStopWriters = true;
+    }
+    mCompressCond.notify_all();
+    mWriteCond.notify_all();
+    for (std::thread& t : mCompressors)
+    {
+        t.join();
+    }
+    mCompressors.clear();
+    mWriter.join();
+
+    mFreeJobs.push_back(mCurrentJob);
+    mCurrentJob = nullptr;
+    for (WriteJob* job : mFreeJobs)
+    {
+        delete [] job->data;
+        delete job;
+    }
+    mFreeJobs.clear();
+    // mCache belonged to the current job
+    mCache = NULL;
+    mCacheP = NULL;
+}
+
+OutFile::WriteJob* OutFile::GetFreeJob(int capacity)
+{
+    WriteJob* job = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mJobMutex);
+        if (!mFreeJobs.empty())
+        {
+            job = mFreeJobs.back();
+            mFreeJobs.pop_back();
+        }
+    }
+    if (!job)
+    {
+        job = new WriteJob;
+    }
+    if (job->capacity < capacity)
+    {
+        delete [] job->data;
+        job->data = new char[capacity];
+        job->capacity = capacity;
+    }
+    return job;
+}
+
+void OutFile::SubmitJob(WriteJob* job)
+{
+    std::unique_lock<std::mutex> lock(mJobMutex);
+    if (job->isHeader)
+    {
+        job->ready = true;
+    }
+    else
+    {
+        // This is the only place the caller blocks, when all in-flight chunks are taken
+        mSpaceCond.wait(lock, [this]{ return mChunksInFlight < mMaxInFlight; });
+        mChunksInFlight++;
+        job->ready = false;
+        mCompressJobs.push_back(job);
+        mCompressCond.notify_one();
+    }
+    mPendingJobs.push_back(job);
+    mWriteCond.notify_one();
+}
+
+void OutFile::WaitForWriter()
+{
+    std::unique_lock<std::mutex> lock(mJobMutex);
+    mSpaceCond.wait(lock, [this]{ return mPendingJobs.empty(); });
+}
+
+void OutFile::CompressThread()
+{
+    while (true)
+    {
+        WriteJob* job;
+        {
+            std::unique_lock<std::mutex> lock(mJobMutex);
+            mCompressCond.wait(lock, [this]{ return mStopWriters || !mCompressJobs.empty(); });
+            if (mCompressJobs.empty())
+            {
+                return;
+            }
+            job = mCompressJobs.front();
+            mCompressJobs.pop_front();
+        }
+
+        size_t compressedLen = mCodecImpl->maxCompressedLength(job->len);
+        if (job->compressed.size() < compressedLen)
+        {
+            job->compressed.resize(compressedLen);
+        }
+        compressedLen = mCodecImpl->compress(job->data, job->len, job->compressed.data(), mCodecLevel);
+
+        {
+            std::lock_guard<std::mutex> lock(mJobMutex);
+            job->len = compressedLen;
+            job->ready = true;
+        }
+        mWriteCond.notify_one();
+    }
+}
+
+void OutFile::WriterThread()
+{
+    while (true)
+    {
+        WriteJob* job;
+        {
+            std::unique_lock<std::mutex> lock(mJobMutex);
+            mWriteCond.wait(lock, [this]{ return (!mPendingJobs.empty() && mPendingJobs.front()->ready) || (mStopWriters && mPendingJobs.empty()); });
+            if (mPendingJobs.empty())
+            {
+                return;
+            }
+            job = mPendingJobs.front();
+        }
+
+        if (job->isHeader)
+        {
+            WriteJsonAndHeader(job->data, job->len, job->header);
+        }
+        else
+        {
+            WriteChunk(job->compressed.data(), job->len);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mJobMutex);
+            mPendingJobs.pop_front();
+            if (!job->isHeader)
+            {
+                mChunksInFlight--;
+            }
+            mFreeJobs.push_back(job);
+        }
+        mSpaceCond.notify_all();
+    }
+}
+
 void OutFile::WriteSigBook(const std::vector<std::string> *sigbook)
 {
     char* buf = new char[1024*1024];
@@ -4,8 +4,14 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <common/file_format.hpp>
+#include <common/chunk_codec.hpp>
 #include <common/os_string.hpp>
 
 namespace common {
@@ -18,6 +24,22 @@ public:
     OutFile(const char *name);
     ~OutFile();
 
+    /// Compress and write filled chunks on background threads. Must be called before Open().
+    /// threads is the number of compression threads (0 to compress and write synchronously),
+    /// inflight the number of filled chunks that may be queued before Write() blocks.
+    /// If never called, the PATRACE_WRITER_THREADS environment variable is used.
+    void setAsync(int threads, int inflight = 4);
+
+    /// Write a seek index (see BSeekIndexHeader) when the file is closed. Must be called before Open().
+    /// Only possible when Open() writes the sigbook, since calls are parsed with it. If never called,
+    /// an index is written only if the PATRACE_SEEK_INDEX environment variable is set to 1.
+    void setSeekIndex(bool enable) { mSeekIndexEnabled = enable ? 1 : 0; }
+
+    /// Compress chunks with the given codec (ChunkCodecId) and codec specific level, -1 for its default.
+    /// Must be called before Open(). If never called, the PATRACE_CHUNK_CODEC environment variable
+    /// is used (see parseChunkCodec()), and snappy when that is not set either.
+    void setChunkCodec(unsigned codec, int level = -1);
+
     bool Open(const char* name = NULL, bool writeSigBook = true, const std::vector<std::string> *sigbook = NULL);
     void Close();
     void Flush();
@@ -28,9 +50,11 @@ public:
             return;
 
         if (FreeSize() > len) {
+            if (mIndexing) IndexCalls((const char*)buf, len);
             memcpy(mCacheP, buf, len);
             mCacheP += len;
         } else if (FreeSize() == len) {
+            if (mIndexing) IndexCalls((const char*)buf, len);
             memcpy(mCacheP, buf, len);
             mCacheP += len;
             Flush();
@@ -38,6 +62,7 @@ public:
             Flush();
             if (mCacheLen < int(len))
                 CreateCache(len);
+            if (mIndexing) IndexCalls((const char*)buf, len);
             memcpy(mCacheP, buf, len);
             mCacheP += len;
         }
@@ -48,8 +73,34 @@ public:
     common::BHeaderV3   mHeader;
 
 private:
+    struct WriteJob
+    {
+        char* data = nullptr;           // uncompressed chunk, or header json
+        int capacity = 0;
+        unsigned int len = 0;
+        std::vector<char> compressed;
+        BHeaderV3 header;               // only for header jobs
+        bool isHeader = false;
+        bool ready = false;
+    };
+
     void CreateCache(int len);
 
+    void StartWriterThreads();
+    void StopWriterThreads();
+    void SubmitJob(WriteJob* job);
+    void WaitForWriter();
+    WriteJob* GetFreeJob(int capacity);
+    void CompressThread();
+    void WriterThread();
+    void WriteJsonAndHeader(const char* buf, unsigned int len, const BHeaderV3& header);
+    void WriteChunk(const char* buf, unsigned int len);
+
+    void StartIndexing(const std::vector<std::string> *sigbook);
+    void IndexCalls(const char* buf, unsigned int len);
+    void IndexChunk(unsigned int len);
+    void WriteSeekIndex();
+
     inline unsigned int UsedSize() const {
         return mCacheP - mCache;
     }
@@ -75,17 +126,6 @@ private:
         }
     }
 
-    void WriteCompressedLength(unsigned int len) {
-        unsigned char buf[4];
-        buf[0] = len & 0xff; len >>= 8;
-        buf[1] = len & 0xff; len >>= 8;
-        buf[2] = len & 0xff; len >>= 8;
-        buf[3] = len & 0xff; len >>= 8;
-        filewrite((char*)buf, sizeof(buf));
-    }
-
-    void FlushHeader();
-
     void WriteSigBook(const std::vector<std::string> *sigbook);
 
     os::String AutogenTraceFileName();
@@ -99,7 +139,42 @@ private:
     char*               mCompressedCache;
     int                 mCompressedCacheLen;
 
+    int                 mCodec = -1;
+    int                 mCodecLevel = -1;
+    const ChunkCodec*   mCodecImpl = nullptr;
+
     std::string         mFileName;
+    long long           mNextChunkOffset = 0;
+
+    // Asynchronous write pipeline, only used when mWriterThreads > 0
+    int                 mWriterThreads = -1;
+    int                 mMaxInFlight = 4;
+    std::vector<std::thread> mCompressors;
+    std::thread         mWriter;
+    std::mutex          mJobMutex;
+    std::condition_variable mCompressCond;  // a chunk needs compressing, or stopping
+    std::condition_variable mWriteCond;     // a job became ready for writing, or stopping
+    std::condition_variable mSpaceCond;     // a job was written
+    std::deque<WriteJob*> mPendingJobs;     // all submitted jobs, in file order
+    std::deque<WriteJob*> mCompressJobs;    // chunk jobs waiting for a compressor
+    std::vector<WriteJob*> mFreeJobs;
+    int                 mChunksInFlight = 0;
+    bool                mStopWriters = false;
+    WriteJob*           mCurrentJob = nullptr; // owner of mCache in async mode
+
+    // Seek index
+    int                 mSeekIndexEnabled = -1;
+    bool                mIndexing = false;
+    std::vector<int>    mIndexIdToLen;      // serialized call length per sigbook id, 0 for variable length
+    std::vector<bool>   mIndexIdIsSwap;
+    unsigned int        mIndexCallNo = 0;
+    unsigned int        mIndexFrameNo = 0;
+    unsigned int        mIndexChunkFirstCall = 0; // call and frame number where the current chunk starts
+    unsigned int        mIndexChunkFirstFrame = 0;
+    std::vector<BSeekIndexChunk> mIndexChunks;
+    std::vector<uint64_t> mIndexChunkOffsets; // filled in by whoever writes the chunks
+    std::vector<BSeekIndexSwap> mIndexSwaps;
+    std::string         mLastJson;          // last JSON header written, to reference the index from
 };
 
 }
@@ -172,6 +172,31 @@ namespace common {
             return false;
         }
 
+        // The first call number from callNo on that one of the ranges with any of the given
+        // frequencies can contain, whatever the function, or ~0 if there is none
+        inline CallNo
+        nextCandidate(CallNo callNo, unsigned freq = FREQUENCY_ALL) const {
+            CallNo next = ~0u;
+            RangeList::const_iterator it;
+            for (it = ranges.begin(); it != ranges.end() && it->start < next; ++it) {
+                if (callNo > it->stop || !(it->freq & freq)) {
+                    continue;
+                }
+                CallNo candidate = callNo > it->start ? callNo : it->start;
+                const CallNo offset = (candidate - it->start) % it->step;
+                if (offset) {
+                    if (it->stop - candidate < it->step - offset) {
+                        continue;
+                    }
+                    candidate += it->step - offset;
+                }
+                if (candidate < next) {
+                    next = candidate;
+                }
+            }
+            return next;
+        }
+
     private:
         // TODO: use binary tree to speed up lookups
         typedef std::list< CallRange > RangeList;
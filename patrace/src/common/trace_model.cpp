@@ -1288,7 +1288,7 @@ void TraceFileTM::Clear()
 
 bool TraceFileTM::Open(const char* name, bool readHeaderAndExit, const std::string& ra_target)
 {
-    // Opens random access file
+    // Opens trace for random access (an uncompressed RA file only if ra_target is given)
     // Creates the first frame object
     // scans tracefile for calls pushing, creating new frimes when hitting frame terminators.
     // Each frame stores readpos in RA file
@@ -1296,6 +1296,7 @@ bool TraceFileTM::Open(const char* name, bool readHeaderAndExit, const std::stri
     gApiInfo.RegisterEntries(parse_callbacks);
 
     mpInFileRA->setTarget(ra_target);
+    mpInFileRA->setUseRAFile(!ra_target.empty());
     if (!mpInFileRA->Open(name, readHeaderAndExit))
         return false;
 
@@ -1318,6 +1319,35 @@ bool TraceFileTM::Open(const char* name, bool readHeaderAndExit, const std::stri
     const int tid = mpInFileRA->getDefaultThreadID();
     const bool multithread = mpInFileRA->getMultithread();
 
+    std::vector<InFileBase::SeekPosition> frameStarts;
+    if (mpInFileRA->hasSeekIndex())
+    {
+        // build frames straight from the seek index, without reading any calls
+        mpInFileRA->getSeekIndexFrames(multithread ? -1 : tid, frameStarts);
+        for (const InFileBase::SeekPosition& pos : frameStarts)
+        {
+            const std::streamoff readPos = mpInFileRA->getSeekReadPos(pos);
+            newFrame->SetCallCount(pos.callNo - newFrame->mFirstCallOfThisFrame);
+            newFrame->mBytes = readPos - newFrame->mReadPos;
+            mFrames.push_back(newFrame);
+
+            newFrame = new FrameTM;
+            newFrame->mReadPos = readPos;
+            newFrame->mFirstCallOfThisFrame = pos.callNo;
+        }
+        if (mpInFileRA->getSeekCallCount() > newFrame->mFirstCallOfThisFrame)
+        {
+            newFrame->SetCallCount(mpInFileRA->getSeekCallCount() - newFrame->mFirstCallOfThisFrame);
+            newFrame->mBytes = mpInFileRA->getSeekEndReadPos() - newFrame->mReadPos;
+            mFrames.push_back(newFrame);
+        }
+        else
+        {
+            delete newFrame;
+        }
+        return true;
+    }
+
     std::streamoff lastReadPos = 0;
 
     // scan file for every single call, divide into frames
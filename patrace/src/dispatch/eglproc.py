@@ -46,6 +46,25 @@ def ResetGLFuncPtrs():
     ResetFuncPtrsInAPI(glesapi)
     print('}')
 
+def NullDriverStubs(api):
+    for func in api.functions:
+        print('static ' + func.prototype('null_' + func.name))
+        print('{')
+        print('    NullDriverScope scope;')
+        if func.type is not stdapi.Void:
+            # EGL calls succeed, everything else returns zero
+            print('    return %s;' % ('EGL_TRUE' if str(func.type) == 'EGLBoolean' else '0'))
+        print('}')
+        print()
+
+def NullDriverTable(apis):
+    print('const NullDriverEntry gNullDriverDefaults[] = {')
+    for api in apis:
+        for func in api.functions:
+            print('    { "%s", (void*)null_%s },' % (func.name, func.name))
+    print('    { NULL, NULL }')
+    print('};')
+
 if __name__ == '__main__':
     # glClientSideBufferData is a fake api to update client-side memory
     glesapi.delFunctionByName("glClientSideBufferData")
@@ -94,3 +113,12 @@ if __name__ == '__main__':
     print()
     ResetGLFuncPtrs()
     print()
+
+    #############################################################
+    sys.stdout = open('eglproc_null_auto.cpp', 'w')
+    print('// Generated by', sys.argv[0])
+    print('#include <dispatch/eglproc_null.hpp>')
+    print()
+    NullDriverStubs(eglapi)
+    NullDriverStubs(glesapi)
+    NullDriverTable([eglapi, glesapi])
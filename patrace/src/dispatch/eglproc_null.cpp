@@ -0,0 +1,638 @@
+#include "eglproc_null.hpp"
+
+#include "helper/eglsize.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+NullDriverProbe gNullDriverProbe;
+
+namespace {
+
+bool gEnabled = false;
+
+/// Handles of EGL objects and GL syncs are counted up from here, GL names from 1
+uintptr_t gNextHandle = 0x1000;
+GLuint gNextName = 1;
+
+// The first display, config, context and surfaces made current are all there is
+int gDisplay;
+int gConfig;
+EGLContext gCurrentContext = EGL_NO_CONTEXT;
+EGLSurface gCurrentDraw = EGL_NO_SURFACE;
+EGLSurface gCurrentRead = EGL_NO_SURFACE;
+
+/// Attributes asked for in the last eglChooseConfig(), which the one config then has
+std::unordered_map<EGLint, EGLint> gConfigAttribs;
+
+/// Buffers bound to each target, and the memory returned when they are mapped
+std::unordered_map<GLenum, GLuint> gBufferBindings;
+struct Buffer
+{
+    GLsizeiptr size = 0;
+    std::vector<char> memory;
+};
+std::unordered_map<GLuint, Buffer> gBuffers;
+
+const struct
+{
+    GLenum target;
+    GLenum binding;
+} gBufferTargets[] = {
+    { GL_ARRAY_BUFFER, GL_ARRAY_BUFFER_BINDING },
+    { GL_ELEMENT_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER_BINDING },
+    { GL_COPY_READ_BUFFER, GL_COPY_READ_BUFFER_BINDING },
+    { GL_COPY_WRITE_BUFFER, GL_COPY_WRITE_BUFFER_BINDING },
+    { GL_PIXEL_PACK_BUFFER, GL_PIXEL_PACK_BUFFER_BINDING },
+    { GL_PIXEL_UNPACK_BUFFER, GL_PIXEL_UNPACK_BUFFER_BINDING },
+    { GL_TRANSFORM_FEEDBACK_BUFFER, GL_TRANSFORM_FEEDBACK_BUFFER_BINDING },
+    { GL_UNIFORM_BUFFER, GL_UNIFORM_BUFFER_BINDING },
+    { GL_ATOMIC_COUNTER_BUFFER, GL_ATOMIC_COUNTER_BUFFER_BINDING },
+    { GL_DISPATCH_INDIRECT_BUFFER, GL_DISPATCH_INDIRECT_BUFFER_BINDING },
+    { GL_DRAW_INDIRECT_BUFFER, GL_DRAW_INDIRECT_BUFFER_BINDING },
+    { GL_SHADER_STORAGE_BUFFER, GL_SHADER_STORAGE_BUFFER_BINDING },
+    { GL_TEXTURE_BUFFER, GL_TEXTURE_BUFFER_BINDING },
+};
+
+template<typename T>
+T newHandle()
+{
+    return (T)(gNextHandle++);
+}
+
+template<typename T>
+void zeroParams(GLenum pname, T* params)
+{
+    if (params)
+    {
+        memset(params, 0, std::max<size_t>(1, _gl_param_size(pname)) * sizeof(T));
+    }
+}
+
+void* mapBuffer(GLenum target, GLintptr offset, GLsizeiptr length)
+{
+    Buffer& buffer = gBuffers[gBufferBindings[target]];
+    const size_t size = std::max<size_t>(offset + length, buffer.size);
+    if (buffer.memory.size() < size)
+    {
+        buffer.memory.resize(size);
+    }
+    return buffer.memory.data() + offset;
+}
+
+// --- EGL
+
+EGLDisplay GLES_CALLCONVENTION null_eglGetDisplay(EGLNativeDisplayType display_id)
+{
+    NullDriverScope scope;
+    return (EGLDisplay)&gDisplay;
+}
+
+EGLDisplay GLES_CALLCONVENTION null_eglGetPlatformDisplay(EGLenum platform, void *native_display, const EGLAttrib *attrib_list)
+{
+    NullDriverScope scope;
+    return (EGLDisplay)&gDisplay;
+}
+
+EGLDisplay GLES_CALLCONVENTION null_eglGetPlatformDisplayEXT(EGLenum platform, void *native_display, const EGLint *attrib_list)
+{
+    NullDriverScope scope;
+    return (EGLDisplay)&gDisplay;
+}
+
+EGLBoolean GLES_CALLCONVENTION null_eglInitialize(EGLDisplay dpy, EGLint *major, EGLint *minor)
+{
+    NullDriverScope scope;
+    if (major) *major = 1;
+    if (minor) *minor = 5;
+    return EGL_TRUE;
+}
+
+EGLBoolean GLES_CALLCONVENTION null_eglQuerySurface(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint *value)
+{
+    NullDriverScope scope;
+    if (value) *value = 0;
+    return EGL_TRUE;
+}
+
+EGLBoolean GLES_CALLCONVENTION null_eglQueryContext(EGLDisplay dpy, EGLContext ctx, EGLint attribute, EGLint *value)
+{
+    NullDriverScope scope;
+    if (value) *value = 0;
+    return EGL_TRUE;
+}
+
+EGLint GLES_CALLCONVENTION null_eglGetError()
+{
+    NullDriverScope scope;
+    return EGL_SUCCESS;
+}
+
+const char* GLES_CALLCONVENTION null_eglQueryString(EGLDisplay dpy, EGLint name)
+{
+    NullDriverScope scope;
+    switch (name)
+    {
+    case EGL_VENDOR: return "patrace";
+    case EGL_VERSION: return "1.5 null driver";
+    case EGL_CLIENT_APIS: return "OpenGL_ES";
+    case EGL_EXTENSIONS: return "EGL_KHR_image_base EGL_KHR_fence_sync EGL_KHR_wait_sync EGL_KHR_create_context EGL_KHR_surfaceless_context";
+    default: return "";
+    }
+}
+
+EGLBoolean GLES_CALLCONVENTION null_eglChooseConfig(EGLDisplay dpy, const EGLint *attrib_list, EGLConfig *configs, EGLint config_size, EGLint *num_config)
+{
+    NullDriverScope scope;
+    gConfigAttribs.clear();
+    for (const EGLint *attrib = attrib_list; attrib && *attrib != EGL_NONE; attrib += 2)
+    {
+        gConfigAttribs[attrib[0]] = attrib[1];
+    }
+    if (configs && config_size > 0)
+    {
+        configs[0] = (EGLConfig)&gConfig;
+    }
+    if (num_config) *num_config = 1;
+    return EGL_TRUE;
+}
+
+EGLBoolean GLES_CALLCONVENTION null_eglGetConfigs(EGLDisplay dpy, EGLConfig *configs, EGLint config_size, EGLint *num_config)
+{
+    NullDriverScope scope;
+    if (configs && config_size > 0)
+    {
+        configs[0] = (EGLConfig)&gConfig;
+    }
+    if (num_config) *num_config = 1;
+    return EGL_TRUE;
+}
+
+EGLBoolean GLES_CALLCONVENTION null_eglGetConfigAttrib(EGLDisplay dpy, EGLConfig config, EGLint attribute, EGLint *value)
+{
+    NullDriverScope scope;
+    // The config has what was asked for, and otherwise RGBA8888 with depth and stencil
+    EGLint result = 0;
+    switch (attribute)
+    {
+    case EGL_RED_SIZE: case EGL_GREEN_SIZE: case EGL_BLUE_SIZE: case EGL_ALPHA_SIZE: case EGL_STENCIL_SIZE: result = 8; break;
+    case EGL_DEPTH_SIZE: result = 24; break;
+    case EGL_BUFFER_SIZE: result = 32; break;
+    case EGL_CONFIG_ID: result = 1; break;
+    case EGL_SURFACE_TYPE: result = EGL_WINDOW_BIT | EGL_PBUFFER_BIT; break;
+    case EGL_RENDERABLE_TYPE: case EGL_CONFORMANT: result = EGL_OPENGL_ES_BIT | EGL_OPENGL_ES2_BIT | EGL_OPENGL_ES3_BIT_KHR; break;
+    }
+    const auto it = gConfigAttribs.find(attribute);
+    if (it != gConfigAttribs.end() && it->second >= 0 && attribute != EGL_SURFACE_TYPE && attribute != EGL_RENDERABLE_TYPE)
+    {
+        result = it->second;
+    }
+    if (value) *value = result;
+    return EGL_TRUE;
+}
+
+EGLContext GLES_CALLCONVENTION null_eglCreateContext(EGLDisplay dpy, EGLConfig config, EGLContext share_context, const EGLint *attrib_list)
+{
+    NullDriverScope scope;
+    return newHandle<EGLContext>();
+}
+
+EGLSurface GLES_CALLCONVENTION null_eglCreateWindowSurface(EGLDisplay dpy, EGLConfig config, EGLNativeWindowType win, const EGLint *attrib_list)
+{
+    NullDriverScope scope;
+    return newHandle<EGLSurface>();
+}
+
+EGLSurface GLES_CALLCONVENTION null_eglCreatePbufferSurface(EGLDisplay dpy, EGLConfig config, const EGLint *attrib_list)
+{
+    NullDriverScope scope;
+    return newHandle<EGLSurface>();
+}
+
+EGLSurface GLES_CALLCONVENTION null_eglCreatePlatformWindowSurface(EGLDisplay dpy, EGLConfig config, void *native_window, const EGLAttrib *attrib_list)
+{
+    NullDriverScope scope;
+    return newHandle<EGLSurface>();
+}
+
+EGLSurface GLES_CALLCONVENTION null_eglCreatePlatformWindowSurfaceEXT(EGLDisplay dpy, EGLConfig config, void *native_window, const EGLint *attrib_list)
+{
+    NullDriverScope scope;
+    return newHandle<EGLSurface>();
+}
+
+EGLBoolean GLES_CALLCONVENTION null_eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx)
+{
+    NullDriverScope scope;
+    gCurrentContext = ctx;
+    gCurrentDraw = draw;
+    gCurrentRead = read;
+    return EGL_TRUE;
+}
+
+EGLContext GLES_CALLCONVENTION null_eglGetCurrentContext()
+{
+    NullDriverScope scope;
+    return gCurrentContext;
+}
+
+EGLSurface GLES_CALLCONVENTION null_eglGetCurrentSurface(EGLint readdraw)
+{
+    NullDriverScope scope;
+    return readdraw == EGL_READ ? gCurrentRead : gCurrentDraw;
+}
+
+EGLDisplay GLES_CALLCONVENTION null_eglGetCurrentDisplay()
+{
+    NullDriverScope scope;
+    return gCurrentContext != EGL_NO_CONTEXT ? (EGLDisplay)&gDisplay : EGL_NO_DISPLAY;
+}
+
+EGLImageKHR GLES_CALLCONVENTION null_eglCreateImageKHR(EGLDisplay dpy, EGLContext ctx, EGLenum target, EGLClientBuffer buffer, const EGLint *attrib_list)
+{
+    NullDriverScope scope;
+    return newHandle<EGLImageKHR>();
+}
+
+EGLImage GLES_CALLCONVENTION null_eglCreateImage(EGLDisplay dpy, EGLContext ctx, EGLenum target, EGLClientBuffer buffer, const EGLAttrib *attrib_list)
+{
+    NullDriverScope scope;
+    return newHandle<EGLImage>();
+}
+
+EGLSyncKHR GLES_CALLCONVENTION null_eglCreateSyncKHR(EGLDisplay dpy, EGLenum type, const EGLint *attrib_list)
+{
+    NullDriverScope scope;
+    return newHandle<EGLSyncKHR>();
+}
+
+EGLSync GLES_CALLCONVENTION null_eglCreateSync(EGLDisplay dpy, EGLenum type, const EGLAttrib *attrib_list)
+{
+    NullDriverScope scope;
+    return newHandle<EGLSync>();
+}
+
+EGLint GLES_CALLCONVENTION null_eglClientWaitSync(EGLDisplay dpy, EGLSync sync, EGLint flags, EGLTime timeout)
+{
+    NullDriverScope scope;
+    return EGL_CONDITION_SATISFIED;
+}
+
+EGLBoolean GLES_CALLCONVENTION null_eglGetSyncAttribKHR(EGLDisplay dpy, EGLSyncKHR sync, EGLint attribute, EGLint *value)
+{
+    NullDriverScope scope;
+    if (value) *value = attribute == EGL_SYNC_STATUS_KHR ? EGL_SIGNALED_KHR : 0;
+    return EGL_TRUE;
+}
+
+__eglMustCastToProperFunctionPointerType GLES_CALLCONVENTION null_eglGetProcAddress(const char *procname)
+{
+    NullDriverScope scope;
+    return (__eglMustCastToProperFunctionPointerType)_getNullProcAddress(procname);
+}
+
+// --- GLES
+
+GLenum GLES_CALLCONVENTION null_glGetError()
+{
+    NullDriverScope scope;
+    return GL_NO_ERROR;
+}
+
+const GLubyte* GLES_CALLCONVENTION null_glGetString(GLenum name)
+{
+    NullDriverScope scope;
+    switch (name)
+    {
+    case GL_VENDOR: return (const GLubyte*)"patrace";
+    case GL_RENDERER: return (const GLubyte*)"Null driver";
+    case GL_VERSION: return (const GLubyte*)"OpenGL ES 3.2 null driver";
+    case GL_SHADING_LANGUAGE_VERSION: return (const GLubyte*)"OpenGL ES GLSL ES 3.20";
+    case GL_EXTENSIONS: return (const GLubyte*)"GL_OES_mapbuffer GL_OES_EGL_image GL_OES_EGL_image_external GL_OES_depth24 "
+                                               "GL_OES_packed_depth_stencil GL_OES_vertex_array_object GL_EXT_discard_framebuffer "
+                                               "GL_EXT_texture_storage GL_EXT_buffer_storage GL_KHR_texture_compression_astc_ldr";
+    default: return (const GLubyte*)"";
+    }
+}
+
+const GLubyte* GLES_CALLCONVENTION null_glGetStringi(GLenum name, GLuint index)
+{
+    NullDriverScope scope;
+    return (const GLubyte*)"";
+}
+
+void GLES_CALLCONVENTION null_glGenNames(GLsizei n, GLuint *names)
+{
+    NullDriverScope scope;
+    for (GLsizei i = 0; i < n; i++)
+    {
+        names[i] = gNextName++;
+    }
+}
+
+GLuint GLES_CALLCONVENTION null_glCreateShader(GLenum type)
+{
+    NullDriverScope scope;
+    return gNextName++;
+}
+
+GLuint GLES_CALLCONVENTION null_glCreateProgram()
+{
+    NullDriverScope scope;
+    return gNextName++;
+}
+
+GLuint GLES_CALLCONVENTION null_glCreateShaderProgramv(GLenum type, GLsizei count, const GLchar *const*strings)
+{
+    NullDriverScope scope;
+    return gNextName++;
+}
+
+GLenum GLES_CALLCONVENTION null_glCheckFramebufferStatus(GLenum target)
+{
+    NullDriverScope scope;
+    return GL_FRAMEBUFFER_COMPLETE;
+}
+
+void GLES_CALLCONVENTION null_glGetShaderiv(GLuint shader, GLenum pname, GLint *params)
+{
+    NullDriverScope scope;
+    zeroParams(pname, params);
+    if (pname == GL_COMPILE_STATUS) *params = GL_TRUE;
+}
+
+void GLES_CALLCONVENTION null_glGetProgramiv(GLuint program, GLenum pname, GLint *params)
+{
+    NullDriverScope scope;
+    zeroParams(pname, params);
+    if (pname == GL_LINK_STATUS || pname == GL_VALIDATE_STATUS) *params = GL_TRUE;
+}
+
+void GLES_CALLCONVENTION null_glGetInfoLog(GLuint object, GLsizei bufSize, GLsizei *length, GLchar *infoLog)
+{
+    NullDriverScope scope;
+    if (length) *length = 0;
+    if (infoLog && bufSize > 0) infoLog[0] = '\0';
+}
+
+void GLES_CALLCONVENTION null_glGetIntegerv(GLenum pname, GLint *data)
+{
+    NullDriverScope scope;
+    zeroParams(pname, data);
+    for (const auto& target : gBufferTargets)
+    {
+        if (target.binding == pname)
+        {
+            *data = gBufferBindings[target.target];
+        }
+    }
+}
+
+void GLES_CALLCONVENTION null_glGetInteger64v(GLenum pname, GLint64 *data)
+{
+    NullDriverScope scope;
+    zeroParams(pname, data);
+}
+
+void GLES_CALLCONVENTION null_glGetFloatv(GLenum pname, GLfloat *data)
+{
+    NullDriverScope scope;
+    zeroParams(pname, data);
+}
+
+void GLES_CALLCONVENTION null_glGetBooleanv(GLenum pname, GLboolean *data)
+{
+    NullDriverScope scope;
+    zeroParams(pname, data);
+}
+
+// The retracer waits for queries to become available, so they always are, with a result of zero
+void GLES_CALLCONVENTION null_glGetQueryObjectuiv(GLuint id, GLenum pname, GLuint *params)
+{
+    NullDriverScope scope;
+    *params = pname == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0;
+}
+
+void GLES_CALLCONVENTION null_glGetQueryObjectivEXT(GLuint id, GLenum pname, GLint *params)
+{
+    NullDriverScope scope;
+    *params = pname == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0;
+}
+
+void GLES_CALLCONVENTION null_glGetQueryObjecti64vEXT(GLuint id, GLenum pname, GLint64 *params)
+{
+    NullDriverScope scope;
+    *params = pname == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0;
+}
+
+void GLES_CALLCONVENTION null_glGetQueryObjectui64vEXT(GLuint id, GLenum pname, GLuint64 *params)
+{
+    NullDriverScope scope;
+    *params = pname == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0;
+}
+
+GLsync GLES_CALLCONVENTION null_glFenceSync(GLenum condition, GLbitfield flags)
+{
+    NullDriverScope scope;
+    return newHandle<GLsync>();
+}
+
+GLenum GLES_CALLCONVENTION null_glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+    NullDriverScope scope;
+    return GL_ALREADY_SIGNALED;
+}
+
+void GLES_CALLCONVENTION null_glGetSynciv(GLsync sync, GLenum pname, GLsizei bufSize, GLsizei *length, GLint *values)
+{
+    NullDriverScope scope;
+    if (length) *length = bufSize > 0 ? 1 : 0;
+    if (values && bufSize > 0) *values = pname == GL_SYNC_STATUS ? GL_SIGNALED : 0;
+}
+
+void GLES_CALLCONVENTION null_glBindBuffer(GLenum target, GLuint buffer)
+{
+    NullDriverScope scope;
+    gBufferBindings[target] = buffer;
+}
+
+void GLES_CALLCONVENTION null_glBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    NullDriverScope scope;
+    gBufferBindings[target] = buffer;
+}
+
+void GLES_CALLCONVENTION null_glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    NullDriverScope scope;
+    gBufferBindings[target] = buffer;
+}
+
+void GLES_CALLCONVENTION null_glDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+    NullDriverScope scope;
+    for (GLsizei i = 0; i < n; i++)
+    {
+        gBuffers.erase(buffers[i]);
+        for (auto& binding : gBufferBindings)
+        {
+            if (binding.second == buffers[i]) binding.second = 0;
+        }
+    }
+}
+
+void GLES_CALLCONVENTION null_glBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+{
+    NullDriverScope scope;
+    Buffer& buffer = gBuffers[gBufferBindings[target]];
+    buffer.size = size;
+    buffer.memory.clear();
+}
+
+void GLES_CALLCONVENTION null_glBufferStorageEXT(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags)
+{
+    NullDriverScope scope;
+    Buffer& buffer = gBuffers[gBufferBindings[target]];
+    buffer.size = size;
+    buffer.memory.clear();
+}
+
+void GLES_CALLCONVENTION null_glGetBufferParameteriv(GLenum target, GLenum pname, GLint *params)
+{
+    NullDriverScope scope;
+    *params = pname == GL_BUFFER_SIZE ? (GLint)gBuffers[gBufferBindings[target]].size : 0;
+}
+
+void* GLES_CALLCONVENTION null_glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    NullDriverScope scope;
+    return mapBuffer(target, offset, length);
+}
+
+void* GLES_CALLCONVENTION null_glMapBufferOES(GLenum target, GLenum access)
+{
+    NullDriverScope scope;
+    return mapBuffer(target, 0, 0);
+}
+
+GLboolean GLES_CALLCONVENTION null_glUnmapBuffer(GLenum target)
+{
+    NullDriverScope scope;
+    return GL_TRUE;
+}
+
+const NullDriverEntry gNullDriverFunctions[] = {
+    { "eglGetDisplay", (void*)null_eglGetDisplay },
+    { "eglGetPlatformDisplay", (void*)null_eglGetPlatformDisplay },
+    { "eglGetPlatformDisplayEXT", (void*)null_eglGetPlatformDisplayEXT },
+    { "eglInitialize", (void*)null_eglInitialize },
+    { "eglQuerySurface", (void*)null_eglQuerySurface },
+    { "eglQueryContext", (void*)null_eglQueryContext },
+    { "eglGetError", (void*)null_eglGetError },
+    { "eglQueryString", (void*)null_eglQueryString },
+    { "eglChooseConfig", (void*)null_eglChooseConfig },
+    { "eglGetConfigs", (void*)null_eglGetConfigs },
+    { "eglGetConfigAttrib", (void*)null_eglGetConfigAttrib },
+    { "eglCreateContext", (void*)null_eglCreateContext },
+    { "eglCreateWindowSurface", (void*)null_eglCreateWindowSurface },
+    { "eglCreatePbufferSurface", (void*)null_eglCreatePbufferSurface },
+    { "eglCreatePlatformWindowSurface", (void*)null_eglCreatePlatformWindowSurface },
+    { "eglCreatePlatformWindowSurfaceEXT", (void*)null_eglCreatePlatformWindowSurfaceEXT },
+    { "eglMakeCurrent", (void*)null_eglMakeCurrent },
+    { "eglGetCurrentContext", (void*)null_eglGetCurrentContext },
+    { "eglGetCurrentSurface", (void*)null_eglGetCurrentSurface },
+    { "eglGetCurrentDisplay", (void*)null_eglGetCurrentDisplay },
+    { "eglCreateImage", (void*)null_eglCreateImage },
+    { "eglCreateImageKHR", (void*)null_eglCreateImageKHR },
+    { "eglCreateSync", (void*)null_eglCreateSync },
+    { "eglCreateSyncKHR", (void*)null_eglCreateSyncKHR },
+    { "eglClientWaitSync", (void*)null_eglClientWaitSync },
+    { "eglClientWaitSyncKHR", (void*)null_eglClientWaitSync },
+    { "eglGetSyncAttribKHR", (void*)null_eglGetSyncAttribKHR },
+    { "eglGetProcAddress", (void*)null_eglGetProcAddress },
+
+    { "glGetError", (void*)null_glGetError },
+    { "glGetString", (void*)null_glGetString },
+    { "glGetStringi", (void*)null_glGetStringi },
+    { "glGenBuffers", (void*)null_glGenNames },
+    { "glGenTextures", (void*)null_glGenNames },
+    { "glGenFramebuffers", (void*)null_glGenNames },
+    { "glGenFramebuffersOES", (void*)null_glGenNames },
+    { "glGenRenderbuffers", (void*)null_glGenNames },
+    { "glGenRenderbuffersOES", (void*)null_glGenNames },
+    { "glGenVertexArrays", (void*)null_glGenNames },
+    { "glGenVertexArraysOES", (void*)null_glGenNames },
+    { "glGenQueries", (void*)null_glGenNames },
+    { "glGenQueriesEXT", (void*)null_glGenNames },
+    { "glGenSamplers", (void*)null_glGenNames },
+    { "glGenTransformFeedbacks", (void*)null_glGenNames },
+    { "glGenProgramPipelines", (void*)null_glGenNames },
+    { "glGenProgramPipelinesEXT", (void*)null_glGenNames },
+    { "glCreateShader", (void*)null_glCreateShader },
+    { "glCreateProgram", (void*)null_glCreateProgram },
+    { "glCreateShaderProgramv", (void*)null_glCreateShaderProgramv },
+    { "glCreateShaderProgramvEXT", (void*)null_glCreateShaderProgramv },
+    { "glCheckFramebufferStatus", (void*)null_glCheckFramebufferStatus },
+    { "glCheckFramebufferStatusOES", (void*)null_glCheckFramebufferStatus },
+    { "glGetShaderiv", (void*)null_glGetShaderiv },
+    { "glGetProgramiv", (void*)null_glGetProgramiv },
+    { "glGetShaderInfoLog", (void*)null_glGetInfoLog },
+    { "glGetProgramInfoLog", (void*)null_glGetInfoLog },
+    { "glGetProgramPipelineInfoLog", (void*)null_glGetInfoLog },
+    { "glGetIntegerv", (void*)null_glGetIntegerv },
+    { "glGetInteger64v", (void*)null_glGetInteger64v },
+    { "glGetFloatv", (void*)null_glGetFloatv },
+    { "glGetBooleanv", (void*)null_glGetBooleanv },
+    { "glGetQueryObjectuiv", (void*)null_glGetQueryObjectuiv },
+    { "glGetQueryObjectuivEXT", (void*)null_glGetQueryObjectuiv },
+    { "glGetQueryObjectivEXT", (void*)null_glGetQueryObjectivEXT },
+    { "glGetQueryObjecti64vEXT", (void*)null_glGetQueryObjecti64vEXT },
+    { "glGetQueryObjectui64vEXT", (void*)null_glGetQueryObjectui64vEXT },
+    { "glFenceSync", (void*)null_glFenceSync },
+    { "glClientWaitSync", (void*)null_glClientWaitSync },
+    { "glGetSynciv", (void*)null_glGetSynciv },
+    { "glBindBuffer", (void*)null_glBindBuffer },
+    { "glBindBufferBase", (void*)null_glBindBufferBase },
+    { "glBindBufferRange", (void*)null_glBindBufferRange },
+    { "glDeleteBuffers", (void*)null_glDeleteBuffers },
+    { "glBufferData", (void*)null_glBufferData },
+    { "glBufferStorageEXT", (void*)null_glBufferStorageEXT },
+    { "glGetBufferParameteriv", (void*)null_glGetBufferParameteriv },
+    { "glMapBufferRange", (void*)null_glMapBufferRange },
+    { "glMapBufferRangeEXT", (void*)null_glMapBufferRange },
+    { "glMapBufferOES", (void*)null_glMapBufferOES },
+    { "glUnmapBuffer", (void*)null_glUnmapBuffer },
+    { "glUnmapBufferOES", (void*)null_glUnmapBuffer },
+    { NULL, NULL }
+};
+
+}
+
+void SetNullDriver(bool enabled)
+{
+    gEnabled = enabled;
+}
+
+bool GetNullDriver()
+{
+    return gEnabled;
+}
+
+void* _getNullProcAddress(const char* procName)
+{
+    if (!procName)
+    {
+        return NULL;
+    }
+    for (const NullDriverEntry* entry = gNullDriverFunctions; entry->name; entry++)
+    {
+        if (strcmp(entry->name, procName) == 0) return entry->function;
+    }
+    for (const NullDriverEntry* entry = gNullDriverDefaults; entry->name; entry++)
+    {
+        if (strcmp(entry->name, procName) == 0) return entry->function;
+    }
+    return NULL;
+}
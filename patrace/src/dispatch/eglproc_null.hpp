@@ -0,0 +1,60 @@
+#ifndef _DISPATCH_EGLPROC_NULL_HPP_
+#define _DISPATCH_EGLPROC_NULL_HPP_
+
+#include "eglimports.hpp"
+#include "common/os.hpp"
+#include "retracer/call_stats.hpp"
+
+#ifndef GLES_CALLCONVENTION
+#define GLES_CALLCONVENTION
+#endif
+
+/// The null driver stands in for the EGL and GLES libraries when retracing with -nulldriver.
+/// Every function returns at once, but with results that keep the retracer going: a display,
+/// config, contexts and surfaces that work, names for generated objects, complete shaders and
+/// framebuffers, and memory for mapped buffers. That leaves only the work of the retracer itself.
+
+/// Route all lookups in _getProcAddress() to the null driver. Must be set before any lookup.
+void SetNullDriver(bool enabled);
+bool GetNullDriver();
+void* _getNullProcAddress(const char* procName);
+
+struct NullDriverEntry
+{
+    const char* name;
+    void* function;
+};
+/// Functions that do nothing and return zero, generated for the whole API
+extern const NullDriverEntry gNullDriverDefaults[];
+
+/// When armed, notes when the retrace function had read its arguments, when it first entered
+/// the null driver and when it last left it
+struct NullDriverProbe
+{
+    bool armed = false;
+    uint64_t decoded = 0;
+    uint64_t enter = 0;
+    uint64_t leave = 0;
+};
+extern NullDriverProbe gNullDriverProbe;
+
+/// Put in retrace functions between reading the arguments and looking up their handles
+inline void NullDriverArgumentsDecoded()
+{
+    if (unlikely(gNullDriverProbe.armed)) gNullDriverProbe.decoded = retracer::CallClock::now();
+}
+
+/// Put at the top of every null driver function
+struct NullDriverScope
+{
+    NullDriverScope()
+    {
+        if (unlikely(gNullDriverProbe.armed) && !gNullDriverProbe.enter) gNullDriverProbe.enter = retracer::CallClock::now();
+    }
+    ~NullDriverScope()
+    {
+        if (unlikely(gNullDriverProbe.armed)) gNullDriverProbe.leave = retracer::CallClock::now();
+    }
+};
+
+#endif /* !_DISPATCH_EGLPROC_NULL_HPP_ */
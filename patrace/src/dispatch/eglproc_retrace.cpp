@@ -26,6 +26,7 @@
 #include "eglproc_retrace.hpp"
 
 #include "eglproc_auto.hpp"
+#include "eglproc_null.hpp"
 #include "os.hpp"
 #include "common/library.hpp"
 #include "os_string.hpp"
@@ -220,6 +221,17 @@ void* _getProcAddress(const char* procName)
 {
     void* retValue = NULL;
 
+    if (GetNullDriver())
+    {
+        retValue = _getNullProcAddress(procName);
+        if (retValue == NULL && complained.count(procName) == 0)
+        {
+            DBG_LOG("The null driver has no function %s\n", procName);
+            complained.insert(procName);
+        }
+        return retValue;
+    }
+
     if (gEGLHandle == NULL || gGLES2Handle == NULL)
     {
         // for ARM GLES 3.0 emulator, a symbol needed by libEGL
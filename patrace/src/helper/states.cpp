@@ -1223,6 +1223,12 @@ void StateLogger::checkIfOpen()
     }
 }
 
+void StateLogger::logMessage(const std::string& message)
+{
+    checkIfOpen();
+    mLog << message << std::endl;
+}
+
 void StateLogger::logFunction(unsigned char tid, const std::string& functionName, unsigned callNo, unsigned drawNo)
 {
     if (!call_in_range())
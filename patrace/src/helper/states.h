@@ -44,6 +44,7 @@ public:
     void logDrawArraysIndirect(unsigned char tid, const void *indirect, int count);
     void logComputeIndirect(unsigned char tid, GLintptr offset);
     void logCompute(unsigned char tid, GLuint x, GLuint y, GLuint z);
+    void logMessage(const std::string& message);
     void open(const std::string& fileName);
     void close();
     void flush() { mLog.flush(); }
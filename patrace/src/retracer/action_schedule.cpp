@@ -0,0 +1,48 @@
+#include "retracer/action_schedule.hpp"
+
+namespace retracer {
+
+void ActionSchedule::init(unsigned funcs)
+{
+    mFunctions.assign(funcs, 0);
+    mFrames.clear();
+    mFrameActions = 0;
+    mSnapshotCalls = nullptr;
+    mNextSnapshotCall = ~0u;
+}
+
+void ActionSchedule::addAllFunctions(uint32_t actions)
+{
+    for (uint32_t& f : mFunctions)
+    {
+        f |= actions;
+    }
+}
+
+void ActionSchedule::addFrames(unsigned first, unsigned last, uint32_t actions)
+{
+    if (first <= last && actions)
+    {
+        mFrames.push_back(Interval{ first, last, actions });
+    }
+}
+
+void ActionSchedule::setFrame(unsigned frame)
+{
+    mFrameActions = 0;
+    for (const Interval& interval : mFrames)
+    {
+        if (frame >= interval.first && frame <= interval.last)
+        {
+            mFrameActions |= interval.actions;
+        }
+    }
+}
+
+void ActionSchedule::setCall(unsigned callNo)
+{
+    // Frame ranges only match swaps, which look for snapshots by frame number instead
+    mNextSnapshotCall = mSnapshotCalls ? mSnapshotCalls->nextCandidate(callNo, ~common::FREQUENCY_FRAME) : ~0u;
+}
+
+}
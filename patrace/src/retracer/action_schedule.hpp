@@ -0,0 +1,70 @@
+#ifndef _RETRACER_ACTION_SCHEDULE_HPP_
+#define _RETRACER_ACTION_SCHEDULE_HPP_
+
+#include "common/trace_callset.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+namespace retracer {
+
+/// What the retrace loop has to do for a call besides making it, compiled from the options before
+/// the retrace starts. Each action applies to some functions, in some intervals of frames, so the
+/// actions of a call are the actions of its function masked by those of the current frame. Snapshots
+/// by call number are only looked up once the next call number that can have one is reached. Most
+/// calls have no actions, and the loop needs a single test to find that out.
+class ActionSchedule
+{
+public:
+    enum Action
+    {
+        ACTION_SWAP         = 1 << 0, ///< end of frame bookkeeping
+        ACTION_SKIP_FENCE   = 1 << 1, ///< skip the call, it waits for a fence
+        ACTION_CALL_STATS   = 1 << 2, ///< count the call, and time it when sampled
+        ACTION_NULL_DRIVER  = 1 << 3, ///< sample the call for the null driver stage statistics
+        ACTION_CACHE_SKIP   = 1 << 4, ///< skip the call, it is not needed to populate the shader cache
+        ACTION_DEBUG        = 1 << 5, ///< log the call and check for errors
+        ACTION_STEP         = 1 << 6, ///< check the step mode budgets
+        ACTION_SNAPSHOT     = 1 << 7, ///< look for a snapshot after the call, by call number
+        ACTION_UNSUPPORTED  = 1 << 8, ///< the call has no retrace function
+        ACTION_RENDER_SKIP  = 1 << 9, ///< skip the call, it only renders, and only the state is needed
+        ACTION_TIMER_QUERY  = 1 << 10, ///< the call begins a query, which may collide with the GPU frame timer
+    };
+
+    void init(unsigned funcs);
+    /// Actions that apply to the given function, in the frames where they are scheduled
+    void addFunction(unsigned funcId, uint32_t actions) { mFunctions.at(funcId) |= actions; }
+    void addAllFunctions(uint32_t actions);
+    /// Schedule actions from frame first to frame last, inclusive
+    void addFrames(unsigned first, unsigned last, uint32_t actions);
+    void setSnapshotCalls(const common::CallSet* calls) { mSnapshotCalls = calls; }
+
+    /// Call whenever the frame number changes
+    void setFrame(unsigned frame);
+    /// Call whenever the call number goes anywhere else than forward
+    void setCall(unsigned callNo);
+    /// Call after looking for a snapshot by call number
+    void snapshotChecked(unsigned callNo) { setCall(callNo + 1); }
+
+    inline uint32_t actions(unsigned funcId, unsigned callNo) const
+    {
+        return (mFunctions[funcId] & mFrameActions) | (callNo >= mNextSnapshotCall ? ACTION_SNAPSHOT : 0);
+    }
+
+private:
+    struct Interval
+    {
+        unsigned first;
+        unsigned last;
+        uint32_t actions;
+    };
+    std::vector<uint32_t> mFunctions;
+    std::vector<Interval> mFrames;
+    uint32_t mFrameActions = 0;
+    const common::CallSet* mSnapshotCalls = nullptr;
+    unsigned mNextSnapshotCall = ~0u;
+};
+
+}
+
+#endif
@@ -0,0 +1,332 @@
+#include "retracer/call_stats.hpp"
+
+#include "common/os.hpp"
+
+#include "json/value.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace retracer {
+
+const char* CallClock::name()
+{
+#if defined(__aarch64__)
+    return "cntvct";
+#elif defined(__x86_64__) || defined(__i386__)
+    return "tsc";
+#else
+    return "monotonic_raw";
+#endif
+}
+
+// Calls that patrace adds to the trace, which take no driver time when the trace was made
+static bool isPatraceCall(const std::string& name)
+{
+    static const char* const calls[] = {
+        "glClientSideBufferData", "glClientSideBufferSubData", "glCreateClientSideBuffer", "glDeleteClientSideBuffer",
+        "glCopyClientSideBuffer", "glPatchClientSideBuffer", "glGenGraphicBuffer_ARM", "glGraphicBufferData_ARM",
+        "glDeleteGraphicBuffer_ARM",
+    };
+    for (const char* call : calls)
+    {
+        if (name == call) return true;
+    }
+    return false;
+}
+
+bool CallStats::init(unsigned functions, unsigned sampleRate, unsigned rangeFrames, unsigned beginFrame)
+{
+    if (functions == 0 || sampleRate == 0)
+    {
+        return false;
+    }
+    mFunctions = functions;
+    mSampler.setRate(sampleRate);
+    mRangeFrames = rangeFrames;
+    mBeginFrame = beginFrame;
+    mRanges.clear();
+    mHistograms.assign((size_t)functions * BUCKETS, 0);
+    setFrame(beginFrame);
+    return true;
+}
+
+void CallStats::start()
+{
+    mStartNs = CallClock::reference();
+    mStartTicks = CallClock::now();
+}
+
+void CallStats::stop()
+{
+    mTicks = CallClock::now() - mStartTicks;
+    mNs = CallClock::reference() - mStartNs;
+}
+
+void CallStats::setFrame(unsigned frame)
+{
+    const unsigned index = (mRangeFrames && frame > mBeginFrame) ? (frame - mBeginFrame) / mRangeFrames : 0;
+    if (!mRanges.empty() && mRanges.back().index == index)
+    {
+        mCurrent = mRanges.back().entries.data();
+        return;
+    }
+    for (Range& range : mRanges) // only when looping back to the first frame
+    {
+        if (range.index == index)
+        {
+            mCurrent = range.entries.data();
+            return;
+        }
+    }
+    mRanges.push_back(Range());
+    mRanges.back().index = index;
+    mRanges.back().entries.resize(mFunctions);
+    mCurrent = mRanges.back().entries.data();
+}
+
+__attribute__ ((noinline)) static int noop(int a)
+{
+    return a;
+}
+
+#define CALL_STATS_NOOP_ROUNDS 1000
+
+void CallStats::calibrate()
+{
+    const int rounds = CALL_STATS_NOOP_ROUNDS;
+    int c = 0;
+    uint64_t ticks = 0;
+    for (int i = 0; i < rounds; i++)
+    {
+        const uint64_t pre = CallClock::now();
+        c = noop(c);
+        ticks += CallClock::now() - pre;
+    }
+    usleep(c); // just to use c for something, to make 100% sure it is not optimized away
+    mNoopTicks = (double)ticks / rounds;
+}
+
+double CallStats::nsPerTick() const
+{
+    return mTicks ? (double)mNs / mTicks : 1.0;
+}
+
+double CallStats::timeNs(const Entry& entry) const
+{
+    if (entry.timed == 0)
+    {
+        return 0.0;
+    }
+    const double ticks = (double)entry.ticks - mNoopTicks * entry.timed;
+    return std::max(0.0, ticks) * nsPerTick() * entry.calls / entry.timed;
+}
+
+double CallStats::save(Json::Value& result, const std::vector<std::string>& names, const std::string& prefix) const
+{
+    std::vector<Entry> totals(mFunctions);
+    for (const Range& range : mRanges)
+    {
+        for (unsigned id = 0; id < mFunctions; id++)
+        {
+            totals[id].calls += range.entries[id].calls;
+            totals[id].timed += range.entries[id].timed;
+            totals[id].ticks += range.entries[id].ticks;
+        }
+    }
+    const auto name = [&names](unsigned id) { return id < names.size() ? names[id] : std::string("unknown"); };
+    const double scale = nsPerTick();
+
+    // Times are in nanoseconds, scaled up to all calls when sampling
+    result["clock"] = CallClock::name();
+    result["ns_per_tick"] = scale;
+    result["sample_rate"] = mSampler.rate();
+    result["noop_ns"] = mNoopTicks * scale;
+    double total = 0.0;
+    Json::Value functions;
+    for (unsigned id = 0; id < mFunctions; id++)
+    {
+        const Entry& entry = totals[id];
+        if (entry.calls == 0) continue;
+        Json::Value function;
+        function["calls"] = (Json::Value::UInt64)entry.calls;
+        function["timed_calls"] = (Json::Value::UInt64)entry.timed;
+        function["time"] = entry.timed ? (double)entry.ticks * scale * entry.calls / entry.timed : 0.0;
+        function["calibrated_time"] = timeNs(entry);
+        // Pairs of the shortest time in the bucket and the number of timed calls in it
+        Json::Value histogram(Json::arrayValue);
+        for (unsigned bucket = 0; bucket < BUCKETS; bucket++)
+        {
+            const uint32_t count = mHistograms[id * BUCKETS + bucket];
+            if (count == 0) continue;
+            Json::Value pair(Json::arrayValue);
+            pair.append((double)(1ull << bucket) * scale);
+            pair.append(count);
+            histogram.append(pair);
+        }
+        function["histogram"] = histogram;
+        functions[name(id)] = function;
+        if (!isPatraceCall(name(id)))
+        {
+            total += timeNs(entry);
+        }
+    }
+    result["functions"] = functions;
+
+    const std::string filename = prefix + ".csv";
+    FILE *fp = fopen(filename.c_str(), "w");
+    if (fp)
+    {
+        fprintf(fp, "Function,Calls,Time,Calibrated_Time,Timed_Calls\n");
+        fprintf(fp, "NO-OP,%d,%" PRIu64 ",0,%d\n", CALL_STATS_NOOP_ROUNDS, (uint64_t)(mNoopTicks * CALL_STATS_NOOP_ROUNDS * scale), CALL_STATS_NOOP_ROUNDS);
+        for (unsigned id = 0; id < mFunctions; id++)
+        {
+            const Entry& entry = totals[id];
+            if (entry.calls == 0) continue;
+            const uint64_t time = entry.timed ? (uint64_t)((double)entry.ticks * scale * entry.calls / entry.timed) : 0;
+            fprintf(fp, "%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", name(id).c_str(), entry.calls, time,
+                    (uint64_t)timeNs(entry), entry.timed);
+        }
+        fsync(fileno(fp));
+        fclose(fp);
+        DBG_LOG("Writing callstats to %s\n", filename.c_str());
+    }
+    else
+    {
+        DBG_LOG("Failed to open output callstats in %s: %s\n", filename.c_str(), strerror(errno));
+    }
+
+    if (mRangeFrames)
+    {
+        Json::Value ranges(Json::arrayValue);
+        for (const Range& range : mRanges)
+        {
+            Json::Value functions;
+            for (unsigned id = 0; id < mFunctions; id++)
+            {
+                const Entry& entry = range.entries[id];
+                if (entry.calls == 0) continue;
+                Json::Value function;
+                function["calls"] = (Json::Value::UInt64)entry.calls;
+                function["calibrated_time"] = timeNs(entry);
+                functions[name(id)] = function;
+            }
+            Json::Value json;
+            json["start_frame"] = mBeginFrame + range.index * mRangeFrames;
+            json["end_frame"] = mBeginFrame + (range.index + 1) * mRangeFrames;
+            json["functions"] = functions;
+            ranges.append(json);
+        }
+        result["ranges"] = ranges;
+
+        const std::string rangesFilename = prefix + "_ranges.csv";
+        fp = fopen(rangesFilename.c_str(), "w");
+        if (fp)
+        {
+            fprintf(fp, "Start_Frame,End_Frame,Function,Calls,Calibrated_Time\n");
+            for (const Range& range : mRanges)
+            {
+                for (unsigned id = 0; id < mFunctions; id++)
+                {
+                    const Entry& entry = range.entries[id];
+                    if (entry.calls == 0) continue;
+                    fprintf(fp, "%u,%u,%s,%" PRIu64 ",%" PRIu64 "\n", mBeginFrame + range.index * mRangeFrames,
+                            mBeginFrame + (range.index + 1) * mRangeFrames, name(id).c_str(), entry.calls, (uint64_t)timeNs(entry));
+                }
+            }
+            fsync(fileno(fp));
+            fclose(fp);
+        }
+        else
+        {
+            DBG_LOG("Failed to open output callstats in %s: %s\n", rangesFilename.c_str(), strerror(errno));
+        }
+    }
+    return total / 1000000000.0;
+}
+
+const char* StageStats::stageName(Stage stage)
+{
+    switch (stage)
+    {
+    case FILE_DECODE: return "file_decode";
+    case ARGUMENT_DECODE: return "argument_decode";
+    case NAME_MAPPING: return "name_mapping";
+    case DISPATCH: return "dispatch";
+    case RESULT_MAPPING: return "result_mapping";
+    default: return "unknown";
+    }
+}
+
+void StageStats::init(unsigned sampleRate)
+{
+    mSampler.setRate(std::max(1u, sampleRate));
+    mCalls = mBytes = mTimedDecodes = mTimedCalls = 0;
+    std::fill(mTicks, mTicks + STAGES, 0);
+    std::fill(mMeasured, mMeasured + STAGES, 0);
+}
+
+void StageStats::start()
+{
+    mStartNs = CallClock::reference();
+    mStartTicks = CallClock::now();
+}
+
+void StageStats::stop()
+{
+    mTicksTotal = CallClock::now() - mStartTicks;
+    mNs = CallClock::reference() - mStartNs;
+}
+
+void StageStats::calibrate()
+{
+    const int rounds = CALL_STATS_NOOP_ROUNDS;
+    uint64_t ticks = 0;
+    for (int i = 0; i < rounds; i++)
+    {
+        const uint64_t pre = CallClock::now();
+        ticks += CallClock::now() - pre;
+    }
+    mClockTicks = (double)ticks / rounds;
+}
+
+void StageStats::save(Json::Value& result) const
+{
+    const double seconds = mNs / 1000000000.0;
+    const double nsPerTick = mTicksTotal ? (double)mNs / mTicksTotal : 1.0;
+    result["calls"] = (Json::Value::UInt64)mCalls;
+    result["bytes"] = (Json::Value::UInt64)mBytes;
+    result["time"] = seconds;
+    result["calls_per_second"] = seconds > 0.0 ? mCalls / seconds : 0.0;
+    result["bytes_per_second"] = seconds > 0.0 ? mBytes / seconds : 0.0;
+    result["sample_rate"] = mSampler.rate();
+    result["timed_calls"] = (Json::Value::UInt64)mTimedCalls;
+    result["clock_ns"] = mClockTicks * nsPerTick;
+
+    // Average nanoseconds per call, and the share of the time of all stages
+    double ns[STAGES];
+    double total = 0.0;
+    for (int stage = 0; stage < STAGES; stage++)
+    {
+        const uint64_t timed = stage == FILE_DECODE ? mTimedDecodes : mTimedCalls;
+        ns[stage] = timed ? std::max(0.0, ((double)mTicks[stage] - mClockTicks * mMeasured[stage]) / timed) * nsPerTick : 0.0;
+        total += ns[stage];
+    }
+    Json::Value stages;
+    for (int stage = 0; stage < STAGES; stage++)
+    {
+        Json::Value json;
+        json["ns_per_call"] = ns[stage];
+        json["share"] = total > 0.0 ? ns[stage] / total : 0.0;
+        stages[stageName((Stage)stage)] = json;
+    }
+    result["stages"] = stages;
+    DBG_LOG("Null driver: %.0f calls/s, %.1f MB/s decoded, ns/call: %.1f file decode, %.1f argument decode, %.1f name mapping, %.1f dispatch, %.1f result mapping\n",
+            result["calls_per_second"].asDouble(), result["bytes_per_second"].asDouble() / (1024.0 * 1024.0),
+            ns[FILE_DECODE], ns[ARGUMENT_DECODE], ns[NAME_MAPPING], ns[DISPATCH], ns[RESULT_MAPPING]);
+}
+
+}
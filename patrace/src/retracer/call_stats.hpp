@@ -0,0 +1,224 @@
+#ifndef _RETRACER_CALL_STATS_HPP_
+#define _RETRACER_CALL_STATS_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace Json { class Value; }
+
+namespace retracer {
+
+/// Timestamps cheap enough to take around every call: the CPU's counter register where user
+/// space can read it, else CLOCK_MONOTONIC_RAW. The tick length is found by comparing against
+/// CLOCK_MONOTONIC_RAW over the whole measurement.
+struct CallClock
+{
+    static inline uint64_t now()
+    {
+#if defined(__aarch64__)
+        uint64_t ticks;
+        __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(ticks) :: "memory");
+        return ticks;
+#elif defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return reference();
+#endif
+    }
+
+    static inline uint64_t reference()
+    {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+        return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+    }
+
+    static const char* name();
+};
+
+/// Picks the calls to time, one in rate on average. The gap to the next timed call is random, so
+/// that calls which repeat with the same period as the sampling are not always or never timed.
+class CallSampler
+{
+public:
+    void setRate(unsigned rate)
+    {
+        mRate = rate;
+        mCountdown = 1;
+    }
+    unsigned rate() const { return mRate; }
+
+    inline bool sample()
+    {
+        if (--mCountdown) return false;
+        mRandom ^= mRandom << 13; // xorshift32
+        mRandom ^= mRandom >> 17;
+        mRandom ^= mRandom << 5;
+        mCountdown = 1 + mRandom % (2 * mRate - 1);
+        return true;
+    }
+
+private:
+    unsigned mRate = 1;
+    unsigned mCountdown = 1;
+    uint32_t mRandom = 2463534242u;
+};
+
+/// Call counts and times per function id, kept in flat arrays so that recording a call is
+/// a couple of array updates. With sampling only one in N calls on average is timed, and
+/// times are scaled up to all calls when reported. Besides the totals, which carry a log2 histogram
+/// of call times, the measured frames can be split into ranges of a fixed number of frames.
+class CallStats
+{
+public:
+    enum { BUCKETS = 40 }; ///< bucket i counts calls of 2^i to 2^(i+1) ticks
+
+    /// Returns false if the arguments make no sense
+    bool init(unsigned functions, unsigned sampleRate, unsigned rangeFrames, unsigned beginFrame);
+    /// Start and stop the clock calibration; calls are only recorded in between
+    void start();
+    void stop();
+    /// Select the range the following calls are added to
+    void setFrame(unsigned frame);
+
+    /// Whether to time the next call
+    inline bool sample() { return mSampler.sample(); }
+    inline void count(unsigned id)
+    {
+        mCurrent[id].calls++;
+    }
+    inline void add(unsigned id, uint64_t ticks)
+    {
+        Entry& entry = mCurrent[id];
+        entry.calls++;
+        entry.timed++;
+        entry.ticks += ticks;
+        const unsigned bucket = 63 - __builtin_clzll(ticks | 1);
+        mHistograms[id * BUCKETS + (bucket < BUCKETS ? bucket : BUCKETS - 1)]++;
+    }
+
+    /// Measure the cost of timing a call that does nothing, which is taken off the times reported
+    void calibrate();
+    /// Writes prefix.csv, and prefix_ranges.csv if ranges are used. Returns the total
+    /// calibrated time of the calls, without those patrace adds to traces, in seconds.
+    double save(Json::Value& result, const std::vector<std::string>& names, const std::string& prefix) const;
+
+private:
+    struct Entry
+    {
+        uint64_t calls = 0;
+        uint64_t timed = 0;
+        uint64_t ticks = 0;
+    };
+    struct Range
+    {
+        unsigned index = 0;
+        std::vector<Entry> entries;
+    };
+    double nsPerTick() const;
+    double timeNs(const Entry& entry) const;
+
+    unsigned mFunctions = 0;
+    CallSampler mSampler;
+    unsigned mRangeFrames = 0;
+    unsigned mBeginFrame = 0;
+    std::vector<Range> mRanges;
+    Entry* mCurrent = nullptr;
+    std::vector<uint32_t> mHistograms;
+    double mNoopTicks = 0;
+    uint64_t mStartTicks = 0;
+    uint64_t mStartNs = 0;
+    uint64_t mTicks = 0;
+    uint64_t mNs = 0;
+};
+
+/// Splits the time spent on each call into the stages of retracing it, when retracing against
+/// the null driver, which takes no time itself but notes when it is entered and left. Only the
+/// sampled calls are timed, but all calls and the bytes decoded for them are counted.
+class StageStats
+{
+public:
+    enum Stage
+    {
+        FILE_DECODE,     ///< finding the next call in the trace, including reading and decompressing chunks
+        ARGUMENT_DECODE, ///< from starting to retrace the call to having read its arguments
+        NAME_MAPPING,    ///< from having read the arguments to entering the driver, mostly looking up handles
+        DISPATCH,        ///< from entering the driver to leaving it the last time
+        RESULT_MAPPING,  ///< from leaving the driver to returning, registering the handles it returned and tracking state
+        STAGES
+    };
+    static const char* stageName(Stage stage);
+
+    void init(unsigned sampleRate);
+    void start();
+    void stop();
+
+    inline bool sample() { return mSampler.sample(); }
+    inline void addDecode(unsigned bytes)
+    {
+        mCalls++;
+        mBytes += bytes;
+    }
+    inline void addDecode(unsigned bytes, uint64_t ticks)
+    {
+        addDecode(bytes);
+        mTimedDecodes++;
+        addTicks(FILE_DECODE, ticks);
+    }
+    /// pre and post are taken around the retrace function. decoded is zero if the retrace function
+    /// does not mark the end of its argument decoding, and enter and leave if it did not call the driver.
+    inline void addCall(uint64_t pre, uint64_t decoded, uint64_t enter, uint64_t leave, uint64_t post)
+    {
+        mTimedCalls++;
+        const uint64_t mapped = enter ? enter : post;
+        if (decoded && decoded <= mapped)
+        {
+            addTicks(ARGUMENT_DECODE, decoded - pre);
+            addTicks(NAME_MAPPING, mapped - decoded);
+        }
+        else
+        {
+            addTicks(ARGUMENT_DECODE, mapped - pre);
+        }
+        if (enter)
+        {
+            addTicks(DISPATCH, leave - enter);
+            addTicks(RESULT_MAPPING, post - leave);
+        }
+    }
+
+    /// Measure the cost of reading the clock, which is taken off the times reported
+    void calibrate();
+    void save(Json::Value& result) const;
+
+private:
+    inline void addTicks(Stage stage, uint64_t ticks)
+    {
+        mTicks[stage] += ticks;
+        mMeasured[stage]++;
+    }
+
+    CallSampler mSampler;
+    uint64_t mCalls = 0;
+    uint64_t mBytes = 0;
+    uint64_t mTimedDecodes = 0;
+    uint64_t mTimedCalls = 0;
+    uint64_t mTicks[STAGES] = {};
+    uint64_t mMeasured[STAGES] = {}; ///< times each stage was measured, each including reading the clock once
+    double mClockTicks = 0;
+    uint64_t mStartTicks = 0;
+    uint64_t mStartNs = 0;
+    uint64_t mTicksTotal = 0;
+    uint64_t mNs = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,267 @@
+#include "retracer/frame_timeline.hpp"
+
+#include "common/os.hpp"
+#include "common/os_time.hpp"
+#include "common/gl_extension_supported.hpp"
+
+#include "json/value.h"
+
+#include <algorithm>
+
+// Jank as commonly defined for frame pacing: a frame taking more than twice as long as the
+// average of the three frames before it, and longer than two (or three) frames at 24 fps
+#define JANK_MIN_US 83333
+#define BIG_JANK_MIN_US 125000
+
+namespace retracer {
+
+static uint32_t ticksToUs(long long ticks)
+{
+    const long long us = ticks * 1000000LL / os::timeFrequency;
+    return (uint32_t)std::min<long long>(std::max(us, 0LL), FrameTime::NONE - 1);
+}
+
+void FrameTimeline::reset(unsigned capacity)
+{
+    mCapacity = std::max(1u, std::min<unsigned>(capacity, MAX_FRAMES));
+    mRing.clear();
+    mRing.reserve(mCapacity);
+    mCount = 0;
+    mMaxUs = 0;
+    mTotalUs = 0;
+    mJank = 0;
+    mBigJank = 0;
+    std::fill(mRecentUs, mRecentUs + 3, 0);
+}
+
+void FrameTimeline::add(unsigned frame, long long frameTicks, long long swapTicks)
+{
+    FrameTime time;
+    time.frame = frame;
+    time.frameUs = ticksToUs(frameTicks);
+    time.cpuUs = swapTicks >= 0 ? ticksToUs(frameTicks - swapTicks) : FrameTime::NONE;
+    time.swapUs = swapTicks >= 0 ? ticksToUs(swapTicks) : FrameTime::NONE;
+    time.gpuUs = FrameTime::NONE;
+    if (mRing.size() < mCapacity)
+    {
+        mRing.push_back(time);
+    }
+    else
+    {
+        mRing[mCount % mRing.size()] = time;
+    }
+
+    if (mCount >= 3)
+    {
+        const uint64_t recent = (uint64_t)mRecentUs[0] + mRecentUs[1] + mRecentUs[2];
+        if (time.frameUs * 3ull > recent * 2 && time.frameUs > JANK_MIN_US)
+        {
+            mJank++;
+            if (time.frameUs > BIG_JANK_MIN_US) mBigJank++;
+        }
+    }
+    mRecentUs[mCount % 3] = time.frameUs;
+    mMaxUs = std::max(mMaxUs, time.frameUs);
+    mTotalUs += time.frameUs;
+    mCount++;
+}
+
+void FrameTimeline::setGpuTime(uint64_t index, uint32_t gpuUs)
+{
+    if (index < mCount && index + mRing.size() >= mCount)
+    {
+        mRing[index % mRing.size()].gpuUs = gpuUs;
+    }
+}
+
+static Json::Value percentiles(std::vector<uint32_t>& values)
+{
+    Json::Value result;
+    if (values.empty())
+    {
+        return result;
+    }
+    std::sort(values.begin(), values.end());
+    const auto at = [&values](double p) { return values[std::min(values.size() - 1, (size_t)(p * values.size()))] / 1000.0; };
+    result["p50"] = at(0.50);
+    result["p90"] = at(0.90);
+    result["p99"] = at(0.99);
+    result["max"] = values.back() / 1000.0;
+    return result;
+}
+
+void FrameTimeline::save(Json::Value& result, bool perFrame) const
+{
+    // Oldest first
+    std::vector<FrameTime> frames;
+    const size_t oldest = mRing.size() == mCapacity ? mCount % mRing.size() : 0;
+    frames.insert(frames.end(), mRing.begin() + oldest, mRing.end());
+    frames.insert(frames.end(), mRing.begin(), mRing.begin() + oldest);
+
+    std::vector<uint32_t> frameUs, cpuUs, swapUs, gpuUs;
+    for (const FrameTime& time : frames)
+    {
+        frameUs.push_back(time.frameUs);
+        if (time.cpuUs != FrameTime::NONE) cpuUs.push_back(time.cpuUs);
+        if (time.swapUs != FrameTime::NONE) swapUs.push_back(time.swapUs);
+        if (time.gpuUs != FrameTime::NONE) gpuUs.push_back(time.gpuUs);
+    }
+
+    // All times in milliseconds
+    result["frames"] = (Json::Value::UInt64)mCount;
+    result["frames_kept"] = (Json::Value::UInt64)frames.size();
+    result["mean"] = mCount ? mTotalUs / 1000.0 / mCount : 0.0;
+    result["frame"] = percentiles(frameUs);
+    result["frame"]["max"] = mMaxUs / 1000.0;
+    if (!cpuUs.empty()) result["cpu"] = percentiles(cpuUs);
+    if (!swapUs.empty()) result["swap"] = percentiles(swapUs);
+    if (!gpuUs.empty()) result["gpu"] = percentiles(gpuUs);
+    result["jank"] = (Json::Value::UInt64)mJank;
+    result["big_jank"] = (Json::Value::UInt64)mBigJank;
+
+    if (perFrame)
+    {
+        // One array per column, in microseconds, with -1 for times not measured
+        const auto column = [&frames](uint32_t FrameTime::*member) {
+            Json::Value values(Json::arrayValue);
+            for (const FrameTime& time : frames)
+            {
+                values.append(time.*member == FrameTime::NONE ? -1 : (Json::Value::Int64)(time.*member));
+            }
+            return values;
+        };
+        Json::Value list;
+        list["frame"] = column(&FrameTime::frame);
+        list["frame_us"] = column(&FrameTime::frameUs);
+        if (!cpuUs.empty()) list["cpu_us"] = column(&FrameTime::cpuUs);
+        if (!swapUs.empty()) list["swap_us"] = column(&FrameTime::swapUs);
+        if (!gpuUs.empty()) list["gpu_us"] = column(&FrameTime::gpuUs);
+        result["per_frame"] = list;
+    }
+}
+
+bool GpuFrameTimer::init()
+{
+    if (mEnabled && mContext == _eglGetCurrentContext())
+    {
+        return true;
+    }
+    if (mTraceQueries)
+    {
+        return false;
+    }
+    if (!isGlesExtensionSupported("GL_EXT_disjoint_timer_query"))
+    {
+        DBG_LOG("GL_EXT_disjoint_timer_query is not supported - not measuring GPU frame times\n");
+        return false;
+    }
+    GLuint ids[QUERIES];
+    _glGenQueriesEXT(QUERIES, ids);
+    for (unsigned i = 0; i < QUERIES; i++)
+    {
+        mQueries[i] = Query();
+        mQueries[i].id = ids[i];
+    }
+    GLint disjoint = 0;
+    _glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint); // clears the flag
+    mContext = _eglGetCurrentContext();
+    mNext = 0;
+    mActive = false;
+    mEnabled = true;
+    return true;
+}
+
+void GpuFrameTimer::beginFrame(FrameTimeline& timeline)
+{
+    if (!mEnabled || _eglGetCurrentContext() != mContext)
+    {
+        return;
+    }
+    collect(timeline);
+    Query& query = mQueries[mNext];
+    if (query.pending)
+    {
+        return; // the GPU is more than QUERIES frames behind, leave this frame out
+    }
+    _glBeginQueryEXT(GL_TIME_ELAPSED_EXT, query.id);
+    query.index = timeline.count();
+    mActive = true;
+}
+
+void GpuFrameTimer::endFrame()
+{
+    if (!mActive)
+    {
+        return;
+    }
+    mActive = false;
+    if (_eglGetCurrentContext() != mContext)
+    {
+        // The query cannot be ended from here, and beginning another one would fail
+        DBG_LOG("Frame ended on another context than it began on - not measuring GPU frame times any more\n");
+        mEnabled = false;
+        return;
+    }
+    _glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+    mQueries[mNext].pending = true;
+    mNext = (mNext + 1) % QUERIES;
+}
+
+void GpuFrameTimer::stopForTraceQueries()
+{
+    if (!mEnabled)
+    {
+        return;
+    }
+    DBG_LOG("The trace uses GL_TIME_ELAPSED_EXT queries itself - not measuring GPU frame times any more\n");
+    if (mActive && _eglGetCurrentContext() == mContext)
+    {
+        _glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+    }
+    mActive = false;
+    mEnabled = false;
+    mTraceQueries = true;
+}
+
+void GpuFrameTimer::collect(FrameTimeline& timeline)
+{
+    uint64_t indices[QUERIES];
+    GLuint64 results[QUERIES];
+    unsigned count = 0;
+    // Queries end in order, so stop at the first one not done yet
+    for (unsigned i = 0; i < QUERIES; i++)
+    {
+        Query& query = mQueries[(mNext + i) % QUERIES];
+        if (!query.pending)
+        {
+            continue;
+        }
+        GLuint available = 0;
+        _glGetQueryObjectuivEXT(query.id, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        if (!available)
+        {
+            break;
+        }
+        _glGetQueryObjectui64vEXT(query.id, GL_QUERY_RESULT_EXT, &results[count]);
+        indices[count++] = query.index;
+        query.pending = false;
+    }
+    if (count == 0)
+    {
+        return;
+    }
+    // A disjoint operation, such as a change of GPU frequency, makes the results meaningless
+    GLint disjoint = 0;
+    _glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint)
+    {
+        mDisjoint += count;
+        return;
+    }
+    for (unsigned i = 0; i < count; i++)
+    {
+        timeline.setGpuTime(indices[i], (uint32_t)std::min<GLuint64>(results[i] / 1000, FrameTime::NONE - 1));
+    }
+}
+
+}
@@ -0,0 +1,92 @@
+#ifndef _RETRACER_FRAME_TIMELINE_HPP_
+#define _RETRACER_FRAME_TIMELINE_HPP_
+
+#include "dispatch/eglimports.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+namespace Json { class Value; }
+
+namespace retracer {
+
+/// Times of one retraced frame, in microseconds
+struct FrameTime
+{
+    enum : uint32_t { NONE = UINT32_MAX }; ///< not measured
+    uint32_t frame;
+    uint32_t frameUs;  ///< from the return of the previous swap to the return of this one
+    uint32_t cpuUs;    ///< from the return of the previous swap to the start of this one
+    uint32_t swapUs;   ///< inside the swap call
+    uint32_t gpuUs;    ///< GPU time of the frame's commands
+};
+
+/// Records the times of the measured frames in a ring allocated up front, so that recording
+/// costs no allocation at swap time. Percentiles are taken over the frames still in the ring;
+/// the maximum and the jank counts cover all frames.
+class FrameTimeline
+{
+public:
+    enum { MAX_FRAMES = 64 * 1024 };
+
+    void reset(unsigned capacity);
+    /// Takes the times in os::getTime() ticks; swap is negative when not measured.
+    void add(unsigned frame, long long frameTicks, long long swapTicks);
+    /// Sets the GPU time of a frame recorded earlier, if it is still in the ring
+    void setGpuTime(uint64_t index, uint32_t gpuUs);
+    uint64_t count() const { return mCount; }
+
+    /// Adds the statistics, and the times of every frame in the ring if perFrame is set
+    void save(Json::Value& result, bool perFrame) const;
+
+private:
+    std::vector<FrameTime> mRing;
+    unsigned mCapacity = 1;
+    uint64_t mCount = 0;
+    uint32_t mMaxUs = 0;
+    uint64_t mTotalUs = 0;
+    uint64_t mJank = 0;
+    uint64_t mBigJank = 0;
+    uint32_t mRecentUs[3] = {};
+};
+
+/// Measures the GPU time of each frame with GL_EXT_disjoint_timer_query. A time elapsed query
+/// spans each frame, and its result is collected a few frames later so that waiting for it never
+/// stalls the pipeline. Only one context is followed; timing stops if the frame ends on another.
+class GpuFrameTimer
+{
+public:
+    enum { QUERIES = 4 };
+
+    /// Call with the context current; returns false if timer queries are not supported
+    bool init();
+    /// Call after the swap that recorded the previous frame in timeline
+    void beginFrame(FrameTimeline& timeline);
+    void endFrame();
+    /// Stop measuring for good, because the trace begins time elapsed queries of its own, which
+    /// cannot nest with ours. Call before the trace's query begins.
+    void stopForTraceQueries();
+    bool enabled() const { return mEnabled; }
+    uint64_t disjoint() const { return mDisjoint; }
+
+private:
+    void collect(FrameTimeline& timeline);
+
+    struct Query
+    {
+        GLuint id = 0;
+        uint64_t index = 0;
+        bool pending = false;
+    };
+    Query mQueries[QUERIES];
+    unsigned mNext = 0;
+    bool mEnabled = false;
+    bool mActive = false;
+    bool mTraceQueries = false;
+    EGLContext mContext = EGL_NO_CONTEXT;
+    uint64_t mDisjoint = 0;
+};
+
+}
+
+#endif
@@ -13,7 +13,9 @@ struct Texture;
 
 namespace glstate {
 
-image::Image* getDrawBufferImage(int attachment=0, int _width=0, int _height=0, GLenum format=GL_RGBA, GLenum type=GL_UNSIGNED_BYTE, int bytes_per_pixel=4, int channel = 4);
+/// With packBuffer, the pixels are read into that buffer instead of the image, which is returned
+/// with its pixels left for the caller to fill in from the buffer once the read has completed.
+image::Image* getDrawBufferImage(int attachment=0, int _width=0, int _height=0, GLenum format=GL_RGBA, GLenum type=GL_UNSIGNED_BYTE, int bytes_per_pixel=4, int channel = 4, GLuint packBuffer = 0);
 std::vector<std::string> dumpTexture(Texture& tex, unsigned int callNo, GLfloat* vertices, int face=-1, GLuint* cm_indices=0); // face=-1 if not cube map
 GLint getMaxColorAttachments();
 GLint getMaxDrawBuffers();
@@ -360,7 +360,7 @@ void getDimensions(int drawFramebuffer, GLenum attachment, int& width, int& heig
     }
 }
 
-image::Image* getDrawBufferImage(int attachment, int _width, int _height, GLenum format, GLenum type, int bytes_per_pixel, int channel)
+image::Image* getDrawBufferImage(int attachment, int _width, int _height, GLenum format, GLenum type, int bytes_per_pixel, int channel, GLuint packBuffer)
 {
     GLint draw_framebuffer = 0;
     const Context* context = gRetracer.mState.mThreadArr[gRetracer.getCurTid()].getContext();
@@ -376,6 +376,11 @@ image::Image* getDrawBufferImage(int attachment, int _width, int _height, GLenum
     {
         getDimensions(draw_framebuffer, attachment, width, height, format, type, bytes_per_pixel, channel, internalFormat);
     }
+    if (packBuffer && isDepth)
+    {
+        isDepth = false;
+        return NULL; // depth is copied with a shader, which cannot go through a pack buffer
+    }
 
     int width_multiplier = bytes_per_pixel / channel;   // if bytes_per_pixel > 4, we need more than one 4-channel pixels to store it.
     image::Image *image = new image::Image(width * width_multiplier, height, channel, true);
@@ -401,7 +406,15 @@ image::Image* getDrawBufferImage(int attachment, int _width, int _height, GLenum
     _glGetIntegerv(GL_PACK_ALIGNMENT, &oldAlignment);
     _glPixelStorei(GL_PACK_ALIGNMENT, 1);
 
-    if (!isDepth) {
+    if (packBuffer) {
+        GLint oldPackBuffer = 0;
+        _glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &oldPackBuffer);
+        _glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+        _glBufferData(GL_PIXEL_PACK_BUFFER, image->size(), NULL, GL_STREAM_READ);
+        _glReadPixels(0, 0, width, height, format, type, 0);
+        _glBindBuffer(GL_PIXEL_PACK_BUFFER, oldPackBuffer);
+    }
+    else if (!isDepth) {
         _glReadPixels(0, 0, width, height, format, type, image->pixels);
     }
     else {      // depth attachment, can't use glReadPixels on arm GPUs
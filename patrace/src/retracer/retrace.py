@@ -117,6 +117,17 @@ get_query_object_funcs = [
     'glGetQueryObjectivEXT', 'glGetQueryObjectuivEXT'
 ]
 
+# Calls that only produce pixels, so that skipping them leaves the state that later calls see
+# untouched, except for framebuffer contents and anything written by transform feedback
+def isRenderOnly(func):
+    name = func.name
+    if not func.sideeffects or name.startswith('glDrawBuffers'):
+        return False
+    return (name.startswith('glDraw') or name.startswith('glMultiDraw')
+            or name == 'glClear' or name.startswith('glClearBuffer') or name.startswith('glClearPixelLocalStorage')
+            or name.startswith('glBlitFramebuffer') or name == 'glResolveMultisampleFramebufferAPPLE'
+            or name == 'glFinish')
+
 # Filled out in main()
 reverse_lookup_maps = set(["program", "shader" ,"pipeline", "texture", "buffer"])
 
@@ -1005,7 +1016,7 @@ class Retracer(object):
         if func.name == 'glLinkProgram2' or func.name == 'glLinkProgram':
             if func.name == 'glLinkProgram':
                 print('    const int status = -1;')
-            print('    if (gRetracer.mOptions.mShaderCacheFile.size() > 0 && gRetracer.mOptions.mShaderCacheLoad)')
+            print('    if (gRetracer.mLoadProgramBinaries)')
             print('    {')
             print('        load_from_shadercache(programNew, program, status);')
             print('    }')
@@ -1026,7 +1037,11 @@ class Retracer(object):
         arg_names = ", ".join(args)
 
         if func.name in shadercache_funcs:
-            print('    if (gRetracer.mOptions.mShaderCacheFile.size() == 0 || !gRetracer.mOptions.mShaderCacheLoad)')
+            if func.name in ['glAttachShader', 'glShaderSource']:
+                # The shader warm-up compiles the shaders of programs it has no binary for, so they must be there
+                print('    if (!gRetracer.mLoadProgramBinaries || gRetracer.mShaderWarmup.started())')
+            else:
+                print('    if (!gRetracer.mLoadProgramBinaries)')
             print('    {')
             print('        {name}({args});'.format(name=func.name, args=arg_names))
             print('    }')
@@ -1075,7 +1090,7 @@ class Retracer(object):
             print('    (void)ret;')
 
         if func.name == 'glCompileShader':
-            print('    if (gRetracer.mOptions.mShaderCacheFile.size() == 0 || !gRetracer.mOptions.mShaderCacheLoad)')
+            print('    if (!gRetracer.mLoadProgramBinaries)')
             print('    {')
             print('        post_glCompileShader(shaderNew, shader);')
             print('    }')
@@ -1089,6 +1104,7 @@ class Retracer(object):
         #print '    DBG_LOG("retrace %s _src = %%p\\n", _src);' % func.name
         print()
         self.deserialize(func)
+        print('    NullDriverArgumentsDecoded();')
         self.assistantParams(func)
         self.lookupHandles(func)
         self.outAllocate(func)
@@ -1125,6 +1141,14 @@ class Retracer(object):
         print('};')
         print()
 
+    def renderCalls(self, functions):
+        print('const std::set<std::string> retracer::gles_render_calls = {')
+        for func in functions:
+            if isRenderOnly(func):
+                print('    "%s",' % (func.name))
+        print('};')
+        print()
+
 strings = {
     'header': r"""//This file was generated by retrace.py
 #include <retracer/retracer.hpp>
@@ -1133,6 +1157,7 @@ strings = {
 #include <retracer/forceoffscreen/offscrmgr.h>
 #include <common/gl_extension_supported.hpp>
 #include <dispatch/eglproc_auto.hpp>
+#include <dispatch/eglproc_null.hpp>
 #include <helper/eglsize.hpp>
 #include <common/trace_model.hpp>
 #include <common/os.hpp>
@@ -1192,6 +1217,7 @@ def main():
         retracer = Retracer()
         retracer.retraceFunctions(api.functions)
         retracer.callbackArray(api.functions)
+        retracer.renderCalls(api.functions)
         sys.stdout = orig_stdout
 
 if __name__ == '__main__':
@@ -77,10 +77,27 @@ void glPatchClientSideBuffer(GLenum target, int _size, const char* _data)
     }
 }
 
+static void unpinClientSideBufferChunk(void *token)
+{
+    gRetracer.mFile.unpinChunk(static_cast<ChunkBuffer*>(token));
+}
+
 void glClientSideBufferData(unsigned int _name, int _size, const char* _data) {
 #ifndef NDEBUG
     gRetracer.mClientSideMemoryDataSize += _size;
 #endif
+    if (gRetracer.mOptions.mZeroCopyCSBLimit)
+    {
+        // Use the data where it is in the trace chunk, unless too many chunks are held already
+        ChunkBuffer *chunk = gRetracer.mFile.pinChunk(_data, _size);
+        if (chunk)
+        {
+            gRetracer.mCSBReferencedBytes += _size;
+            gRetracer.mCSBuffers.object_data_ref(gRetracer.getCurTid(), _name, _size, _data, unpinClientSideBufferChunk, chunk);
+            return;
+        }
+        gRetracer.mCSBCopiedBytes += _size;
+    }
     gRetracer.mCSBuffers.object_data(gRetracer.getCurTid(), _name, _size, _data, true);
 }
 
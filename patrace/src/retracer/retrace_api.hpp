@@ -5,6 +5,9 @@
 #include <common/file_format.hpp>
 #include <dispatch/eglimports.hpp>
 
+#include <set>
+#include <string>
+
 namespace retracer {
 
 typedef void (*RetraceFunc)(char*);
@@ -14,6 +17,9 @@ void unsupported(char*);
 
 extern const common::EntryMap gles_callbacks;
 extern const common::EntryMap egl_callbacks;
+// Calls that only produce pixels, and can be left out when only the state matters
+extern const std::set<std::string> gles_render_calls;
+extern const std::set<std::string> egl_render_calls;
 
 }
 
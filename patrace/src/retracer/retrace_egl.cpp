@@ -1409,3 +1409,8 @@ const common::EntryMap retracer::egl_callbacks = {
     {"glEGLImageTargetTexture2DOES", std::make_pair((void*)retrace_glEGLImageTargetTexture2DOES, false)},
     {"glEGLImageTargetTexStorageEXT", std::make_pair((void*)retrace_glEGLImageTargetTexStorageEXT, false)},
 };
+
+const std::set<std::string> retracer::egl_render_calls = {
+    "eglSwapBuffers",
+    "eglSwapBuffersWithDamageKHR",
+};
@@ -28,13 +28,23 @@ usage(const char *argv0) {
         "  -tid THREADID the function calls invoked by thread <THREADID> will be retraced\n"
         "  -s CALL_SET take snapshot for the calls in the specific call set. Please try to post process the captured snapshot with imagemagick to turn off alpha value if it shows black.\n"
         "  -snapshotprefix PREFIX Prepend this label to every snapshot. Useful for automation.\n"
+        "  -snapshotthreads N Write snapshots on N threads, and read them back without waiting for the GPU where possible.\n"
+        "  -snapshothash Instead of writing snapshots to disk, put a hash of their pixels in the results file.\n"
+        "  -snapshothashtile SIZE With -snapshothash, also hash each tile of SIZE x SIZE pixels, to show where snapshots differ.\n"
         "  -step use F1-F4 to step forward frame by frame, F5-F8 to step forward draw call by draw call (not supported on all platforms)\n"
         "  -ores W H override the resolution of the final onscreen rendering (FBOs used in earlier renderpasses are not affected!)\n"
         "  -msaa SAMPLES enable multi sample anti alias for the final framebuffer\n"
         "  -overrideMSAA SAMPLES override any existing MSAA setting for intermediate framebuffers with MSAA\n"
         "  -preload START STOP preload the trace file frames from START to STOP. START must be greater than zero.\n"
+        "  -zerocopycsb MB use client-side buffer data in place in the trace file chunks, keeping at most MB megabytes of chunks alive for it, and copy it when over this limit\n"
+        "  -predecode decode the calls of the preloaded frame range once, and replay them with less overhead on every further loop\n"
+        "  -preloadbudget MB keep at most this many megabytes of preloaded trace data in memory, falling back to keeping it compressed or reading it from file\n"
         "  -all run all calls even those with no side-effects. This is useful for CPU load measurements.\n"
         "  -framerange FRAME_START FRAME_END start fps timer at frame start (inclusive), stop timer and playback before frame end (exclusive).\n"
+        "  -perframe record the time of every measured frame, and write percentiles and jank counts to the results\n"
+        "  -perframelist like -perframe, and also write the times of each frame\n"
+        "  -swaptime with -perframe, split frame times into time spent before and inside the swap\n"
+        "  -gputime with -perframe, measure the GPU time of each frame with GL_EXT_disjoint_timer_query\n"
         "  -loop TIMES repeat the preloaded frames at least the given number of times\n"
         "  -looptime SECONDS repeat the preloaded frames at least the given number of seconds\n"
         "  -jsonParameters FILE RESULT_FILE TRACE_DIR path to a JSON file containing the parameters, the output result file and base trace path\n"
@@ -50,6 +60,10 @@ usage(const char *argv0) {
         "  -debugfull output all of the current invoked gl functions, with callNo, frameNo and skipped or discarded information\n"
         "  -infojson Dump the header of the trace file in json format, then exit\n"
         "  -callstats Used with -framerange to output call statistics to callstats.csv on disk, including the calling number and running time\n"
+        "  -callstatssample N with -callstats, time only one in N calls, and scale the times up to all calls\n"
+        "  -callstatsrange FRAMES with -callstats, also break the statistics down into ranges of FRAMES frames\n"
+        "  -nulldriver Retrace against a null driver that does nothing, and report how fast the retracer itself decodes and dispatches calls\n"
+        "  -nulldriversample N with -nulldriver, time the stages of one in N calls (default 16)\n"
         "  -overrideEGL Red Green Blue Alpha Depth Stencil, example: overrideEGL 5 6 5 0 16 8, for 16 bit color and 16 bit depth and 8 bit stencil\n"
         "  -strict Use strict EGL mode (fail unless the specified EGL configuration is valid)\n"
         "  -strictcolor Same as -strict, but only checks color channels (RGBA). Useful for dumping when we want to be sure returned EGL is same as requested\n"
@@ -60,9 +74,11 @@ usage(const char *argv0) {
         "  -skipfence START-END,START-END... Skip some fence waits calls (eglClientWaitSync, eglWaitSync, eglClientWaitSyncKHR, eglWaitSyncKHR, glWaitSync, glClientWaitSync) when within any of the given (comma separated list of) ranges. All ranges include the start frame and the end frame,\n"
         "  -flush Before starting running the defined measurement range, make sure we flush all pending driver work\n"
         "  -multithread Run all threads in the trace\n"
-        "  -loadcache FILENAME Load shaders from this cache. Will add .bin and .idx to the given file name.\n"
-        "  -savecache FILENAME Save shaders to this cache. Will add .bin and .idx to the given file name.\n"
+        "  -loadcache FILENAME Load shaders from this cache. Will add .cache, or .bin and .idx for an old cache, to the given file name.\n"
+        "  -savecache FILENAME Save shaders to this cache. Will add .cache to the given file name.\n"
         "  -cacheonly Used with -savecache to only populate the shader cache and do not run anything else not needed for that from the trace.\n"
+        "  -stateonly Before the first measured frame, only retrace calls that create or modify state, leaving out draws, clears, blits, swaps and glFinish\n"
+        "  -shaderwarmup N Compile and link the programs of the trace on N threads while it is retraced, and load them as binaries when the trace links them.\n"
         "  -script Script_PATH FRAME Trigger script on a specific frame.\n"
 #ifndef __APPLE__
         "  -perfrange START END run Linux perf on selected frame range and save it to disk\n"
@@ -78,6 +94,8 @@ usage(const char *argv0) {
         "  -flushonswap Call explicit flush before every call to swap the backbuffer\n"
         "  -fpslimit FPS Limit the fps of replaying\n"
         "  -cpumask Set explicit CPU mask (written as a string of ones and zeroes)\n"
+        "  -decodeahead THREADS DEPTH Decompress up to DEPTH trace chunks ahead of playback on THREADS background threads\n"
+        "  -decodecpumask Set explicit CPU mask for the -decodeahead threads (written as a string of ones and zeroes)\n"
         "  -libEGL PATH Set path to libEGL.so\n"
         "  -libGLESv1 PATH Set path to libGLESv1_CM.so\n"
         "  -libGLESv2 PATH Set path to libGLESv2.so\n"
@@ -175,6 +193,14 @@ bool ParseCommandLine(int argc, char** argv, RetraceOptions& mOptions)
             DBG_LOG("Override the existing MSAA for fbo attachment with new MSAA: %d\n", mOptions.mOverrideMSAA);
         } else if (!strcmp(arg, "-callstats")) {
             mOptions.mCallStats = true;
+        } else if (!strcmp(arg, "-callstatssample")) {
+            mOptions.mCallStatsSampleRate = std::max(1, readValidValue(argv[++i]));
+        } else if (!strcmp(arg, "-callstatsrange")) {
+            mOptions.mCallStatsRangeFrames = readValidValue(argv[++i]);
+        } else if (!strcmp(arg, "-nulldriver")) {
+            mOptions.mNullDriver = true;
+        } else if (!strcmp(arg, "-nulldriversample")) {
+            mOptions.mNullDriverSampleRate = std::max(1, readValidValue(argv[++i]));
         } else if (!strcmp(arg, "-perfrange")) {
             mOptions.mPerfStart = readValidValue(argv[++i]);
             mOptions.mPerfStop = readValidValue(argv[++i]);
@@ -199,6 +225,12 @@ bool ParseCommandLine(int argc, char** argv, RetraceOptions& mOptions)
             mOptions.mSnapshotFrameNames = true;
         } else if (!strcmp(arg, "-snapshotprefix")) {
             mOptions.mSnapshotPrefix = argv[++i];
+        } else if (!strcmp(arg, "-snapshotthreads")) {
+            mOptions.mSnapshotThreads = readValidValue(argv[++i]);
+        } else if (!strcmp(arg, "-snapshothash")) {
+            mOptions.mSnapshotHash = true;
+        } else if (!strcmp(arg, "-snapshothashtile")) {
+            mOptions.mSnapshotHashTile = readValidValue(argv[++i]);
         } else if (!strcmp(arg, "-forceanisolevel")) {
             mOptions.mForceAnisotropicLevel = readValidValue(argv[++i]);
         } else if (!strcmp(arg, "-step")) {
@@ -208,6 +240,16 @@ bool ParseCommandLine(int argc, char** argv, RetraceOptions& mOptions)
             return false;
         } else if (!strcmp(arg, "-cpumask")) {
             mOptions.mCpuMask = argv[++i];
+        } else if (!strcmp(arg, "-decodeahead")) {
+            mOptions.mDecodeThreads = readValidValue(argv[++i]);
+            mOptions.mDecodeDepth = readValidValue(argv[++i]);
+            if (mOptions.mDecodeThreads < 0 || mOptions.mDecodeDepth < 1)
+            {
+                DBG_LOG("Bad value for -decodeahead: threads must be zero or more and depth at least one\n");
+                return false;
+            }
+        } else if (!strcmp(arg, "-decodecpumask")) {
+            mOptions.mDecodeCpuMask = argv[++i];
         } else if (!strcmp(arg, "-loop")) {
             mOptions.mLoopTimes = readValidValue(argv[++i]);
         } else if (!strcmp(arg, "-looptime")) {
@@ -234,6 +276,21 @@ bool ParseCommandLine(int argc, char** argv, RetraceOptions& mOptions)
                 DBG_LOG("Start frame must be lower than end frame. (End frame is never played.)\n");
                 return false;
             }
+        } else if (!strcmp(arg, "-preloadbudget")) {
+            mOptions.mPreloadBudget = (size_t)readValidValue(argv[++i]) * 1024 * 1024;
+        } else if (!strcmp(arg, "-predecode")) {
+            mOptions.mPredecode = true;
+        } else if (!strcmp(arg, "-zerocopycsb")) {
+            mOptions.mZeroCopyCSBLimit = (size_t)readValidValue(argv[++i]) * 1024 * 1024;
+        } else if (!strcmp(arg, "-perframe")) {
+            mOptions.mMeasurePerFrame = true;
+        } else if (!strcmp(arg, "-perframelist")) {
+            mOptions.mMeasurePerFrame = true;
+            mOptions.mPerFrameList = true;
+        } else if (!strcmp(arg, "-swaptime")) {
+            mOptions.mMeasureSwapTime = true;
+        } else if (!strcmp(arg, "-gputime")) {
+            mOptions.mMeasureGpuTime = true;
         } else if (!strcmp(arg, "-jsonParameters")) {
             const char *jsonParameters = argv[++i];
             const char *resultFile = argv[++i];
@@ -306,6 +363,10 @@ bool ParseCommandLine(int argc, char** argv, RetraceOptions& mOptions)
             mOptions.mShaderCacheLoad = false;
         } else if (!strcmp(arg, "-cacheonly")) {
             mOptions.mCacheOnly = true;
+        } else if (!strcmp(arg, "-stateonly")) {
+            mOptions.mStateOnly = true;
+        } else if (!strcmp(arg, "-shaderwarmup")) {
+            mOptions.mShaderWarmupThreads = readValidValue(argv[++i]);
         } else if (!strcmp(arg, "-insequence")) {
             // nothing, this is always the case now
         } else if (!strcmp(arg, "-singleframe")) {
@@ -435,6 +496,11 @@ bool ParseCommandLine(int argc, char** argv, RetraceOptions& mOptions)
         DBG_LOG("-cacheonly requires -savecache\n");
         return false;
     }
+    if (mOptions.mShaderWarmupThreads > 0 && mOptions.mShaderCacheFile.size() > 0)
+    {
+        DBG_LOG("-shaderwarmup cannot be used together with -loadcache or -savecache\n");
+        return false;
+    }
 
     if (gRetracer.mCollectors)
     {
@@ -39,6 +39,9 @@ struct RetraceOptions
     bool                mDoOverrideWinSize = false;
     bool                mDoOverrideResolution = false;
     bool                mPreload = false;
+    size_t              mPreloadBudget = 0; // in bytes, zero for no limit
+    bool                mPredecode = false;
+    size_t              mZeroCopyCSBLimit = 0; // in bytes, zero to always copy client-side buffer data
     bool                mStepMode = false;
     unsigned int        mBeginMeasureFrame = 1;
     unsigned int        mEndMeasureFrame = INT32_MAX;
@@ -56,6 +59,9 @@ struct RetraceOptions
     std::string         mSnapshotPrefix;
     common::CallSet*    mSnapshotCallSet = nullptr;
     bool                mUploadSnapshots = false;
+    unsigned int        mSnapshotThreads = 0; // zero to read back and write snapshots on the retrace thread
+    bool                mSnapshotHash = false; // put hashes of the snapshots in the results instead of writing them
+    unsigned int        mSnapshotHashTile = 0; // also hash tiles of this many pixels square, zero for none
     bool                mFailOnShaderError = false;
     int                 mDebug = 0;
     bool                mStateLogging = false;
@@ -66,6 +72,8 @@ struct RetraceOptions
 
     bool                mMeasurePerFrame = false;
     bool                mMeasureSwapTime = false;
+    bool                mMeasureGpuTime = false;
+    bool                mPerFrameList = false;
     Profile             mApiVersion = PROFILE_ES2;
     Profile             mLocalApiVersion = PROFILE_ESX;
     bool                mSnapshotFrameNames = false;
@@ -83,6 +91,10 @@ struct RetraceOptions
     bool                mForceSingleWindow = false;
     bool                mMultiThread = false;
     bool                mCallStats = false;
+    unsigned int        mCallStatsSampleRate = 1; // time one in this many calls
+    unsigned int        mCallStatsRangeFrames = 0; // zero for no per frame range breakdown
+    bool                mNullDriver = false; // retrace against functions that do nothing, to measure the retracer itself
+    unsigned int        mNullDriverSampleRate = 16; // time the stages of one in this many calls
 
     bool                mPbufferRendering = false;
     int                 mSingleSurface = -1;
@@ -111,6 +123,9 @@ struct RetraceOptions
 #endif
 
     std::string         mCpuMask;
+    int                 mDecodeThreads = 0;
+    int                 mDecodeDepth = 4;
+    std::string         mDecodeCpuMask;
 
     bool                mRunAll = false;
     bool                dmaSharedMemory = false;
@@ -121,6 +136,8 @@ struct RetraceOptions
     std::string         mShaderCacheFile;
     bool                mShaderCacheLoad = true;
     bool                mCacheOnly = false;
+    unsigned int        mShaderWarmupThreads = 0; // compile the programs of the trace ahead of time on this many threads
+    bool                mStateOnly = false; // before the measured frames, only make calls that create or modify state
 
     bool                mCollectorEnabled = false;
     Json::Value         mCollectorValue;
@@ -16,8 +16,10 @@
 #include "helper/shadermod.hpp"
 
 #include "dispatch/eglproc_auto.hpp"
+#include "dispatch/eglproc_null.hpp"
 
 #include "common/image.hpp"
+#include "common/hash.hpp"
 #include "common/os_string.hpp"
 #include "common/pa_exception.h"
 #include "common/gl_extension_supported.hpp"
@@ -60,17 +62,6 @@ namespace retracer {
 
 Retracer gRetracer;
 
-static inline uint64_t gettime()
-{
-    struct timespec t;
-    // CLOCK_MONOTONIC_COARSE is much more light-weight, but resolution is quite poor.
-    // CLOCK_PROCESS_CPUTIME_ID is another possibility, it ignores rest of system, but costs more,
-    // and also on some CPUs process migration between cores can screw up such measurements.
-    // CLOCK_MONOTONIC is therefore a reasonable and portable compromise.
-    clock_gettime(CLOCK_MONOTONIC_RAW, &t);
-    return ((uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec);
-}
-
 /// -- Mali HWCPipe support
 
 struct mali_hwc
@@ -466,37 +457,38 @@ Retracer::~Retracer()
 
 bool Retracer::OpenTraceFile(const char* filename)
 {
+    mFile.setDecodeAhead(mOptions.mDecodeThreads, mOptions.mDecodeDepth, mOptions.mDecodeCpuMask);
+    mFile.setPreloadBudget(mOptions.mPreloadBudget);
+    mFile.setPinLimit(mOptions.mZeroCopyCSBLimit);
     if (!mFile.Open(filename))
         return false;
 
     mFileFormatVersion = mFile.getHeaderVersion();
     mStateLogger.open(std::string(filename) + ".retracelog");
     loadRetraceOptionsFromHeader();
+    if (mOptions.mNullDriver)
+    {
+        SetNullDriver(true);
+        mOptions.mPbufferRendering = true; // nothing is shown, so no window system is needed
+        mStageStats.init(mOptions.mNullDriverSampleRate);
+    }
     mFinish.store(false);
+    mHandover.reset();
     initializeCallCounter();
 
     return true;
 }
 
-__attribute__ ((noinline)) static int noop(int a)
-{
-    return a + 1;
-}
-
 void Retracer::CloseTraceFile()
 {
+    mCSBuffers.clear(); // may reference chunks of the file
     mFile.Close();
     mFileFormatVersion = INVALID_VERSION;
     mStateLogger.close();
     mState.Reset();
-    mCSBuffers.clear();
     mSnapshotPaths.clear();
 
-    if (shaderCacheFile)
-    {
-        fclose(shaderCacheFile);
-        shaderCacheFile = NULL;
-    }
+    shaderCache.close(shaderCacheVersionMD5);
 }
 
 bool Retracer::loadRetraceOptionsByThreadId(int tid)
@@ -750,6 +742,89 @@ void Retracer::StepShot(unsigned int callNo, unsigned int frameNo, const char *f
     }
 }
 
+// Snapshots taken from the retrace loop are timed, to tell how much they took from the measured frames
+void Retracer::timedSnapshot(unsigned int callNo, unsigned int frameNo)
+{
+    const int64_t pre = os::getTime();
+    TakeSnapshot(callNo, frameNo);
+    if (mCurFrameNo >= mOptions.mBeginMeasureFrame && mCurFrameNo < mOptions.mEndMeasureFrame)
+    {
+        mSnapshotTicks += os::getTime() - pre;
+        mSnapshotsMeasured++;
+    }
+}
+
+// Adds the hash of the image, and optionally of each tile of it, to the results instead of writing it
+void Retracer::hashSnapshot(image::Image *src, const std::string& name, unsigned int frameNo, unsigned int callNo)
+{
+    Json::Value entry;
+    entry["name"] = name;
+    entry["frame"] = frameNo;
+    entry["call"] = callNo;
+    entry["width"] = src->width;
+    entry["height"] = src->height;
+    entry["hash"] = common::hashToString(common::hash64(src->pixels, src->size()));
+    const unsigned tile = mOptions.mSnapshotHashTile;
+    if (tile > 0)
+    {
+        // Row by row from the top left, as the tiles appear in the image file
+        const unsigned stride = src->width * src->channels;
+        Json::Value tiles = Json::arrayValue;
+        for (unsigned y = 0; y < src->height; y += tile)
+        {
+            for (unsigned x = 0; x < src->width; x += tile)
+            {
+                const unsigned rowBytes = std::min(tile, src->width - x) * src->channels;
+                uint64_t hash = 0;
+                for (unsigned row = y; row < std::min(y + tile, src->height); row++)
+                {
+                    const unsigned line = src->flipped ? src->height - 1 - row : row;
+                    hash = common::hash64(src->pixels + line * stride + x * src->channels, rowBytes, hash);
+                }
+                tiles.append(common::hashToString(hash));
+            }
+        }
+        entry["tile_size"] = tile;
+        entry["tiles_x"] = (src->width + tile - 1) / tile;
+        entry["tiles"] = tiles;
+    }
+    DBG_LOG("Snapshot (frame %d, call %d) : %s hashed to %s\n", frameNo, callNo, name.c_str(), entry["hash"].asCString());
+    mSnapshotHashes.append(entry);
+    delete src;
+}
+
+// Takes ownership of the image
+void Retracer::saveSnapshot(image::Image *src, const std::string& filename, unsigned int frameNo, unsigned int callNo)
+{
+    if (mOptions.mSnapshotHash)
+    {
+        hashSnapshot(src, filename, frameNo, callNo);
+        return;
+    }
+    else if (mSnapshotWriter.running())
+    {
+        DBG_LOG("Snapshot (frame %d, call %d) : %s, queued\n", frameNo, callNo, filename.c_str());
+        mSnapshotWriter.write(src, filename);
+    }
+    else
+    {
+        const bool written = src->writePNG(filename.c_str());
+        delete src;
+        if (!written)
+        {
+            DBG_LOG("Failed to write snapshot : %s\n", filename.c_str());
+            return;
+        }
+        DBG_LOG("Snapshot (frame %d, call %d) : %s\n", frameNo, callNo, filename.c_str());
+    }
+
+    // Register the snapshot to be uploaded
+    if (mOptions.mUploadSnapshots)
+    {
+        mSnapshotPaths.push_back(filename);
+    }
+}
+
 void Retracer::TakeSnapshot(unsigned int callNo, unsigned int frameNo, const char *filename)
 {
     // Only take snapshots inside the measurement range
@@ -788,14 +863,6 @@ void Retracer::TakeSnapshot(unsigned int callNo, unsigned int frameNo, const cha
             else {
                 _glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFboId);
             }
-            image::Image *src = getDrawBufferImage(colorAttachment);
-            _glBindFramebuffer(GL_READ_FRAMEBUFFER, readFboId);
-            _glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFboId);
-            if (src == NULL)
-            {
-                DBG_LOG("Failed to take snapshot for call no: %d\n", callNo);
-                return;
-            }
 
             std::string filenameToBeUsed;
             if (filename)
@@ -823,22 +890,27 @@ void Retracer::TakeSnapshot(unsigned int callNo, unsigned int frameNo, const cha
                 filenameToBeUsed = ss.str();
             }
 
-            if (src->writePNG(filenameToBeUsed.c_str()))
+            // Without waiting for the GPU if we can, else the slow way
+            const bool started = mSnapshotWriter.running() && hasCurrentContext() && getCurrentContext()._profile >= PROFILE_ES3
+                                 && mSnapshotReadback.read(colorAttachment, filenameToBeUsed, frameNo);
+            image::Image *src = started ? NULL : getDrawBufferImage(colorAttachment);
+            _glBindFramebuffer(GL_READ_FRAMEBUFFER, readFboId);
+            _glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFboId);
+            if (started)
             {
-                DBG_LOG("Snapshot (frame %d, call %d) : %s\n", frameNo, callNo, filenameToBeUsed.c_str());
-
-                // Register the snapshot to be uploaded
+                DBG_LOG("Snapshot (frame %d, call %d) : %s, reading back\n", frameNo, callNo, filenameToBeUsed.c_str());
                 if (mOptions.mUploadSnapshots)
                 {
                     mSnapshotPaths.push_back(filenameToBeUsed);
                 }
+                continue;
             }
-            else
+            if (src == NULL)
             {
-                DBG_LOG("Failed to write snapshot : %s\n", filenameToBeUsed.c_str());
+                DBG_LOG("Failed to take snapshot for call no: %d\n", callNo);
+                return;
             }
-
-            delete src;
+            saveSnapshot(src, filenameToBeUsed, frameNo, callNo);
         }
     }
     if (!colorAttach)   // no color attachment, there might be a depth attachment
@@ -887,22 +959,7 @@ void Retracer::TakeSnapshot(unsigned int callNo, unsigned int frameNo, const cha
             filenameToBeUsed = ss.str();
         }
 
-        if (src->writePNG(filenameToBeUsed.c_str()))
-        {
-            DBG_LOG("Snapshot (frame %d, call %d) : %s\n", frameNo, callNo, filenameToBeUsed.c_str());
-
-            // Register the snapshot to be uploaded
-            if (mOptions.mUploadSnapshots)
-            {
-                mSnapshotPaths.push_back(filenameToBeUsed);
-            }
-        }
-        else
-        {
-            DBG_LOG("Failed to write snapshot : %s\n", filenameToBeUsed.c_str());
-        }
-
-        delete src;
+        saveSnapshot(src, filenameToBeUsed, frameNo, callNo);
     }
 
     std::vector<Texture> textures = getTexturesToDump();
@@ -1198,61 +1255,111 @@ void Retracer::perfMonInit()
     delayedPerfmonInit = false;
 }
 
-// Only one thread runs at a time, so no need for mutexing etc. except for when we go to sleep.
+// Only one thread runs at a time, so no need for mutexing etc. The turn is passed on with mHandover.
 void Retracer::RetraceThread(const int threadidx, const int our_tid)
 {
-    std::unique_lock<std::mutex> lk(mConditionMutex);
     thread_result r;
     r.our_tid = our_tid;
-    unsigned int skip_fence_range_index = 0;
+
+    if (threadidx != 0 && !waitForTurn(threadidx, r)) // the first thread starts with the turn
+    {
+        results[threadidx] = r;
+        return;
+    }
 
     while (!mFinish.load(std::memory_order_consume))
     {
-        const bool isSwapBuffers = swapvals[mCurCall.funcId];
+        // Most calls need nothing but the call itself
+        const uint32_t actions = mSchedule.actions(mCurCall.funcId, mFile.curCallNo);
+        if (actions == 0)
+        {
+            (*(RetraceFunc)fptr)(src);
+            r.total++;
+            goto skip_call;
+        }
 
-        if (mOptions.mSnapshotCallSet && (mOptions.mSnapshotCallSet->contains(mCurFrameNo, mFile.ExIdToName(mCurCall.funcId))) && isSwapBuffers)
         {
-            TakeSnapshot(mFile.curCallNo - 1, mCurFrameNo);
+        const bool isSwapBuffers = actions & ActionSchedule::ACTION_SWAP;
+
+        if (isSwapBuffers && mOptions.mSnapshotCallSet && mOptions.mSnapshotCallSet->contains(mCurFrameNo, mFile.ExIdToName(mCurCall.funcId)))
+        {
+            timedSnapshot(mFile.curCallNo - 1, mCurFrameNo);
         }
 
         if (fptr)
         {
             r.total++;
-            if (isSwapBuffers)
+            // call glFinish() before eglSwapbuffers in every frame when mFinishBeforeSwap is true or in frame#0 of a FF trace
+            if (isSwapBuffers && !(actions & ActionSchedule::ACTION_RENDER_SKIP) && (mOptions.mFinishBeforeSwap || (mCurFrameNo == 0 && mFile.isFFTrace())))
+            {
+                _glFinish();
+            }
+
+            if (mOptions.mDebug > 1) DBG_LOG("    %s: t%d, c%d, f%d \n", mFile.ExIdToName(mCurCall.funcId), our_tid, mFile.curCallNo, mCurFrameNo);
+
+            if (actions & ActionSchedule::ACTION_TIMER_QUERY)
             {
-                // call glFinish() before eglSwapbuffers in every frame when mFinishBeforeSwap is true or in frame#0 of a FF trace
-                if (mOptions.mFinishBeforeSwap || (mCurFrameNo == 0 && mFile.isFFTrace()))
+                int target = 0;
+                common::PeekFixed(src, target);
+                if (target == GL_TIME_ELAPSED_EXT)
                 {
-                    _glFinish();
+                    mGpuFrameTimer.stopForTraceQueries();
                 }
+            }
 
-                if (mOptions.mSkipFence && ((mCurFrameNo + 1) > mOptions.mSkipFenceRanges[skip_fence_range_index].second))
+            if (actions & ActionSchedule::ACTION_SKIP_FENCE)
+            {
+                if (mOptions.mDebug) DBG_LOG("    FENCE SKIP : function name: %s (id: %d), call no: %d\n", mFile.ExIdToName(mCurCall.funcId), mCurCall.funcId, mFile.curCallNo);
+            }
+            else if (actions & ActionSchedule::ACTION_RENDER_SKIP)
+            {
+                if (isSwapBuffers)
                 {
-                    skip_fence_range_index += 1;
-
-                    if (skip_fence_range_index >= mOptions.mSkipFenceRanges.size())
+                    // Count the frame without showing it, as swapBuffersCommon() would
+                    OnFrameComplete();
+                    if (mState.mThreadArr[getCurTid()].getDrawable())
                     {
-                        mOptions.mSkipFence = false;
+                        OnNewFrame();
+                    }
+                    else
+                    {
+                        DBG_LOG("WARNING: no drawable for tid=%u when skipping swap at call=%u\n", getCurTid(), GetCurCallId());
                     }
                 }
             }
-
-            if (mOptions.mDebug > 1) DBG_LOG("    %s: t%d, c%d, f%d \n", mFile.ExIdToName(mCurCall.funcId), our_tid, mFile.curCallNo, mCurFrameNo);
-
-            if (mOptions.mSkipFence && syncvals[mCurCall.funcId] && (mCurFrameNo >= mOptions.mSkipFenceRanges[skip_fence_range_index].first) && (mCurFrameNo <= mOptions.mSkipFenceRanges[skip_fence_range_index].second))
+            else if (actions & ActionSchedule::ACTION_CALL_STATS)
             {
-                if (mOptions.mDebug) DBG_LOG("    FENCE SKIP : function name: %s (id: %d), call no: %d\n", mFile.ExIdToName(mCurCall.funcId), mCurCall.funcId, mFile.curCallNo);
+                if (mCallStats.sample())
+                {
+                    const uint64_t pre = CallClock::now();
+                    (*(RetraceFunc)fptr)(src);
+                    mCallStats.add(mCurCall.funcId, CallClock::now() - pre);
+                }
+                else
+                {
+                    (*(RetraceFunc)fptr)(src);
+                    mCallStats.count(mCurCall.funcId);
+                }
             }
-            else if (mOptions.mCallStats && mCurFrameNo >= mOptions.mBeginMeasureFrame && mCurFrameNo < mOptions.mEndMeasureFrame)
+            else if (actions & ActionSchedule::ACTION_NULL_DRIVER)
             {
-                const char *funcName = mFile.ExIdToName(mCurCall.funcId);
-                uint64_t pre = gettime();
-                (*(RetraceFunc)fptr)(src);
-                uint64_t post = gettime();
-                mCallStats[funcName].count++;
-                mCallStats[funcName].time += post - pre;
+                if (mStageStats.sample())
+                {
+                    gNullDriverProbe.decoded = 0;
+                    gNullDriverProbe.enter = 0;
+                    gNullDriverProbe.armed = true;
+                    const uint64_t pre = CallClock::now();
+                    (*(RetraceFunc)fptr)(src);
+                    const uint64_t post = CallClock::now();
+                    gNullDriverProbe.armed = false;
+                    mStageStats.addCall(pre, gNullDriverProbe.decoded, gNullDriverProbe.enter, gNullDriverProbe.leave, post);
+                }
+                else
+                {
+                    (*(RetraceFunc)fptr)(src);
+                }
             }
-            else if (!mOptions.mCacheOnly || cachevals[mCurCall.funcId])
+            else if (!(actions & ActionSchedule::ACTION_CACHE_SKIP))
             {
                 (*(RetraceFunc)fptr)(src);
             }
@@ -1273,8 +1380,24 @@ void Retracer::RetraceThread(const int threadidx, const int our_tid)
             DBG_LOG("    Unsupported function : %s, call no: %d\n", mFile.ExIdToName(mCurCall.funcId), mFile.curCallNo);
         }
 
+        if (actions & ActionSchedule::ACTION_SNAPSHOT)
+        {
+            if (!isSwapBuffers && mOptions.mSnapshotCallSet->contains(mFile.curCallNo, mFile.ExIdToName(mCurCall.funcId)))
+            {
+                timedSnapshot(mFile.curCallNo, mCurFrameNo);
+            }
+            mSchedule.snapshotChecked(mFile.curCallNo);
+        }
+
         if (isSwapBuffers)
         {
+            if (mSnapshotReadback.pending())
+            {
+                const int64_t pre = os::getTime();
+                mSnapshotReadback.collect(mCurFrameNo, false);
+                if (mCurFrameNo >= mOptions.mBeginMeasureFrame && mCurFrameNo < mOptions.mEndMeasureFrame) mSnapshotTicks += os::getTime() - pre;
+            }
+
             if (mOptions.mPerfStart == (int)mCurFrameNo) // before perf frame
             {
                 PerfStart();
@@ -1307,8 +1430,10 @@ void Retracer::RetraceThread(const int threadidx, const int our_tid)
                     fclose(fp);
                 }
                 const double f = 1024.0 * 1024.0;
-                DBG_LOG("Frame %d memory (mb): %.02f max RSS, %.02f current RSS, %.02f available, %u client side memory, %.02f loaded file data\n",
-                        mCurFrameNo, (double)usage.ru_maxrss / 1024.0, (double)curr_rss / f, (double)available / f, mClientSideMemoryDataSize, (double)mFile.memoryUsed() / f);
+                const ChunkPool::Stats pool = mFile.getChunkPoolStats();
+                DBG_LOG("Frame %d memory (mb): %.02f max RSS, %.02f current RSS, %.02f available, %u client side memory, %.02f loaded file data (%u chunks in use, %u slabs, %u allocations)\n",
+                        mCurFrameNo, (double)usage.ru_maxrss / 1024.0, (double)curr_rss / f, (double)available / f, mClientSideMemoryDataSize, (double)mFile.memoryUsed() / f,
+                        (unsigned)pool.buffers, (unsigned)pool.slabs, (unsigned)pool.allocations);
             }
 
             const int secs = (os::getTime() - mTimerBeginTime) / os::timeFrequency;
@@ -1317,9 +1442,18 @@ void Retracer::RetraceThread(const int threadidx, const int our_tid)
                 DBG_LOG("Executing rollback %d / %d times - %d / %d secs\n", mLoopTimes, mOptions.mLoopTimes, secs, mOptions.mLoopSeconds);
                 if (mCollectors) mCollectors->summarize();
                 mFile.rollback();
+                if (mPredecodeRecording || mPredecodeReplay)
+                {
+                    if (mPredecodeRecording) DBG_LOG("Replaying %u pre-decoded calls from now on\n", (unsigned)mPredecoded.size());
+                    mPredecodeRecording = false;
+                    mPredecodeReplay = true;
+                    mPredecodedNext = 0;
+                }
                 unsigned numOfFrames = mCurFrameNo - mOptions.mBeginMeasureFrame;
                 mCurFrameNo = mOptions.mBeginMeasureFrame;
+                if (mOptions.mCallStats) mCallStats.setFrame(mCurFrameNo);
                 mFile.curCallNo = mRollbackCallNo;
+                mSchedule.setCall(mFile.curCallNo);
                 int64_t endTime;
                 const float duration = getDuration(mLoopBeginTime, &endTime);
                 const float fps = ((double)numOfFrames) / duration;
@@ -1327,28 +1461,29 @@ void Retracer::RetraceThread(const int threadidx, const int our_tid)
                 mLoopBeginTime = os::getTime();
                 mLoopTimes++;
             }
-        }
-        else if (mOptions.mSnapshotCallSet && (mOptions.mSnapshotCallSet->contains(mFile.curCallNo, mFile.ExIdToName(mCurCall.funcId))))
-        {
-            TakeSnapshot(mFile.curCallNo, mCurFrameNo);
+            mSchedule.setFrame(mCurFrameNo);
         }
 
-        while (frameBudget <= 0 && drawBudget <= 0) // Step mode
+        if (actions & ActionSchedule::ACTION_STEP)
         {
-            frameBudget = 0;
-            drawBudget = 0;
-            StepShot(mFile.curCallNo, mCurFrameNo);
-            GLWS::instance().processStepEvent(); // will wait here for user input to increase budgets
+            while (frameBudget <= 0 && drawBudget <= 0) // Step mode
+            {
+                frameBudget = 0;
+                drawBudget = 0;
+                StepShot(mFile.curCallNo, mCurFrameNo);
+                GLWS::instance().processStepEvent(); // will wait here for user input to increase budgets
+            }
+        }
         }
 
         // ---------------------------------------------------------------------------
         // Get next call
 skip_call:
 
-        if (!mFile.GetNextCall(fptr, mCurCall, src))
+        if (!(mOptions.mNullDriver ? nextCallTimed(r) : mPredecodeReplay ? nextPredecodedCall(r) : mFile.GetNextCall(fptr, mCurCall, src)))
         {
             mFinish.store(true);
-            for (auto &cv : conditions) cv.notify_one(); // Wake up all other threads
+            mHandover.stopAll(); // Wake up all other threads
             break;
         }
         // Skip call because it is on an ignored thread?
@@ -1357,35 +1492,219 @@ skip_call:
             r.skipped++;
             goto skip_call;
         }
+        if (mPredecodeRecording)
+        {
+            recordPredecodedCall();
+        }
         // Need to switch active thread?
         if (our_tid != mCurCall.tid)
         {
-            latest_call_tid = mCurCall.tid; // need to use an atomic member copy of this here
+            int otheridx;
             // Do we need to make this thread?
             if (thread_remapping.count(mCurCall.tid) == 0)
             {
-                thread_remapping[mCurCall.tid] = threads.size();
-                int newthreadidx = threads.size();
-                conditions.emplace_back();
+                otheridx = threads.size();
+                thread_remapping[mCurCall.tid] = otheridx;
                 results.emplace_back();
-                threads.emplace_back(&Retracer::RetraceThread, this, (int)newthreadidx, (int)mCurCall.tid);
+                threads.emplace_back(&Retracer::RetraceThread, this, otheridx, (int)mCurCall.tid);
             }
-            else // Wake up existing thread
+            else
             {
-                const int otheridx = thread_remapping.at(mCurCall.tid);
-                conditions.at(otheridx).notify_one();
+                otheridx = thread_remapping.at(mCurCall.tid);
             }
             r.handovers++;
-            bool success = false;
-            do {
-                success = conditions.at(threadidx).wait_for(lk, std::chrono::milliseconds(50), [&]{ return our_tid == latest_call_tid || mFinish.load(std::memory_order_consume); });
-                if (!success) r.timeouts++; else r.wakeups++;
-            } while (!success);
+            mHandover.give(otheridx); // from here on, the other thread owns everything
+            if (!waitForTurn(threadidx, r))
+            {
+                break;
+            }
         }
     }
     results[threadidx] = r;
 }
 
+// The measured frame range is recorded as it is played the first time, and replayed from the
+// recording on every loop after that. This is only safe if the trace file keeps all its chunks.
+void Retracer::startPredecoding()
+{
+    if (mOptions.mLoopTimes == 0 && mOptions.mLoopSeconds == 0)
+    {
+        return;
+    }
+    if (!mFile.keepsAllChunks())
+    {
+        DBG_LOG("Pre-decoding needs the trace file to keep all chunks of the frame range - not pre-decoding\n");
+        return;
+    }
+    if (mFile.getPreloadStats().mode != InFile::PRELOAD_DECOMPRESSED)
+    {
+        DBG_LOG("Pre-decoding needs the frame range to be preloaded decompressed - not pre-decoding\n");
+        return;
+    }
+    mPredecoded.clear();
+    mPredecodeRecording = true;
+}
+
+void Retracer::recordPredecodedCall()
+{
+    PredecodedCall c;
+    c.fptr = fptr;
+    c.src = src;
+    c.call = mCurCall;
+    c.callNo = mFile.curCallNo;
+    c.flags = 0;
+    // Calls that switch threads, and calls with scheduled actions, go the long way. The recorded
+    // frames are the same on every loop, and so are their actions.
+    if (mSchedule.actions(mCurCall.funcId, mFile.curCallNo) == 0 && !mPredecoded.empty() && mPredecoded.back().call.tid == mCurCall.tid)
+    {
+        c.flags |= PREDECODED_INLINE;
+    }
+    mPredecoded.push_back(c);
+}
+
+// Run pre-decoded calls that need no bookkeeping right here, and return the first one that does
+bool Retracer::nextPredecodedCall(thread_result& r)
+{
+    while (mPredecodedNext < mPredecoded.size())
+    {
+        const PredecodedCall& c = mPredecoded[mPredecodedNext++];
+        mCurCall = c.call;
+        fptr = c.fptr;
+        src = c.src;
+        mFile.curCallNo = c.callNo;
+        if (!(c.flags & PREDECODED_INLINE))
+        {
+            return true;
+        }
+        (*(RetraceFunc)fptr)(src);
+        r.total++;
+    }
+    return false;
+}
+
+// Get the next call like the retrace loop does, but count the bytes decoded, and time it when sampled
+bool Retracer::nextCallTimed(thread_result& r)
+{
+    const bool measuring = mCurFrameNo >= mOptions.mBeginMeasureFrame && mCurFrameNo < mOptions.mEndMeasureFrame;
+    const bool timed = measuring && mStageStats.sample();
+    const uint64_t pre = timed ? CallClock::now() : 0;
+    if (!(mPredecodeReplay ? nextPredecodedCall(r) : mFile.GetNextCall(fptr, mCurCall, src)))
+    {
+        return false;
+    }
+    if (timed)
+    {
+        mStageStats.addDecode(mFile.getCallSize(mCurCall), CallClock::now() - pre);
+    }
+    else if (measuring)
+    {
+        mStageStats.addDecode(mFile.getCallSize(mCurCall));
+    }
+    return true;
+}
+
+bool Retracer::waitForTurn(int threadidx, thread_result& r)
+{
+    // Time out regularly, since mFinish may be set from the window system without waking us
+    const ThreadHandover::WaitResult wait = mHandover.wait(threadidx, mFinish, 50);
+    r.timeouts += wait.timeouts;
+    if (wait.stopped)
+    {
+        return false;
+    }
+    r.wakeups++;
+    r.sleeps += (int)wait.slept;
+    r.handover_latency.add(wait.latency);
+    return true;
+}
+
+// Compile the options into what needs doing for which calls, so that the retrace loop does not have
+// to check them for every call
+void Retracer::initSchedule()
+{
+    const unsigned funcs = mFile.getMaxSigId() + 1;
+    const unsigned allFrames = ~0u;
+    mSchedule.init(funcs);
+    const auto addByName = [this](const char* name, uint32_t actions)
+    {
+        const unsigned id = mFile.NameToExId(name);
+        if (id != 0) mSchedule.addFunction(id, actions); // not in the trace
+    };
+
+    addByName("eglSwapBuffers", ActionSchedule::ACTION_SWAP);
+    addByName("eglSwapBuffersWithDamageKHR", ActionSchedule::ACTION_SWAP);
+    mSchedule.addFrames(0, allFrames, ActionSchedule::ACTION_SWAP);
+    for (unsigned id = 0; id < funcs; id++)
+    {
+        if (!mFile.getFuncPtr(id)) mSchedule.addFunction(id, ActionSchedule::ACTION_UNSUPPORTED);
+    }
+    mSchedule.addFrames(0, allFrames, ActionSchedule::ACTION_UNSUPPORTED);
+
+    if (mOptions.mSkipFence)
+    {
+        for (const char* name : { "eglClientWaitSync", "eglClientWaitSyncKHR", "eglWaitSync", "eglWaitSyncKHR", "glWaitSync", "glClientWaitSync" })
+        {
+            addByName(name, ActionSchedule::ACTION_SKIP_FENCE);
+        }
+        for (const auto& range : mOptions.mSkipFenceRanges)
+        {
+            mSchedule.addFrames(range.first, range.second, ActionSchedule::ACTION_SKIP_FENCE);
+        }
+    }
+
+    const uint32_t measured = (mOptions.mCallStats ? ActionSchedule::ACTION_CALL_STATS : 0) | (mOptions.mNullDriver ? ActionSchedule::ACTION_NULL_DRIVER : 0);
+    if (measured && mOptions.mEndMeasureFrame > mOptions.mBeginMeasureFrame)
+    {
+        mSchedule.addAllFunctions(measured);
+        mSchedule.addFrames(mOptions.mBeginMeasureFrame, mOptions.mEndMeasureFrame - 1, measured);
+    }
+
+    if (mOptions.mCacheOnly)
+    {
+        // Only what it takes to build the programs
+        for (const auto& s : mFile.getFuncNames())
+        {
+            if (!(s.find("Uniform") != string::npos || s.find("Attrib") != string::npos || s.find("Shader") != string::npos || s.find("Program") != string::npos || (s[0] == 'e' && s[1] == 'g' && s[2] == 'l')
+                || s.find("Feedback") != string::npos || s.find("Buffer") != string::npos))
+            {
+                addByName(s.c_str(), ActionSchedule::ACTION_CACHE_SKIP);
+            }
+        }
+        mSchedule.addFrames(0, allFrames, ActionSchedule::ACTION_CACHE_SKIP);
+    }
+
+    if (mOptions.mStateOnly && mOptions.mBeginMeasureFrame > 0)
+    {
+        // Draws, clears and swaps have nothing to show before the measured frames
+        for (const std::set<std::string>* calls : { &gles_render_calls, &egl_render_calls })
+        {
+            for (const std::string& name : *calls)
+            {
+                addByName(name.c_str(), ActionSchedule::ACTION_RENDER_SKIP);
+            }
+        }
+        mSchedule.addFrames(0, mOptions.mBeginMeasureFrame - 1, ActionSchedule::ACTION_RENDER_SKIP);
+    }
+
+    if (mOptions.mMeasureGpuTime && !mOptions.mMultiThread)
+    {
+        addByName("glBeginQuery", ActionSchedule::ACTION_TIMER_QUERY);
+        addByName("glBeginQueryEXT", ActionSchedule::ACTION_TIMER_QUERY);
+        mSchedule.addFrames(0, allFrames, ActionSchedule::ACTION_TIMER_QUERY);
+    }
+
+    const uint32_t always = (mOptions.mDebug ? ActionSchedule::ACTION_DEBUG : 0) | (mOptions.mStepMode ? ActionSchedule::ACTION_STEP : 0);
+    if (always)
+    {
+        mSchedule.addAllFunctions(always);
+        mSchedule.addFrames(0, allFrames, always);
+    }
+
+    mSchedule.setSnapshotCalls(mOptions.mSnapshotCallSet);
+    mSchedule.setFrame(mCurFrameNo);
+    mSchedule.setCall(mFile.curCallNo);
+}
+
 void Retracer::Retrace()
 {
     if (!mOptions.mCpuMask.empty()) set_cpu_mask(mOptions.mCpuMask);
@@ -1397,35 +1716,35 @@ void Retracer::Retrace()
         if (gRetracer.mOptions.mShaderCacheLoad)
             OpenShaderCacheFile();
         else
-            DeleteShaderCacheFile();
+            CreateShaderCacheFile();
+    }
+    mLoadProgramBinaries = mOptions.mShaderCacheFile.size() > 0 && mOptions.mShaderCacheLoad;
+    if (mOptions.mShaderWarmupThreads > 0)
+    {
+        if (mOptions.mNullDriver || mOptions.mStoreProgramInformation || mOptions.mRemoveUnusedVertexAttributes)
+        {
+            DBG_LOG("Shader warm-up cannot be used with the null driver or with options that modify or inspect programs\n");
+        }
+        else if (mShaderWarmup.scan(mOptions.mFileName, mOptions.mEndMeasureFrame, mOptions.mMultiThread ? -1 : mOptions.mRetraceTid) > 0
+                 && mShaderWarmup.start(mOptions.mShaderWarmupThreads, mOptions.mApiVersion))
+        {
+            mLoadProgramBinaries = true;
+        }
     }
 
-    mFile.setFrameRange(mOptions.mBeginMeasureFrame, mOptions.mEndMeasureFrame, mOptions.mMultiThread ? -1 : mOptions.mRetraceTid, mOptions.mPreload, mOptions.mLoopTimes != 0);
+    mFile.setFrameRange(mOptions.mBeginMeasureFrame, mOptions.mEndMeasureFrame, mOptions.mMultiThread ? -1 : mOptions.mRetraceTid, mOptions.mPreload, mOptions.mLoopTimes != 0 || mOptions.mLoopSeconds != 0);
 
     mInitTime = os::getTime();
     mInitTimeMono = os::getTimeType(CLOCK_MONOTONIC);
     mInitTimeMonoRaw = os::getTimeType(CLOCK_MONOTONIC_RAW);
     mInitTimeBoot = os::getTimeType(CLOCK_BOOTTIME);
 
-    swapvals.resize(mFile.getMaxSigId());
-    swapvals[mFile.NameToExId("eglSwapBuffers")] = true;
-    swapvals[mFile.NameToExId("eglSwapBuffersWithDamageKHR")] = true;
-    cachevals.resize(mFile.getMaxSigId());
-    for (const auto& s : mFile.getFuncNames())
+    initSchedule();
+    if (mOptions.mCallStats && !mCallStats.init(std::max<unsigned>(mFile.getMaxSigId(), mFile.getFuncNames().size()), mOptions.mCallStatsSampleRate,
+                                                 mOptions.mCallStatsRangeFrames, mOptions.mBeginMeasureFrame))
     {
-        if (s.find("Uniform") != string::npos || s.find("Attrib") != string::npos || s.find("Shader") != string::npos || s.find("Program") != string::npos || (s[0] == 'e' && s[1] == 'g' && s[2] == 'l')
-            || s.find("Feedback") != string::npos || s.find("Buffer") != string::npos)
-        {
-            cachevals[mFile.NameToExId(s.c_str())] = true;
-        }
+        reportAndAbort("Bad call statistics options\n");
     }
-    syncvals.resize(mFile.getMaxSigId());
-    syncvals[mFile.NameToExId("eglClientWaitSync")] = true;
-    syncvals[mFile.NameToExId("eglClientWaitSyncKHR")] = true;
-    syncvals[mFile.NameToExId("eglWaitSync")] = true;
-    syncvals[mFile.NameToExId("eglWaitSyncKHR")] = true;
-    syncvals[mFile.NameToExId("glWaitSync")] = true;
-    syncvals[mFile.NameToExId("glClientWaitSync")] = true;
 
     if (mOptions.mScriptFrame == 0 && mOptions.mScriptPath.size() > 0)
     {
@@ -1447,7 +1766,6 @@ void Retracer::Retrace()
         }
     } while (!mOptions.mMultiThread && mCurCall.tid != mOptions.mRetraceTid);
     threads.resize(1);
-    conditions.resize(1);
     results.resize(1);
     thread_remapping[mCurCall.tid] = 0;
     results[0].our_tid = mCurCall.tid;
@@ -1456,6 +1774,10 @@ void Retracer::Retrace()
         mMaxDuration = 1.0/mOptions.mFixedFps;
         mFixedFpsOldTime = os::getTime();
     }
+    if (mOptions.mSnapshotThreads > 0 && mOptions.mSnapshotCallSet && !mOptions.mSnapshotHash)
+    {
+        mSnapshotWriter.start(mOptions.mSnapshotThreads);
+    }
     RetraceThread(0, mCurCall.tid); // run the first thread on this thread
 
     for (std::thread &t : threads)
@@ -1475,6 +1797,19 @@ void Retracer::Retrace()
                                      gRetracer.mState.mThreadArr[gRetracer.getCurTid()].getContext());
         _glFinish();
     }
+
+    mSnapshotReadback.collect(mCurFrameNo, true);
+    if (mSnapshotReadback.pending())
+    {
+        DBG_LOG("%u snapshots were left unread on another context\n", (unsigned)mSnapshotReadback.pending());
+    }
+    mSnapshotWriter.stop();
+    mShaderWarmup.stop();
+
+    if (shaderCache.saving() && !shaderCache.close(shaderCacheVersionMD5))
+    {
+        reportAndAbort("Failed to write shader cache %s.cache", mOptions.mShaderCacheFile.c_str());
+    }
 }
 
 void Retracer::CheckGlError()
@@ -1492,9 +1827,13 @@ void Retracer::OnFrameComplete()
     if (getCurTid() == mOptions.mRetraceTid || mOptions.mMultiThread)
     {
         // Per frame measurement
-        if (mOptions.mMeasureSwapTime && mEndFrameTime)
+        if (mOptions.mMeasurePerFrame && mEndFrameTime && mCurFrameNo >= mOptions.mBeginMeasureFrame && mCurFrameNo < mOptions.mEndMeasureFrame)
         {
-            getDuration(mEndFrameTime, &mFinishSwapTime);
+            mGpuFrameTimer.endFrame();
+            if (mOptions.mMeasureSwapTime)
+            {
+                mFinishSwapTime = os::getTime();
+            }
         }
     }
 }
@@ -1510,12 +1849,29 @@ void Retracer::StartMeasuring()
         mCollectors->start();
     }
     mRollbackCallNo = mFile.curCallNo;
+    if (mOptions.mCallStats) mCallStats.start();
+    if (mOptions.mNullDriver) mStageStats.start();
+    if (mOptions.mPredecode)
+    {
+        startPredecoding();
+    }
     DBG_LOG("================== Start timer (Frame: %u) ==================\n", mCurFrameNo);
     mTimerBeginTime = mLoopBeginTime = os::getTime();
     mTimerBeginTimeMono = os::getTimeType(CLOCK_MONOTONIC);
     mTimerBeginTimeMonoRaw = os::getTimeType(CLOCK_MONOTONIC_RAW);
     mTimerBeginTimeBoot = os::getTimeType(CLOCK_BOOTTIME);
     mEndFrameTime = mTimerBeginTime;
+    if (mOptions.mMeasurePerFrame)
+    {
+        const bool looping = mOptions.mLoopTimes > 0 || mOptions.mLoopSeconds > 0;
+        mFrameTimeline.reset(looping ? FrameTimeline::MAX_FRAMES : mOptions.mEndMeasureFrame - mOptions.mBeginMeasureFrame);
+        mFinishSwapTime = 0;
+        // Only one context can be followed, so not with several threads
+        if (mOptions.mMeasureGpuTime && !mOptions.mMultiThread && mGpuFrameTimer.init())
+        {
+            mGpuFrameTimer.beginFrame(mFrameTimeline);
+        }
+    }
 }
 
 void Retracer::OnNewFrame()
@@ -1523,9 +1879,16 @@ void Retracer::OnNewFrame()
     if (getCurTid() == mOptions.mRetraceTid || mOptions.mMultiThread)
     {
         IncCurFrameId();
+        if (mOptions.mCallStats && mOptions.mCallStatsRangeFrames) mCallStats.setFrame(mCurFrameNo);
 
         if (mCurFrameNo == mOptions.mBeginMeasureFrame)
         {
+            if (mShaderWarmup.running())
+            {
+                // Keep the workers off the other cores while measuring
+                mShaderWarmup.finish();
+                DBG_LOG("Waited %.3f s for the shader warm-up to finish before measuring\n", ticksToSeconds(mShaderWarmup.getStats().finishTicks));
+            }
             if (mOptions.mFlushWork)
             {
                 // First try to flush all the work we can
@@ -1544,10 +1907,22 @@ void Retracer::OnNewFrame()
         // Per frame measurement
         if (mCurFrameNo > mOptions.mBeginMeasureFrame && mCurFrameNo <= mOptions.mEndMeasureFrame)
         {
+            if (mOptions.mMeasurePerFrame)
+            {
+                const int64_t now = os::getTime();
+                mFrameTimeline.add(mCurFrameNo - 1, now - mEndFrameTime, mFinishSwapTime ? now - mFinishSwapTime : -1);
+                mEndFrameTime = now;
+                mFinishSwapTime = 0;
+                mGpuFrameTimer.beginFrame(mFrameTimeline);
+            }
             if (mOptions.mInstrumentationDelay > 0) {
                 usleep(mOptions.mInstrumentationDelay);
             }
             if (mCollectors) mCollectors->collect();
+            if (mOptions.mMeasurePerFrame && (mOptions.mInstrumentationDelay > 0 || mCollectors))
+            {
+                mEndFrameTime = os::getTime(); // leave the instrumentation out of the next frame
+            }
         }
         if (mOptions.mFixedFps != 0) //Limited fps replay mode
         {
@@ -1782,6 +2157,76 @@ void Retracer::saveResult(Json::Value& result)
     result["start_time_boot"] = ((double)mTimerBeginTimeBoot) / os::timeFrequency;
     result["end_time_boot"] = ((double)endTimeBoot) / os::timeFrequency;
     result["patrace_version"] = PATRACE_VERSION;
+    if (mOptions.mDecodeThreads > 0)
+    {
+        const InFile::DecodeStats stats = mFile.getDecodeStats();
+        Json::Value decode;
+        decode["threads"] = stats.threads;
+        decode["depth"] = stats.depth;
+        decode["chunks"] = (Json::Value::UInt64)stats.chunks;
+        decode["consumer_waits"] = (Json::Value::UInt64)stats.waits;
+        decode["consumer_wait_time"] = ((double)stats.waitTime) / os::timeFrequency;
+        result["decode_ahead"] = decode;
+    }
+    if (mOptions.mMultiThread)
+    {
+        Json::Value handovers(Json::arrayValue);
+        for (const thread_result& r : results)
+        {
+            Json::Value thread;
+            thread["tid"] = r.our_tid;
+            thread["calls"] = r.total;
+            thread["handovers"] = r.handovers;
+            thread["sleeps"] = r.sleeps;
+            thread["timeouts"] = r.timeouts;
+            // Bucket i counts handovers taking less than 2^i microseconds, the last one all longer
+            Json::Value latency(Json::arrayValue);
+            for (int i = 0; i < HandoverHistogram::BUCKETS; i++)
+            {
+                latency.append((Json::Value::UInt64)r.handover_latency.counts[i]);
+            }
+            thread["handover_latency_log2_us"] = latency;
+            handovers.append(thread);
+        }
+        result["threads"] = handovers;
+    }
+    if (mOptions.mPreload)
+    {
+        const InFile::PreloadStats stats = mFile.getPreloadStats();
+        Json::Value preload;
+        preload["mode"] = InFile::preloadModeName(stats.mode);
+        preload["budget"] = (Json::Value::UInt64)stats.budget;
+        preload["chunks"] = (Json::Value::UInt64)stats.chunks;
+        preload["compressed_bytes"] = (Json::Value::UInt64)stats.compressedBytes;
+        preload["uncompressed_bytes"] = (Json::Value::UInt64)stats.uncompressedBytes;
+        preload["peak_bytes"] = (Json::Value::UInt64)stats.peakBytes;
+        result["preload"] = preload;
+    }
+    if (mOptions.mZeroCopyCSBLimit)
+    {
+        const InFile::PinStats stats = mFile.getPinStats();
+        Json::Value csb;
+        csb["referenced_bytes"] = (Json::Value::UInt64)mCSBReferencedBytes;
+        csb["copied_bytes"] = (Json::Value::UInt64)mCSBCopiedBytes;
+        csb["pinned_chunks"] = (Json::Value::UInt64)stats.pins;
+        csb["refused_pins"] = (Json::Value::UInt64)stats.refused;
+        csb["peak_held_bytes"] = (Json::Value::UInt64)stats.peakHeldBytes;
+        result["zero_copy_csb"] = csb;
+    }
+    if (mOptions.mMeasurePerFrame && mTimerBeginTime != 0)
+    {
+        Json::Value frameTimes;
+        mFrameTimeline.save(frameTimes, mOptions.mPerFrameList);
+        if (mGpuFrameTimer.enabled())
+        {
+            frameTimes["gpu_disjoint"] = (Json::Value::UInt64)mGpuFrameTimer.disjoint();
+        }
+        result["frame_times"] = frameTimes;
+        DBG_LOG("Frame time (ms): p50 = %.2f, p90 = %.2f, p99 = %.2f, max = %.2f, jank = %u\n",
+                frameTimes["frame"].get("p50", 0.0).asDouble(), frameTimes["frame"].get("p90", 0.0).asDouble(),
+                frameTimes["frame"].get("p99", 0.0).asDouble(), frameTimes["frame"].get("max", 0.0).asDouble(),
+                frameTimes["jank"].asUInt());
+    }
     if (mOptions.mPerfmon) perfmon_end(result);
 
     if (mCollectors)
@@ -1791,56 +2236,87 @@ void Retracer::saveResult(Json::Value& result)
 
     if (mOptions.mCallStats)
     {
-        // First generate some info on no-op calls as a baseline
-        int c = 0;
-        for (int i = 0; i < 1000; i++)
-        {
-            auto pre = gettime();
-            c = noop(c);
-            auto post = gettime();
-            mCallStats["NO-OP"].count++;
-            mCallStats["NO-OP"].time += post - pre;
-            usleep(c); // just to use c for something, to make 100% sure it is not optimized away
-        }
+        mCallStats.stop();
+        mCallStats.calibrate(); // the cost of timing a call, as a baseline
 #if ANDROID
-        const char *filename = "/sdcard/callstats.csv";
+        const char *prefix = "/sdcard/callstats";
 #else
-        const char *filename = "callstats.csv";
+        const char *prefix = "callstats";
 #endif
-        FILE *fp = fopen(filename, "w");
-        if (fp)
-        {
-            uint64_t total = 0;
-            float noop_avg = (float)mCallStats["NO-OP"].time / mCallStats["NO-OP"].count;
-            fprintf(fp, "Function,Calls,Time,Calibrated_Time\n");
-            for (const auto& pair : mCallStats)
-            {
-                uint64_t noop = (uint64_t)(pair.second.count*noop_avg);
-                uint64_t calibrated_time = (pair.second.time > noop) ? (pair.second.time - noop) : 0;
-                fprintf(fp, "%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", pair.first.c_str(), pair.second.count, pair.second.time, calibrated_time);
-                // exclude APIs introduced from patrace
-                if (strcmp(pair.first.c_str(), "glClientSideBufferData")   && strcmp(pair.first.c_str(), "glClientSideBufferSubData") &&
-                    strcmp(pair.first.c_str(), "glCreateClientSideBuffer") && strcmp(pair.first.c_str(), "glDeleteClientSideBuffer") &&
-                    strcmp(pair.first.c_str(), "glCopyClientSideBuffer")   && strcmp(pair.first.c_str(), "glPatchClientSideBuffer") &&
-                    strcmp(pair.first.c_str(), "glGenGraphicBuffer_ARM")   && strcmp(pair.first.c_str(), "glGraphicBufferData_ARM") &&
-                    strcmp(pair.first.c_str(), "glDeleteGraphicBuffer_ARM")&& strcmp(pair.first.c_str(), "NO-OP"))
-                    total += calibrated_time;
-            }
-            fsync(fileno(fp));
-            fclose(fp);
-
-            const float ddk_fps = ((float)numOfFrames * std::max(1, mLoopTimes)) / ticksToSeconds(total);
-            const float ddk_mspf = (1000 * ticksToSeconds(total)) / (float)numOfFrames;
-            result["fps_ddk"] = ddk_fps;
-            result["ms/frame_ddk"] = ddk_mspf;
-            DBG_LOG("DDK FPS = %f, ms/frame = %f\n", ddk_fps, ddk_mspf);
-            DBG_LOG("Writing callstats to %s\n", filename);
-        }
-        else
-        {
-            DBG_LOG("Failed to open output callstats in %s: %s\n", filename, strerror(errno));
-        }
-        mCallStats.clear();
+        Json::Value callStats;
+        const double total = mCallStats.save(callStats, mFile.getFuncNames(), prefix);
+        result["call_stats"] = callStats;
+
+        const float ddk_fps = ((float)numOfFrames * std::max(1, mLoopTimes)) / total;
+        const float ddk_mspf = (1000 * total) / (float)numOfFrames;
+        result["fps_ddk"] = ddk_fps;
+        result["ms/frame_ddk"] = ddk_mspf;
+        DBG_LOG("DDK FPS = %f, ms/frame = %f\n", ddk_fps, ddk_mspf);
+    }
+
+    if (mShaderWarmup.started())
+    {
+        const ShaderWarmup::Stats stats = mShaderWarmup.getStats();
+        Json::Value warmup;
+        warmup["threads"] = mOptions.mShaderWarmupThreads;
+        warmup["programs"] = (Json::Value::UInt64)stats.programs;
+        warmup["linked"] = (Json::Value::UInt64)stats.linked;
+        warmup["failed"] = (Json::Value::UInt64)stats.failed;
+        warmup["hits"] = (Json::Value::UInt64)stats.hits;
+        warmup["misses"] = (Json::Value::UInt64)stats.misses;
+        warmup["scan_time"] = ticksToSeconds(stats.scanTicks);
+        warmup["compile_time"] = ticksToSeconds(stats.workTicks);
+        warmup["wait_time"] = ticksToSeconds(stats.waitTicks);
+        warmup["finish_time"] = ticksToSeconds(stats.finishTicks);
+        result["shader_warmup"] = warmup;
+        DBG_LOG("Shader warm-up: %u of %u programs linked ahead, %u hits, %u misses, %.3f s waiting for it\n", (unsigned)stats.linked,
+                (unsigned)stats.programs, (unsigned)stats.hits, (unsigned)stats.misses, ticksToSeconds(stats.waitTicks));
+    }
+
+    if (mOptions.mShaderCacheFile.size() > 0)
+    {
+        const ShaderCache::Stats& stats = shaderCache.stats();
+        Json::Value cache;
+        cache["mode"] = mOptions.mShaderCacheLoad ? "load" : "save";
+        cache["entries"] = (Json::Value::UInt64)stats.entries;
+        cache["hits"] = (Json::Value::UInt64)stats.hits;
+        cache["skipped"] = (Json::Value::UInt64)stats.skipped;
+        cache["misses"] = (Json::Value::UInt64)stats.misses;
+        cache["bytes"] = (Json::Value::UInt64)stats.bytes;
+        cache["time"] = ticksToSeconds(stats.ticks);
+        result["shader_cache"] = cache;
+        DBG_LOG("Shader cache: %u entries, %u hits, %u skipped, %.3f s %s programs\n", (unsigned)stats.entries, (unsigned)stats.hits,
+                (unsigned)stats.skipped, ticksToSeconds(stats.ticks), mOptions.mShaderCacheLoad ? "loading" : "saving");
+    }
+
+    if (mOptions.mSnapshotCallSet)
+    {
+        const SnapshotWriter::Stats stats = mSnapshotWriter.getStats();
+        Json::Value snapshots;
+        snapshots["measured"] = (Json::Value::UInt64)mSnapshotsMeasured;
+        snapshots["time"] = ticksToSeconds(mSnapshotTicks);
+        snapshots["threads"] = mOptions.mSnapshotThreads;
+        snapshots["readbacks"] = (Json::Value::UInt64)mSnapshotReadback.count();
+        snapshots["written"] = (Json::Value::UInt64)stats.written;
+        snapshots["failed"] = (Json::Value::UInt64)stats.failed;
+        snapshots["write_time"] = ticksToSeconds(stats.workTicks);
+        snapshots["blocked_time"] = ticksToSeconds(stats.blockedTicks);
+        result["snapshots"] = snapshots;
+        if (mOptions.mSnapshotHash)
+        {
+            result["snapshot_hashes"] = mSnapshotHashes;
+        }
+        DBG_LOG("Snapshots took %.3f s of the measured frames (%u snapshots, %.3f s waiting for the writer)\n",
+                ticksToSeconds(mSnapshotTicks), (unsigned)mSnapshotsMeasured, ticksToSeconds(stats.blockedTicks));
+    }
+
+    if (mOptions.mNullDriver)
+    {
+        mStageStats.stop();
+        mStageStats.calibrate();
+        Json::Value nullDriver;
+        mStageStats.save(nullDriver);
+        result["null_driver"] = nullDriver;
     }
 
     DBG_LOG("Saving results...\n");
@@ -1863,6 +2339,17 @@ void Retracer::saveResult(Json::Value& result)
             DBG_LOG("\tHandovers: %d\n", r.handovers);
             DBG_LOG("\tWakeups: %d\n", r.wakeups);
             DBG_LOG("\tTimeouts: %d\n", r.timeouts);
+            DBG_LOG("\tSleeps: %d\n", r.sleeps);
+            std::string latency;
+            for (int i = 0; i < HandoverHistogram::BUCKETS; i++)
+            {
+                if (r.handover_latency.counts[i] == 0) continue;
+                char bucket[64];
+                snprintf(bucket, sizeof(bucket), " %s%dus:%llu", i == HandoverHistogram::BUCKETS - 1 ? ">=" : "<",
+                         1 << (i == HandoverHistogram::BUCKETS - 1 ? i - 1 : i), (unsigned long long)r.handover_latency.counts[i]);
+                latency += bucket;
+            }
+            DBG_LOG("\tHandover latency:%s\n", latency.c_str());
         }
     }
 
@@ -1969,7 +2456,7 @@ void post_glCompileShader(GLuint shader, GLuint originalShaderName)
 
 void post_glShaderSource(GLuint shader, GLuint originalShaderName, GLsizei count, const GLchar **string, const GLint *length)
 {
-    if (gRetracer.mOptions.mShaderCacheFile.size() > 0 && string && count)
+    if ((gRetracer.mOptions.mShaderCacheFile.size() > 0 || gRetracer.mLoadProgramBinaries) && string && count)
     {
         std::string cat;
         for (int i = 0; i < count; i++)
@@ -1981,88 +2468,66 @@ void post_glShaderSource(GLuint shader, GLuint originalShaderName, GLsizei count
     }
 }
 
-void DeleteShaderCacheFile()
+void CreateShaderCacheFile()
 {
-    const std::string bpath = gRetracer.mOptions.mShaderCacheFile + ".bin";
-    remove(bpath.c_str());
+    if (!gRetracer.shaderCache.create(gRetracer.mOptions.mShaderCacheFile))
+    {
+        gRetracer.reportAndAbort("Failed to create shader cache %s.cache", gRetracer.mOptions.mShaderCacheFile.c_str());
+    }
 }
 
 void OpenShaderCacheFile()
 {
-        const std::string bpath = gRetracer.mOptions.mShaderCacheFile + ".bin";
-        gRetracer.shaderCacheFile = fopen(bpath.c_str(), "rb");
-        if (!gRetracer.shaderCacheFile)
+    if (!gRetracer.shaderCache.load(gRetracer.mOptions.mShaderCacheFile, gRetracer.shaderCacheVersionMD5))
+    {
+        gRetracer.reportAndAbort("Failed to open shader cache %s", gRetracer.mOptions.mShaderCacheFile.c_str());
+    }
+}
+
+// For programs the shader warm-up has no binary for. Their shaders were sourced and attached as in
+// the trace, which also keeps shaders the trace deleted alive, but not compiled, so compile the
+// attached shaders that are not compiled yet.
+static bool link_from_sources(GLuint program, GLuint originalProgramName, int status)
+{
+    GLint count = 0;
+    _glGetProgramiv(program, GL_ATTACHED_SHADERS, &count);
+    std::vector<GLuint> shaders(std::max(count, 0));
+    if (count > 0)
+    {
+        _glGetAttachedShaders(program, count, NULL, shaders.data());
+    }
+    for (const GLuint shader : shaders)
+    {
+        GLint compiled = GL_FALSE;
+        _glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (compiled == GL_TRUE)
         {
-            gRetracer.reportAndAbort("Failed to open shader cache file %s: %s", bpath.c_str(), strerror(errno));
+            continue;
         }
-
-        const std::string ipath = gRetracer.mOptions.mShaderCacheFile + ".idx";
-        FILE *idx = fopen(ipath.c_str(), "rb");
-        if (idx)
+        _glCompileShader(shader);
+        _glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (compiled != GL_TRUE)
         {
-            std::vector<char> ver_md5;
-            ver_md5.resize(MD5Digest::DIGEST_LEN * 2);
-            int r = fread(ver_md5.data(), ver_md5.size(), 1, idx);
-            if (r != 1)
-            {
-                gRetracer.reportAndAbort("Failed to read shader cache version: %s", ipath.c_str(), strerror(ferror(idx)));
-            }
-            gRetracer.shaderCacheVersionMD5 = std::string(ver_md5.data(), ver_md5.size());
-
-            uint32_t size = 0;
-            r = fread(&size, sizeof(size), 1, idx);
-            if (r != 1)
-            {
-                gRetracer.reportAndAbort("Failed to read shader cache index size: %s", ipath.c_str(), strerror(ferror(idx)));
-            }
-            for (unsigned i = 0; i < size; i++)
-            {
-                std::vector<char> md5;
-                uint64_t offset = 0;
-                std::string md5_str;
-                md5.resize(MD5Digest::DIGEST_LEN * 2);
-                r = fread(md5.data(), md5.size(), 1, idx);
-                r += fread(&offset, sizeof(offset), 1, idx);
-                if (r != 2)
-                {
-                    gRetracer.reportAndAbort("Failed to read shader cache index: %s", ipath.c_str(), strerror(ferror(idx)));
-                }
-                md5_str = std::string(md5.data(), md5.size());
-                gRetracer.shaderCacheIndex[md5_str] = offset;
-
-                if (offset == UINT64_MAX) continue;  // skipped shadercacheIndex
-
-                GLenum binaryFormat = GL_NONE;
-                uint32_t size = 0;
-
-                if (fseek(gRetracer.shaderCacheFile, offset, SEEK_SET) != 0)
-                {
-                    gRetracer.reportAndAbort("Could not seek to desired cache item at %ld", offset);
-                }
-                if (fread(&binaryFormat, sizeof(binaryFormat), 1, gRetracer.shaderCacheFile) != 1 || fread(&size, sizeof(size), 1, gRetracer.shaderCacheFile) != 1)
-                {
-                    gRetracer.reportAndAbort("Failed to read data from cache at %ld as %s: %s", offset, md5_str.c_str(), strerror(ferror(gRetracer.shaderCacheFile)));
-                }
-                if (binaryFormat == GL_NONE || size == 0)
-                {
-                    gRetracer.reportAndAbort("Invalid cache metadata at %ld for %s", offset, md5_str.c_str());
-                }
-
-                gRetracer.shaderCache[md5_str].format = binaryFormat;
-                gRetracer.shaderCache[md5_str].buffer.resize(size);
-                if (fread(gRetracer.shaderCache[md5_str].buffer.data(), gRetracer.shaderCache[md5_str].buffer.size(), 1, gRetracer.shaderCacheFile) != 1)
-                {
-                    gRetracer.reportAndAbort("Failed to read %d bytes of data from cache as %s: %s", size, md5_str.c_str(), strerror(ferror(gRetracer.shaderCacheFile)));
-                }
-            }
-            fclose(idx);
-            DBG_LOG("Found shader cache index file, loaded %d cache entries\n", (int)size);
+            DBG_LOG("Warning: shader %u of program %u did not compile when linking the program without the shader warm-up\n", shader, originalProgramName);
         }
+    }
+    if (count == 0)
+    {
+        DBG_LOG("Warning: program %u has no shaders attached to link it without the shader warm-up\n", originalProgramName);
+    }
+    _glLinkProgram(program);
+    post_glLinkProgram(program, originalProgramName, status);
+    if (gRetracer.mOptions.mDebug)
+    {
+        DBG_LOG("Program %u was not warmed up, compiled it from source.\n", originalProgramName);
+    }
+    return true;
 }
 
 bool load_from_shadercache(GLuint program, GLuint originalProgramName, int status)
 {
-    assert(gRetracer.mOptions.mShaderCacheLoad);
+    assert(gRetracer.mLoadProgramBinaries);
+    const int64_t pre = os::getTime();
 
     // check this particular shader
     std::vector<std::string> shaders;
@@ -2073,21 +2538,44 @@ bool load_from_shadercache(GLuint program, GLuint originalProgramName, int statu
 
     MD5Digest cached_md5(shaders);
     const std::string md5 = cached_md5.text();
-    if (gRetracer.shaderCacheIndex.count(md5) == 0)
+    if (gRetracer.mShaderWarmup.started())
+    {
+        GLenum format = GL_NONE;
+        std::vector<char> buffer;
+        if (gRetracer.mShaderWarmup.take(md5, format, buffer))
+        {
+            _glGetError(); // clear
+            _glProgramBinary(program, format, buffer.data(), buffer.size());
+            GLint linkStatus = GL_FALSE;
+            _glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+            if (_glGetError() == GL_NO_ERROR && linkStatus == GL_TRUE)
+            {
+                if (gRetracer.mOptions.mDebug)
+                {
+                    DBG_LOG("Loaded program %u from the shader warm-up as %s.\n", originalProgramName, md5.c_str());
+                }
+                return true;
+            }
+        }
+        return link_from_sources(program, originalProgramName, status);
+    }
+    ShaderCache::Program binary;
+    if (!gRetracer.shaderCache.find(md5, binary))
     {
         gRetracer.reportAndAbort("Could not find shader %s in cache!", md5.c_str());
     }
 
-    if (gRetracer.shaderCacheIndex[md5] == UINT64_MAX)
+    if (binary.size == 0)
     {
         if (gRetracer.mOptions.mDebug)
         {
             DBG_LOG("warning: skip load_from_shadercache for program %u because of error linking: status %d\n", originalProgramName, status);
         }
+        gRetracer.shaderCache.stats().ticks += os::getTime() - pre;
         return false;
     }
     _glGetError(); // clear
-    _glProgramBinary(program, gRetracer.shaderCache[md5].format, gRetracer.shaderCache[md5].buffer.data(), gRetracer.shaderCache[md5].buffer.size());
+    _glProgramBinary(program, binary.format, binary.data, binary.size);
     GLenum err = _glGetError();
     if (err != GL_NO_ERROR)
     {
@@ -2097,77 +2585,48 @@ bool load_from_shadercache(GLuint program, GLuint originalProgramName, int statu
     {
         DBG_LOG("Loaded program %u from cache as %s.\n", originalProgramName, md5.c_str());
     }
+    gRetracer.shaderCache.stats().ticks += os::getTime() - pre;
     return true;
 }
 
 static void save_shadercache(GLuint program, GLuint originalProgramName, bool bSkipShadercache)
 {
+    const int64_t pre = os::getTime();
     std::vector<std::string> shaders;
     for (const GLuint shader_id : gRetracer.getCurrentContext().getShaderIDs(program))
     {
         shaders.push_back(gRetracer.getCurrentContext().getShaderSource(shader_id));
     }
     MD5Digest cached_md5(shaders);
-    if (gRetracer.shaderCacheIndex.count(cached_md5.text()) == 0)
+    const std::string md5 = cached_md5.text();
+    if (gRetracer.shaderCache.contains(md5))
     {
-        if (!bSkipShadercache)
-        {
-            // save and write binary to disk
-            GLint len = 0;
-            _glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &len);
-
-            std::vector<char> buffer(len);
-            GLenum binaryFormat = GL_NONE;
-            _glGetProgramBinary(program, len, NULL, &binaryFormat, (void*)buffer.data());
-
-            const std::string bpath = gRetracer.mOptions.mShaderCacheFile + ".bin";
-            FILE* fp = fopen(bpath.c_str(), "ab+");
-            if (!fp) gRetracer.reportAndAbort("Failed to open shader cache file %s for writing: %s", bpath.c_str(), strerror(errno));
-            uint32_t size = len;
-            (void)fseek(fp, 0, SEEK_END);
-            long offset = ftell(fp);
-            if (fwrite(&binaryFormat, sizeof(GLenum), 1, fp) != 1 || fwrite(&size, sizeof(size), 1, fp) != 1 || fwrite(buffer.data(), buffer.size(), 1, fp) != 1)
-            {
-                gRetracer.reportAndAbort("Failed to write data to shader cache file: %s", strerror(ferror(gRetracer.shaderCacheFile)));
-            }
-            fclose(fp);
+        return;
+    }
+    if (!bSkipShadercache)
+    {
+        GLint len = 0;
+        _glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &len);
 
-            gRetracer.shaderCacheIndex[cached_md5.text()] = offset;
-            if (gRetracer.mOptions.mDebug)
-            {
-                DBG_LOG("Saving program %u(retraceProgram %u) to shader cache as %s{.idx|.bin} with offset=%ld size=%ld md5=%s\n", originalProgramName, program, gRetracer.mOptions.mShaderCacheFile.c_str(), offset, (long)size, cached_md5.text().c_str());
-            }
-        }
-        else
-        {
-            gRetracer.shaderCacheIndex[cached_md5.text()] = UINT64_MAX;
-        }
-        // Overwrite index on disk
-        const std::string ipath = gRetracer.mOptions.mShaderCacheFile + ".idx";
-        FILE *fp = fopen(ipath.c_str(), "wb");
-        if (!fp)
-        {
-            gRetracer.reportAndAbort("Failed to open index file %s for writing: %s", ipath.c_str(), strerror(errno));
-        }
-        if (fwrite(gRetracer.shaderCacheVersionMD5.c_str(), gRetracer.shaderCacheVersionMD5.size(), 1, fp ) != 1)
-        {
-            gRetracer.reportAndAbort("Failed to write ddk version MD5 (%s) to shader cache index: %s", gRetracer.shaderCacheVersionMD5.c_str(), strerror(ferror(fp)));
-        }
+        std::vector<char> buffer(len);
+        GLenum binaryFormat = GL_NONE;
+        _glGetProgramBinary(program, len, NULL, &binaryFormat, (void*)buffer.data());
 
-        uint32_t entries = gRetracer.shaderCacheIndex.size();
-        if (fwrite(&entries, sizeof(entries), 1, fp) != 1)
+        // Written out in batches, and the index at the end of the retrace
+        if (!gRetracer.shaderCache.add(md5, binaryFormat, buffer.data(), buffer.size()))
         {
-            gRetracer.reportAndAbort("Failed to write size of data to shader cache index: %s", strerror(ferror(fp)));
+            gRetracer.reportAndAbort("Failed to write data to shader cache file %s.cache", gRetracer.mOptions.mShaderCacheFile.c_str());
         }
-        for (const auto &pair : gRetracer.shaderCacheIndex)
+        if (gRetracer.mOptions.mDebug)
         {
-            if (fwrite(pair.first.c_str(), pair.first.size(), 1, fp) != 1 || fwrite(&pair.second, sizeof(pair.second), 1, fp) != 1)
-            {
-                gRetracer.reportAndAbort("Failed to write data to shader cache index: %s", strerror(ferror(fp)));
-            }
+            DBG_LOG("Saving program %u(retraceProgram %u) to shader cache as %s.cache with size=%ld md5=%s\n", originalProgramName, program, gRetracer.mOptions.mShaderCacheFile.c_str(), (long)len, md5.c_str());
         }
-        fclose(fp);
     }
+    else
+    {
+        gRetracer.shaderCache.add(md5, GL_NONE, nullptr, 0);
+    }
+    gRetracer.shaderCache.stats().ticks += os::getTime() - pre;
 }
 
 void post_glLinkProgram(GLuint program, GLuint originalProgramName, int status)
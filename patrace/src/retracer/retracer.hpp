@@ -4,6 +4,13 @@
 #include "retracer/retrace_options.hpp"
 #include "retracer/state.hpp"
 #include "retracer/texture.hpp"
+#include "retracer/thread_handover.hpp"
+#include "retracer/frame_timeline.hpp"
+#include "retracer/call_stats.hpp"
+#include "retracer/action_schedule.hpp"
+#include "retracer/shader_cache.hpp"
+#include "retracer/shader_warmup.hpp"
+#include "retracer/snapshot_writer.hpp"
 #include "helper/states.h"
 #include "graphic_buffer/GraphicBuffer.hpp"
 #include "dma_buffer/dma_buffer.hpp"
@@ -45,7 +52,9 @@ struct thread_result // internal counters
     int handovers = 0;
     int wakeups = 0;
     int timeouts = 0;
+    int sleeps = 0; ///< wakeups that came after the spinning phase was over
     int swaps = 0;
+    HandoverHistogram handover_latency; ///< time from handing over to this thread until it ran
 };
 
 class Retracer
@@ -79,6 +88,9 @@ public:
     std::string changeAttributesToConstants(const std::string& source, const std::vector<VertexArrayInfo>& attributesToRemove);
     std::vector<Texture> getTexturesToDump();
     void TakeSnapshot(unsigned int callNo, unsigned int frameNo, const char *filename = NULL);
+    void timedSnapshot(unsigned int callNo, unsigned int frameNo);
+    void saveSnapshot(image::Image *src, const std::string& filename, unsigned int frameNo, unsigned int callNo);
+    void hashSnapshot(image::Image *src, const std::string& name, unsigned int frameNo, unsigned int callNo);
     void StepShot(unsigned int callNo, unsigned int frameNo, const char *filename = NULL);
     void dumpUniformBuffers(unsigned int callno);
     inline int getCurTid() const { return mCurCall.tid; }
@@ -108,6 +120,8 @@ public:
     unsigned mTextureDataSize = 0;
     unsigned mCompressedTextureDataSize = 0;
     unsigned mClientSideMemoryDataSize = 0;
+    uint64_t mCSBReferencedBytes = 0; ///< client-side buffer data used in place, with -zerocopycsb
+    uint64_t mCSBCopiedBytes = 0;
     std::unordered_map<std::string, int> mCallCounter;
 
     Collection *mCollectors = nullptr;
@@ -117,27 +131,44 @@ public:
     void perfMonInit();
     int mSurfaceCount = 0;
 
-    struct ProgramCache
-    {
-        GLenum format;
-        std::vector<char> buffer;
-    };
-    FILE *shaderCacheFile = NULL;
     std::string shaderCacheVersionMD5;
-    std::map<std::string, uint64_t> shaderCacheIndex; // md5 of shader source to offset of cache file
-    std::unordered_map<std::string, ProgramCache> shaderCache; // md5 of shader source to cache struct in mem
+    ShaderCache shaderCache; // md5 of shader source to program binary
+    ShaderWarmup mShaderWarmup;
+    bool mLoadProgramBinaries = false; // link programs from binaries, from the shader cache or the warm-up, instead of compiling shaders
     int64_t frameBudget = INT64_MAX;
     int64_t drawBudget = INT64_MAX;
 
     void* fptr = nullptr;
     char* src = nullptr;
-    std::deque<std::condition_variable> conditions;
+
+    /// A call of the measured frame range, decoded once for replaying it on every loop
+    struct PredecodedCall
+    {
+        void* fptr;
+        char* src;
+        common::BCall_vlen call;
+        unsigned callNo; ///< calls on ignored threads are not recorded, but are counted
+        unsigned flags;
+    };
+    enum PredecodedFlags
+    {
+        PREDECODED_INLINE = 1 << 0, ///< needs none of the per call bookkeeping, so can be run straight from the stream
+    };
+    std::vector<PredecodedCall> mPredecoded;
+    size_t mPredecodedNext = 0;
+    bool mPredecodeRecording = false;
+    bool mPredecodeReplay = false;
     std::deque<std::thread> threads;
     std::unordered_map<int, int> thread_remapping;
-    std::atomic_int latest_call_tid;
-    std::mutex mConditionMutex;
+    ThreadHandover mHandover;
 
 private:
+    bool waitForTurn(int threadidx, thread_result& r);
+    void startPredecoding();
+    void initSchedule();
+    void recordPredecodedCall();
+    bool nextPredecodedCall(thread_result& r);
+    bool nextCallTimed(thread_result& r);
     bool loadRetraceOptionsByThreadId(int tid);
     void loadRetraceOptionsFromHeader();
     float getDuration(int64_t lastTime, int64_t* thisTime) const;
@@ -150,20 +181,20 @@ private:
 
     std::deque<thread_result> results;
 
-    std::vector<bool> swapvals;
-    std::vector<bool> cachevals;
-    std::vector<bool> syncvals;
+    ActionSchedule mSchedule;
 
     int64_t mInitTime = 0;
     int64_t mInitTimeMono = 0;
     int64_t mInitTimeMonoRaw = 0;
     int64_t mInitTimeBoot = 0;
-    int64_t mEndFrameTime = 0;
+    int64_t mEndFrameTime = 0; ///< when the last swap returned
     int64_t mTimerBeginTime = 0;
     int64_t mTimerBeginTimeMono = 0;
     int64_t mTimerBeginTimeMonoRaw = 0;
     int64_t mTimerBeginTimeBoot = 0;
-    int64_t mFinishSwapTime = 0;
+    int64_t mFinishSwapTime = 0; ///< when the current swap was started, if measuring swap time
+    FrameTimeline mFrameTimeline;
+    GpuFrameTimer mGpuFrameTimer;
     //For fixed fps command
     double mMaxDuration = 0;
     int64_t mFixedFpsOldTime = 0;
@@ -172,13 +203,14 @@ private:
     StateLogger mStateLogger;
     common::HeaderVersion mFileFormatVersion = common::INVALID_VERSION;
     std::vector<std::string> mSnapshotPaths;
+    SnapshotWriter mSnapshotWriter;
+    SnapshotReadback mSnapshotReadback{mSnapshotWriter};
+    int64_t mSnapshotTicks = 0; ///< time the retrace thread spent on snapshots in the measured frames
+    uint64_t mSnapshotsMeasured = 0;
+    Json::Value mSnapshotHashes = Json::arrayValue;
 
-    struct CallStat
-    {
-        uint64_t count = 0;
-        uint64_t time = 0;
-    };
-    std::unordered_map<std::string, CallStat> mCallStats;
+    CallStats mCallStats;
+    StageStats mStageStats;
 
     pid_t child = 0;
 
@@ -212,7 +244,7 @@ void post_glLinkProgram(GLuint shader, GLuint originalShaderName, int status);
 void post_glCompileShader(GLuint program, GLuint originalProgramName);
 void post_glShaderSource(GLuint shader, GLuint originalshaderName, GLsizei count, const GLchar **string, const GLint *length);
 void OpenShaderCacheFile();
-void DeleteShaderCacheFile();
+void CreateShaderCacheFile();
 bool load_from_shadercache(GLuint program, GLuint originalProgramName, int status);
 void hardcode_glBindFramebuffer(int target, unsigned int framebuffer);
 void hardcode_glDeleteBuffers(int n, unsigned int* oldBuffers);
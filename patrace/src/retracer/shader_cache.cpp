@@ -0,0 +1,282 @@
+#include "retracer/shader_cache.hpp"
+
+#include "common/os.hpp"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace retracer {
+
+static const char MAGIC[8] = { 'P', 'A', 'S', 'H', 'C', 'A', 'C', 'H' };
+static const uint32_t FORMAT_VERSION = 1;
+
+static bool keyLess(const char* a, const char* b)
+{
+    return memcmp(a, b, ShaderCache::KEY_LEN) < 0;
+}
+
+bool ShaderCache::map(const std::string& path)
+{
+    mFd = open(path.c_str(), O_RDONLY);
+    if (mFd == -1)
+    {
+        return false;
+    }
+    struct stat64 sb;
+    if (fstat64(mFd, &sb) == -1 || sb.st_size == 0)
+    {
+        DBG_LOG("Failed to stat shader cache %s: %s\n", path.c_str(), strerror(errno));
+        ::close(mFd);
+        mFd = -1;
+        return false;
+    }
+    mData = (char*)mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, mFd, 0);
+    if (mData == MAP_FAILED)
+    {
+        DBG_LOG("Failed to mmap shader cache %s: %s\n", path.c_str(), strerror(errno));
+        mData = nullptr;
+        ::close(mFd);
+        mFd = -1;
+        return false;
+    }
+    mDataSize = sb.st_size;
+    madvise(mData, mDataSize, MADV_RANDOM); // only the binaries of linked programs are needed
+    return true;
+}
+
+bool ShaderCache::load(const std::string& prefix, std::string& version)
+{
+    close();
+    mStats = Stats();
+    const std::string path = prefix + ".cache";
+    if (!map(path))
+    {
+        return loadLegacy(prefix, version);
+    }
+    const FileHeader* header = (const FileHeader*)mData;
+    if (mDataSize < sizeof(FileHeader) || memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        DBG_LOG("%s is not a shader cache\n", path.c_str());
+        close();
+        return false;
+    }
+    if (header->version != FORMAT_VERSION)
+    {
+        DBG_LOG("Shader cache %s has unsupported version %u\n", path.c_str(), header->version);
+        close();
+        return false;
+    }
+    if (header->indexOffset > mDataSize || (mDataSize - header->indexOffset) / sizeof(IndexEntry) < header->entries)
+    {
+        DBG_LOG("Shader cache %s is truncated\n", path.c_str());
+        close();
+        return false;
+    }
+    mIndex = (const IndexEntry*)(mData + header->indexOffset);
+    mEntries = header->entries;
+    version = header->driverVersion[0] ? std::string(header->driverVersion, KEY_LEN) : std::string();
+    mStats.entries = mEntries;
+    DBG_LOG("Opened shader cache %s with %u entries\n", path.c_str(), mEntries);
+    return true;
+}
+
+bool ShaderCache::loadLegacy(const std::string& prefix, std::string& version)
+{
+    const std::string ipath = prefix + ".idx";
+    const std::string bpath = prefix + ".bin";
+    FILE* idx = fopen(ipath.c_str(), "rb");
+    if (!idx)
+    {
+        DBG_LOG("Failed to open shader cache %s.cache or %s: %s\n", prefix.c_str(), ipath.c_str(), strerror(errno));
+        return false;
+    }
+    char ver[KEY_LEN];
+    uint32_t entries = 0;
+    if (fread(ver, sizeof(ver), 1, idx) != 1 || fread(&entries, sizeof(entries), 1, idx) != 1)
+    {
+        DBG_LOG("Failed to read shader cache index %s\n", ipath.c_str());
+        fclose(idx);
+        return false;
+    }
+    mLegacyIndex.resize(entries);
+    for (IndexEntry& entry : mLegacyIndex)
+    {
+        if (fread(entry.key, sizeof(entry.key), 1, idx) != 1 || fread(&entry.offset, sizeof(entry.offset), 1, idx) != 1)
+        {
+            DBG_LOG("Failed to read shader cache index %s\n", ipath.c_str());
+            mLegacyIndex.clear();
+            fclose(idx);
+            return false;
+        }
+    }
+    fclose(idx);
+    // The old index was written from a std::map, but do not rely on it
+    std::sort(mLegacyIndex.begin(), mLegacyIndex.end(), [](const IndexEntry& a, const IndexEntry& b) { return keyLess(a.key, b.key); });
+
+    if (!map(bpath))
+    {
+        DBG_LOG("Failed to open shader cache %s: %s\n", bpath.c_str(), strerror(errno));
+        mLegacyIndex.clear();
+        return false;
+    }
+    mIndex = mLegacyIndex.data();
+    mEntries = entries;
+    version = std::string(ver, KEY_LEN);
+    mStats.entries = mEntries;
+    DBG_LOG("Opened old format shader cache %s{.idx|.bin} with %u entries\n", prefix.c_str(), mEntries);
+    return true;
+}
+
+bool ShaderCache::find(const std::string& key, Program& program)
+{
+    if (key.size() != KEY_LEN || !mIndex)
+    {
+        mStats.misses++;
+        return false;
+    }
+    const IndexEntry* end = mIndex + mEntries;
+    const IndexEntry* entry = std::lower_bound(mIndex, end, key.c_str(), [](const IndexEntry& e, const char* k) { return keyLess(e.key, k); });
+    if (entry == end || memcmp(entry->key, key.c_str(), KEY_LEN) != 0)
+    {
+        mStats.misses++;
+        return false;
+    }
+    if (entry->offset == UINT64_MAX)
+    {
+        program.format = GL_NONE;
+        program.data = nullptr;
+        program.size = 0;
+        mStats.skipped++;
+        return true;
+    }
+    // Binaries in old .idx/.bin caches are not necessarily aligned
+    BinaryHeader binary = {};
+    if (entry->offset + sizeof(BinaryHeader) <= mDataSize)
+    {
+        memcpy(&binary, mData + entry->offset, sizeof(binary));
+    }
+    if (binary.format == GL_NONE || binary.size == 0 || binary.size > mDataSize - entry->offset - sizeof(BinaryHeader))
+    {
+        DBG_LOG("Invalid shader cache entry at %lu for %s\n", (unsigned long)entry->offset, key.c_str());
+        mStats.misses++;
+        return false;
+    }
+    program.format = binary.format;
+    program.data = mData + entry->offset + sizeof(BinaryHeader);
+    program.size = binary.size;
+    mStats.hits++;
+    mStats.bytes += binary.size;
+    return true;
+}
+
+bool ShaderCache::create(const std::string& prefix)
+{
+    close();
+    mStats = Stats();
+    mOutPath = prefix + ".cache";
+    mOut = fopen(mOutPath.c_str(), "wb");
+    if (!mOut)
+    {
+        DBG_LOG("Failed to create shader cache %s: %s\n", mOutPath.c_str(), strerror(errno));
+        return false;
+    }
+    // The header is filled in by close()
+    mBatch.assign(sizeof(FileHeader), 0);
+    mWriteOffset = sizeof(FileHeader);
+    return true;
+}
+
+bool ShaderCache::add(const std::string& key, GLenum format, const void* data, uint32_t size)
+{
+    if (!mOut || key.size() != KEY_LEN || mSaved.count(key))
+    {
+        return false;
+    }
+    if (!data || size == 0)
+    {
+        mSaved[key] = UINT64_MAX;
+        mStats.skipped++;
+        return true;
+    }
+    const BinaryHeader binary = { format, size };
+    mBatch.insert(mBatch.end(), (const char*)&binary, (const char*)(&binary + 1));
+    mBatch.insert(mBatch.end(), (const char*)data, (const char*)data + size);
+    // Keep the next binary header, and the index, aligned for reading in place
+    const uint32_t padded = (size + 7) & ~7u;
+    mBatch.resize(mBatch.size() + padded - size, 0);
+    mSaved[key] = mWriteOffset;
+    mWriteOffset += sizeof(binary) + padded;
+    mStats.entries++;
+    mStats.bytes += size;
+    return mBatch.size() < BATCH_SIZE || flush();
+}
+
+bool ShaderCache::flush()
+{
+    if (!mBatch.empty() && fwrite(mBatch.data(), mBatch.size(), 1, mOut) != 1)
+    {
+        DBG_LOG("Failed to write to shader cache %s: %s\n", mOutPath.c_str(), strerror(errno));
+        return false;
+    }
+    mBatch.clear();
+    return true;
+}
+
+bool ShaderCache::close(const std::string& version)
+{
+    bool ok = true;
+    if (mOut)
+    {
+        // Index, sorted by key since mSaved is
+        for (const auto& pair : mSaved)
+        {
+            IndexEntry entry;
+            memcpy(entry.key, pair.first.c_str(), KEY_LEN);
+            entry.offset = pair.second;
+            mBatch.insert(mBatch.end(), (const char*)&entry, (const char*)(&entry + 1));
+        }
+        FileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = FORMAT_VERSION;
+        header.entries = mSaved.size();
+        header.indexOffset = mWriteOffset;
+        memcpy(header.driverVersion, version.c_str(), std::min<size_t>(version.size(), KEY_LEN));
+        ok = flush() && fseek(mOut, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, mOut) == 1;
+        ok = (fclose(mOut) == 0) && ok;
+        if (ok)
+        {
+            DBG_LOG("Saved %u programs to shader cache %s\n", (unsigned)mSaved.size(), mOutPath.c_str());
+        }
+        else
+        {
+            DBG_LOG("Failed to write shader cache %s\n", mOutPath.c_str());
+        }
+        mOut = nullptr;
+        mSaved.clear();
+        mBatch.clear();
+        mWriteOffset = 0;
+    }
+    if (mData)
+    {
+        munmap(mData, mDataSize);
+        mData = nullptr;
+        mDataSize = 0;
+    }
+    if (mFd != -1)
+    {
+        ::close(mFd);
+        mFd = -1;
+    }
+    mIndex = nullptr;
+    mEntries = 0;
+    mLegacyIndex.clear();
+    return ok;
+}
+
+}
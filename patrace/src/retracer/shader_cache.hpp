@@ -0,0 +1,103 @@
+#ifndef _RETRACER_SHADER_CACHE_HPP_
+#define _RETRACER_SHADER_CACHE_HPP_
+
+#include "dispatch/eglimports.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace retracer {
+
+/// Cache of program binaries, keyed by the MD5 of the shader sources of each program. The cache
+/// is a single file holding a header, the binaries, and an index sorted by key at the end. It is
+/// memory mapped for loading and the index is searched in place, so a binary is only read from
+/// disk when its program is linked. When saving, binaries are appended in batches and the index
+/// is written once, by close(). Caches in the old format, split into .idx and .bin files, can
+/// still be loaded.
+class ShaderCache
+{
+public:
+    enum { KEY_LEN = 32 }; ///< MD5 as hex text
+    enum { BATCH_SIZE = 4 * 1024 * 1024 };
+
+    ~ShaderCache() { close(); }
+
+    /// Open an existing cache for loading, and get the driver version it was made with
+    bool load(const std::string& prefix, std::string& version);
+    /// Start a new cache, replacing any existing one
+    bool create(const std::string& prefix);
+    /// When saving, write out what is left and the index, with the given driver version
+    bool close(const std::string& version = std::string());
+    bool saving() const { return mOut != nullptr; }
+
+    struct Program
+    {
+        GLenum format;
+        const void* data;
+        uint32_t size; ///< zero if the program did not link when the cache was made
+    };
+    /// Returns false if the key is not in the cache
+    bool find(const std::string& key, Program& program);
+    bool contains(const std::string& key) const { return mSaved.count(key) != 0; }
+    /// Add a program binary when saving. Pass no data for a program that did not link.
+    bool add(const std::string& key, GLenum format, const void* data, uint32_t size);
+
+    struct Stats
+    {
+        uint64_t entries = 0;
+        uint64_t hits = 0;      ///< programs found with a binary
+        uint64_t skipped = 0;   ///< programs found that did not link when the cache was made
+        uint64_t misses = 0;
+        uint64_t bytes = 0;     ///< binary bytes loaded or saved
+        int64_t ticks = 0;      ///< time spent loading or saving programs, added by the caller
+    };
+    Stats& stats() { return mStats; }
+
+private:
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t entries;
+        uint64_t indexOffset;
+        char driverVersion[KEY_LEN];
+    };
+    struct IndexEntry
+    {
+        char key[KEY_LEN];
+        uint64_t offset; ///< of the binary header, UINT64_MAX if there is no binary
+    };
+    struct BinaryHeader
+    {
+        uint32_t format;
+        uint32_t size;
+    };
+
+    bool map(const std::string& path);
+    bool loadLegacy(const std::string& prefix, std::string& version);
+    bool flush();
+
+    // Loading
+    int mFd = -1;
+    char* mData = nullptr;
+    uint64_t mDataSize = 0;
+    const IndexEntry* mIndex = nullptr;
+    uint32_t mEntries = 0;
+    std::vector<IndexEntry> mLegacyIndex;
+
+    // Saving
+    FILE* mOut = nullptr;
+    std::string mOutPath;
+    std::vector<char> mBatch;
+    uint64_t mWriteOffset = 0;
+    std::map<std::string, uint64_t> mSaved;
+
+    Stats mStats;
+};
+
+}
+
+#endif
@@ -0,0 +1,382 @@
+#include "retracer/shader_warmup.hpp"
+
+#include "retracer/glws.hpp"
+#include "dispatch/eglproc_auto.hpp"
+#include "common/in_file_ra.hpp"
+#include "common/memory.hpp"
+#include "common/os.hpp"
+#include "common/os_time.hpp"
+
+#include <unordered_set>
+
+using namespace common;
+
+namespace retracer {
+
+size_t ShaderWarmup::scan(const std::string& filename, unsigned endFrame, int tid)
+{
+    const int64_t pre = os::getTime();
+    InFileRA file;
+    if (!file.Open(filename.c_str()))
+    {
+        DBG_LOG("Failed to open %s to look for shaders\n", filename.c_str());
+        return 0;
+    }
+    const unsigned swapBuffers = file.NameToExId("eglSwapBuffers");
+    const unsigned swapBuffersWithDamage = file.NameToExId("eglSwapBuffersWithDamageKHR");
+    const unsigned createShader = file.NameToExId("glCreateShader");
+    const unsigned shaderSource = file.NameToExId("glShaderSource");
+    const unsigned deleteShader = file.NameToExId("glDeleteShader");
+    const unsigned attachShader = file.NameToExId("glAttachShader");
+    const unsigned bindAttribLocation = file.NameToExId("glBindAttribLocation");
+    const unsigned transformFeedbackVaryings = file.NameToExId("glTransformFeedbackVaryings");
+    const unsigned programParameteri = file.NameToExId("glProgramParameteri");
+    const unsigned linkProgram = file.NameToExId("glLinkProgram");
+    const unsigned linkProgram2 = file.NameToExId("glLinkProgram2");
+    const unsigned deleteProgram = file.NameToExId("glDeleteProgram");
+
+    // What the retracer will know about shaders and programs, by their names in the trace
+    std::unordered_map<GLuint, GLenum> shaderTypes;
+    std::unordered_map<GLuint, std::string> shaderSources;
+    std::unordered_map<GLuint, std::vector<GLuint>> programShaders;
+    std::unordered_map<GLuint, Program> programSettings;
+
+    void* fptr = nullptr;
+    char* src = nullptr;
+    BCall_vlen call;
+    unsigned frame = 0;
+    while (frame <= endFrame && file.GetNextCall(fptr, call, src))
+    {
+        const unsigned id = call.funcId;
+        if (id == 0)
+        {
+            continue;
+        }
+        else if (id == swapBuffers || id == swapBuffersWithDamage)
+        {
+            if (tid == -1 || call.tid == tid) frame++;
+        }
+        else if (id == createShader)
+        {
+            GLenum type;
+            GLuint shader;
+            src = ReadFixed(src, type);
+            src = ReadFixed(src, shader);
+            shaderTypes[shader] = type;
+        }
+        else if (id == shaderSource)
+        {
+            // Concatenated like post_glShaderSource does it
+            GLuint shader;
+            GLsizei count;
+            Array<const char*> string;
+            Array<GLint> length;
+            src = ReadFixed(src, shader);
+            src = ReadFixed(src, count);
+            src = ReadStringArray(src, string);
+            src = Read1DArray(src, length);
+            if (string.v && count)
+            {
+                std::string cat;
+                for (int i = 0; i < count && i < (int)string.cnt; i++)
+                {
+                    if (length.v) cat += std::string(string.v[i], length.v[i]);
+                    else cat += string.v[i];
+                }
+                shaderSources[shader] = cat;
+            }
+        }
+        else if (id == deleteShader)
+        {
+            GLuint shader;
+            src = ReadFixed(src, shader);
+            shaderSources.erase(shader);
+        }
+        else if (id == attachShader)
+        {
+            GLuint program, shader;
+            src = ReadFixed(src, program);
+            src = ReadFixed(src, shader);
+            programShaders[program].push_back(shader);
+        }
+        else if (id == bindAttribLocation)
+        {
+            GLuint program, index;
+            char* name;
+            src = ReadFixed(src, program);
+            src = ReadFixed(src, index);
+            src = ReadString(src, name);
+            if (name) programSettings[program].attribLocations.emplace_back(index, name);
+        }
+        else if (id == transformFeedbackVaryings)
+        {
+            GLuint program;
+            GLsizei count;
+            Array<const char*> varyings;
+            int bufferMode;
+            src = ReadFixed(src, program);
+            src = ReadFixed(src, count);
+            src = ReadStringArray(src, varyings);
+            src = ReadFixed(src, bufferMode);
+            Program& settings = programSettings[program];
+            settings.varyings.clear();
+            for (unsigned i = 0; i < varyings.cnt; i++)
+            {
+                settings.varyings.push_back(varyings.v[i] ? varyings.v[i] : "");
+            }
+            settings.bufferMode = bufferMode;
+        }
+        else if (id == programParameteri)
+        {
+            GLuint program;
+            int pname;
+            GLint value;
+            src = ReadFixed(src, program);
+            src = ReadFixed(src, pname);
+            src = ReadFixed(src, value);
+            if (pname == GL_PROGRAM_SEPARABLE) programSettings[program].separable = value;
+        }
+        else if (id == linkProgram || id == linkProgram2)
+        {
+            GLuint name;
+            src = ReadFixed(src, name);
+            const auto attached = programShaders.find(name);
+            if (attached == programShaders.end())
+            {
+                continue;
+            }
+            Program program = programSettings[name];
+            std::vector<std::string> sources;
+            std::unordered_set<GLuint> seen;
+            bool complete = true;
+            for (const GLuint shader : attached->second)
+            {
+                const auto source = shaderSources.find(shader);
+                const auto type = shaderTypes.find(shader);
+                if (source == shaderSources.end() || type == shaderTypes.end())
+                {
+                    complete = false;
+                    break;
+                }
+                sources.push_back(source->second);
+                if (seen.insert(shader).second) // attached only once, whatever the trace does
+                {
+                    program.shaders.push_back(Shader{ type->second, source->second });
+                }
+            }
+            if (!complete)
+            {
+                continue;
+            }
+            program.key = MD5Digest(sources).text();
+            if (mKeys.count(program.key) == 0)
+            {
+                mKeys[program.key] = mPrograms.size();
+                mPrograms.push_back(program);
+            }
+        }
+        else if (id == deleteProgram)
+        {
+            GLuint program;
+            src = ReadFixed(src, program);
+            programShaders.erase(program);
+            programSettings.erase(program);
+        }
+    }
+    file.Close();
+
+    mStats.programs = mPrograms.size();
+    mStats.scanTicks = os::getTime() - pre;
+    DBG_LOG("Found %u programs to warm up in %.3f s\n", (unsigned)mPrograms.size(), (double)mStats.scanTicks / os::timeFrequency);
+    return mPrograms.size();
+}
+
+bool ShaderWarmup::start(unsigned threads, Profile profile)
+{
+    stop();
+    if (profile < PROFILE_ES3)
+    {
+        DBG_LOG("Shader warm-up needs GLES 3 for program binaries\n");
+        return false;
+    }
+    mStopping = false;
+    for (unsigned i = 0; i < threads; i++)
+    {
+        // Not sharing with the retracer's contexts, since only the binaries are handed over
+        const EGLint attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        Drawable* drawable = GLWS::instance().CreatePbufferDrawable(attribs);
+        Context* context = GLWS::instance().CreateContext(nullptr, profile);
+        if (!drawable || !context)
+        {
+            DBG_LOG("Failed to create a context for shader warm-up thread %u\n", i);
+            if (drawable) drawable->release();
+            if (context) context->release();
+            break;
+        }
+        mThreads.emplace_back(&ShaderWarmup::worker, this, context, drawable);
+    }
+    mStarted = running();
+    return mStarted;
+}
+
+void ShaderWarmup::stop()
+{
+    if (mThreads.empty())
+    {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    for (std::thread& t : mThreads)
+    {
+        t.join();
+    }
+    mThreads.clear();
+    mDone.notify_all(); // nothing more will be done
+}
+
+void ShaderWarmup::finish()
+{
+    if (mThreads.empty())
+    {
+        return;
+    }
+    const int64_t pre = os::getTime();
+    for (std::thread& t : mThreads) // they return once there are no programs left
+    {
+        t.join();
+    }
+    mThreads.clear();
+    std::unique_lock<std::mutex> lock(mMutex);
+    mStats.finishTicks = os::getTime() - pre;
+    mDone.notify_all();
+}
+
+bool ShaderWarmup::take(const std::string& key, GLenum& format, std::vector<char>& binary)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    const auto it = mKeys.find(key);
+    if (it == mKeys.end())
+    {
+        mStats.misses++;
+        return false;
+    }
+    Program& program = mPrograms[it->second];
+    if (program.state == Program::QUEUED)
+    {
+        program.state = Program::TAKEN;
+    }
+    else if (program.state == Program::COMPILING)
+    {
+        const int64_t pre = os::getTime();
+        mDone.wait(lock, [&program]{ return program.state == Program::DONE; });
+        mStats.waitTicks += os::getTime() - pre;
+    }
+    if (program.state != Program::DONE || !program.linked)
+    {
+        mStats.misses++;
+        return false;
+    }
+    // Kept, since the trace may link the same shaders again
+    format = program.format;
+    binary = program.binary;
+    mStats.hits++;
+    return true;
+}
+
+ShaderWarmup::Stats ShaderWarmup::getStats()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+void ShaderWarmup::worker(Context* context, Drawable* drawable)
+{
+    GLWS::instance().MakeCurrent(drawable, context);
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mStopping)
+    {
+        while (mNext < mPrograms.size() && mPrograms[mNext].state != Program::QUEUED)
+        {
+            mNext++;
+        }
+        if (mNext == mPrograms.size())
+        {
+            break;
+        }
+        Program& program = mPrograms[mNext++];
+        program.state = Program::COMPILING;
+        lock.unlock();
+
+        const int64_t pre = os::getTime();
+        build(program);
+        const int64_t ticks = os::getTime() - pre;
+
+        lock.lock();
+        program.state = Program::DONE;
+        mStats.workTicks += ticks;
+        if (program.linked) mStats.linked++; else mStats.failed++;
+        mDone.notify_all();
+    }
+    lock.unlock();
+    GLWS::instance().MakeCurrent(nullptr, nullptr);
+    context->release();
+    drawable->release();
+}
+
+void ShaderWarmup::build(Program& program)
+{
+    const GLuint name = _glCreateProgram();
+    std::vector<GLuint> shaders;
+    for (const Shader& shader : program.shaders)
+    {
+        const GLuint id = _glCreateShader(shader.type);
+        const GLchar* source = shader.source.c_str();
+        _glShaderSource(id, 1, &source, NULL);
+        _glCompileShader(id);
+        _glAttachShader(name, id);
+        shaders.push_back(id);
+    }
+    for (const auto& attrib : program.attribLocations)
+    {
+        _glBindAttribLocation(name, attrib.first, attrib.second.c_str());
+    }
+    if (!program.varyings.empty())
+    {
+        std::vector<const GLchar*> varyings;
+        for (const std::string& varying : program.varyings)
+        {
+            varyings.push_back(varying.c_str());
+        }
+        _glTransformFeedbackVaryings(name, varyings.size(), varyings.data(), program.bufferMode);
+    }
+    if (program.separable)
+    {
+        _glProgramParameteri(name, GL_PROGRAM_SEPARABLE, GL_TRUE);
+    }
+    _glProgramParameteri(name, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    _glLinkProgram(name);
+
+    GLint status = GL_FALSE;
+    GLint length = 0;
+    _glGetProgramiv(name, GL_LINK_STATUS, &status);
+    if (status == GL_TRUE)
+    {
+        _glGetProgramiv(name, GL_PROGRAM_BINARY_LENGTH, &length);
+    }
+    if (length > 0)
+    {
+        program.binary.resize(length);
+        _glGetProgramBinary(name, length, NULL, &program.format, program.binary.data());
+        program.linked = (program.format != GL_NONE);
+    }
+    for (const GLuint id : shaders)
+    {
+        _glDeleteShader(id);
+    }
+    _glDeleteProgram(name);
+}
+
+}
@@ -0,0 +1,102 @@
+#ifndef _RETRACER_SHADER_WARMUP_HPP_
+#define _RETRACER_SHADER_WARMUP_HPP_
+
+#include "dispatch/eglimports.hpp"
+#include "retracer/retrace_options.hpp"
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace retracer {
+
+class Context;
+class Drawable;
+
+/// Compiles and links the programs of a trace on worker threads, each with its own context, while
+/// the retrace runs. The programs are found by scanning the trace for the calls that build them,
+/// and are keyed like the shader cache, so that glLinkProgram in the trace can load a program
+/// binary instead of waiting for the compiler. Workers take programs in the order the trace
+/// links them.
+class ShaderWarmup
+{
+public:
+    ~ShaderWarmup() { stop(); }
+
+    /// Find the programs the trace links up to the end of the given frame, counting swaps of
+    /// thread tid only, or of all threads if tid is -1. Returns the number of distinct programs.
+    size_t scan(const std::string& filename, unsigned endFrame, int tid);
+    /// Start compiling the programs found. Needs GLES 3 for program binaries.
+    bool start(unsigned threads, Profile profile);
+    /// Stop the threads once they are done with the programs they are working on
+    void stop();
+    /// Wait for the threads to build all the programs left, and stop them
+    void finish();
+    bool running() const { return !mThreads.empty(); }
+    /// Whether it was started, even if it has stopped since
+    bool started() const { return mStarted; }
+
+    /// Get the binary of the program with the given key, waiting for the worker if one is busy
+    /// with it. Returns false if there is none, in which case the caller should compile the
+    /// program itself. Programs no worker has started on yet are taken off the queue then,
+    /// since compiling them on the calling thread is quicker than waiting.
+    bool take(const std::string& key, GLenum& format, std::vector<char>& binary);
+
+    struct Stats
+    {
+        uint64_t programs = 0;  ///< found by the scan
+        uint64_t linked = 0;    ///< compiled and linked by the workers
+        uint64_t failed = 0;    ///< did not link on the workers
+        uint64_t hits = 0;      ///< binaries taken by the retracer
+        uint64_t misses = 0;    ///< programs the retracer had to compile itself
+        int64_t scanTicks = 0;
+        int64_t workTicks = 0;  ///< summed over all threads
+        int64_t waitTicks = 0;  ///< time the retracer waited for a worker
+        int64_t finishTicks = 0; ///< time the retracer waited for the workers to finish, before measuring
+    };
+    Stats getStats();
+
+private:
+    struct Shader
+    {
+        GLenum type;
+        std::string source;
+    };
+    struct Program
+    {
+        enum State { QUEUED, COMPILING, DONE, TAKEN };
+        std::string key;
+        std::vector<Shader> shaders;
+        std::vector<std::pair<GLuint, std::string>> attribLocations;
+        std::vector<std::string> varyings;
+        GLenum bufferMode = GL_NONE;
+        bool separable = false;
+
+        State state = QUEUED;
+        bool linked = false;
+        GLenum format = GL_NONE;
+        std::vector<char> binary;
+    };
+
+    void worker(Context* context, Drawable* drawable);
+    static void build(Program& program);
+
+    std::vector<Program> mPrograms; ///< in the order the trace links them
+    std::unordered_map<std::string, size_t> mKeys; ///< key to index in mPrograms
+    size_t mNext = 0; ///< next program for a worker to start on
+    bool mStopping = false;
+    bool mStarted = false;
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mDone;
+    Stats mStats;
+};
+
+}
+
+#endif
@@ -0,0 +1,192 @@
+#include "retracer/snapshot_writer.hpp"
+
+#include "retracer/glstate.hpp"
+#include "dispatch/eglproc_auto.hpp"
+#include "common/image.hpp"
+#include "common/os.hpp"
+#include "common/os_time.hpp"
+
+#include <string.h>
+
+namespace retracer {
+
+void SnapshotWriter::start(unsigned threads)
+{
+    stop();
+    mStopping = false;
+    mQueueLimit = threads * QUEUE_PER_THREAD;
+    for (unsigned i = 0; i < threads; i++)
+    {
+        mThreads.emplace_back(&SnapshotWriter::worker, this);
+    }
+}
+
+void SnapshotWriter::stop()
+{
+    if (mThreads.empty())
+    {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mQueued.notify_all();
+    for (std::thread& t : mThreads)
+    {
+        t.join();
+    }
+    mThreads.clear();
+}
+
+void SnapshotWriter::write(image::Image* image, const std::string& filename)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (mQueue.size() >= mQueueLimit)
+    {
+        const int64_t pre = os::getTime();
+        mTaken.wait(lock, [this]{ return mQueue.size() < mQueueLimit; });
+        mStats.blockedTicks += os::getTime() - pre;
+    }
+    mQueue.push_back(Job{ image, filename });
+    lock.unlock();
+    mQueued.notify_one();
+}
+
+SnapshotWriter::Stats SnapshotWriter::getStats()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+void SnapshotWriter::worker()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
+    {
+        mQueued.wait(lock, [this]{ return !mQueue.empty() || mStopping; });
+        if (mQueue.empty())
+        {
+            return; // stopping, and all written
+        }
+        Job job = mQueue.front();
+        mQueue.pop_front();
+        lock.unlock();
+        mTaken.notify_one();
+
+        const int64_t pre = os::getTime();
+        const bool ok = job.image->writePNG(job.filename.c_str());
+        delete job.image;
+        const int64_t ticks = os::getTime() - pre;
+        if (ok)
+        {
+            DBG_LOG("Snapshot written : %s\n", job.filename.c_str());
+        }
+        else
+        {
+            DBG_LOG("Failed to write snapshot : %s\n", job.filename.c_str());
+        }
+
+        lock.lock();
+        mStats.workTicks += ticks;
+        if (ok) mStats.written++; else mStats.failed++;
+    }
+}
+
+bool SnapshotReadback::read(int attachment, const std::string& filename, unsigned frame)
+{
+    const EGLContext context = _eglGetCurrentContext();
+    if (context != mContext)
+    {
+        if (!mPending.empty())
+        {
+            return false;
+        }
+        mFreeBuffers.clear();
+        mContext = context;
+    }
+    if (mPending.size() >= MAX_PENDING)
+    {
+        finish(mPending.front());
+        mPending.pop_front();
+    }
+
+    GLuint buffer = 0;
+    if (mFreeBuffers.empty())
+    {
+        _glGenBuffers(1, &buffer);
+    }
+    else
+    {
+        buffer = mFreeBuffers.back();
+        mFreeBuffers.pop_back();
+    }
+    image::Image* image = glstate::getDrawBufferImage(attachment, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, 4, 4, buffer);
+    if (!image)
+    {
+        mFreeBuffers.push_back(buffer);
+        return false;
+    }
+    Readback readback;
+    readback.buffer = buffer;
+    readback.fence = _glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.image = image;
+    readback.filename = filename;
+    readback.frame = frame;
+    mPending.push_back(readback);
+    mCount++;
+    return true;
+}
+
+void SnapshotReadback::collect(unsigned frame, bool wait)
+{
+    if (mPending.empty() || _eglGetCurrentContext() != mContext)
+    {
+        return;
+    }
+    // Fences signal in order, so stop at the first one that has not
+    while (!mPending.empty())
+    {
+        Readback& readback = mPending.front();
+        if (!wait && frame < readback.frame + MAX_FRAMES && _glClientWaitSync(readback.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            break;
+        }
+        finish(readback);
+        mPending.pop_front();
+    }
+}
+
+void SnapshotReadback::finish(Readback& readback)
+{
+    GLenum status;
+    do
+    {
+        status = _glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    } while (status == GL_TIMEOUT_EXPIRED);
+    _glDeleteSync(readback.fence);
+
+    GLint oldBuffer = 0;
+    _glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &oldBuffer);
+    _glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    const void* pixels = (status != GL_WAIT_FAILED) ? _glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readback.image->size(), GL_MAP_READ_BIT) : nullptr;
+    if (pixels)
+    {
+        memcpy(readback.image->pixels, pixels, readback.image->size());
+        _glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    _glBindBuffer(GL_PIXEL_PACK_BUFFER, oldBuffer);
+    mFreeBuffers.push_back(readback.buffer);
+
+    if (pixels)
+    {
+        mWriter.write(readback.image, readback.filename);
+    }
+    else
+    {
+        DBG_LOG("Failed to read back snapshot : %s\n", readback.filename.c_str());
+        delete readback.image;
+    }
+}
+
+}
@@ -0,0 +1,106 @@
+#ifndef _RETRACER_SNAPSHOT_WRITER_HPP_
+#define _RETRACER_SNAPSHOT_WRITER_HPP_
+
+#include "dispatch/eglimports.hpp"
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace image { class Image; }
+
+namespace retracer {
+
+/// Encodes snapshots as PNG and writes them to disk on worker threads. The queue is bounded, so
+/// that snapshots taken faster than they can be written hold up the retracer instead of piling up
+/// in memory.
+class SnapshotWriter
+{
+public:
+    enum { QUEUE_PER_THREAD = 2 };
+
+    ~SnapshotWriter() { stop(); }
+
+    void start(unsigned threads);
+    /// Writes everything still queued, then stops the threads
+    void stop();
+    bool running() const { return !mThreads.empty(); }
+
+    /// Takes ownership of the image. Waits while the queue is full.
+    void write(image::Image* image, const std::string& filename);
+
+    struct Stats
+    {
+        uint64_t written = 0;
+        uint64_t failed = 0;
+        int64_t workTicks = 0; ///< time spent encoding and writing, summed over all threads
+        int64_t blockedTicks = 0; ///< time the retracer waited for room in the queue
+    };
+    Stats getStats();
+
+private:
+    void worker();
+
+    struct Job
+    {
+        image::Image* image;
+        std::string filename;
+    };
+    std::vector<std::thread> mThreads;
+    std::deque<Job> mQueue;
+    size_t mQueueLimit = 0;
+    bool mStopping = false;
+    std::mutex mMutex;
+    std::condition_variable mQueued;
+    std::condition_variable mTaken;
+    Stats mStats;
+};
+
+/// Reads snapshots back into pixel pack buffers with a fence after each, so that taking one does
+/// not wait for the GPU to finish the frame. The pixels are copied out and handed to the writer
+/// once the fence has signalled, or when the snapshot is MAX_FRAMES frames old at the latest.
+/// Needs GLES 3. Readbacks are only collected on the context that made them; while some are
+/// pending on one context, snapshots on other contexts have to be taken the synchronous way.
+class SnapshotReadback
+{
+public:
+    enum { MAX_PENDING = 4, MAX_FRAMES = 2 };
+
+    explicit SnapshotReadback(SnapshotWriter& writer) : mWriter(writer) {}
+
+    /// Start reading the given color attachment of the draw framebuffer, which must be bound for
+    /// reading. Returns false if the snapshot could not be started this way.
+    bool read(int attachment, const std::string& filename, unsigned frame);
+    /// Hand the readbacks that are done to the writer. Readbacks MAX_FRAMES or more behind frame
+    /// are waited for, and with wait set, all of them are.
+    void collect(unsigned frame, bool wait);
+    size_t pending() const { return mPending.size(); }
+    uint64_t count() const { return mCount; }
+
+private:
+    struct Readback
+    {
+        GLuint buffer;
+        GLsync fence;
+        image::Image* image;
+        std::string filename;
+        unsigned frame;
+    };
+    void finish(Readback& readback);
+
+    SnapshotWriter& mWriter;
+    std::deque<Readback> mPending;
+    /// Buffers of mContext free for reuse. When snapshots move to another context, these are left
+    /// to be deleted with the old one.
+    std::vector<GLuint> mFreeBuffers;
+    EGLContext mContext = EGL_NO_CONTEXT;
+    uint64_t mCount = 0;
+};
+
+}
+
+#endif
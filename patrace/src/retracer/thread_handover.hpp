@@ -0,0 +1,206 @@
+#ifndef _RETRACER_THREAD_HANDOVER_HPP_
+#define _RETRACER_THREAD_HANDOVER_HPP_
+
+#include "common/os_time.hpp"
+
+#include <atomic>
+#include <errno.h>
+#include <stdint.h>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#else
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace retracer {
+
+/// Log2 histogram of handover latencies: bucket i counts handovers that took less than
+/// 2^i microseconds, and the last bucket all that took longer.
+struct HandoverHistogram
+{
+    enum { BUCKETS = 16 };
+    uint64_t counts[BUCKETS] = {};
+
+    void add(long long ticks)
+    {
+        const long long us = ticks * 1000000LL / os::timeFrequency;
+        int bucket = 0;
+        while (bucket < BUCKETS - 1 && us >= (1LL << bucket))
+        {
+            bucket++;
+        }
+        counts[bucket]++;
+    }
+};
+
+/// Passes the right to run between retrace threads, so that exactly one of them runs at a time.
+/// Each thread has its own flag; the running thread sets the flag of the next one, which makes
+/// everything it did visible to that thread. A waiting thread spins on its flag
+/// for a short while before going to sleep on it with a futex.
+class ThreadHandover
+{
+public:
+    enum { MAX_THREADS = 256 }; // thread ids are stored in 8 bits in the trace
+    enum { SPIN_COUNT = 2000 };
+    /// Bits of a slot's futex word
+    enum { TURN = 1, STOP_WAKE = 2 };
+
+    // Spinning only helps if the thread handing over can run at the same time
+    ThreadHandover() : mSpinCount(std::thread::hardware_concurrency() > 1 ? SPIN_COUNT : 0) {}
+
+    struct WaitResult
+    {
+        bool stopped = false;
+        bool slept = false;
+        int timeouts = 0;
+        long long latency = 0; ///< from give() to the waiter running, in os::timeFrequency units
+    };
+
+    /// Give the turn to thread index to. The caller must not touch shared state afterwards.
+    void give(int to)
+    {
+        Slot& slot = mSlots[to];
+        slot.givenAt = os::getTime();
+        slot.turn.store(TURN, std::memory_order_seq_cst); // also orders it against reading the sleeping flag
+        if (slot.sleeping.load(std::memory_order_seq_cst))
+        {
+            wake(slot);
+        }
+    }
+
+    /// Wait until thread index self has the turn, or stop becomes true. Stop is checked at least
+    /// every timeout_ms milliseconds, since it may be set without anyone calling stopAll().
+    WaitResult wait(int self, const std::atomic_bool& stop, int timeout_ms)
+    {
+        Slot& slot = mSlots[self];
+        WaitResult result;
+        for (int i = 0; i < mSpinCount; i++)
+        {
+            if (slot.turn.load(std::memory_order_acquire) & TURN)
+            {
+                return take(slot, result);
+            }
+            pause();
+        }
+        result.slept = true;
+        while (true)
+        {
+            slot.sleeping.store(true, std::memory_order_seq_cst);
+            if (slot.turn.load(std::memory_order_seq_cst) & TURN)
+            {
+                slot.sleeping.store(false, std::memory_order_relaxed);
+                return take(slot, result);
+            }
+            if (stop.load(std::memory_order_consume))
+            {
+                slot.sleeping.store(false, std::memory_order_relaxed);
+                slot.turn.fetch_and(~STOP_WAKE, std::memory_order_relaxed);
+                result.stopped = true;
+                return result;
+            }
+            if (!sleep(slot, timeout_ms))
+            {
+                result.timeouts++;
+            }
+            slot.sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    /// Forget the turns and stop wakes of a previous run. No thread may be waiting.
+    void reset()
+    {
+        for (Slot& slot : mSlots)
+        {
+            slot.turn.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /// Wake all waiting threads, after stop has been set. Like give(), this changes the futex word
+    /// first, so that a thread about to sleep on it does not miss the wake.
+    void stopAll()
+    {
+        for (Slot& slot : mSlots)
+        {
+            slot.turn.fetch_or(STOP_WAKE, std::memory_order_seq_cst);
+            if (slot.sleeping.load(std::memory_order_seq_cst))
+            {
+                wake(slot);
+            }
+        }
+    }
+
+private:
+    struct alignas(64) Slot // one cache line each, so that spinning threads do not disturb each other
+    {
+        std::atomic<int> turn{0}; // TURN and STOP_WAKE bits, also the futex word
+        std::atomic_bool sleeping{false};
+        long long givenAt = 0;
+#ifndef __linux__
+        std::mutex mutex;
+        std::condition_variable cond;
+#endif
+    };
+
+    WaitResult& take(Slot& slot, WaitResult& result)
+    {
+        slot.turn.store(0, std::memory_order_relaxed);
+        result.latency = os::getTime() - slot.givenAt;
+        return result;
+    }
+
+    static void pause()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+#ifdef __linux__
+    // Returns false on timeout
+    static bool sleep(Slot& slot, int timeout_ms)
+    {
+        struct timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        const long ret = syscall(SYS_futex, reinterpret_cast<int*>(&slot.turn), FUTEX_WAIT_PRIVATE, 0, &timeout, nullptr, 0);
+        return !(ret == -1 && errno == ETIMEDOUT);
+    }
+
+    static void wake(Slot& slot)
+    {
+        syscall(SYS_futex, reinterpret_cast<int*>(&slot.turn), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+#else
+    static bool sleep(Slot& slot, int timeout_ms)
+    {
+        std::unique_lock<std::mutex> lk(slot.mutex);
+        return slot.cond.wait_for(lk, std::chrono::milliseconds(timeout_ms), [&]{ return slot.turn.load() != 0; });
+    }
+
+    static void wake(Slot& slot)
+    {
+        std::lock_guard<std::mutex> lk(slot.mutex);
+        slot.cond.notify_one();
+    }
+#endif
+
+    const int mSpinCount;
+    Slot mSlots[MAX_THREADS];
+};
+
+}
+
+#endif
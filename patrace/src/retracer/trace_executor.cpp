@@ -103,6 +103,17 @@ void TraceExecutor::overrideDefaultsWithJson(Json::Value &value)
         options.mCpuMask = value.get("cpumask", "").asString();
     }
 
+    options.mDecodeThreads = value.get("decodeAheadThreads", options.mDecodeThreads).asInt();
+    options.mDecodeDepth = value.get("decodeAheadDepth", options.mDecodeDepth).asInt();
+    if (options.mDecodeThreads < 0 || options.mDecodeDepth < 1)
+    {
+        gRetracer.reportAndAbort("Bad value for decodeAheadThreads or decodeAheadDepth");
+    }
+    if (value.isMember("decodeCpumask"))
+    {
+        options.mDecodeCpuMask = value.get("decodeCpumask", "").asString();
+    }
+
     options.mForceSingleWindow = value.get("forceSingleWindow", options.mForceSingleWindow).asBool();
     options.mForceOffscreen = value.get("offscreen", options.mForceOffscreen).asBool();
     options.mPbufferRendering = value.get("noscreen", options.mPbufferRendering).asBool();
@@ -110,6 +121,9 @@ void TraceExecutor::overrideDefaultsWithJson(Json::Value &value)
 
     options.mOverrideConfig = eglConfig;
     options.mMeasurePerFrame = value.get("measurePerFrame", false).asBool();
+    options.mPerFrameList = value.get("perFrameList", false).asBool();
+    options.mMeasureSwapTime = value.get("measureSwapTime", false).asBool();
+    options.mMeasureGpuTime = value.get("measureGpuTime", false).asBool();
 
     if (options.mOverrideConfig.msaa_samples > 0)
         DBG_LOG("Enable multi sample: %d, for EGL window surface.\n", options.mOverrideConfig.msaa_samples);
@@ -133,6 +147,10 @@ void TraceExecutor::overrideDefaultsWithJson(Json::Value &value)
     }
 
     options.mCallStats = value.get("callStats", options.mCallStats).asBool();
+    options.mCallStatsSampleRate = std::max(1u, value.get("callStatsSampleRate", 1).asUInt());
+    options.mCallStatsRangeFrames = value.get("callStatsRange", 0).asUInt();
+    options.mNullDriver = value.get("nullDriver", options.mNullDriver).asBool();
+    options.mNullDriverSampleRate = std::max(1u, value.get("nullDriverSampleRate", options.mNullDriverSampleRate).asUInt());
     if (options.mCallStats && !usedFramerange)
     {
         gRetracer.reportAndAbort("callStats requires frames to also be present in the JSON input!\n");
@@ -171,6 +189,9 @@ void TraceExecutor::overrideDefaultsWithJson(Json::Value &value)
     options.mPerfEvent = value.get("perfevent", "").asString();
     options.mPerfCmd = value.get("perfcmd", "").asString();
     options.mPreload = value.get("preload", false).asBool();
+    options.mPreloadBudget = (size_t)value.get("preloadBudget", 0).asUInt() * 1024 * 1024;
+    options.mPredecode = value.get("predecode", false).asBool();
+    options.mZeroCopyCSBLimit = (size_t)value.get("zeroCopyCSB", 0).asUInt() * 1024 * 1024;
     options.mRunAll = value.get("runAllCalls", false).asBool();
 
     // Values needed by CLI and GUI
@@ -200,6 +221,9 @@ void TraceExecutor::overrideDefaultsWithJson(Json::Value &value)
     }
 
     options.mSnapshotFrameNames = value.get("snapshotFrameNames", false).asBool();
+    options.mSnapshotThreads = value.get("snapshotThreads", 0).asUInt();
+    options.mSnapshotHash = value.get("snapshotHash", false).asBool();
+    options.mSnapshotHashTile = value.get("snapshotHashTile", 0).asUInt();
 
     // Whether or not to upload taken snapshots.
     options.mUploadSnapshots = value.get("snapshotUpload", false).asBool();
@@ -308,6 +332,9 @@ void TraceExecutor::overrideDefaultsWithJson(Json::Value &value)
         options.mShaderCacheLoad = false;
     }
     options.mCacheOnly = value.get("cacheOnly", options.mCacheOnly).asBool();
+    options.mShaderWarmupThreads = value.get("shaderWarmupThreads", 0).asUInt();
+    options.mStateOnly = value.get("stateOnly", false).asBool();
+    if (options.mShaderWarmupThreads > 0 && options.mShaderCacheFile.size() > 0) gRetracer.reportAndAbort("shaderWarmupThreads cannot be used together with loadShaderCache or saveShaderCache in the JSON input!");
     if (value.isMember("loadShaderCache") && value.isMember("saveShaderCache")) gRetracer.reportAndAbort("loadShaderCache and saveShaderCache cannot be used at the same time in the JSON input!");
     if (!value.isMember("saveShaderCache") && value.isMember("cacheOnly")) gRetracer.reportAndAbort("cacheOnly requires saveShaderCache to also be present in the JSON input!");
 
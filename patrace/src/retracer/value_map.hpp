@@ -5,7 +5,9 @@
 #ifndef _WIN32
 #include <unistd.h>
 #endif
+#include <algorithm>
 #include <unordered_map>
+#include <vector>
 
 namespace retracer {
 
@@ -44,100 +46,133 @@ private:
     V mNull;
 };
 
+/// Translates object names from the trace to the names the driver gave us, or back. Names
+/// index a two-level table directly: a directory of pages of PAGE_SIZE entries, where a page is
+/// only allocated once PROMOTE_COUNT names in it have been written. Until then, and for names
+/// beyond the directory's size limit, names are kept one by one in a hash map, so that sparse
+/// names do not cost a page each. Unallocated pages all share one page of zeros, so a lookup of
+/// a dense name is a bounds check and two loads.
 template <class T>
 class hmap {
 private:
-    static const unsigned int KEY_LIMIT = 10*1024;
-    // map for small keys (< KEY_LIMIT)
-    T *mpData;
-    // map for large keys (>= KEY_LIMIT)
-    std::unordered_map<T, T> mMap;
+    enum
+    {
+        PAGE_BITS = 10,
+        PAGE_SIZE = 1 << PAGE_BITS,
+        MAX_DIRECT_PAGES = 64 * 1024, // names below 64M
+        PROMOTE_COUNT = 32,
+    };
+    static T sZeroPage[PAGE_SIZE]; // never written
+
+    std::vector<T*> mPages;
+    std::vector<unsigned short> mSparseCounts; // per page, names of it in mSparse
+    std::unordered_map<T, T> mSparse;
+
+    T& sparseLValue(const T& key, size_t page)
+    {
+        if (page >= MAX_DIRECT_PAGES)
+        {
+            return mSparse[key];
+        }
+        const auto it = mSparse.find(key);
+        if (it != mSparse.end())
+        {
+            return it->second;
+        }
+        if (page >= mPages.size())
+        {
+            const size_t size = std::min<size_t>(std::max(page + 1, mPages.size() * 2), MAX_DIRECT_PAGES);
+            mPages.resize(size, sZeroPage);
+            mSparseCounts.resize(size, 0);
+        }
+        if (++mSparseCounts[page] < PROMOTE_COUNT)
+        {
+            return mSparse[key];
+        }
 
-    unsigned int mSize;
-    T mNull;
+        // Dense enough to be worth a page, so move the page's names over
+        T* data = new T[PAGE_SIZE]();
+        const size_t first = page << PAGE_BITS;
+        for (size_t i = 0; i < PAGE_SIZE; i++)
+        {
+            const auto moved = mSparse.find((T)(first + i));
+            if (moved != mSparse.end())
+            {
+                data[i] = moved->second;
+                mSparse.erase(moved);
+            }
+        }
+        mPages[page] = data;
+        return data[key & (PAGE_SIZE - 1)];
+    }
 
 public:
-    hmap():mpData(NULL), mSize(0)
-    {
-        resize(128);
-        mNull = 0;
-    }
+    hmap() : mPages(1, sZeroPage), mSparseCounts(1, 0) {}
 
     ~hmap()
     {
-        delete [] mpData;
+        for (T* page : mPages)
+        {
+            if (page != sZeroPage) delete [] page;
+        }
     }
 
-    std::unordered_map<T, T> GetCopy()
-    {
-        std::unordered_map<T, T> newMap = mMap;
+    hmap(const hmap&) = delete;
+    hmap& operator=(const hmap&) = delete;
 
-        for(size_t i = 0; i < mSize; i++)
+    std::unordered_map<T, T> GetCopy() const
+    {
+        std::unordered_map<T, T> newMap;
+        for (size_t page = 0; page < mPages.size(); page++)
         {
-            if (mpData[i] != 0)
+            if (mPages[page] == sZeroPage) continue;
+            for (size_t i = 0; i < PAGE_SIZE; i++)
             {
-                newMap[i] = mpData[i];
+                if (mPages[page][i] != 0)
+                {
+                    newMap[(T)((page << PAGE_BITS) + i)] = mPages[page][i];
+                }
+            }
+        }
+        for (const auto& entry : mSparse)
+        {
+            if (entry.second != 0)
+            {
+                newMap[entry.first] = entry.second;
             }
         }
-
         return newMap;
     }
 
     inline T& LValue(const T& key)
     {
-        if (key < KEY_LIMIT) {
-            if (((unsigned int)key) >= mSize)
-                resize(key);
-            return mpData[key];
-        }
-        const auto it = mMap.find(key);
-        if (it == mMap.end())
+        const size_t page = (size_t)key >> PAGE_BITS;
+        if (page < mPages.size() && mPages[page] != sZeroPage)
         {
-            mMap.insert(std::pair<T, T>(key, mNull));
+            return mPages[page][key & (PAGE_SIZE - 1)];
         }
-        return mMap.at(key);
+        return sparseLValue(key, page);
     }
 
     inline const T& RValue(const T& key) const
     {
-        if (key < KEY_LIMIT) {
-            if (((unsigned int)key) >= mSize)
-                return mNull;
-            return mpData[key];
-        }
-        //DBG_LOG("Map index (%u) larger than KEY_LIMIT, using map instead of array.\n", (unsigned)key);
-        const auto it = mMap.find(key);
-        if (it == mMap.end())
+        const size_t page = (size_t)key >> PAGE_BITS;
+        if (page < mPages.size() && mPages[page] != sZeroPage)
         {
-            return mNull;
+            return mPages[page][key & (PAGE_SIZE - 1)];
         }
-        else
+        if (mSparse.empty())
         {
-            return it->second;
+            return sZeroPage[0];
         }
-    }
-
-    void resize(unsigned int sz)
-    {
-        if (sz < mSize)
-            return;
-
-        int newSz = 1;
-        for (; sz ; sz>>=1, newSz<<=1)
-            ;
-
-        newSz <<= 2;
-
-        T *newData = new T[newSz];
-        if (mpData)
-            memcpy(newData, mpData, mSize*sizeof(T));
-        memset(newData+mSize, 0, (newSz-mSize)*sizeof(T));
-        delete [] mpData;
-        mpData = newData;
-        mSize = newSz;
+        const auto it = mSparse.find(key);
+        return it != mSparse.end() ? it->second : sZeroPage[0];
     }
 };
 
+template <class T>
+T hmap<T>::sZeroPage[hmap<T>::PAGE_SIZE];
+
 // The logic in this map is specific for <attribute location> and <uniform location>.
 class locationmap {
 private:
@@ -175,6 +175,19 @@ void ParseInterface::writeout(common::OutFile &outputFile, common::CallTM *call)
     outputFile.Write(buffer, dest-buffer);
 }
 
+bool ParseInterface::seek_frame(int frame)
+{
+    if (!inputFile.seekToFrame(frame, only_default ? (int)defaultTid : -1))
+    {
+        return false;
+    }
+    frames = frame;
+    mCallNo = inputFile.curCallNo + 1;
+    current_pos.frame = frames;
+    current_pos.call = mCallNo;
+    return true;
+}
+
 static void unbind_renderbuffers_if(StateTracker::Context& context, const int fb_index, bool renderBuffer, GLuint id)
 {
     if (fb_index == UNBOUND) return;
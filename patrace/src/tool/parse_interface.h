@@ -805,8 +805,12 @@ public:
 
     virtual void writeout(common::OutFile &outputFile, common::CallTM *call);
 
+    /// Skip to the given frame using the seek index, without interpreting the calls in between.
+    /// Returns false if the trace has no seek index.
+    bool seek_frame(int frame);
+
     common::InFile inputFile;
-    common::OutFile outputFile = "trace";
+    common::OutFile outputFile{"trace"};
     common::CallTM *mCall = nullptr;
 
 private:
@@ -0,0 +1,307 @@
+// Recompress the chunks of a trace file with another codec, without parsing any calls.
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/file_format.hpp"
+#include "common/chunk_codec.hpp"
+#include "common/os.hpp"
+#include "tool/config.hpp"
+#include "tool/utils.hpp"
+
+#include "json/writer.h"
+#include "json/reader.h"
+
+static void printHelp()
+{
+    std::cout <<
+        "Usage : repack [OPTIONS] <source trace> <target trace>\n"
+        "Recompresses all chunks of a trace. The calls are not changed.\n"
+        "Options:\n"
+        "  -codec NAME   codec to use: snappy (default), zlib or zlib:LEVEL with LEVEL 1 to 9\n"
+        "  -threads N    number of compression threads, default is the number of CPU cores\n"
+        "  -h            print help\n"
+        "  -v            print version\n"
+        ;
+}
+
+static void printVersion()
+{
+    std::cout << PATRACE_VERSION << std::endl;
+}
+
+struct Chunk
+{
+    std::vector<char> input;
+    unsigned codec;
+    std::vector<char> uncompressed;
+    std::vector<char> output;
+    size_t outputLength;
+};
+
+// Read the header in front of a chunk. field is its first 32 bit field, to tell the seek index apart.
+static bool readChunkHeader(FILE *in, uint32_t& field, unsigned& codec, uint32_t& length, size_t& headerLength)
+{
+    char buf[CHUNK_HEADER_MAX_LENGTH];
+    if (fread(buf, 4, 1, in) != 1)
+    {
+        return false;
+    }
+    field = common::readLE32(buf);
+    if (field == SEEK_INDEX_MARKER)
+    {
+        return true;
+    }
+    headerLength = common::chunkHeaderLength(field);
+    if (headerLength > 4 && fread(buf + 4, headerLength - 4, 1, in) != 1)
+    {
+        return false;
+    }
+    return common::readChunkHeader(buf, headerLength, codec, length) != 0;
+}
+
+static void recompress(Chunk& chunk, unsigned codec, int level)
+{
+    const common::ChunkCodec* decoder = common::getChunkCodec(chunk.codec);
+    size_t length = 0;
+    if (!decoder || !decoder->uncompressedLength(chunk.input.data(), chunk.input.size(), &length))
+    {
+        DBG_LOG("Failed to parse chunk of size %u - file is corrupt - aborting!\n", (unsigned)chunk.input.size());
+        os::abort();
+    }
+    chunk.uncompressed.resize(length);
+    if (!decoder->uncompress(chunk.input.data(), chunk.input.size(), chunk.uncompressed.data()))
+    {
+        DBG_LOG("Failed to decompress chunk of size %u - file is corrupt - aborting!\n", (unsigned)chunk.input.size());
+        os::abort();
+    }
+    const common::ChunkCodec* encoder = common::getChunkCodec(codec);
+    chunk.output.resize(encoder->maxCompressedLength(length));
+    chunk.outputLength = encoder->compress(chunk.uncompressed.data(), length, chunk.output.data(), level);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned codec = common::CHUNK_CODEC_SNAPPY;
+    int level = -1;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int argIndex = 1;
+    for (; argIndex < argc; ++argIndex)
+    {
+        const char *arg = argv[argIndex];
+
+        if (arg[0] != '-')
+            break;
+
+        if (!strcmp(arg, "-h"))
+        {
+            printHelp();
+            return 1;
+        }
+        else if (!strcmp(arg, "-v"))
+        {
+            printVersion();
+            return 0;
+        }
+        else if (!strcmp(arg, "-codec") && argIndex + 1 < argc)
+        {
+            if (!common::parseChunkCodec(argv[++argIndex], codec, level))
+            {
+                printf("Error: Unknown codec %s\n", argv[argIndex]);
+                return 1;
+            }
+        }
+        else if (!strcmp(arg, "-threads") && argIndex + 1 < argc)
+        {
+            threads = std::max(1, atoi(argv[++argIndex]));
+        }
+        else
+        {
+            printf("Error: Unknow option %s\n", arg);
+            printHelp();
+            return 1;
+        }
+    }
+
+    if (argIndex + 2 > argc)
+    {
+        printHelp();
+        return 1;
+    }
+    const char* source_trace_filename = argv[argIndex++];
+    const char* target_trace_filename = argv[argIndex++];
+
+    FILE *in = fopen(source_trace_filename, "rb");
+    if (!in)
+    {
+        DBG_LOG("Failed to open for reading: %s\n", source_trace_filename);
+        return 1;
+    }
+    common::BHeaderV3 header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magicNo != 0x20122012
+        || header.version < common::HEADER_VERSION_3 || header.version > common::HEADER_VERSION_4)
+    {
+        DBG_LOG("%s is not a trace file of version 3 or above\n", source_trace_filename);
+        return 1;
+    }
+    std::vector<char> jsonArea(header.jsonFileEnd - sizeof(header));
+    if (fread(jsonArea.data(), jsonArea.size(), 1, in) != 1)
+    {
+        DBG_LOG("Failed to read the header of %s\n", source_trace_filename);
+        return 1;
+    }
+    Json::Value json;
+    Json::Reader reader;
+    if (!reader.parse(std::string(jsonArea.data() + header.jsonFileBegin - sizeof(header), header.jsonLength), json))
+    {
+        DBG_LOG("Failed to parse the JSON header of %s\n", source_trace_filename);
+        return 1;
+    }
+
+    FILE *out = fopen(target_trace_filename, "wb");
+    if (!out)
+    {
+        DBG_LOG("Failed to open for writing: %s\n", target_trace_filename);
+        return 1;
+    }
+    // The header is rewritten at the end
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(jsonArea.data(), jsonArea.size(), 1, out);
+
+    // Recompress batches of chunks in parallel and write each batch in file order
+    std::vector<uint64_t> newOffsets;
+    uint64_t offset = header.jsonFileEnd;
+    uint64_t inputBytes = 0, outputBytes = 0;
+    std::vector<Chunk> batch(threads * 4);
+    bool done = false;
+    while (!done)
+    {
+        size_t count = 0;
+        uint32_t field = 0;
+        unsigned chunkCodec = common::CHUNK_CODEC_SNAPPY;
+        uint32_t chunkLength = 0;
+        size_t headerLength = 0;
+        while (count < batch.size() && readChunkHeader(in, field, chunkCodec, chunkLength, headerLength))
+        {
+            if (field == SEEK_INDEX_MARKER)
+            {
+                done = true;
+                break;
+            }
+            Chunk& chunk = batch[count++];
+            chunk.codec = chunkCodec;
+            chunk.input.resize(chunkLength);
+            inputBytes += headerLength + chunkLength;
+            if (fread(chunk.input.data(), chunk.input.size(), 1, in) != 1 && !chunk.input.empty())
+            {
+                DBG_LOG("Chunk is truncated - file is corrupt\n");
+                return 1;
+            }
+        }
+        if (count < batch.size())
+        {
+            done = true;
+        }
+
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> workers;
+        for (int i = 0; i < std::min<int>(threads, count); i++)
+        {
+            workers.push_back(std::thread([&]{
+                for (size_t j = next++; j < count; j = next++)
+                {
+                    recompress(batch[j], codec, level);
+                }
+            }));
+        }
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const Chunk& chunk = batch[i];
+            if (chunk.outputLength >= CHUNK_CODEC_MARKER)
+            {
+                DBG_LOG("Compressed chunk of %u bytes is too large for the file format\n", (unsigned)chunk.outputLength);
+                return 1;
+            }
+            char outHeader[CHUNK_HEADER_MAX_LENGTH];
+            const size_t outHeaderLength = common::writeChunkHeader(outHeader, codec, chunk.outputLength);
+            fwrite(outHeader, outHeaderLength, 1, out);
+            fwrite(chunk.output.data(), chunk.outputLength, 1, out);
+            newOffsets.push_back(offset);
+            offset += outHeaderLength + chunk.outputLength;
+            outputBytes += outHeaderLength + chunk.outputLength;
+        }
+    }
+
+    // Carry the seek index over, with the new chunk offsets
+    if (json.isMember("seekIndex"))
+    {
+        const Json::Value index = json["seekIndex"];
+        json.removeMember("seekIndex");
+        std::vector<char> data(index.get("size", 0).asUInt64());
+        common::BSeekIndexHeader indexHeader;
+        if (data.size() >= sizeof(indexHeader)
+            && fseek(in, index.get("offset", 0).asInt64(), SEEK_SET) == 0
+            && fread(data.data(), data.size(), 1, in) == 1)
+        {
+            memcpy(&indexHeader, data.data(), sizeof(indexHeader));
+        }
+        if (indexHeader.chunkCount == newOffsets.size()
+            && data.size() == sizeof(indexHeader) + indexHeader.chunkCount * sizeof(common::BSeekIndexChunk)
+                                                  + indexHeader.swapCount * sizeof(common::BSeekIndexSwap))
+        {
+            common::BSeekIndexChunk *chunks = (common::BSeekIndexChunk *)(data.data() + sizeof(indexHeader));
+            for (unsigned i = 0; i < indexHeader.chunkCount; i++)
+            {
+                chunks[i].offset = newOffsets[i];
+            }
+            fwrite(data.data(), data.size(), 1, out);
+            json["seekIndex"] = index;
+            json["seekIndex"]["offset"] = (Json::Int64)offset;
+        }
+        else
+        {
+            DBG_LOG("Seek index does not match the chunks - dropping it\n");
+        }
+    }
+    fclose(in);
+
+    Json::Value info;
+    info["codec"] = common::getChunkCodec(codec)->name();
+    if (level >= 0)
+    {
+        info["level"] = level;
+    }
+    addConversionEntry(json, "repack", source_trace_filename, info);
+    Json::FastWriter writer;
+    const std::string jsonString = writer.write(json);
+    if ((long long)jsonString.size() > header.jsonFileEnd - header.jsonFileBegin)
+    {
+        DBG_LOG("JSON header too long: %u bytes\n", (unsigned)jsonString.size());
+        return 1;
+    }
+    header.jsonLength = jsonString.size();
+    fseek(out, header.jsonFileBegin, SEEK_SET);
+    fwrite(jsonString.c_str(), jsonString.size(), 1, out);
+    fseek(out, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, out);
+    if (fclose(out) != 0)
+    {
+        DBG_LOG("Failed to write %s\n", target_trace_filename);
+        return 1;
+    }
+
+    printf("Repacked %u chunks with %s: %llu -> %llu bytes\n", (unsigned)newOffsets.size(), common::getChunkCodec(codec)->name(),
+           (unsigned long long)inputBytes, (unsigned long long)outputBytes);
+    return 0;
+}
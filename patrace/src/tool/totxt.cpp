@@ -14,6 +14,7 @@ static int our_tid = -1;
 static bool verbose = false;
 static bool colours = false;
 static bool bare = false;
+static bool seek = false;
 
 #define RED   "\x1B[31m"
 #define GRN   "\x1B[32m"
@@ -33,6 +34,8 @@ void usage(const char *argv0)
         "\n"
         "  -help  Display this message\n"
         "  -f <f> <l> Define frame interval, inclusive\n"
+        "  -seek  With -f, jump straight to the first frame if the trace has a seek index. State such as\n"
+        "         the current context is then not tracked through the skipped frames.\n"
         "  -tid   <thread_id> Only the function calls invoked by thread <thread_id> will be printed\n"
         "  -v     Verbose output\n"
         "  -c     Add colours\n"
@@ -199,6 +202,10 @@ int main(int argc, const char* argv[])
                 return -1;
             }
         }
+        else if (!strcmp(arg, "-seek"))
+        {
+            seek = true;
+        }
         else if (!strcmp(arg, "-tid"))
         {
             our_tid = readValidValue(argv[++i]);
@@ -237,6 +244,10 @@ int main(int argc, const char* argv[])
         std::cerr << "Failed to open for reading: " << filename << std::endl;
         return 1;
     }
+    if (seek && start_frame > 0 && !inputFile.seek_frame(start_frame))
+    {
+        DBG_LOG("No seek index for frame %d - reading from the start\n", start_frame);
+    }
     common::CallTM *call = nullptr;
     while ((call = inputFile.next_call()) && callback(inputFile, call, fp)) {}
     fclose(fp);
@@ -4,7 +4,7 @@
 // Makes trace files look like they have been created with a very old tracer by optimizing their sigbooks.
 //
 // To compile:
-// gcc -o update_dictionary patrace/src/tool/update_dictionary.cpp patrace/src/common/out_file.cpp -Wall -g -O3 -I thirdparty/snappy -std=c++11 builds/patrace/x11_x64/debug/snappy/libsnappy_bundled.a -lstdc++ -I patrace/src
+// gcc -o update_dictionary patrace/src/tool/update_dictionary.cpp patrace/src/common/out_file.cpp patrace/src/common/chunk_codec.cpp -Wall -g -O3 -I thirdparty/snappy -std=c++11 builds/patrace/x11_x64/debug/snappy/libsnappy_bundled.a -lz -lstdc++ -I patrace/src
 //
 
 #include <assert.h>
@@ -17,6 +17,7 @@
 #include <stdbool.h>
 
 #include <snappy.h>
+#include "common/chunk_codec.hpp"
 
 #include "common/out_file.hpp"
 
@@ -63,10 +64,10 @@ void mywrite(const void *data, size_t size, FILE *fp)
 }
 
 // no idea why we're doing conversion stuff only here but ignore it everywhere else
-bool read_compressed_length(unsigned *length, FILE *in)
+bool read_compressed_length(unsigned *length, const common::ChunkCodec **codec, FILE *in)
 {
-	unsigned char buf[4];
-	if (fread(buf, sizeof(buf), 1, in) != 1)
+	unsigned char buf[CHUNK_HEADER_MAX_LENGTH];
+	if (fread(buf, 4, 1, in) != 1)
 	{
 		if (feof(in))
 		{
@@ -75,10 +76,27 @@ bool read_compressed_length(unsigned *length, FILE *in)
 		printf("Error: %s\n", strerror(ferror(in)));
 		exit(1);
 	}
-	*length  =  (size_t)buf[0];
-	*length |= ((size_t)buf[1] <<  8);
-	*length |= ((size_t)buf[2] << 16);
-	*length |= ((size_t)buf[3] << 24);
+	const uint32_t field = common::readLE32((const char *)buf);
+	if (field == SEEK_INDEX_MARKER)
+	{
+		return false; // seek index follows the last chunk
+	}
+	const size_t headerLength = common::chunkHeaderLength(field);
+	unsigned codecId = common::CHUNK_CODEC_SNAPPY;
+	uint32_t chunkLength = 0;
+	if ((headerLength > 4 && fread(buf + 4, headerLength - 4, 1, in) != 1)
+	    || !common::readChunkHeader((const char *)buf, headerLength, codecId, chunkLength))
+	{
+		printf("Chunk header is truncated\n");
+		exit(1);
+	}
+	*codec = common::getChunkCodec(codecId);
+	if (!*codec)
+	{
+		printf("Unknown chunk codec %u\n", codecId);
+		exit(1);
+	}
+	*length = chunkLength;
 	return true;
 }
 
@@ -142,6 +160,7 @@ int main(int argc, char **argv)
 
 	// Find size of uncompressed data buffer -- parsing everything twice, which is wildly inefficient but don't care
 	uint32_t compressed_length = 0;
+	const common::ChunkCodec *codec = nullptr;
 	size_t size = 0;
 	size_t start_pos = ftell(in);
 	size_t uncompressed_length = 0;
@@ -149,14 +168,14 @@ int main(int argc, char **argv)
 	for (;;)
 	{
 		// Read chunk length
-		if (!read_compressed_length(&compressed_length, in))
+		if (!read_compressed_length(&compressed_length, &codec, in))
 		{
 			printf("Done reading first round\n");
 			break;
 		}
 		buffer_compressed.resize(compressed_length);
 		myread(buffer_compressed.data(), compressed_length, in, "reading chunk pass 1");
-		if (snappy::GetUncompressedLength(buffer_compressed.data(), buffer_compressed.size(), &size) == false)
+		if (codec->uncompressedLength(buffer_compressed.data(), buffer_compressed.size(), &size) == false)
 		{
 			printf("Error checking chunk size (pass 1)\n");
 			abort();
@@ -172,19 +191,19 @@ int main(int argc, char **argv)
 	for (;;)
 	{
 		// Read chunk length
-		if (!read_compressed_length(&compressed_length, in))
+		if (!read_compressed_length(&compressed_length, &codec, in))
 		{
 			printf("Done reading second round\n");
 			break;
 		}
 		buffer_compressed.resize(compressed_length);
 		myread(buffer_compressed.data(), compressed_length, in, "reading chunk pass 2");
-		if (snappy::GetUncompressedLength(buffer_compressed.data(), buffer_compressed.size(), &size) == false)
+		if (codec->uncompressedLength(buffer_compressed.data(), buffer_compressed.size(), &size) == false)
 		{
 			printf("Error checking chunk size (pass 2)\n");
 			abort();
 		}
-		if (snappy::RawUncompress(buffer_compressed.data(), buffer_compressed.size(), &big_buffer.data()[big_counter]) == false)
+		if (codec->uncompress(buffer_compressed.data(), buffer_compressed.size(), &big_buffer.data()[big_counter]) == false)
 		{
 			printf("Error decompressing chunk (pass 2)\n");
 			abort();
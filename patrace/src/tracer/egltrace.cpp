@@ -57,7 +57,14 @@ struct MyEGLContext
 static std::map<EGLContext, TraceContext*> gCtxMap;
 static std::map<EGLSurface, TraceSurface*> gSurfMap;
 static thread_local int thread_id = -1;
+// Gives back the write buffer of a thread when it exits
+struct ThreadExit
+{
+    ~ThreadExit() { if (gTraceOut && thread_id != -1) gTraceOut->ReleaseThread(thread_id); }
+};
+static thread_local ThreadExit thread_exit;
 static int threads = 0; // atomic protected by gcc/clang atomics, not c++11 atomics, since the latter cannot be default initialized
+static unsigned programGeneration = 0; // as above; changed whenever the active attributes of any program may change
 static std::vector<std::unordered_map<int, int>> timesEGLConfigIdUsed;
 static std::unordered_map<int, MyEGLAttribs> configIdToConfigAttribsMap;
 std::vector<TraceThread> gTraceThread(PATRACE_THREAD_LIMIT);
@@ -89,7 +96,7 @@ const std::string& get_extension_string()
 
 static void callback(unsigned int source, unsigned int type, unsigned int id, unsigned int severity, int length, const char* message, const void* userParam)
 {
-    DBG_LOG("%s::%s::%s (call=%u): %s\n", cbsource(source), cbtype(type), cbseverity(severity), gTraceOut->callNo, message);
+    DBG_LOG("%s::%s::%s (call=%u): %s\n", cbsource(source), cbtype(type), cbseverity(severity), gTraceOut->callNo.load(), message);
 }
 
 static MyEGLAttribArray GetBestConfigPerThread()
@@ -152,6 +159,14 @@ BinAndMeta::BinAndMeta()
     free(bn);
 
     traceFile = new OutFile;
+    if (tracerParams.TraceFileWriterThreads >= 0)
+    {
+        traceFile->setAsync(tracerParams.TraceFileWriterThreads);
+    }
+    if (tracerParams.SeekIndex)
+    {
+        traceFile->setSeekIndex(true);
+    }
     traceFile->Open(binName.str());
 
     // Reset per thread counters
@@ -179,7 +194,7 @@ static void addEGLConfigToJSON(Json::Value& v, const MyEGLAttribs& config)
 
 void BinAndMeta::writeHeader(bool cleanExit)
 {
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex); // need to lock against both file access and global EGL config access here
+    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex); // global EGL config access
 
     MyEGLAttribArray perThreadEGLConfigs = GetBestConfigPerThread();
 
@@ -204,6 +219,7 @@ void BinAndMeta::writeHeader(bool cleanExit)
     }
     jsonRoot["tracer"] = PATRACE_VERSION;
     jsonRoot["tracer_extensions"] = tracerParams.SupportedExtensionsString;
+    jsonRoot["clientSideBufferDigest"] = common::digestKindName(common::bufferDigestKind());
 
     // add date of trace capture
     char tmpstr[40];
@@ -315,6 +331,7 @@ void BinAndMeta::writeHeader(bool cleanExit)
     std::string jsonData = writer.write(jsonRoot);
 
     // Now that we have all header data written to JSON, write it to reserved header-area
+    std::lock_guard<std::mutex> fileGuard(gTraceOut->writeMutex);
     if (0 != jsonData.length())
     {
         traceFile->WriteHeader(jsonData.c_str(), jsonData.length(), !tracerParams.FlushTraceFileEveryFrame);
@@ -402,14 +419,112 @@ std::string BinAndMeta::getFileName() const
     return traceFile->getFileName();
 }
 
-TraceOut::TraceOut() : writebuf(new char[WRITE_BUF_LEN])
+TraceOut::TraceOut()
 {
 }
 
 TraceOut::~TraceOut()
 {
     Close();
-    delete [] writebuf;
+    for (ThreadCalls& calls : mThreadCalls)
+    {
+        delete [] calls.writebuf;
+    }
+}
+
+void TraceOut::Open()
+{
+    mpBinAndMeta = new BinAndMeta();
+    mStateLogger.open(mpBinAndMeta->getFileName() + ".tracelog");
+}
+
+void TraceOut::EndCalls(int tid, const char* endPointer)
+{
+    ThreadCalls& calls = mThreadCalls[tid];
+    const size_t size = endPointer - calls.writebuf;
+    if (size > calls.capacity)
+    {
+        DBG_LOG("Write buffer overflow (%lu > %lu)\n", (unsigned long)size, (unsigned long)calls.capacity);
+        abort(); // we've already overwritten memory, no way to recover
+    }
+
+    WriteCalls(calls, endPointer);
+    if (calls.capacity > WRITE_BUF_KEEP_LEN)
+    {
+        ReleaseThread(tid);
+    }
+}
+
+void TraceOut::ReleaseThread(int tid)
+{
+    ThreadCalls& calls = mThreadCalls[tid];
+    delete [] calls.writebuf;
+    calls.writebuf = nullptr;
+    calls.capacity = 0;
+}
+
+void TraceOut::WriteCalls(const ThreadCalls& calls, const char* endPointer)
+{
+    const size_t size = endPointer - calls.writebuf;
+    std::lock_guard<std::mutex> guard(writeMutex);
+    if (mpBinAndMeta == NULL)
+    {
+        Open();
+    }
+    if (calls.firstCallNo != mNextWriteNo)
+    {
+        // Another thread is still serializing a call before these
+        HeldCalls& held = mHeldCalls[calls.firstCallNo];
+        held.count = calls.count;
+        held.data.assign((const char*)calls.writebuf, endPointer);
+        mHeldCallCount += calls.count;
+        return;
+    }
+    mpBinAndMeta->write(calls.writebuf, size);
+    mNextWriteNo += calls.count;
+
+    // Then the calls that were waiting for these
+    auto it = mHeldCalls.begin();
+    while (it != mHeldCalls.end() && it->first == mNextWriteNo)
+    {
+        mpBinAndMeta->write(it->second.data.data(), it->second.data.size());
+        mNextWriteNo += it->second.count;
+        it = mHeldCalls.erase(it);
+    }
+}
+
+void TraceOut::Close()
+{
+    {
+        std::lock_guard<std::mutex> guard(writeMutex);
+        if (!mHeldCalls.empty())
+        {
+            // Some call before these was never finished, so do not leave the rest out
+            DBG_LOG("Call %u was never written, writing the %u calls after it anyway\n", mNextWriteNo, (unsigned)mHeldCalls.size());
+            for (const auto& held : mHeldCalls)
+            {
+                if (mpBinAndMeta) mpBinAndMeta->write(held.second.data.data(), held.second.data.size());
+            }
+            mHeldCalls.clear();
+        }
+        if (mHeldCallCount)
+        {
+            DBG_LOG("%llu calls were held for calls before them on other threads\n", (unsigned long long)mHeldCallCount);
+        }
+        mNextWriteNo = 0;
+        mHeldCallCount = 0;
+    }
+    if (mpBinAndMeta)
+    {
+        mpBinAndMeta->callCnt = callNo;
+        mpBinAndMeta->frameCnt = frameNo;
+        mStateLogger.close();
+        delete mpBinAndMeta;
+        mpBinAndMeta = NULL;
+    }
+    callNo = 0;
+    frameNo = 0;
+    snapDraw = false;
 }
 
 unsigned char GetThreadId()
@@ -417,6 +532,7 @@ unsigned char GetThreadId()
     if (thread_id == -1)
     {
         thread_id = __atomic_fetch_add(&threads, 1, __ATOMIC_SEQ_CST);
+        (void)&thread_exit; // constructs it, so that it is destroyed when the thread exits
     }
     return __atomic_load_n(&thread_id, __ATOMIC_ACQUIRE);
 }
@@ -436,6 +552,23 @@ TraceContext* GetCurTraceContext(unsigned char tid)
     return gTraceThread.at(tid).mCurCtx;
 }
 
+ShadowState* GetShadowState(unsigned char tid)
+{
+    TraceContext* ctx = gTraceThread.at(tid).mCurCtx;
+    return (ctx && ctx->mShadow.initialized()) ? &ctx->mShadow : NULL;
+}
+
+GLuint GetShadowBoundBuffer(unsigned char tid, GLenum target)
+{
+    GLuint buffer = 0;
+    const ShadowState* shadow = GetShadowState(tid);
+    if (shadow && shadow->boundBuffer(target, buffer))
+    {
+        return buffer;
+    }
+    return getBoundBuffer(target);
+}
+
 TraceContext::TraceContext(EGLContext ctx, EGLint configId): mEGLCtx(ctx), mEGLConfigId(configId)
 {
     if (gCtxMap.find(mEGLCtx) != gCtxMap.end())
@@ -543,7 +676,15 @@ void after_glBindAttribLocation(unsigned char tid, GLuint program, GLuint index)
     it->second |= (0x1 << index);
 }
 
-void after_glMapBufferRange(GLenum target, GLsizeiptr length, GLbitfield access, GLvoid* base)
+static const unsigned int CSB_PATCH_MIN_BUFFER_SIZE = 0x8000; // 32kB
+static const unsigned int CSB_PATCH_PAGE_SIZE = 0x400; // 1kB
+static const float CSB_PATCH_UP_THRESHOLD = 0.8;
+
+// Bytes of buffers mapped with glMapBuffer and unmapped in this frame, and of what was stored for them
+static uint64_t mappedBufferBytes = 0;
+static uint64_t patchedBufferBytes = 0;
+
+GLvoid* after_glMapBufferRange(GLenum target, GLsizeiptr length, GLbitfield access, GLvoid* base)
 {
     BufferRangeData data;
     data.length = length;
@@ -551,7 +692,7 @@ void after_glMapBufferRange(GLenum target, GLsizeiptr length, GLbitfield access,
     data.access = access;
 
     unsigned char tid = GetThreadId();
-    GLuint currentlyBoundBuffer = getBoundBuffer(target);
+    GLuint currentlyBoundBuffer = GetShadowBoundBuffer(tid, target);
     if (currentlyBoundBuffer == 0)
     {
         DBG_LOG("No buffer currently bound to target %s for glMapBufferRange!\n", bufferName(target));
@@ -559,18 +700,36 @@ void after_glMapBufferRange(GLenum target, GLsizeiptr length, GLbitfield access,
 
     GetCurTraceContext(tid)->bufferToClientPointerMap[currentlyBoundBuffer] = data;
 
+    GLvoid* result = base;
     if (data.access == GL_WRITE_ONLY)
     {
-        std::vector<unsigned char>& contents = GetCurTraceContext(tid)->bufferToClientPointerMap[currentlyBoundBuffer].contents;
+        BufferRangeData& stored = GetCurTraceContext(tid)->bufferToClientPointerMap[currentlyBoundBuffer];
         BufferInitializedSet_t &bufInitSet = GetCurTraceContext(tid)->bufferInitializedSet;
         if (bufInitSet.find(currentlyBoundBuffer) != bufInitSet.end())
         {
-            unsigned char* bufdata = static_cast<unsigned char*>(base);
-            contents.assign(bufdata, bufdata + length);
+            if (tracerParams.TrackMappedBufferWrites && data.length >= CSB_PATCH_MIN_BUFFER_SIZE)
+            {
+                stored.tracker.reset(WriteTracker::create(base, data.length));
+                static bool warned = false;
+                if (!stored.tracker && !warned)
+                {
+                    DBG_LOG("Failed to track writes to mapped buffer %u, comparing its contents instead\n", currentlyBoundBuffer);
+                    warned = true;
+                }
+            }
+            if (stored.tracker)
+            {
+                result = stored.tracker->pointer();
+            }
+            else
+            {
+                unsigned char* bufdata = static_cast<unsigned char*>(base);
+                stored.contents.assign(bufdata, bufdata + length);
+            }
         }
         else
         {
-            contents.resize(length);
+            stored.contents.resize(length);
         }
     }
 
@@ -581,6 +740,7 @@ void after_glMapBufferRange(GLenum target, GLsizeiptr length, GLbitfield access,
         DBG_LOG("Suggest adding a parameter to /data/apitrace/tracerparams.cfg to disable the GL_EXT_buffer_storage extension:\n");
         DBG_LOG("    echo \"DisableBufferStorage true\" >> /data/apitrace/tracerparams.cfg\n");
     }
+    return result;
 }
 
 void pre_glFlushMappedBufferRange(GLenum target, GLintptr offset, GLsizeiptr length)
@@ -588,7 +748,7 @@ void pre_glFlushMappedBufferRange(GLenum target, GLintptr offset, GLsizeiptr len
     unsigned char tid = GetThreadId();
     BufferToClientPointerMap_t& map = GetCurTraceContext(tid)->bufferToClientPointerMap;
 
-    GLuint currentlyBoundBuffer = getBoundBuffer(target);
+    GLuint currentlyBoundBuffer = GetShadowBoundBuffer(tid, target);
     BufferToClientPointerMap_t::iterator it = map.find(currentlyBoundBuffer);
     if (it != map.end())
     {
@@ -608,38 +768,10 @@ void pre_glFlushMappedBufferRange(GLenum target, GLintptr offset, GLsizeiptr len
     }
 }
 
-static const unsigned int CSB_PATCH_MIN_BUFFER_SIZE = 0x8000; // 32kB
-static const unsigned int CSB_PATCH_PAGE_SIZE = 0x400; // 1kB
-static const float CSB_PATCH_UP_THRESHOLD = 0.8;
-static bool genCSBPatchList(GLenum target, const void* old_data, const void* new_data, unsigned int length)
+// Store the given pages of a buffer as a patch, unless they are so many that storing the whole buffer is better
+static bool genCSBPatch(GLenum target, const std::vector<unsigned int>& dirty_page_list, unsigned int page_size, const void* new_data, unsigned int length, unsigned int& patch_size)
 {
-    const unsigned char* old_ptr = static_cast<const unsigned char*>(old_data);
-    const unsigned char* new_ptr = static_cast<const unsigned char*>(new_data);
-    unsigned int page_num = 0;
-    unsigned int remain_data_length = length;
-    std::vector<unsigned int> dirty_page_list;
-
-    if (length < CSB_PATCH_MIN_BUFFER_SIZE)
-    {
-        // skip for small buffers
-        //DBG_LOG("INFO: The length of buffer is %d that is too small then skip it\n", length);
-        return false;
-    }
-
-    while(remain_data_length > 0)
-    {
-        unsigned int cmp_size = remain_data_length > CSB_PATCH_PAGE_SIZE ? CSB_PATCH_PAGE_SIZE : remain_data_length;
-        if (memcmp(old_ptr, new_ptr, cmp_size))
-        {
-            dirty_page_list.push_back(page_num);
-        }
-        remain_data_length -= cmp_size;
-        page_num++;
-        old_ptr += cmp_size;
-        new_ptr += cmp_size;
-    }
-
-    if ((dirty_page_list.size() * CSB_PATCH_PAGE_SIZE) > (length * CSB_PATCH_UP_THRESHOLD))
+    if ((dirty_page_list.size() * page_size) > (length * CSB_PATCH_UP_THRESHOLD))
     {
         // too many dirty area so fall back on full copy
         //DBG_LOG("INFO: %d dirty area are found for buffer length %d, that is too many dirty area for patch so skip it\n", dirty_area_count, length);
@@ -649,7 +781,7 @@ static bool genCSBPatchList(GLenum target, const void* old_data, const void* new
     //DBG_LOG("INFO: PatchCSB is enabled with buffer size %d, dirty area count %d!\n", length, dirty_area_count);
 
     // calc patch list buffer size
-    unsigned int patch_buf_size = sizeof(CSBPatchList) + (sizeof(CSBPatch) + CSB_PATCH_PAGE_SIZE) * dirty_page_list.size();
+    unsigned int patch_buf_size = sizeof(CSBPatchList) + (sizeof(CSBPatch) + page_size) * dirty_page_list.size();
     unsigned char* patch_buf = new unsigned char[patch_buf_size];
     unsigned char* patch_buf_ptr = patch_buf;
     CSBPatchList pl;
@@ -662,28 +794,61 @@ static bool genCSBPatchList(GLenum target, const void* old_data, const void* new
     for (size_t i = 0; i < dirty_page_list.size(); i++)
     {
         CSBPatch patch;
-        patch.offset = CSB_PATCH_PAGE_SIZE * dirty_page_list[i];
-        patch.length = (patch.offset + CSB_PATCH_PAGE_SIZE) > length ? (length - patch.offset) : (CSB_PATCH_PAGE_SIZE);
+        patch.offset = page_size * dirty_page_list[i];
+        patch.length = (patch.offset + page_size) > length ? (length - patch.offset) : (page_size);
 
         memcpy(patch_buf_ptr, &patch, sizeof(patch));
         patch_buf_ptr += sizeof(patch);
         memcpy(patch_buf_ptr, ((unsigned char*)new_data + patch.offset), patch.length);
         patch_buf_ptr += patch.length;
     }
+    patch_buf_size = patch_buf_ptr - patch_buf; // the last page may be partial
 
     _glPatchClientSideBuffer(target, patch_buf_size, patch_buf);
 
     delete[] patch_buf;
 
+    patch_size = patch_buf_size;
     return true;
 }
 
+static bool genCSBPatchList(GLenum target, const void* old_data, const void* new_data, unsigned int length, unsigned int& patch_size)
+{
+    const unsigned char* old_ptr = static_cast<const unsigned char*>(old_data);
+    const unsigned char* new_ptr = static_cast<const unsigned char*>(new_data);
+    unsigned int page_num = 0;
+    unsigned int remain_data_length = length;
+    std::vector<unsigned int> dirty_page_list;
+
+    if (length < CSB_PATCH_MIN_BUFFER_SIZE)
+    {
+        // skip for small buffers
+        //DBG_LOG("INFO: The length of buffer is %d that is too small then skip it\n", length);
+        return false;
+    }
+
+    while(remain_data_length > 0)
+    {
+        unsigned int cmp_size = remain_data_length > CSB_PATCH_PAGE_SIZE ? CSB_PATCH_PAGE_SIZE : remain_data_length;
+        if (memcmp(old_ptr, new_ptr, cmp_size))
+        {
+            dirty_page_list.push_back(page_num);
+        }
+        remain_data_length -= cmp_size;
+        page_num++;
+        old_ptr += cmp_size;
+        new_ptr += cmp_size;
+    }
+
+    return genCSBPatch(target, dirty_page_list, CSB_PATCH_PAGE_SIZE, new_data, length, patch_size);
+}
+
 void pre_glUnmapBuffer(GLenum target)
 {
     unsigned char tid = GetThreadId();
     BufferToClientPointerMap_t& map = GetCurTraceContext(tid)->bufferToClientPointerMap;
 
-    GLuint currentlyBoundBuffer = getBoundBuffer(target);
+    GLuint currentlyBoundBuffer = GetShadowBoundBuffer(tid, target);
     BufferToClientPointerMap_t::iterator it = map.find(currentlyBoundBuffer);
     if (it != map.end())
     {
@@ -697,7 +862,20 @@ void pre_glUnmapBuffer(GLenum target)
             BufferInitializedSet_t &bufInitSet = GetCurTraceContext(tid)->bufferInitializedSet;
             if (data.access == GL_WRITE_ONLY && bufInitSet.find(currentlyBoundBuffer) != bufInitSet.end())
             {
-                hasPatch = genCSBPatchList(target, data.contents.data(), data.base, data.length);
+                unsigned int patchSize = data.length;
+                if (data.tracker)
+                {
+                    // Only the touched pages are in the driver's buffer until now
+                    const std::vector<unsigned int> pages = data.tracker->writeBack();
+                    hasPatch = genCSBPatch(target, pages, data.tracker->pageSize(), data.tracker->contents(), data.length, patchSize);
+                    data.tracker.reset();
+                }
+                else
+                {
+                    hasPatch = genCSBPatchList(target, data.contents.data(), data.base, data.length, patchSize);
+                }
+                __atomic_fetch_add(&mappedBufferBytes, data.length, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&patchedBufferBytes, hasPatch ? patchSize : data.length, __ATOMIC_RELAXED);
             }
 
             if (!hasPatch)
@@ -725,12 +903,28 @@ void pre_glUnmapBuffer(GLenum target)
     }
 }
 
+// A buffer whose writes are tracked is mapped at the tracker's view, and the application must not
+// get the driver's mapping from a query either, or writes through it would be lost
+void after_glGetBufferPointerv(unsigned char tid, GLenum target, GLenum pname, GLvoid** params)
+{
+    TraceContext* ctx = GetCurTraceContext(tid);
+    if (pname != GL_BUFFER_MAP_POINTER || !params || !*params || !ctx)
+    {
+        return;
+    }
+    BufferToClientPointerMap_t::iterator it = ctx->bufferToClientPointerMap.find(GetShadowBoundBuffer(tid, target));
+    if (it != ctx->bufferToClientPointerMap.end() && it->second.tracker && *params == it->second.base)
+    {
+        *params = it->second.tracker->pointer();
+    }
+}
+
 void after_glUnmapBuffer(GLenum target)
 {
     unsigned char tid = GetThreadId();
     BufferToClientPointerMap_t& map = GetCurTraceContext(tid)->bufferToClientPointerMap;
 
-    GLuint currentlyBoundBuffer = getBoundBuffer(target);
+    GLuint currentlyBoundBuffer = GetShadowBoundBuffer(tid, target);
     BufferToClientPointerMap_t::iterator it = map.find(currentlyBoundBuffer);
     if (it != map.end())
     {
@@ -803,6 +997,7 @@ bool pre_glLinkProgram(unsigned char tid, unsigned int program)
 
     // 1. link the 'program' in order to figure out its active vertex attributes
     _glLinkProgram(program);
+    InvalidateActiveAttribMasks();
     GLint success = GL_TRUE;
     _glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (success == GL_FALSE)
@@ -855,6 +1050,7 @@ void after_glDeleteProgram(unsigned char tid, GLuint program)
     {
          return;
     }
+    InvalidateActiveAttribMasks(); // the name may be reused
     std::map<unsigned int, unsigned int>& mapPrgToBoundAttribs = GetCurTraceContext(tid)->mapPrgToBoundAttribs;
     std::map<unsigned int, unsigned int>::iterator it = mapPrgToBoundAttribs.find(program);
     if (it == mapPrgToBoundAttribs.end()) {
@@ -870,7 +1066,7 @@ static bool TakeSnapshot(int frNoOverride = -1)
     image::Image *src = glstate::getDrawBufferImage();
     if (src == NULL)
     {
-        DBG_LOG("Failed to take snapshot for frame %u, call no: %u\n", gTraceOut->frameNo, gTraceOut->callNo);
+        DBG_LOG("Failed to take snapshot for frame %u, call no: %u\n", gTraceOut->frameNo, gTraceOut->callNo.load());
         return false;
     }
 
@@ -886,7 +1082,7 @@ static bool TakeSnapshot(int frNoOverride = -1)
     } else {
         frNo = gTraceOut->frameNo;
     }
-    sprintf(filename, "%sf%05u_c%010u.png", snapPath, frNo, gTraceOut->callNo);
+    sprintf(filename, "%sf%05u_c%010u.png", snapPath, frNo, gTraceOut->callNo.load());
 
     if (src->writePNG(filename))
         DBG_LOG("Snapshot : %s\n", filename);
@@ -1107,7 +1303,14 @@ void after_eglMakeCurrent(EGLDisplay dpy, EGLSurface drawSurf, EGLContext ctx)
 
     int gles_version_major = gGlesFeatures.glesVersion() / 100;
     if (gles_version_major >= 2)
+    {
         _glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &traceCtx->mMaxVertexAttribs);
+        if (!traceCtx->mShadow.initialized())
+        {
+            // First time current, so the context is in its initial state
+            traceCtx->mShadow.init(traceCtx->mMaxVertexAttribs, gGlesFeatures.glesVersion());
+        }
+    }
 
     if (extension_list_initialized) return; // only run the below code once
     extension_list_initialized = true;
@@ -1207,7 +1410,7 @@ void pre_eglSwapBuffers()
 
 void insert_glBindTexture(GLenum target, GLuint texture, int tid)
 {
-    char* dest = gTraceOut->writebuf;
+    char* dest = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 2 * WRITE_FIXED_MAX_SIZE);
     BCall *pCall = (BCall*)dest;
     pCall->funcId = glBindTexture_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1216,13 +1419,13 @@ void insert_glBindTexture(GLenum target, GLuint texture, int tid)
     dest = WriteFixed<int>(dest, target); // enum
     dest = WriteFixed<unsigned int>(dest, texture); // literal
     pCall->errNo = GetCallErrorNo("glBindTexture", tid);
-    gTraceOut->WriteBuf(dest);
-    gTraceOut->callNo++;
+    gTraceOut->EndCalls(tid, dest);
 }
 
 void insert_glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid * pixels, int tid)
 {
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 9 * WRITE_FIXED_MAX_SIZE + Write1DArraySize<char>((unsigned int)_glTexImage2D_size(format, type, width, height), (const char*)pixels));
+    char* dest = writebuf;
     BCall_vlen *pCall2 = (BCall_vlen*)dest;
     pCall2->funcId = glTexImage2D_id;
     pCall2->tid = tid; pCall2->reserved = 0; pCall2->source = 1;
@@ -1239,9 +1442,8 @@ void insert_glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsiz
     dest = WriteFixed<unsigned int>(dest, BlobType);
     dest = Write1DArray<char>(dest, (unsigned int)_glTexImage2D_size(format, type, width, height), (const char*)pixels);
     pCall2->errNo = GetCallErrorNo("glTexImage2D", tid);
-    pCall2->toNext = dest-gTraceOut->writebuf;
-    gTraceOut->WriteBuf(dest);
-    gTraceOut->callNo++;
+    pCall2->toNext = dest-writebuf;
+    gTraceOut->EndCalls(tid, dest);
 }
 
 GLuint pre_eglCreateImageKHR(EGLDisplay dpy, EGLImageKHR image, EGLenum target, EGLClientBuffer buffer, const EGLint *attrib_list)
@@ -1308,12 +1510,9 @@ GLuint pre_eglCreateImageKHR(EGLDisplay dpy, EGLImageKHR image, EGLenum target,
     GLuint textureId = 0;
     inject_glGenTextures(1, &textureId);
 
-    gTraceOut->callMutex.lock();
-
     insert_glBindTexture(GL_TEXTURE_2D, textureId, tid);
     insert_glTexImage2D(GL_TEXTURE_2D, level, internalformat, width, height, border, format, type, pixels, tid);
     insert_glBindTexture(GL_TEXTURE_2D, oldBoundTexture, tid);
-    gTraceOut->callMutex.unlock();
 
     // Delete image data
     _EGLImageKHR_free_image_info(info);
@@ -1388,11 +1587,9 @@ GLuint pre_glEGLImageTargetTexture2DOES(EGLImageKHR image, EGLint *&attrib_list)
     else {
         textureId = iter->second;
     }
-    gTraceOut->callMutex.lock();
     insert_glBindTexture(GL_TEXTURE_2D, textureId, tid);
     insert_glTexImage2D(GL_TEXTURE_2D, level, internalformat, width, height, border, format, type, pixels, tid);
     insert_glBindTexture(GL_TEXTURE_2D, oldBoundTexture, tid);
-    gTraceOut->callMutex.unlock();
 
     // Delete image data
     _EGLImageKHR_free_image_info(info);
@@ -1433,6 +1630,7 @@ void updateUsage(GLenum target)
 
 void after_eglSwapBuffers()
 {
+    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
     long long frameEnd = os::getTime();
     frameTime.push_back(frameEnd - gTraceOut->mFrameBegTime);
     gTraceOut->mFrameBegTime = frameEnd;
@@ -1441,6 +1639,16 @@ void after_eglSwapBuffers()
     {
         gTraceOut->mpBinAndMeta->writeHeader(true);
     }
+
+    const uint64_t mapped = __atomic_exchange_n(&mappedBufferBytes, 0, __ATOMIC_RELAXED);
+    const uint64_t patched = __atomic_exchange_n(&patchedBufferBytes, 0, __ATOMIC_RELAXED);
+    if (mapped && (tracerParams.TrackMappedBufferWrites || stateLoggingEnabled))
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "@B: frame=%u mapped=%llu patched=%llu saved=%llu", gTraceOut->frameNo,
+                 (unsigned long long)mapped, (unsigned long long)patched, (unsigned long long)(mapped > patched ? mapped - patched : 0));
+        gTraceOut->getStateLogger().logMessage(line);
+    }
     gTraceOut->frameNo++;
 }
 
@@ -1475,8 +1683,8 @@ void after_eglDestroySurface(EGLSurface surf)
 void _glVertexPointer_fake(GLint size, GLenum type, GLsizei stride, const GLvoid * pointer, unsigned int _size)
 {
     unsigned char tid = GetThreadId();
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 4 * WRITE_FIXED_MAX_SIZE + Write1DArraySize<char>(_size, (char*)pointer));
+    char* dest = writebuf;
     BCall_vlen *pCall = (BCall_vlen*)dest;
     pCall->funcId = glVertexPointer_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1489,16 +1697,15 @@ void _glVertexPointer_fake(GLint size, GLenum type, GLsizei stride, const GLvoid
     dest = WriteFixed<unsigned int>(dest, 1); // IS *BLOB*
     dest = Write1DArray<char>(dest, _size, (char*)pointer); // opaque -> blob
     pCall->errNo = GetCallErrorNo("glVertexPointer", tid);
-    pCall->toNext = dest-gTraceOut->writebuf;
-    gTraceOut->Write(gTraceOut->writebuf, dest-gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    pCall->toNext = dest-writebuf;
+    gTraceOut->EndCalls(tid, dest);
 }
 
 void _glNormalPointer_fake(GLenum type, GLsizei stride, const GLvoid * pointer, unsigned int _size)
 {
     unsigned char tid = GetThreadId();
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 3 * WRITE_FIXED_MAX_SIZE + Write1DArraySize<char>(_size, (char*)pointer));
+    char* dest = writebuf;
     BCall_vlen *pCall = (BCall_vlen*)dest;
     pCall->funcId = glNormalPointer_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1510,16 +1717,15 @@ void _glNormalPointer_fake(GLenum type, GLsizei stride, const GLvoid * pointer,
     dest = WriteFixed<unsigned int>(dest, 1); // IS *BLOB*
     dest = Write1DArray<char>(dest, _size, (char*)pointer); // opaque -> blob
     pCall->errNo = GetCallErrorNo("glNormalPointer", tid);
-    pCall->toNext = dest-gTraceOut->writebuf;
-    gTraceOut->Write(gTraceOut->writebuf, dest-gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    pCall->toNext = dest-writebuf;
+    gTraceOut->EndCalls(tid, dest);
 }
 
 void _glColorPointer_fake(GLint size, GLenum type, GLsizei stride, const GLvoid * pointer, unsigned int _size)
 {
     unsigned char tid = GetThreadId();
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 4 * WRITE_FIXED_MAX_SIZE + Write1DArraySize<char>(_size, (char*)pointer));
+    char* dest = writebuf;
     BCall_vlen *pCall = (BCall_vlen*)dest;
     pCall->funcId = glColorPointer_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1532,15 +1738,14 @@ void _glColorPointer_fake(GLint size, GLenum type, GLsizei stride, const GLvoid
     dest = WriteFixed<unsigned int>(dest, 1); // IS *BLOB*
     dest = Write1DArray<char>(dest, _size, (char*)pointer); // opaque -> blob
     pCall->errNo = GetCallErrorNo("glColorPointer", tid);
-    pCall->toNext = dest-gTraceOut->writebuf;
-    gTraceOut->Write(gTraceOut->writebuf, dest-gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    pCall->toNext = dest-writebuf;
+    gTraceOut->EndCalls(tid, dest);
 }
 
 void _glTexCoordPointer_fake(GLint size, GLenum type, GLsizei stride, const GLvoid * pointer, unsigned int _size){
     unsigned char tid = GetThreadId();
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 4 * WRITE_FIXED_MAX_SIZE + Write1DArraySize<char>(_size, (char*)pointer));
+    char* dest = writebuf;
     BCall_vlen *pCall = (BCall_vlen*)dest;
     pCall->funcId = glTexCoordPointer_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1553,17 +1758,16 @@ void _glTexCoordPointer_fake(GLint size, GLenum type, GLsizei stride, const GLvo
     dest = WriteFixed<unsigned int>(dest, 1); // IS *BLOB*
     dest = Write1DArray<char>(dest, _size, (char*)pointer); // opaque -> blob
     pCall->errNo = GetCallErrorNo("glTexCoordPointer", tid);
-    pCall->toNext = dest-gTraceOut->writebuf;
-    gTraceOut->Write(gTraceOut->writebuf, dest-gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    pCall->toNext = dest-writebuf;
+    gTraceOut->EndCalls(tid, dest);
 }
 
 #if ENABLE_CLIENT_SIDE_BUFFER
 void _glVertexAttribPointer_fake(const VertexAttributeMemoryMerger::AttributeInfo *ai, unsigned int name)
 {
     unsigned char tid = GetThreadId();
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 8 * WRITE_FIXED_MAX_SIZE);
+    char* dest = writebuf;
     BCall_vlen *pCall = (BCall_vlen*)dest;
     pCall->funcId = glVertexAttribPointer_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1579,17 +1783,16 @@ void _glVertexAttribPointer_fake(const VertexAttributeMemoryMerger::AttributeInf
     dest = WriteFixed<unsigned int>(dest, (unsigned int)(name));
     dest = WriteFixed<unsigned int>(dest, (unsigned int)(ai->offset));
     pCall->errNo = GetCallErrorNo("glVertexAttribPointer", tid);
-    pCall->toNext = dest-gTraceOut->writebuf;
-    gTraceOut->Write(gTraceOut->writebuf, dest-gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    pCall->toNext = dest-writebuf;
+    gTraceOut->EndCalls(tid, dest);
 }
 #else
 void _glVertexAttribPointer_fake(GLuint index, GLint size, GLenum type, GLboolean normalized,
     GLsizei stride, const GLvoid *pointer, GLint _size)
 {
     unsigned char tid = GetThreadId();
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 5 * WRITE_FIXED_MAX_SIZE + Write1DArraySize<char>((unsigned int)_size, (const char*)pointer));
+    char* dest = writebuf;
     BCall_vlen *pCall = (BCall_vlen*)dest;
     pCall->funcId = glVertexAttribPointer_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1603,16 +1806,15 @@ void _glVertexAttribPointer_fake(GLuint index, GLint size, GLenum type, GLboolea
     dest = WriteFixed<int>(dest, stride); // literal
     dest = Write1DArray<char>(dest, (unsigned int)_size, (const char*)pointer); // blob
     pCall->errNo = GetCallErrorNo("glVertexAttribPointer", tid);
-    pCall->toNext = dest-gTraceOut->writebuf;
-    gTraceOut->Write(gTraceOut->writebuf, dest-gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    pCall->toNext = dest-writebuf;
+    gTraceOut->EndCalls(tid, dest);
 }
 #endif
 
 void _glClientActiveTexture_fake(GLenum texture){
     unsigned char tid = GetThreadId();
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 1 * WRITE_FIXED_MAX_SIZE);
+    char* dest = writebuf;
     BCall *pCall = (BCall*)dest;
     pCall->funcId = glClientActiveTexture_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1621,8 +1823,7 @@ void _glClientActiveTexture_fake(GLenum texture){
     // _glClientActiveTexture(texture);
     dest = WriteFixed<int>(dest, texture); // enum
     pCall->errNo = GetCallErrorNo("glClientActiveTexture", tid);
-    gTraceOut->Write(gTraceOut->writebuf, dest-gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    gTraceOut->EndCalls(tid, dest);
 }
 
 #if ENABLE_CLIENT_SIDE_BUFFER
@@ -1632,8 +1833,8 @@ ClientSideBufferObjectName _glCreateClientSideBuffer()
     const unsigned char tid = GetThreadId();
     const ClientSideBufferObjectName name = gTraceOut->mCSBufferSet.create_object(tid);
 
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 1 * WRITE_FIXED_MAX_SIZE);
+    char* dest = writebuf;
     BCall *pCall = (BCall*)dest;
     pCall->funcId = glCreateClientSideBuffer_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1641,8 +1842,7 @@ ClientSideBufferObjectName _glCreateClientSideBuffer()
 
     dest = WriteFixed<unsigned int>(dest, name); // literal
     pCall->errNo = GetCallErrorNo("glCreateClientSideBuffer", tid);
-    gTraceOut->Write(gTraceOut->writebuf, dest-gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    gTraceOut->EndCalls(tid, dest);
     return name;
 }
 
@@ -1651,8 +1851,8 @@ void _glDeleteClientSideBuffer(ClientSideBufferObjectName name)
     const unsigned char tid = GetThreadId();
     gTraceOut->mCSBufferSet.delete_object(tid, name);
 
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 1 * WRITE_FIXED_MAX_SIZE);
+    char* dest = writebuf;
     BCall *pCall = (BCall*)dest;
     pCall->funcId = glDeleteClientSideBuffer_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1660,16 +1860,15 @@ void _glDeleteClientSideBuffer(ClientSideBufferObjectName name)
 
     dest = WriteFixed<unsigned int>(dest, name); // literal
     pCall->errNo = GetCallErrorNo("glDeleteClientSideBuffer", tid);
-    gTraceOut->Write(gTraceOut->writebuf, dest-gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    gTraceOut->EndCalls(tid, dest);
 }
 
 void _glCopyClientSideBuffer(GLenum target, ClientSideBufferObjectName name)
 {
     const unsigned char tid = GetThreadId();
 
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 2 * WRITE_FIXED_MAX_SIZE);
+    char* dest = writebuf;
     BCall *pCall = (BCall*)dest;
     pCall->funcId = glCopyClientSideBuffer_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1678,18 +1877,17 @@ void _glCopyClientSideBuffer(GLenum target, ClientSideBufferObjectName name)
     dest = WriteFixed<int>(dest, target); // enum
     dest = WriteFixed<unsigned int>(dest, name); // literal
     pCall->errNo = GetCallErrorNo("glCopyClientSideBuffer", tid);
-    gTraceOut->Write(gTraceOut->writebuf, dest - gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    gTraceOut->EndCalls(tid, dest);
 
-    gTraceOut->mCSBufferSet.get_object(tid, name)->save_md5_last_copy();
+    gTraceOut->mCSBufferSet.get_object(tid, name)->save_last_copy_digest();
 }
 
 void _glPatchClientSideBuffer(GLenum target, int length, const void *data)
 {
     const unsigned char tid = GetThreadId();
 
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 2 * WRITE_FIXED_MAX_SIZE + Write1DArraySize<GLubyte>((unsigned int)(length), (const GLubyte *)(data)));
+    char* dest = writebuf;
     BCall_vlen *pCall = (BCall_vlen*)dest;
     pCall->funcId = glPatchClientSideBuffer_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1699,9 +1897,8 @@ void _glPatchClientSideBuffer(GLenum target, int length, const void *data)
     dest = WriteFixed<int>(dest, length); // literal
     dest = Write1DArray<GLubyte>(dest, (unsigned int)(length), (const GLubyte *)(data)); // array
     pCall->errNo = GetCallErrorNo("glPatchClientSideBuffer", tid);
-    pCall->toNext = dest-gTraceOut->writebuf;
-    gTraceOut->Write(gTraceOut->writebuf, dest - gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    pCall->toNext = dest-writebuf;
+    gTraceOut->EndCalls(tid, dest);
 }
 
 void _glClientSideBufferData(ClientSideBufferObjectName name,
@@ -1710,8 +1907,8 @@ void _glClientSideBufferData(ClientSideBufferObjectName name,
     const unsigned char tid = GetThreadId();
     gTraceOut->mCSBufferSet.object_data(tid, name, length, data);
 
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 2 * WRITE_FIXED_MAX_SIZE + Write1DArraySize<GLubyte>((unsigned int)(length), (const GLubyte *)(data)));
+    char* dest = writebuf;
     BCall_vlen *pCall = (BCall_vlen*)dest;
     pCall->funcId = glClientSideBufferData_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1721,9 +1918,8 @@ void _glClientSideBufferData(ClientSideBufferObjectName name,
     dest = WriteFixed<int>(dest, length); // literal
     dest = Write1DArray<GLubyte>(dest, (unsigned int)(length), (const GLubyte *)(data)); // array
     pCall->errNo = GetCallErrorNo("glClientSideBufferData", tid);
-    pCall->toNext = dest-gTraceOut->writebuf;
-    gTraceOut->Write(gTraceOut->writebuf, dest-gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    pCall->toNext = dest-writebuf;
+    gTraceOut->EndCalls(tid, dest);
 }
 
 void _glClientSideBufferSubData(ClientSideBufferObjectName name,
@@ -1732,8 +1928,8 @@ void _glClientSideBufferSubData(ClientSideBufferObjectName name,
     const unsigned char tid = GetThreadId();
     gTraceOut->mCSBufferSet.object_subdata(tid, name, offset, length, data);
 
-    std::lock_guard<std::recursive_mutex> guard(gTraceOut->callMutex);
-    char* dest = gTraceOut->writebuf;
+    char* const writebuf = gTraceOut->BeginCalls(tid, sizeof(BCall_vlen) + 3 * WRITE_FIXED_MAX_SIZE + Write1DArraySize<GLubyte>((unsigned int)(length), (const GLubyte *)(data)));
+    char* dest = writebuf;
     BCall_vlen *pCall = (BCall_vlen*)dest;
     pCall->funcId = glClientSideBufferSubData_id;
     pCall->tid = tid; pCall->reserved = 0; pCall->source = 1;
@@ -1744,9 +1940,8 @@ void _glClientSideBufferSubData(ClientSideBufferObjectName name,
     dest = WriteFixed<int>(dest, length); // literal
     dest = Write1DArray<GLubyte>(dest, (unsigned int)(length), (const GLubyte *)(data)); // array
     pCall->errNo = GetCallErrorNo("glClientSideBufferSubData", tid);
-    pCall->toNext = dest-gTraceOut->writebuf;
-    gTraceOut->Write(gTraceOut->writebuf, dest-gTraceOut->writebuf);
-    gTraceOut->callNo++;
+    pCall->toNext = dest-writebuf;
+    gTraceOut->EndCalls(tid, dest);
 }
 
 bool _isClientSideBufferModified(ClientSideBufferObjectName name)
@@ -1799,6 +1994,11 @@ ClientSideBufferObjectName _glClientSideBufferData(const void *p, ptrdiff_t size
 
 #endif
 
+void InvalidateActiveAttribMasks()
+{
+    __atomic_fetch_add(&programGeneration, 1, __ATOMIC_SEQ_CST);
+}
+
 void GetActiveAttribIdx(GLint prg, unsigned int &flagArray)
 {
     const int MAX_VERTEX_ATTRIB_COUNT = 32;
@@ -1829,6 +2029,29 @@ void GetActiveAttribIdx(GLint prg, unsigned int &flagArray)
     }
 }
 
+// Programs are shared between contexts, and may be relinked on another thread, so instead of finding the
+// masks to drop in every context, all masks are dropped whenever any program may have changed. Programs
+// are rarely linked once loading is done.
+static unsigned int GetActiveAttribMask(unsigned char tid, GLint prg)
+{
+    TraceContext* ctx = GetCurTraceContext(tid);
+    const unsigned generation = __atomic_load_n(&programGeneration, __ATOMIC_SEQ_CST);
+    if (ctx->mActiveAttribMasksGeneration != generation)
+    {
+        ctx->mActiveAttribMasks.clear();
+        ctx->mActiveAttribMasksGeneration = generation;
+    }
+    const auto it = ctx->mActiveAttribMasks.find(prg);
+    if (it != ctx->mActiveAttribMasks.end())
+    {
+        return it->second;
+    }
+    unsigned int mask = 0;
+    GetActiveAttribIdx(prg, mask);
+    ctx->mActiveAttribMasks[prg] = mask;
+    return mask;
+}
+
 bool _need_user_arrays()
 {
     unsigned char tid = GetThreadId();
@@ -1880,6 +2103,16 @@ bool _need_user_arrays()
         return false;
     }
 
+    ShadowState* shadow = GetShadowState(tid);
+    if (shadow && tracerParams.CheckShadowState)
+    {
+        shadow->check();
+    }
+    if (shadow && shadow->tracked())
+    {
+        return shadow->hasClientArrays();
+    }
+
     GLint maxVertexAttribs = GetCurTraceContext(tid)->mMaxVertexAttribs;
     for (GLint index = 0; index < maxVertexAttribs; ++index)
     {
@@ -1998,66 +2231,50 @@ void _trace_user_arrays(int count, int instancecount)
     }
 
     // void GLES_CALLCONVENTION glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid * pointer)
+    const ShadowState* shadow = GetShadowState(tid);
     unsigned int activeAttribArray = 0xffffffff;
     if (tracerParams.EnableActiveAttribCheck == true) {
         GLint currentPrg = 0;
-        _glGetIntegerv(GL_CURRENT_PROGRAM, &currentPrg);
-            if (currentPrg != 0)
-                GetActiveAttribIdx(currentPrg, activeAttribArray);
+        if (shadow)
+            currentPrg = shadow->currentProgram();
+        else
+            _glGetIntegerv(GL_CURRENT_PROGRAM, &currentPrg);
+        if (currentPrg != 0)
+            activeAttribArray = GetActiveAttribMask(tid, currentPrg);
+    }
+    if (shadow && !shadow->tracked())
+    {
+        shadow = NULL;
     }
 
 #if ENABLE_CLIENT_SIDE_BUFFER
     VertexAttributeMemoryMerger mbc;
 #endif
-    GLint _max_vertex_attribs = 0;
-    _glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &_max_vertex_attribs);
+    GLint _max_vertex_attribs = GetCurTraceContext(tid)->mMaxVertexAttribs;
     for (GLint index = 0; index < _max_vertex_attribs; ++index)
     {
-        GLint _enabled = 0;
-        _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &_enabled);
-
-        if (!_enabled)
-        {
-            continue;
-        }
-
         if (!(activeAttribArray & (0x1 << index)))
         {
             continue;
         }
 
-        GLint _binding = 0;
-        _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &_binding);
+        // No need to check if in a GLES3 profile, since instancecount
+        // will always be 0 in GLES2. GL_VERTEX_ATTRIB_ARRAY_DIVISOR
+        // would have resulted in GL_INVALID_ENUM if queried in a
+        // GLES2 profile.
+        const ShadowState::VertexAttrib attrib = shadow ? shadow->vertexAttrib(index) : ShadowState::queryVertexAttrib(index, instancecount != 0);
 
-        if (_binding)
+        if (!attrib.enabled || attrib.buffer)
         {
             continue;
         }
 
-        GLint size = 0;
-        _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_SIZE, &size);
-
-        GLint type = 0;
-        _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
-
-        GLint normalized = 0;
-        _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &normalized);
-
-        GLint stride = 0;
-        _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
-
-        GLvoid * pointer = 0;
-        _glGetVertexAttribPointerv(index, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
-
-        GLint divisor = 0;
-        if (instancecount)
-        {
-            // No need to check if in a GLES3 profile, since instancecount
-            // will always be 0 in GLES2. GL_VERTEX_ATTRIB_ARRAY_DIVISOR
-            // would have resulted in GL_INVALID_ENUM if queried in a
-            // GLES2 profile.
-            _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_DIVISOR, &divisor);
-        }
+        GLint size = attrib.size;
+        GLint type = attrib.type;
+        GLint normalized = attrib.normalized;
+        GLint stride = attrib.stride;
+        GLvoid * pointer = const_cast<GLvoid*>(attrib.pointer);
+        GLint divisor = instancecount ? attrib.divisor : 0;
 
         size_t _size = 0;
         if (!divisor)
@@ -2093,8 +2310,7 @@ void _trace_user_arrays(int count, int instancecount)
     const unsigned int attr_count = mbc.attribute_count();
     if (attr_count)
     {
-        GLint originallyBoundBuffer = 0;
-        _glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &originallyBoundBuffer);
+        GLint originallyBoundBuffer = GetShadowBoundBuffer(tid, GL_ARRAY_BUFFER);
 
         // Make sure that 0 is bound to GL_ARRAY_BUFFER when injecting
         // glVertexAttribPointer below.
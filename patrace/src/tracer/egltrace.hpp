@@ -3,6 +3,8 @@
 
 #include <tracer/tracerparams.hpp>
 #include "tracer/path.hpp"
+#include "tracer/shadow_state.hpp"
+#include "tracer/write_tracker.hpp"
 
 #include <dispatch/eglproc_auto.hpp>
 
@@ -13,6 +15,9 @@
 #include "common/memory.hpp"
 #include "helper/states.h"
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <map>
 #include <unordered_map>
@@ -74,12 +79,17 @@ public:
     BinAndMeta* mpBinAndMeta = nullptr;
     common::ClientSideBufferObjectSet mCSBufferSet;
 
-    // The buffer and mutex used during capturing
-    const static int WRITE_BUF_LEN = (150*1024*1024);
-    char* writebuf = nullptr;
+    // Each thread serializes its calls into its own buffer, which starts at this size and grows
+    // to fit the calls being written. Buffers that grew larger than WRITE_BUF_KEEP_LEN for some
+    // big call are given back as soon as it has been written.
+    const static size_t WRITE_BUF_MIN_LEN = 64*1024;
+    const static size_t WRITE_BUF_KEEP_LEN = 4*1024*1024;
+    // For global state, such as the EGL configs and frame counting. Not needed for writing calls.
     std::recursive_mutex callMutex;
+    // For the trace file, and the calls waiting to be written to it
+    std::mutex writeMutex;
 
-    unsigned callNo = 0;
+    std::atomic<unsigned> callNo{0}; // number of the next call to start serializing
     unsigned frameNo = 0;
     bool snapDraw = false;
     long long mFrameBegTime = 0;
@@ -87,45 +97,56 @@ public:
     TraceOut();
     ~TraceOut();
 
-    inline void Write(const void* buf, unsigned int len)
+    /// Start serializing count calls made on thread tid, taking at most size bytes, and get where
+    /// to put them. This takes the next call numbers, and calls are written to the trace in call
+    /// number order, so in the order their threads got here. Threads serialize their calls at the
+    /// same time.
+    inline char* BeginCalls(int tid, size_t size, unsigned count = 1)
     {
-        if (mpBinAndMeta == NULL)
+        ThreadCalls& calls = mThreadCalls[tid];
+        if (size > calls.capacity)
         {
-            mpBinAndMeta = new BinAndMeta();
-            mStateLogger.open(mpBinAndMeta->getFileName() + ".tracelog");
+            delete [] calls.writebuf;
+            calls.capacity = std::max(size, (size_t)WRITE_BUF_MIN_LEN);
+            calls.writebuf = new char[calls.capacity];
         }
-        mpBinAndMeta->write(buf, len);
+        calls.firstCallNo = callNo.fetch_add(count);
+        calls.count = count;
+        return calls.writebuf;
     }
 
-    inline void WriteBuf(const char *endPointer)
-    {
-        const int size = endPointer - writebuf;
-        if (size > WRITE_BUF_LEN)
-        {
-            DBG_LOG("Write buffer overflow (%d > %d)\n", size, WRITE_BUF_LEN);
-            abort(); // we've already overwritten memory, no way to recover
-        }
-        Write(writebuf, size);
-    }
+    /// The calls started by BeginCalls() end at endPointer. They are written to the trace now if
+    /// all calls before them have been, and are otherwise held until then.
+    void EndCalls(int tid, const char* endPointer);
 
-    void Close()
-    {
-        if (mpBinAndMeta)
-        {
-            mpBinAndMeta->callCnt = callNo;
-            mpBinAndMeta->frameCnt = frameNo;
-            mStateLogger.close();
-            delete mpBinAndMeta;
-            mpBinAndMeta = NULL;
-        }
-        callNo = 0;
-        frameNo = 0;
-        snapDraw = false;
-    }
+    /// Give back the buffer of thread tid, when the thread exits
+    void ReleaseThread(int tid);
+
+    void Close();
 
     StateLogger& getStateLogger() { return mStateLogger; }
 
 private:
+    struct ThreadCalls
+    {
+        char* writebuf = nullptr;
+        size_t capacity = 0;
+        unsigned firstCallNo = 0;
+        unsigned count = 0;
+    };
+    struct HeldCalls
+    {
+        unsigned count;
+        std::vector<char> data;
+    };
+
+    void Open();
+    void WriteCalls(const ThreadCalls& calls, const char* endPointer);
+
+    ThreadCalls mThreadCalls[PATRACE_THREAD_LIMIT];
+    std::map<unsigned, HeldCalls> mHeldCalls; ///< by first call number, waiting for calls before them
+    unsigned mNextWriteNo = 0; ///< first call number not written yet
+    uint64_t mHeldCallCount = 0;
     StateLogger mStateLogger;
 };
 
@@ -138,6 +159,7 @@ struct BufferRangeData
     void* base;
     GLbitfield access;
     std::vector<unsigned char> contents;
+    std::shared_ptr<WriteTracker> tracker; ///< instead of contents, when the writes are tracked
 };
 
 typedef std::unordered_map<GLuint, BufferRangeData> BufferToClientPointerMap_t;
@@ -157,9 +179,16 @@ struct TraceContext
     /// Whether the currently mapped buffer is the whole buffer or just a range
     bool isFullMapping = false;
     GLenum lastGlError = GL_NO_ERROR;
+    /// Error fetched by ShadowCallFailed() that GetCallErrorNo() has not reported yet
+    GLenum pendingGlError = GL_NO_ERROR;
     EGLContext mEGLCtx;
     EGLint mEGLConfigId;
     GLint mMaxVertexAttribs = 0;
+    /// Buffer bindings and vertex arrays of a GLES 2+ context, so that draws need not query them
+    ShadowState mShadow;
+    /// Vertex attribute locations used by each program, as found by GetActiveAttribIdx()
+    std::unordered_map<GLuint, unsigned int> mActiveAttribMasks;
+    unsigned mActiveAttribMasksGeneration = 0;
 
     TraceContext(EGLContext ctx, EGLint configId);
     ~TraceContext();
@@ -217,13 +246,20 @@ unsigned char GetThreadId();
 void UpdateTimesEGLConfigUsed(int threadid);
 TraceContext* GetCurTraceContext(unsigned char tid);
 TraceSurface* GetCurTraceSurface(unsigned char tid);
+/// Shadow state of the current context, or NULL if there is none
+ShadowState* GetShadowState(unsigned char tid);
+/// Buffer bound to target in the current context, queried from the driver if the shadow state does not have it
+GLuint GetShadowBoundBuffer(unsigned char tid, GLenum target);
 
 void after_glBindAttribLocation(unsigned char tid, GLuint program, GLuint index);
-void after_glMapBufferRange(GLenum target, GLsizeiptr length, GLbitfield access, void* base);
+/// Call when the active attributes of a program may have changed
+void InvalidateActiveAttribMasks();
+GLvoid* after_glMapBufferRange(GLenum target, GLsizeiptr length, GLbitfield access, GLvoid* base);
 void after_glCreateProgram(unsigned char tid, GLuint program);
 void pre_glFlushMappedBufferRange(GLenum target, GLintptr offset, GLsizeiptr length);
 void pre_glUnmapBuffer(GLenum target);
 void after_glUnmapBuffer(GLenum target);
+void after_glGetBufferPointerv(unsigned char tid, GLenum target, GLenum pname, GLvoid** params);
 bool pre_glLinkProgram(unsigned char tid, unsigned int program);
 GLuint replace_glCreateShaderProgramv(unsigned char tid, GLenum type, GLsizei count, const GLchar * const * strings);
 void after_glDeleteProgram(unsigned char tid, GLuint program);
@@ -254,8 +290,15 @@ static inline common::CALL_ERROR_NO GetCallErrorNo(const char *funcname, unsigne
     if (!tracerParams.EnableErrorCheck)
         return common::CALL_GL_NO_ERROR;
 
+    TraceContext* ctx = GetCurTraceContext(tid);
     GLenum glErr = _glGetError();
-    GetCurTraceContext(tid)->lastGlError = glErr;
+    if (ctx->pendingGlError != GL_NO_ERROR)
+    {
+        // The first error sticks, as in GL
+        glErr = ctx->pendingGlError;
+        ctx->pendingGlError = GL_NO_ERROR;
+    }
+    ctx->lastGlError = glErr;
 
 #if defined(REPORT_GL_ERRORS)
     if (glErr != GL_NO_ERROR)
@@ -282,6 +325,23 @@ static inline common::CALL_ERROR_NO GetCallErrorNo(const char *funcname, unsigne
     return common::CALL_GL_NO_ERROR;
 }
 
+/// Whether the call just made raised an error, so that the shadow state does not follow it. Only
+/// known when EnableErrorCheck fetches the error of every call anyway. Otherwise the call is taken
+/// to have succeeded, and CheckShadowState is the way to find where the shadow went wrong.
+static inline bool ShadowCallFailed(unsigned char tid)
+{
+    if (!tracerParams.EnableErrorCheck)
+        return false;
+
+    TraceContext* ctx = GetCurTraceContext(tid);
+    const GLenum glErr = _glGetError();
+    if (ctx->pendingGlError == GL_NO_ERROR)
+    {
+        ctx->pendingGlError = glErr;
+    }
+    return glErr != GL_NO_ERROR;
+}
+
 __eglMustCastToProperFunctionPointerType _wrapProcAddress(
     const char * procName, __eglMustCastToProperFunctionPointerType procPtr);
 bool _need_user_arrays();
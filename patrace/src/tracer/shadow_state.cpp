@@ -0,0 +1,270 @@
+#include "tracer/shadow_state.hpp"
+
+#include "dispatch/eglproc_auto.hpp"
+#include "helper/states.h"
+#include "common/os.hpp"
+
+// The generic buffer bindings that are context state, and the GLES version that has them. The
+// element array buffer binding is vertex array state, and the transform feedback one is
+// transform feedback object state, so they are not here.
+static const struct
+{
+    GLenum target;
+    int version;
+} bufferTargets[] = {
+    { GL_ARRAY_BUFFER, 200 },
+    { GL_COPY_READ_BUFFER, 300 },
+    { GL_COPY_WRITE_BUFFER, 300 },
+    { GL_PIXEL_PACK_BUFFER, 300 },
+    { GL_PIXEL_UNPACK_BUFFER, 300 },
+    { GL_UNIFORM_BUFFER, 300 },
+    { GL_SHADER_STORAGE_BUFFER, 310 },
+    { GL_ATOMIC_COUNTER_BUFFER, 310 },
+    { GL_DRAW_INDIRECT_BUFFER, 310 },
+    { GL_DISPATCH_INDIRECT_BUFFER, 310 },
+    { GL_TEXTURE_BUFFER, 320 },
+};
+
+int ShadowState::targetIndex(GLenum target)
+{
+    static_assert(sizeof(bufferTargets) / sizeof(bufferTargets[0]) == BUFFER_TARGETS, "buffer targets");
+    for (int i = 0; i < BUFFER_TARGETS; i++)
+    {
+        if (bufferTargets[i].target == target)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void ShadowState::init(GLint maxVertexAttribs, int glesVersion)
+{
+    mMaxVertexAttribs = maxVertexAttribs;
+    mGlesVersion = glesVersion;
+    mVertexArrays.clear();
+    mCurrentVertexArray = 0;
+    mCurrent = &mVertexArrays[0];
+    mCurrent->attribs.resize(mMaxVertexAttribs);
+}
+
+void ShadowState::bindBuffer(GLenum target, GLuint buffer)
+{
+    if (target == GL_ELEMENT_ARRAY_BUFFER)
+    {
+        mCurrent->elementArrayBuffer = buffer;
+        return;
+    }
+    const int index = targetIndex(target);
+    if (index >= 0)
+    {
+        mBuffers[index] = buffer;
+    }
+}
+
+void ShadowState::deleteBuffers(GLsizei n, const GLuint* buffers)
+{
+    // Deleted buffers are unbound from the context, and from the current vertex array only
+    for (GLsizei i = 0; i < n && buffers; i++)
+    {
+        const GLuint buffer = buffers[i];
+        if (buffer == 0)
+        {
+            continue;
+        }
+        for (GLuint& binding : mBuffers)
+        {
+            if (binding == buffer) binding = 0;
+        }
+        if (mCurrent->elementArrayBuffer == buffer) mCurrent->elementArrayBuffer = 0;
+        for (VertexAttrib& attrib : mCurrent->attribs)
+        {
+            if (attrib.buffer == buffer) attrib.buffer = 0;
+        }
+    }
+}
+
+void ShadowState::bindVertexArray(GLuint array)
+{
+    mCurrentVertexArray = array;
+    mCurrent = &mVertexArrays[array];
+    if (mCurrent->attribs.empty())
+    {
+        mCurrent->attribs.resize(mMaxVertexAttribs);
+    }
+}
+
+void ShadowState::deleteVertexArrays(GLsizei n, const GLuint* arrays)
+{
+    for (GLsizei i = 0; i < n && arrays; i++)
+    {
+        if (arrays[i] == 0)
+        {
+            continue; // silently ignored
+        }
+        if (arrays[i] == mCurrentVertexArray)
+        {
+            bindVertexArray(0);
+        }
+        mVertexArrays.erase(arrays[i]);
+    }
+}
+
+void ShadowState::enableVertexAttribArray(GLuint index, bool enabled)
+{
+    if (index < (GLuint)mMaxVertexAttribs)
+    {
+        mCurrent->attribs[index].enabled = enabled;
+    }
+}
+
+void ShadowState::vertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* pointer)
+{
+    if (index < (GLuint)mMaxVertexAttribs)
+    {
+        VertexAttrib& attrib = mCurrent->attribs[index];
+        attrib.buffer = mBuffers[0];
+        attrib.size = size;
+        attrib.type = type;
+        attrib.normalized = normalized;
+        attrib.stride = stride;
+        attrib.pointer = pointer;
+    }
+}
+
+void ShadowState::vertexAttribDivisor(GLuint index, GLuint divisor)
+{
+    if (index < (GLuint)mMaxVertexAttribs)
+    {
+        mCurrent->attribs[index].divisor = divisor;
+    }
+}
+
+bool ShadowState::boundBuffer(GLenum target, GLuint& buffer) const
+{
+    if (target == GL_ELEMENT_ARRAY_BUFFER)
+    {
+        buffer = mCurrent->elementArrayBuffer;
+        return true;
+    }
+    const int index = targetIndex(target);
+    if (index < 0)
+    {
+        return false;
+    }
+    buffer = mBuffers[index];
+    return true;
+}
+
+bool ShadowState::hasClientArrays() const
+{
+    for (const VertexAttrib& attrib : mCurrent->attribs)
+    {
+        if (attrib.enabled && !attrib.buffer)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+ShadowState::VertexAttrib ShadowState::queryVertexAttrib(GLuint index, bool divisor)
+{
+    VertexAttrib attrib;
+    GLint value = 0;
+    _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &value);
+    attrib.enabled = value;
+    if (!attrib.enabled)
+    {
+        return attrib;
+    }
+    _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &value);
+    attrib.buffer = value;
+    if (attrib.buffer)
+    {
+        return attrib;
+    }
+    _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_SIZE, &attrib.size);
+    _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_TYPE, &value);
+    attrib.type = value;
+    _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &value);
+    attrib.normalized = value;
+    _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &attrib.stride);
+    GLvoid* pointer = nullptr;
+    _glGetVertexAttribPointerv(index, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+    attrib.pointer = pointer;
+    if (divisor)
+    {
+        // GL_VERTEX_ATTRIB_ARRAY_DIVISOR is GLES 3 only
+        _glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_DIVISOR, &value);
+        attrib.divisor = value;
+    }
+    return attrib;
+}
+
+void ShadowState::check()
+{
+    GLint value = 0;
+    _glGetIntegerv(GL_CURRENT_PROGRAM, &value);
+    if ((GLuint)value != mCurrentProgram)
+    {
+        DBG_LOG("Shadow state: current program is %d, not %u\n", value, mCurrentProgram);
+        mCurrentProgram = value;
+    }
+    if (mGlesVersion >= 300)
+    {
+        _glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
+        if ((GLuint)value != mCurrentVertexArray)
+        {
+            DBG_LOG("Shadow state: vertex array %d is bound, not %u\n", value, mCurrentVertexArray);
+            bindVertexArray(value);
+        }
+    }
+    for (int i = 0; i < BUFFER_TARGETS; i++)
+    {
+        if (bufferTargets[i].version > mGlesVersion)
+        {
+            continue;
+        }
+        const GLuint buffer = getBoundBuffer(bufferTargets[i].target);
+        if (buffer != mBuffers[i])
+        {
+            DBG_LOG("Shadow state: buffer %u is bound to %s, not %u\n", buffer, bufferName(bufferTargets[i].target), mBuffers[i]);
+            mBuffers[i] = buffer;
+        }
+    }
+    const GLuint elementArrayBuffer = getBoundBuffer(GL_ELEMENT_ARRAY_BUFFER);
+    if (elementArrayBuffer != mCurrent->elementArrayBuffer)
+    {
+        DBG_LOG("Shadow state: buffer %u is bound to GL_ELEMENT_ARRAY_BUFFER, not %u\n", elementArrayBuffer, mCurrent->elementArrayBuffer);
+        mCurrent->elementArrayBuffer = elementArrayBuffer;
+    }
+    if (!mTracked)
+    {
+        return;
+    }
+    const bool divisor = mGlesVersion >= 300;
+    for (GLint index = 0; index < mMaxVertexAttribs; index++)
+    {
+        const VertexAttrib actual = queryVertexAttrib(index, divisor);
+        VertexAttrib& shadow = mCurrent->attribs[index];
+        bool same = actual.enabled == shadow.enabled && actual.buffer == shadow.buffer;
+        if (same && actual.enabled && !actual.buffer)
+        {
+            same = actual.size == shadow.size && actual.type == shadow.type && actual.normalized == shadow.normalized
+                && actual.stride == shadow.stride && actual.pointer == shadow.pointer && (!divisor || actual.divisor == shadow.divisor);
+        }
+        if (!same)
+        {
+            DBG_LOG("Shadow state: vertex attribute %d is %s with buffer %u and pointer %p, not %s with buffer %u and pointer %p\n", index,
+                    actual.enabled ? "enabled" : "disabled", actual.buffer, actual.pointer,
+                    shadow.enabled ? "enabled" : "disabled", shadow.buffer, shadow.pointer);
+            shadow.enabled = actual.enabled;
+            shadow.buffer = actual.buffer;
+            if (actual.enabled && !actual.buffer)
+            {
+                shadow = actual; // the rest is only known for client side arrays
+            }
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef _TRACER_SHADOW_STATE_HPP_
+#define _TRACER_SHADOW_STATE_HPP_
+
+#include "dispatch/eglimports.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+/// A copy of the buffer bindings and vertex array state of a GLES 2+ context, kept up to date from
+/// the calls the tracer intercepts, so that draws and buffer mappings do not need to query the
+/// driver. Each query may stall the pipeline on some drivers. State that is changed in ways the
+/// shadow does not follow, such as with the separate vertex attribute format calls, makes it
+/// untracked, and the driver is queried for it again.
+class ShadowState
+{
+public:
+    struct VertexAttrib
+    {
+        bool enabled = false;
+        GLuint buffer = 0;
+        GLint size = 4;
+        GLenum type = GL_FLOAT;
+        GLboolean normalized = GL_FALSE;
+        GLsizei stride = 0;
+        const GLvoid* pointer = nullptr;
+        GLuint divisor = 0;
+    };
+
+    /// Call when the context is first made current, since its limits are not known before.
+    /// The version is as in GlesFeatures, so 310 for GLES 3.1.
+    void init(GLint maxVertexAttribs, int glesVersion);
+    bool initialized() const { return mCurrent != nullptr; }
+    /// Whether the vertex array state can be read from here rather than from the driver
+    bool tracked() const { return mTracked; }
+    /// Stop tracking the vertex array state, until the context is gone
+    void untrack() { mTracked = false; }
+
+    void bindBuffer(GLenum target, GLuint buffer);
+    void deleteBuffers(GLsizei n, const GLuint* buffers);
+    void bindVertexArray(GLuint array);
+    void deleteVertexArrays(GLsizei n, const GLuint* arrays);
+    void enableVertexAttribArray(GLuint index, bool enabled);
+    void vertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* pointer);
+    void vertexAttribDivisor(GLuint index, GLuint divisor);
+    void useProgram(GLuint program) { mCurrentProgram = program; }
+
+    /// Returns false if the binding of this target is not tracked
+    bool boundBuffer(GLenum target, GLuint& buffer) const;
+    GLuint currentProgram() const { return mCurrentProgram; }
+    const VertexAttrib& vertexAttrib(GLuint index) const { return mCurrent->attribs[index]; }
+    /// Whether any enabled vertex attribute array is read from client memory
+    bool hasClientArrays() const;
+
+    /// Query the state of one vertex attribute from the driver. Only whether it is enabled, and its
+    /// buffer, are queried unless it is an enabled client side array.
+    static VertexAttrib queryVertexAttrib(GLuint index, bool divisor);
+    /// Compare the shadow with the driver's state, and log and correct any differences. For debugging.
+    void check();
+
+private:
+    struct VertexArray
+    {
+        std::vector<VertexAttrib> attribs;
+        GLuint elementArrayBuffer = 0;
+    };
+    static int targetIndex(GLenum target);
+
+    static const int BUFFER_TARGETS = 11;
+
+    bool mTracked = true;
+    int mGlesVersion = 0;
+    GLint mMaxVertexAttribs = 0;
+    GLuint mBuffers[BUFFER_TARGETS] = {}; ///< generic bindings, except the element array buffer of the vertex array
+    GLuint mCurrentProgram = 0;
+    GLuint mCurrentVertexArray = 0;
+    std::unordered_map<GLuint, VertexArray> mVertexArrays; ///< including the default one, 0
+    VertexArray* mCurrent = nullptr; ///< stays valid, since the map does not move its elements
+};
+
+#endif
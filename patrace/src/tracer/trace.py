@@ -131,6 +131,31 @@ ignore_functions = [
     'glDebugMessageControl'
 ]
 
+# Calls that change the state kept in ShadowState, and how to follow them there
+shadow_functions = {
+    'glBindBuffer': 'bindBuffer(target, buffer)',
+    'glBindBufferBase': 'bindBuffer(target, buffer)',
+    'glBindBufferRange': 'bindBuffer(target, buffer)',
+    'glDeleteBuffers': 'deleteBuffers(n, buffers)',
+    'glBindVertexArray': 'bindVertexArray(array)',
+    'glBindVertexArrayOES': 'bindVertexArray(array)',
+    'glDeleteVertexArrays': 'deleteVertexArrays(n, arrays)',
+    'glDeleteVertexArraysOES': 'deleteVertexArrays(n, arrays)',
+    'glEnableVertexAttribArray': 'enableVertexAttribArray(index, true)',
+    'glDisableVertexAttribArray': 'enableVertexAttribArray(index, false)',
+    'glVertexAttribPointer': 'vertexAttribPointer(index, size, type, normalized, stride, pointer)',
+    'glVertexAttribIPointer': 'vertexAttribPointer(index, size, type, GL_FALSE, stride, pointer)',
+    'glVertexAttribDivisor': 'vertexAttribDivisor(index, divisor)',
+    'glVertexAttribDivisorEXT': 'vertexAttribDivisor(index, divisor)',
+    'glUseProgram': 'useProgram(program)',
+    # not followed, so the vertex array state is queried from the driver from then on
+    'glVertexAttribFormat': 'untrack()',
+    'glVertexAttribIFormat': 'untrack()',
+    'glVertexAttribBinding': 'untrack()',
+    'glBindVertexBuffer': 'untrack()',
+    'glVertexBindingDivisor': 'untrack()',
+}
+
 # Will be prepended with 'after_'
 post_functions = [
     'glLinkProgram',
@@ -273,6 +298,74 @@ class SerializeVisitor(stdapi.Visitor):
     def visitPolymorphic(self, polymorphic, name, func):
         print('    #error')
 
+class SerializeSizeVisitor(stdapi.Visitor):
+    '''Upper bound of what SerializeVisitor writes. Fixed size arguments are counted in
+    self.fixed, and the code adding up the rest is collected in self.lines.'''
+
+    def __init__(self):
+        self.fixed = 0
+        self.lines = []
+
+    def visitVoid(self, void, name, func):
+        pass
+    def visitLiteral(self, literal, name, func):
+        self.fixed += 1
+    def visitString(self, string, name, func):
+        if func.name == 'glAssertBuffer_ARM': # md5sum text
+            self.lines.append('    _size += WriteStringSize(NULL) + 33;')
+        else:
+            self.lines.append('    _size += WriteStringSize((const char*)%s);' % (name))
+    def visitConst(self, const, name, func):
+        self.visit(const.type, name, func)
+    def visitStruct(self, struct, name, func):
+        self.lines.append('    #error')
+    def visitArray(self, array, name, func):
+        eleSerialType = stdapi.getSerializationType(array.type)
+        if stdapi.isString(array.type):
+            self.lines.append('    _size += WriteStringArraySize(%s, %s);' % (array.length, name))
+        elif func.name == "glGetSynciv":
+            self.lines.append('    _size += Write1DArraySize<%s>(%s ? *%s : 0, (%s*)%s);' % (eleSerialType, array.length, array.length, eleSerialType, name))
+        else:
+            self.lines.append('    _size += Write1DArraySize<%s>(%s, (%s*)%s);' % (eleSerialType, array.length, eleSerialType, name))
+    def visitBlob(self, blob, name, func):
+        if func.name == 'glGetProgramBinary':
+            self.lines.append('    _size += Write1DArraySize<char>(%s ? (unsigned int)*%s : 0, (const char*)%s);' % (blob.size, blob.size, name))
+        else:
+            self.lines.append('    _size += Write1DArraySize<char>((unsigned int)%s, (const char*)%s);' % (blob.size, name))
+    def visitEnum(self, enum, name, func):
+        self.fixed += 1
+    def visitBitmask(self, bitmask, name, func):
+        self.visit(bitmask.type, name, func)
+    def visitPointer(self, pointer, name, func):
+        self.fixed += 2
+    def visitIntPointer(self, pointer, name, func):
+        self.fixed += 1
+    def visitObjPointer(self, pointer, name, func):
+        self.lines.append('    #error')
+    def visitLinearPointer(self, pointer, name, func):
+        self.fixed += 1
+    def visitReference(self, reference, name, func):
+        self.lines.append('    #error')
+    def visitHandle(self, handle, name, func):
+        self.visit(handle.type, name, func)
+    def visitAlias(self, alias, name, func):
+        self.visit(alias.type, name, func)
+    def visitOpaque(self, opaque, name, func):
+        if func.name in stdapi.draw_function_names and name == 'indices':
+            self.fixed += 3
+            self.lines.append('#if !ENABLE_CLIENT_SIDE_BUFFER')
+            self.lines.append('    _size += Write1DArraySize<char>((unsigned int)(count*_gl_type_size(type)), (const char*)indices);')
+            self.lines.append('#endif')
+        elif func.name in stdapi.texture_function_names:
+            self.fixed += 2
+            self.lines.append('    _size += Write1DArraySize<char>((unsigned int)%s, (const char*)%s);' % (opaque.size, name))
+        else:
+            self.fixed += 2
+    def visitInterface(self, interface, name, func):
+        self.lines.append('    #error')
+    def visitPolymorphic(self, polymorphic, name, func):
+        self.lines.append('    #error')
+
 class TypeGetter(stdapi.Visitor):
     '''Determine which glGet*v function that matches the specified type.'''
 
@@ -471,8 +564,26 @@ class Tracer:
             print('        params[bufSize - 1] = 2; // the list is always sorted in descending order, and 2 is always the minimum possible')
             print('    }')
         print('    // save parameters')
-        print('    gTraceOut->callMutex.lock();')
-        print('    char* dest = gTraceOut->writebuf;')
+        sizeVisitor = SerializeSizeVisitor()
+        for arg in func.args:
+            sizeVisitor.visit(arg.type, arg.name, func)
+        if func.name == 'eglCreateWindowSurface':
+            sizeVisitor.fixed += 4
+        if func.name == 'glLinkProgram':
+            sizeVisitor.fixed += 1
+        if func.type is not stdapi.Void:
+            sizeVisitor.visit(func.type, '_result', func)
+        if func.name == 'glEGLImageTargetTexture2DOES':
+            # the eglDestroyImageKHR and eglCreateImageKHR calls inserted in front of it
+            print('    size_t _size = 3 * sizeof(BCall_vlen) + %d * WRITE_FIXED_MAX_SIZE;' % (sizeVisitor.fixed + 8))
+            print('    _size += Write1DArraySize<unsigned int>(_AttribPairList_size(attrib_list, EGL_NONE), (unsigned int*)attrib_list);')
+        else:
+            print('    size_t _size = sizeof(BCall_vlen) + %d * WRITE_FIXED_MAX_SIZE;' % sizeVisitor.fixed)
+        for line in sizeVisitor.lines:
+            print(line)
+        # the call numbers are taken here, and the calls are written in that order once serialized
+        print('    char* const _writebuf = gTraceOut->BeginCalls(tid, _size, %d);' % (3 if func.name == 'glEGLImageTargetTexture2DOES' else 1))
+        print('    char* dest = _writebuf;')
         if func.name == 'glEGLImageTargetTexture2DOES':
             print()
             print('    // Firstly, insert an eglDestroyImageKHR')
@@ -484,7 +595,6 @@ class Tracer:
             print('    dest = WriteFixed<int>(dest, (intptr_t)dpy); // int pointer')
             print('    dest = WriteFixed<int>(dest, (intptr_t)image); // int pointer')
             print('    dest = WriteFixed<int>(dest, EGL_TRUE); // enum')
-            print('    gTraceOut->callNo++;')
             print()
             print('    // Secondly, save an eglCreateImageKHR')
             print('    char *starting_point2 = dest;')
@@ -500,7 +610,6 @@ class Tracer:
             print('    dest = Write1DArray<unsigned int>(dest, _AttribPairList_size(attrib_list, EGL_NONE), (unsigned int*)attrib_list); // array')
             print('    dest = WriteFixed<int>(dest, (intptr_t)image); // int pointer')
             print('    pCall1->toNext = dest-starting_point2;')
-            print('    gTraceOut->callNo++;')
             print()
             print('    // finally, save glEGLImageTargetTexture2DOES')
 
@@ -539,20 +648,18 @@ class Tracer:
         if func.name.startswith('gl') and func.name != 'glGetError':
             print('    pCall->errNo = GetCallErrorNo("%s", tid);' % func.name)
         if gIdToLength[func.id] == '0':
-            print('    pCall->toNext = dest-gTraceOut->writebuf;')
+            print('    pCall->toNext = dest-_writebuf;')
             print('#ifdef DEBUG')
             print('    if (pCall->toNext == 0)')
             print('    {')
-            print('        DBG_LOG("Zero-length variable call detected for %s in call %%d\\n", (int)gTraceOut->callNo);' % func.name)
+            print('        DBG_LOG("Zero-length variable call detected for %s in call %%d\\n", (int)gTraceOut->callNo.load());' % func.name)
             print('        abort();')
             print('    }')
             print('#endif')
 
-        print('    gTraceOut->WriteBuf(dest);')
-        print('    gTraceOut->callNo++;')
-        if func.name in ['eglSwapBuffers', 'eglSwapBuffersWithDamageKHR']: # must be before mutex unlock
+        print('    gTraceOut->EndCalls(tid, dest);')
+        if func.name in ['eglSwapBuffers', 'eglSwapBuffersWithDamageKHR']:
             print('    after_eglSwapBuffers();')
-        print('    gTraceOut->callMutex.unlock();')
 
     def invokeFunction(self, func, prefix='_', suffix='', indent='    '):
         if func.name in ignore_functions:
@@ -584,8 +691,10 @@ class Tracer:
 
         if func.name == 'glGetError':
             print('    if (tracerParams.EnableErrorCheck) {')
-            print('        _result = GetCurTraceContext(tid)->lastGlError;')
-            print('        GetCurTraceContext(tid)->lastGlError = GL_NO_ERROR;')
+            print('        TraceContext* _ctx = GetCurTraceContext(tid);')
+            print('        _result = _ctx->lastGlError != GL_NO_ERROR ? _ctx->lastGlError : _ctx->pendingGlError;')
+            print('        _ctx->lastGlError = GL_NO_ERROR;')
+            print('        _ctx->pendingGlError = GL_NO_ERROR;')
             print('    }')
             print('    else {')
             print('        _result = _glGetError();')
@@ -682,6 +791,11 @@ class Tracer:
         print('%s++gTraceThread.at(tid).mCallDepth;' % indent)
         print('%s%s%s(%s);' % (indent, result, dispatch, params))
         print('%s--gTraceThread.at(tid).mCallDepth;' % indent)
+        if func.name in shadow_functions:
+            print('%sif (ShadowState* _shadow = GetShadowState(tid))' % indent)
+            print('%s{' % indent)
+            print('%s    if (!ShadowCallFailed(tid)) _shadow->%s;' % (indent, shadow_functions[func.name]))
+            print('%s}' % indent)
         print()
 
         if func.name == 'glGetString':
@@ -790,8 +904,7 @@ class Tracer:
     def traceFunctionBody_pre(self, func):
         print('    // traceFunctionBody_pre')
         if (func.name in array_pointer_function_names):
-            print('    GLint _array_buffer = 0;')
-            print('    _glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &_array_buffer);')
+            print('    GLint _array_buffer = GetShadowBoundBuffer(tid, GL_ARRAY_BUFFER);')
             print('    if (_array_buffer==0) {')
             self.invokeFunction(func, indent='        ')
             print('        return;')
@@ -807,7 +920,7 @@ class Tracer:
             print('    }')
         if func.name in stdapi.draw_function_names or func.name == 'glDispatchCompute':
             print('    if (unlikely(stateLoggingEnabled)) {')
-            print('        gTraceOut->getStateLogger().logFunction(tid, "' + func.name + '", gTraceOut->callNo, 0);')
+            print('        gTraceOut->getStateLogger().logFunction(tid, "' + func.name + '", gTraceOut->callNo.load(), 0);')
 
         if func.name in stdapi.draw_array_function_names:
             if func.name not in stdapi.draw_indirect_function_names:
@@ -821,8 +934,7 @@ class Tracer:
             else:
                 print('        gTraceOut->getStateLogger().logState(tid);')
             print('    }')
-            print('    GLint _element_array_buffer = 0;')
-            print('    _glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &_element_array_buffer);')
+            print('    GLint _element_array_buffer = GetShadowBoundBuffer(tid, GL_ELEMENT_ARRAY_BUFFER);')
             if func.name not in stdapi.draw_indirect_function_names:
                 print('    GLuint clientSideBufferObjName = 0;')
                 print('#if ENABLE_CLIENT_SIDE_BUFFER')
@@ -847,7 +959,7 @@ class Tracer:
         if func.name == 'glBufferData':
             print('    if (size < 0)')
             print('        return;')
-            print('    GLint boundBuffer = getBoundBuffer(target);')
+            print('    GLint boundBuffer = GetShadowBoundBuffer(tid, target);')
             print('    BufferInitializedSet_t &bufInitSet = GetCurTraceContext(tid)->bufferInitializedSet;')
             print('    if (data != NULL)')
             print('    {')
@@ -930,14 +1042,18 @@ class Tracer:
             print('    after_glDeleteProgram(tid, program);')
         if func.name == 'glBindAttribLocation':
             print('    after_glBindAttribLocation(tid, program, index);')
+        if func.name in ('glProgramBinary', 'glProgramBinaryOES'):
+            print('    InvalidateActiveAttribMasks();')
         if func.name in ['glMapBufferRange', 'glMapBuffer', 'glMapBufferOES']:
-            print('    after_glMapBufferRange(target, length, access, _result);')
+            print('    _result = after_glMapBufferRange(target, length, access, _result);')
         if func.name == 'glMapBufferRange':
             print('    GetCurTraceContext(tid)->isFullMapping = false;')
         if func.name in stdapi.draw_function_names:
             print('    after_glDraw();')
-        if func.name == ['glUnmapBufferOES', 'glUnmapBuffer']:
+        if func.name in ['glUnmapBufferOES', 'glUnmapBuffer']:
             print('    after_glUnmapBuffer(target);')
+        if func.name in ['glGetBufferPointerv', 'glGetBufferPointervOES']:
+            print('    after_glGetBufferPointerv(tid, target, pname, params);')
 
         params = ', '.join([str(arg.name) for arg in func.args])
 
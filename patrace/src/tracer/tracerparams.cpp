@@ -1,6 +1,7 @@
 #include "tracerparams.hpp"
 #include "helper/states.h"
 
+#include <common/memory.hpp>
 #include <common/os.hpp>
 
 #include <string>
@@ -44,6 +45,8 @@ TracerParams::TracerParams()
         DBG_LOG("EnableActiveAttribCheck: %s\n", EnableActiveAttribCheck ? "true" : "false");
         DBG_LOG("InteractiveIntercept: %s\n", InteractiveIntercept ? "true" : "false");
         DBG_LOG("FlushTraceFileEveryFrame: %s\n", FlushTraceFileEveryFrame ? "true" : "false");
+        if (TraceFileWriterThreads >= 0) DBG_LOG("TraceFileWriterThreads: %d\n", TraceFileWriterThreads);
+        if (SeekIndex) DBG_LOG("SeekIndex: true\n");
         DBG_LOG("DisableBufferStorage: %s\n", DisableBufferStorage ? "true" : "false");
         DBG_LOG("RendererName: %s\n", RendererName.c_str());
         DBG_LOG("EnableRandomVersion: %s\n", EnableRandomVersion ? "true": "false");
@@ -52,6 +55,9 @@ TracerParams::TracerParams()
         if (DisableErrorReporting) DBG_LOG("DisableErrorReporting: true\n");
         if (StateDumpAfterSnapshot) DBG_LOG("StateDumpAfterSnapshot: true\n");
         if (StateDumpAfterDrawCall) DBG_LOG("StateDumpAfterDrawCall: true\n");
+        if (CheckShadowState) DBG_LOG("CheckShadowState: true\n");
+        if (TrackMappedBufferWrites) DBG_LOG("TrackMappedBufferWrites: true\n");
+        DBG_LOG("ClientSideBufferDigest: %s\n", common::digestKindName(common::bufferDigestKind()));
         if (FilterSupportedExtension) {
             DBG_LOG("%sFilterSupportedExtension true%s\n",redOnBlack, resetColor);
             for (unsigned int i = 0; i < SupportedExtensions.size(); ++i) {
@@ -134,6 +140,10 @@ void TracerParams::LoadParams()
             FilterSupportedExtension = (strParamValue.compare("true") == 0);
         } else if (strParamName.compare("FlushTraceFileEveryFrame") == 0) {
             FlushTraceFileEveryFrame = (strParamValue.compare("true") == 0);
+        } else if (strParamName.compare("TraceFileWriterThreads") == 0) {
+            TraceFileWriterThreads = atoi(strParamValue.c_str());
+        } else if (strParamName.compare("SeekIndex") == 0) {
+            SeekIndex = (strParamValue.compare("true") == 0);
         } else if (strParamName.compare("StateDumpAfterSnapshot") == 0) {
             StateDumpAfterSnapshot = (strParamValue.compare("true") == 0);
         } else if (strParamName.compare("DisableErrorReporting") == 0) {
@@ -141,6 +151,17 @@ void TracerParams::LoadParams()
         } else if (strParamName.compare("StateDumpAfterDrawCall") == 0) {
             StateDumpAfterDrawCall = (strParamValue.compare("true") == 0);
             stateLoggingEnabled = StateDumpAfterDrawCall;
+        } else if (strParamName.compare("CheckShadowState") == 0) {
+            CheckShadowState = (strParamValue.compare("true") == 0);
+        } else if (strParamName.compare("TrackMappedBufferWrites") == 0) {
+            TrackMappedBufferWrites = (strParamValue.compare("true") == 0);
+        } else if (strParamName.compare("ClientSideBufferDigest") == 0) {
+            common::DigestKind kind;
+            if (common::parseDigestKind(strParamValue, kind)) {
+                common::setBufferDigestKind(kind);
+            } else {
+                DBG_LOG("Unknown client-side buffer digest: %s\n", strParamValue.c_str());
+            }
         } else if (strParamName.compare("DisableBufferStorage") == 0) {
             DisableBufferStorage = (strParamValue.compare("true") == 0);
         } else if (strParamName.compare("RendererName") == 0) {
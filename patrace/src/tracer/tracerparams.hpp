@@ -17,8 +17,12 @@ public:
     std::string RendererName = "";
     bool DisableBufferStorage = false;
     bool FlushTraceFileEveryFrame = true;           // Save trace file for each completed frame. Slower but safer.
+    int TraceFileWriterThreads = -1;                // Compress and write trace file in background threads. -1 uses PATRACE_WRITER_THREADS.
+    bool SeekIndex = false;                         // Write a frame seek index at the end of the trace file. Otherwise PATRACE_SEEK_INDEX decides.
     bool StateDumpAfterSnapshot = false;            // Debugging
     bool StateDumpAfterDrawCall = false;            // Debugging
+    bool CheckShadowState = false;                  // Debugging: compare the tracked GL state with the driver's on each draw
+    bool TrackMappedBufferWrites = false;           // Find the pages written to in glMapBuffer maps with page faults, instead of comparing
     int UniformBufferOffsetAlignment = 256;         // Enforce an alignment that works crossplatform
     int ShaderStorageBufferOffsetAlignment = 256;   // As above
     int MaximumAnisotropicFiltering = 0;            // Anisotropic support. Must also add GL_EXT_texture_filter_anisotropic to SupportedExtensions
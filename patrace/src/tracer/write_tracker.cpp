@@ -0,0 +1,193 @@
+#include "tracer/write_tracker.hpp"
+
+#include "common/os.hpp"
+
+#include <algorithm>
+#include <errno.h>
+#include <mutex>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Buffers that are mapped at the same time, which the signal handler looks through without locking.
+// The handler counts itself as a user of a slot before loading its tracker, and a tracker is only
+// freed once it has been taken out of its slot and the slot has no users.
+static const int MAX_TRACKERS = 64;
+struct TrackerSlot
+{
+    std::atomic<WriteTracker*> tracker;
+    std::atomic<int> users;
+};
+static TrackerSlot trackers[MAX_TRACKERS];
+static struct sigaction previousAction;
+
+static int createMemoryFile(const char* name)
+{
+#ifdef __NR_memfd_create
+    return syscall(__NR_memfd_create, name, 0);
+#else
+    (void)name;
+    return -1;
+#endif
+}
+
+bool WriteTracker::installHandler()
+{
+    static std::mutex mutex;
+    static bool installed = false;
+    static bool failed = false;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!installed && !failed)
+    {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = handler;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        installed = (sigaction(SIGSEGV, &action, &previousAction) == 0);
+        failed = !installed;
+        if (failed)
+        {
+            DBG_LOG("Failed to install the signal handler for tracking writes to mapped buffers: %s\n", strerror(errno));
+        }
+    }
+    return installed;
+}
+
+void WriteTracker::handler(int sig, siginfo_t* info, void* context)
+{
+    char* address = static_cast<char*>(info->si_addr);
+    for (TrackerSlot& slot : trackers)
+    {
+        slot.users.fetch_add(1);
+        WriteTracker* tracker = slot.tracker.load();
+        const bool handled = tracker && tracker->handleFault(address);
+        slot.users.fetch_sub(1);
+        if (handled)
+        {
+            return;
+        }
+    }
+
+    // Not ours
+    if (previousAction.sa_flags & SA_SIGINFO)
+    {
+        previousAction.sa_sigaction(sig, info, context);
+    }
+    else if (previousAction.sa_handler != SIG_DFL && previousAction.sa_handler != SIG_IGN)
+    {
+        previousAction.sa_handler(sig);
+    }
+    else
+    {
+        // Fault again, without us
+        signal(sig, SIG_DFL);
+    }
+}
+
+bool WriteTracker::handleFault(char* address)
+{
+    if (address < mView || address >= mView + mSize)
+    {
+        return false;
+    }
+    const size_t page = (address - mView) / mPageSize;
+    if (mTouched[page].exchange(1) == 0)
+    {
+        const size_t offset = page * mPageSize;
+        memcpy(mStaging + offset, mMapped + offset, std::min(mPageSize, mLength - offset));
+        mprotect(mView + offset, mPageSize, PROT_READ | PROT_WRITE);
+    }
+    // Otherwise another thread is copying the page, and the access faults until it is done
+    return true;
+}
+
+WriteTracker* WriteTracker::create(void* mapped, size_t length)
+{
+    if (!mapped || length == 0 || !installHandler())
+    {
+        return NULL;
+    }
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    const size_t size = (length + pageSize - 1) / pageSize * pageSize;
+    const int fd = createMemoryFile("patrace-mapped-buffer");
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    char* staging = NULL;
+    char* view = NULL;
+    if (ftruncate(fd, size) == 0)
+    {
+        void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        staging = (p != MAP_FAILED) ? static_cast<char*>(p) : NULL;
+        p = mmap(NULL, size, PROT_NONE, MAP_SHARED, fd, 0);
+        view = (p != MAP_FAILED) ? static_cast<char*>(p) : NULL;
+    }
+    close(fd); // the mappings keep the memory
+    if (!staging || !view)
+    {
+        if (staging) munmap(staging, size);
+        if (view) munmap(view, size);
+        return NULL;
+    }
+
+    WriteTracker* tracker = new WriteTracker(mapped, length, size, pageSize, staging, view);
+    for (TrackerSlot& slot : trackers)
+    {
+        WriteTracker* empty = NULL;
+        if (slot.tracker.compare_exchange_strong(empty, tracker))
+        {
+            return tracker;
+        }
+    }
+    delete tracker; // too many buffers are mapped
+    return NULL;
+}
+
+WriteTracker::WriteTracker(void* mapped, size_t length, size_t size, size_t pageSize, char* staging, char* view)
+    : mMapped(static_cast<char*>(mapped))
+    , mLength(length)
+    , mSize(size)
+    , mPageSize(pageSize)
+    , mStaging(staging)
+    , mView(view)
+    , mTouched(new std::atomic<uint8_t>[size / pageSize]())
+{
+}
+
+WriteTracker::~WriteTracker()
+{
+    for (TrackerSlot& slot : trackers)
+    {
+        WriteTracker* self = this;
+        if (slot.tracker.compare_exchange_strong(self, NULL))
+        {
+            // A fault on another thread may still be looking at us
+            while (slot.users.load() != 0)
+            {
+                sched_yield();
+            }
+        }
+    }
+    munmap(mView, mSize);
+    munmap(mStaging, mSize);
+    delete[] mTouched;
+}
+
+std::vector<unsigned int> WriteTracker::writeBack()
+{
+    std::vector<unsigned int> pages;
+    for (size_t page = 0; page < mSize / mPageSize; page++)
+    {
+        if (mTouched[page].load())
+        {
+            const size_t offset = page * mPageSize;
+            memcpy(mMapped + offset, mStaging + offset, std::min(mPageSize, mLength - offset));
+            pages.push_back(page);
+        }
+    }
+    return pages;
+}
@@ -0,0 +1,49 @@
+#ifndef _TRACER_WRITE_TRACKER_HPP_
+#define _TRACER_WRITE_TRACKER_HPP_
+
+#include <atomic>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// Finds the pages of a mapped buffer that the application touches, so that they need not be
+/// copied when the buffer is mapped and compared when it is unmapped. The application is given a
+/// view of a shared memory file instead of the driver's mapping, with all its pages protected. The
+/// first access to a page faults, and the signal handler copies that page from the driver's
+/// mapping, through a second, writable, view of the same memory, before unprotecting it. At unmap,
+/// only the touched pages are copied back to the driver's mapping.
+///
+/// Reads count as touches. Memory that the kernel accesses for the application, such as with
+/// read(), fails with EFAULT instead of faulting, so such buffers cannot be tracked.
+class WriteTracker
+{
+public:
+    /// Returns NULL if the driver's mapping cannot be tracked
+    static WriteTracker* create(void* mapped, size_t length);
+    ~WriteTracker();
+
+    /// What to give to the application instead of the driver's mapping
+    void* pointer() const { return mView; }
+    /// The contents of the buffer, valid in the touched pages only
+    const void* contents() const { return mStaging; }
+    size_t pageSize() const { return mPageSize; }
+    /// Copy the touched pages back to the driver's mapping, and return their indices
+    std::vector<unsigned int> writeBack();
+
+private:
+    WriteTracker(void* mapped, size_t length, size_t size, size_t pageSize, char* staging, char* view);
+    static bool installHandler();
+    static void handler(int sig, siginfo_t* info, void* context);
+    bool handleFault(char* address);
+
+    char* mMapped;
+    size_t mLength;
+    size_t mSize; ///< length rounded up to whole pages
+    size_t mPageSize;
+    char* mStaging; ///< writable view
+    char* mView; ///< the application's view, protected until touched
+    std::atomic<uint8_t>* mTouched; ///< per page
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "chunk_codec_test.hpp"
+#include "common/chunk_codec.hpp"
+#include "common/file_format.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+using namespace common;
+
+ChunkCodecTest::ChunkCodecTest()
+{
+}
+
+void ChunkCodecTest::setUp()
+{
+}
+
+void ChunkCodecTest::tearDown()
+{
+}
+
+void ChunkCodecTest::testRoundTrip()
+{
+    std::vector<char> data(100000);
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = (i * 7) % 13 + (i / 1000);
+    }
+
+    for (unsigned id = 0; id < CHUNK_CODEC_COUNT; id++)
+    {
+        const ChunkCodec* codec = getChunkCodec(id);
+        CPPUNIT_ASSERT(codec);
+        std::vector<char> compressed(codec->maxCompressedLength(data.size()));
+        const size_t length = codec->compress(data.data(), data.size(), compressed.data(), -1);
+        CPPUNIT_ASSERT(length > 0 && length <= compressed.size());
+
+        size_t uncompressedLength = 0;
+        CPPUNIT_ASSERT(codec->uncompressedLength(compressed.data(), std::min<size_t>(length, CHUNK_CODEC_PREFIX_LENGTH), &uncompressedLength));
+        CPPUNIT_ASSERT(uncompressedLength == data.size());
+
+        std::vector<char> uncompressed(uncompressedLength);
+        CPPUNIT_ASSERT(codec->uncompress(compressed.data(), length, uncompressed.data()));
+        CPPUNIT_ASSERT(memcmp(uncompressed.data(), data.data(), data.size()) == 0);
+    }
+    CPPUNIT_ASSERT(getChunkCodec(CHUNK_CODEC_COUNT) == NULL);
+
+    // The zlib prefix is little endian whatever the host
+    const ChunkCodec* zlib = getChunkCodec(CHUNK_CODEC_ZLIB);
+    std::vector<char> compressed(zlib->maxCompressedLength(data.size()));
+    zlib->compress(data.data(), data.size(), compressed.data(), -1);
+    CPPUNIT_ASSERT(compressed[0] == (char)0xa0 && compressed[1] == (char)0x86 && compressed[2] == 0x01 && compressed[3] == 0);
+}
+
+void ChunkCodecTest::testLengthField()
+{
+    char header[CHUNK_HEADER_MAX_LENGTH];
+    unsigned codec = CHUNK_CODEC_COUNT;
+    uint32_t length = 0;
+
+    // Snappy chunks keep the plain length, as in files written before codecs existed,
+    // including lengths of 1 GiB and more
+    CPPUNIT_ASSERT(writeChunkHeader(header, CHUNK_CODEC_SNAPPY, 0x40000001) == 4);
+    CPPUNIT_ASSERT(header[0] == 0x01 && header[3] == 0x40);
+    CPPUNIT_ASSERT(readChunkHeader(header, 4, codec, length) == 4);
+    CPPUNIT_ASSERT(codec == CHUNK_CODEC_SNAPPY && length == 0x40000001);
+
+    CPPUNIT_ASSERT(writeChunkHeader(header, CHUNK_CODEC_ZLIB, 12345) == CHUNK_HEADER_MAX_LENGTH);
+    CPPUNIT_ASSERT(readLE32(header) == CHUNK_CODEC_MARKER);
+    CPPUNIT_ASSERT(chunkHeaderLength(readLE32(header)) == CHUNK_HEADER_MAX_LENGTH);
+    CPPUNIT_ASSERT(readChunkHeader(header, 4, codec, length) == 0);
+    CPPUNIT_ASSERT(readChunkHeader(header, sizeof(header), codec, length) == CHUNK_HEADER_MAX_LENGTH);
+    CPPUNIT_ASSERT(codec == CHUNK_CODEC_ZLIB && length == 12345);
+}
+
+void ChunkCodecTest::testParse()
+{
+    unsigned codec = 0;
+    int level = 0;
+    CPPUNIT_ASSERT(parseChunkCodec("snappy", codec, level) && codec == CHUNK_CODEC_SNAPPY && level == -1);
+    CPPUNIT_ASSERT(parseChunkCodec("zlib", codec, level) && codec == CHUNK_CODEC_ZLIB && level == -1);
+    CPPUNIT_ASSERT(parseChunkCodec("zlib:9", codec, level) && codec == CHUNK_CODEC_ZLIB && level == 9);
+    CPPUNIT_ASSERT(!parseChunkCodec("zlib:10", codec, level));
+    CPPUNIT_ASSERT(!parseChunkCodec("zlib:0", codec, level));
+    CPPUNIT_ASSERT(!parseChunkCodec("lz4", codec, level));
+}
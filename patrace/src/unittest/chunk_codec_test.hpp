@@ -0,0 +1,27 @@
+#ifndef _INCLUDE_CHUNK_CODEC_TEST_
+#define _INCLUDE_CHUNK_CODEC_TEST_
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class ChunkCodecTest : public CPPUNIT_NS::TestFixture
+{
+	CPPUNIT_TEST_SUITE(ChunkCodecTest);
+
+    CPPUNIT_TEST(testRoundTrip);
+    CPPUNIT_TEST(testLengthField);
+    CPPUNIT_TEST(testParse);
+
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+    ChunkCodecTest();
+
+    virtual void setUp();
+    virtual void tearDown();
+
+    void testRoundTrip();
+    void testLengthField();
+    void testParse();
+};
+
+#endif
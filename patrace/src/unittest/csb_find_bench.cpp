@@ -0,0 +1,94 @@
+// Micro-benchmark of how the tracer captures client-side vertex arrays: each draw digests the array,
+// looks for a client-side buffer with the same contents, and creates one if there is none.
+// Compares the digest kinds, and the index against the linear scan that was used before it.
+// Usage: csb_find_bench [CAPTURES] [BUFFERS]
+
+#include "common/memory.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace common;
+
+// The linear scan, as ClientSideBufferObjectSetPerThread::find did it
+static bool findLinear(const ClientSideBufferObjectSet& set, const std::vector<ClientSideBufferObjectName>& names,
+                       const ClientSideBufferObject& obj, ClientSideBufferObjectName& name)
+{
+    for (ClientSideBufferObjectName candidate : names)
+    {
+        const ClientSideBufferObject* other = set.get_object(0, candidate);
+        if (other && *other == obj)
+        {
+            name = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void run(const char* label, DigestKind kind, bool linear, const std::vector<std::vector<char>>& arrays,
+                const std::vector<unsigned int>& order)
+{
+    setBufferDigestKind(kind);
+    ClientSideBufferObjectSet set;
+    std::vector<ClientSideBufferObjectName> names;
+    size_t bytes = 0, created = 0;
+
+    const auto begin = std::chrono::steady_clock::now();
+    for (unsigned int index : order)
+    {
+        const std::vector<char>& array = arrays[index];
+        const ClientSideBufferObject obj(array.data(), array.size(), false);
+        ClientSideBufferObjectName name = 0;
+        const bool found = linear ? findLinear(set, names, obj, name) : set.find(0, obj, name);
+        if (!found)
+        {
+            name = set.create_object(0);
+            set.object_data(0, name, array.size(), array.data());
+            names.push_back(name);
+            created++;
+        }
+        bytes += array.size();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    const double seconds = std::chrono::duration<double>(end - begin).count();
+    printf("%-20s %8u captures, %6u created: %8.2f us per capture, %7.1f MB/s\n", label, (unsigned)order.size(),
+           (unsigned)created, seconds * 1e6 / order.size(), bytes / seconds / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    const size_t captures = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    const size_t buffers = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10000;
+    std::mt19937 random(1);
+
+    // Vertex arrays of GLES1/2 content, from a few vertices to a few thousand
+    std::vector<std::vector<char>> arrays(buffers);
+    for (std::vector<char>& array : arrays)
+    {
+        array.resize(16 * (4 + random() % 1024));
+        for (char& c : array)
+        {
+            c = (char)random();
+        }
+    }
+    // Most draws reuse arrays seen before
+    std::vector<unsigned int> order(captures);
+    for (unsigned int& index : order)
+    {
+        index = random() % buffers;
+    }
+
+    run("md5, index", DIGEST_MD5, false, arrays, order);
+    run("xxh64x2, index", DIGEST_XXH64X2, false, arrays, order);
+    // The scan is quadratic, so fewer captures
+    order.resize(std::min(captures, buffers));
+    run("md5, linear scan", DIGEST_MD5, true, arrays, order);
+    run("md5, index", DIGEST_MD5, false, arrays, order);
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "hash_test.hpp"
+#include "common/hash.hpp"
+
+#include <string.h>
+#include <vector>
+
+using namespace common;
+
+HashTest::HashTest()
+{
+}
+
+void HashTest::setUp()
+{
+}
+
+void HashTest::tearDown()
+{
+}
+
+void HashTest::testKnownValues()
+{
+    // Reference values of XXH64, covering the tail only and the 32 byte stripe paths
+    CPPUNIT_ASSERT(hash64("", 0) == 0xef46db3751d8e999ull);
+    CPPUNIT_ASSERT(hash64("a", 1) == 0xd24ec4f1a98c6e5bull);
+    CPPUNIT_ASSERT(hash64("abc", 3) == 0x44bc2cf5ad770999ull);
+    const char* text = "Nobody inspects the spammish repetition";
+    CPPUNIT_ASSERT(hash64(text, strlen(text)) == 0xfbcea83c8a378bf1ull);
+    CPPUNIT_ASSERT(hash64("abc", 3, 1) != hash64("abc", 3));
+    CPPUNIT_ASSERT(hashToString(0x44bc2cf5ad770999ull) == "44bc2cf5ad770999");
+    CPPUNIT_ASSERT(hashToString(1) == "0000000000000001");
+}
+
+void HashTest::testAlignment()
+{
+    std::vector<unsigned char> data(1000 + 8);
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = (unsigned char)(i * 31 + 7);
+    }
+    std::vector<unsigned char> copy(data.size() + 8);
+    for (size_t offset = 1; offset < 8; offset++)
+    {
+        memcpy(copy.data() + offset, data.data(), data.size());
+        CPPUNIT_ASSERT(hash64(copy.data() + offset, data.size()) == hash64(data.data(), data.size()));
+    }
+    data[500] ^= 1;
+    CPPUNIT_ASSERT(hash64(copy.data() + 7, data.size()) != hash64(data.data(), data.size()));
+}
+
+void HashTest::testHash128()
+{
+    // Both halves, through the stripe path and every tail length
+    std::vector<unsigned char> data(100);
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = (unsigned char)(i * 13 + 5);
+    }
+    for (size_t size = 0; size <= data.size(); size++)
+    {
+        const Hash128 hash = hash128(data.data(), size);
+        CPPUNIT_ASSERT(hash.low == hash64(data.data(), size, 0));
+        CPPUNIT_ASSERT(hash.high == hash64(data.data(), size, 1));
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef _INCLUDE_HASH_TEST_
+#define _INCLUDE_HASH_TEST_
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class HashTest : public CPPUNIT_NS::TestFixture
+{
+	CPPUNIT_TEST_SUITE(HashTest);
+
+    CPPUNIT_TEST(testKnownValues);
+    CPPUNIT_TEST(testAlignment);
+    CPPUNIT_TEST(testHash128);
+
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+    HashTest();
+
+    virtual void setUp();
+    virtual void tearDown();
+
+    void testKnownValues();
+    void testAlignment();
+    void testHash128();
+};
+
+#endif
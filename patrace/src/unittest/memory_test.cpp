@@ -226,3 +226,39 @@ void MemoryTest::testClientSideBufferObjectSet()
     memcpy(BUFFER0, BUFFER1, 16);
     CPPUNIT_ASSERT(mbs.find(0, ClientSideBufferObject(BUFFER0, 16), name) == false);
 }
+
+void MemoryTest::testClientSideBufferObjectIndex()
+{
+    const unsigned char BUFFER0[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+    const unsigned char BUFFER1[8] = {7, 6, 5, 4, 3, 2, 1, 0};
+
+    for (DigestKind kind : { DIGEST_MD5, DIGEST_XXH64X2 })
+    {
+        setBufferDigestKind(kind);
+        ClientSideBufferObjectSet mbs;
+        ClientSideBufferObjectName name = 99;
+        const ClientSideBufferObjectName name0 = mbs.create_object(0);
+        mbs.object_data(0, name0, 8, BUFFER0, true);
+        CPPUNIT_ASSERT(mbs.find(0, ClientSideBufferObject(BUFFER0, 8), name) == true);
+        CPPUNIT_ASSERT(name == name0);
+
+        // Same contents, different size
+        CPPUNIT_ASSERT(mbs.find(0, ClientSideBufferObject(BUFFER0, 4), name) == false);
+
+        // Changed after it was indexed
+        mbs.object_subdata(0, name0, 0, 8, BUFFER1);
+        CPPUNIT_ASSERT(mbs.find(0, ClientSideBufferObject(BUFFER0, 8), name) == false);
+        CPPUNIT_ASSERT(mbs.find(0, ClientSideBufferObject(BUFFER1, 8), name) == true);
+        CPPUNIT_ASSERT(name == name0);
+
+        // Another object with the same contents is found once the first is deleted
+        const ClientSideBufferObjectName name1 = mbs.create_object(0);
+        mbs.object_data(0, name1, 8, BUFFER1, true);
+        mbs.delete_object(0, name0);
+        CPPUNIT_ASSERT(mbs.find(0, ClientSideBufferObject(BUFFER1, 8), name) == true);
+        CPPUNIT_ASSERT(name == name1);
+        mbs.delete_object(0, name1);
+        CPPUNIT_ASSERT(mbs.find(0, ClientSideBufferObject(BUFFER1, 8), name) == false);
+    }
+    setBufferDigestKind(DIGEST_XXH64X2);
+}
@@ -4,6 +4,10 @@
 #include "context_test.hpp"
 #include "system_test.hpp"
 #include "image_test.hpp"
+#include "chunk_codec_test.hpp"
+#include "hash_test.hpp"
+#include "value_map_test.hpp"
+#include "write_tracker_test.hpp"
 
 #define TEST(name) \
 /* Registers the fixture into the "all tests" registry */ \
@@ -17,3 +21,7 @@ TEST(MemoryTest)
 TEST(ContextTest)
 TEST(SystemTest)
 TEST(ImageTest)
+TEST(ChunkCodecTest)
+TEST(HashTest)
+TEST(ValueMapTest)
+TEST(WriteTrackerTest)
@@ -0,0 +1,69 @@
+// Micro-benchmark of the object name maps used by the retracer, against std::unordered_map.
+// Usage: value_map_bench [LOOKUPS]
+
+#include "retracer/value_map.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace retracer;
+
+template <class F>
+static double nsPerOp(size_t ops, F f)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    f();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / ops;
+}
+
+static void run(const char* pattern, const std::vector<unsigned int>& names, size_t lookups)
+{
+    std::mt19937 random(1);
+    std::vector<unsigned int> order(lookups);
+    for (unsigned int& name : order)
+    {
+        name = names[random() % names.size()];
+    }
+
+    hmap<unsigned int> map;
+    std::unordered_map<unsigned int, unsigned int> reference;
+    unsigned int sum = 0, refSum = 0;
+    const double insert = nsPerOp(names.size(), [&]{ for (unsigned int name : names) map.LValue(name) = name + 1; });
+    const double refInsert = nsPerOp(names.size(), [&]{ for (unsigned int name : names) reference[name] = name + 1; });
+    const double lookup = nsPerOp(lookups, [&]{ for (unsigned int name : order) sum += map.RValue(name); });
+    const double refLookup = nsPerOp(lookups, [&]{ for (unsigned int name : order) refSum += reference.find(name)->second; });
+    if (sum != refSum)
+    {
+        printf("%s: results differ!\n", pattern);
+        exit(1);
+    }
+    printf("%-28s %8u names: insert %6.2f ns (unordered_map %6.2f), lookup %6.2f ns (unordered_map %6.2f)\n",
+           pattern, (unsigned)names.size(), insert, refInsert, lookup, refLookup);
+}
+
+int main(int argc, char** argv)
+{
+    const size_t lookups = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000000;
+    std::mt19937 random(2);
+    std::vector<unsigned int> names;
+
+    for (unsigned int i = 1; i <= 5000; i++) names.push_back(i);
+    run("dense below 10K", names, lookups);
+
+    names.clear();
+    for (unsigned int i = 0; i < 5000; i++) names.push_back(100000 + i);
+    run("dense above 10K", names, lookups);
+
+    names.clear();
+    for (unsigned int i = 0; i < 5000; i++) names.push_back(100000 + (random() % 1000000));
+    run("sparse up to 1M", names, lookups);
+
+    names.clear();
+    for (unsigned int i = 0; i < 5000; i++) names.push_back(random() | 0x80000000u);
+    run("random 32 bit", names, lookups);
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "value_map_test.hpp"
+#include "retracer/value_map.hpp"
+
+using namespace retracer;
+
+ValueMapTest::ValueMapTest()
+{
+}
+
+void ValueMapTest::setUp()
+{
+}
+
+void ValueMapTest::tearDown()
+{
+}
+
+void ValueMapTest::testLookup()
+{
+    hmap<unsigned int> map;
+    CPPUNIT_ASSERT(map.RValue(0) == 0);
+    CPPUNIT_ASSERT(map.RValue(5) == 0);
+    map.LValue(5) = 50;
+    map.LValue(1023) = 10230;
+    map.LValue(1024) = 10240;
+    CPPUNIT_ASSERT(map.RValue(5) == 50);
+    CPPUNIT_ASSERT(map.RValue(1023) == 10230);
+    CPPUNIT_ASSERT(map.RValue(1024) == 10240);
+    CPPUNIT_ASSERT(map.RValue(4) == 0);
+    CPPUNIT_ASSERT(map.RValue(1025) == 0);
+    map.LValue(5) = 0;
+    CPPUNIT_ASSERT(map.RValue(5) == 0);
+}
+
+void ValueMapTest::testSparseNames()
+{
+    hmap<unsigned int> map;
+    const unsigned int names[] = { 10 * 1024, 100000, 123456789, 0x80000000u, 0xffffffffu };
+    for (unsigned int name : names)
+    {
+        map.LValue(name) = name ^ 0x5555;
+    }
+    for (unsigned int name : names)
+    {
+        CPPUNIT_ASSERT(map.RValue(name) == (name ^ 0x5555));
+        CPPUNIT_ASSERT(map.RValue(name - 1) == 0);
+    }
+    // Reading names nobody wrote must not allocate pages or fail
+    CPPUNIT_ASSERT(map.RValue(0x7fffffffu) == 0);
+    CPPUNIT_ASSERT(map.RValue(0xfffffffeu) == 0);
+}
+
+void ValueMapTest::testDensePage()
+{
+    // Names start out one by one, and move to a page once there are enough of them
+    hmap<unsigned int> map;
+    for (unsigned int name = 5000; name < 6000; name += 3)
+    {
+        map.LValue(name) = name + 1;
+    }
+    map.LValue(5001) = 0;
+    for (unsigned int name = 5000; name < 6000; name++)
+    {
+        const unsigned int expected = (name % 3 == 5000 % 3 && name != 5001) ? name + 1 : 0;
+        CPPUNIT_ASSERT(map.RValue(name) == expected);
+    }
+    CPPUNIT_ASSERT(map.GetCopy().size() == 334);
+}
+
+void ValueMapTest::testCopy()
+{
+    hmap<unsigned int> map;
+    map.LValue(1) = 2;
+    map.LValue(70000) = 3;
+    map.LValue(70001) = 0;
+    map.LValue(0x80000000u) = 4;
+    const std::unordered_map<unsigned int, unsigned int> copy = map.GetCopy();
+    CPPUNIT_ASSERT(copy.size() == 3);
+    CPPUNIT_ASSERT(copy.at(1) == 2);
+    CPPUNIT_ASSERT(copy.at(70000) == 3);
+    CPPUNIT_ASSERT(copy.at(0x80000000u) == 4);
+}
@@ -0,0 +1,29 @@
+#ifndef _INCLUDE_VALUE_MAP_TEST_
+#define _INCLUDE_VALUE_MAP_TEST_
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class ValueMapTest : public CPPUNIT_NS::TestFixture
+{
+	CPPUNIT_TEST_SUITE(ValueMapTest);
+
+    CPPUNIT_TEST(testLookup);
+    CPPUNIT_TEST(testSparseNames);
+    CPPUNIT_TEST(testDensePage);
+    CPPUNIT_TEST(testCopy);
+
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+    ValueMapTest();
+
+    virtual void setUp();
+    virtual void tearDown();
+
+    void testLookup();
+    void testSparseNames();
+    void testDensePage();
+    void testCopy();
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "write_tracker_test.hpp"
+#include "tracer/write_tracker.hpp"
+
+#include <string.h>
+#include <unistd.h>
+#include <memory>
+#include <vector>
+
+WriteTrackerTest::WriteTrackerTest()
+{
+}
+
+void WriteTrackerTest::setUp()
+{
+}
+
+void WriteTrackerTest::tearDown()
+{
+}
+
+void WriteTrackerTest::testWriteBack()
+{
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    const size_t length = 3 * pageSize + 100; // the last page is partial
+    std::vector<char> mapped(length);
+    for (size_t i = 0; i < length; i++)
+    {
+        mapped[i] = i % 251;
+    }
+
+    std::unique_ptr<WriteTracker> tracker(WriteTracker::create(mapped.data(), length));
+    if (!tracker)
+    {
+        return; // no memfd_create on this system
+    }
+    CPPUNIT_ASSERT(tracker->pageSize() == pageSize);
+    char* view = static_cast<char*>(tracker->pointer());
+    CPPUNIT_ASSERT(view != mapped.data());
+
+    // Reading a page touches it and shows what was in the driver's mapping
+    CPPUNIT_ASSERT(view[pageSize + 7] == (char)((pageSize + 7) % 251));
+    view[5] = 'a';
+    view[3 * pageSize + 99] = 'b';
+    CPPUNIT_ASSERT(view[6] == 6);
+
+    const std::vector<unsigned int> pages = tracker->writeBack();
+    CPPUNIT_ASSERT(pages.size() == 3);
+    CPPUNIT_ASSERT(pages[0] == 0 && pages[1] == 1 && pages[2] == 3);
+    CPPUNIT_ASSERT(mapped[5] == 'a');
+    CPPUNIT_ASSERT(mapped[3 * pageSize + 99] == 'b');
+    CPPUNIT_ASSERT(mapped[2 * pageSize] == (char)((2 * pageSize) % 251));
+    const char* contents = static_cast<const char*>(tracker->contents());
+    CPPUNIT_ASSERT(memcmp(contents, mapped.data(), 2 * pageSize) == 0);
+}
+
+void WriteTrackerTest::testSeveralTrackers()
+{
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    std::vector<char> first(2 * pageSize, 1);
+    std::vector<char> second(2 * pageSize, 2);
+    std::unique_ptr<WriteTracker> a(WriteTracker::create(first.data(), first.size()));
+    std::unique_ptr<WriteTracker> b(WriteTracker::create(second.data(), second.size()));
+    if (!a || !b)
+    {
+        return;
+    }
+    static_cast<char*>(b->pointer())[pageSize] = 3;
+    a.reset(); // the other tracker must keep working
+    static_cast<char*>(b->pointer())[0] = 4;
+    const std::vector<unsigned int> pages = b->writeBack();
+    CPPUNIT_ASSERT(pages.size() == 2);
+    CPPUNIT_ASSERT(second[0] == 4 && second[1] == 2 && second[pageSize] == 3);
+    CPPUNIT_ASSERT(first[0] == 1);
+}
@@ -0,0 +1,25 @@
+#ifndef _INCLUDE_WRITE_TRACKER_TEST_
+#define _INCLUDE_WRITE_TRACKER_TEST_
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class WriteTrackerTest : public CPPUNIT_NS::TestFixture
+{
+	CPPUNIT_TEST_SUITE(WriteTrackerTest);
+
+    CPPUNIT_TEST(testWriteBack);
+    CPPUNIT_TEST(testSeveralTrackers);
+
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+    WriteTrackerTest();
+
+    virtual void setUp();
+    virtual void tearDown();
+
+    void testWriteBack();
+    void testSeveralTrackers();
+};
+
+#endif